@@ -5,39 +5,1881 @@
  * Komentar:
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
 #include "ahed.h"
 
+/** výpočet CRC32C instrukcí SSE4.2 (vybírá se za běhu) */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_KERNEL
+#endif
+
+/** výchozí a největší bitová šířka vzorku; abecedu tvoří vzorky, symboly
+ * běhů a u širších vzorků symbol zbylého lichého byte */
+#define AHEDbitness 8
+#define AHEDmaxWidth 16
+#define AHEDrunSymbols 32
+/** uzly stromu se přidávají za uzel zero, pole roste po násobcích */
+#define AHEDzeroNode 0
+#define AHEDnodeChunk 1024
+#define AHEDnullNode -1
+/** nejkratší běh kódovaný symbolem běhu; symbol běhu k nese délku
+ * v = běh - AHEDminRun + 1 z intervalu <2^k, 2^(k+1)), za symbolem
+ * následuje k nižších bitů v */
+#define AHEDminRun 4
+#define AHEDmaxRun ((((int64_t)1) << AHEDrunSymbols) - 2 + AHEDminRun)
+
+/** počet a velikost bloků v kruhovém bufferu mezi vlákny */
+#define AHEDringSlots 4
+#define AHEDringSlotSize 65536
+/** kolikrát vlákno otestuje buffer, než se uspí */
+#define AHEDringSpin 256
+
+/** hlavička formátu AHEDFormatFramed: značka, verze, příznaky a parametry */
+#define AHEDmagic "AHD"
+#define AHEDversion 1
+#define AHEDheaderSize 5
+/** příznak hlavičky: proud je transformovaný po blocích (BWT, MTF, běhy
+ * nul), následuje 32bitová velikost bloku */
+#define AHEDflagBlocks 1
+/** příznak hlavičky: abeceda obsahuje symboly běhů opakovaného vzorku */
+#define AHEDflagRuns 2
+/** příznak hlavičky: vzorky jsou širší než byte, následuje byte s šířkou */
+#define AHEDflagWidth 4
+/** příznak hlavičky: kódovaný proud je rozdělen na bloky s kontrolním
+ * součtem, konec proudu nese délku původních dat */
+#define AHEDflagCheck 8
+/** největší blok transformace */
+#define AHEDmaxBlock (64 << 20)
+/** největší délka bloku kódovaného proudu s kontrolním součtem, délka
+ * záhlaví bloku (délka a CRC32C) a záznamu o konci proudu (záhlaví
+ * s nulovou délkou a 64bitová délka původních dat) */
+#define AHEDchunkSize 65536
+#define AHEDchunkHeader 8
+#define AHEDchunkEnd 16
+/** polynom CRC32C (Castagnoli) s obráceným pořadím bitů */
+#define AHEDcrcPolynomial 0x82f63b78u
+/** rámec bloku v transformovaném proudu: délka bloku, primární index
+ * a délka transformovaných dat, vše 32bitově */
+#define AHEDframeSize 12
+/** po kolika byte nekódovaných dat se kontroluje limit převodu */
+#define AHEDbudgetBytes 65536
+/** po kolika krocích smyček transformace bloku se kontroluje limit převodu */
+#define AHEDbudgetSteps (1 << 20)
+
+/**
+ * Struktura jednoho uzlu v poli
+ */
+struct node {
+	int64_t count;	/** kolikrát se znak objevil ve vstupním řetězci */
+	int64_t order;	/** pořadí ve stromu pro případný přesun */
+	int64_t	left;	/** ukazatel na levého syna */
+	int64_t right;	/** ukazatel na pravého syna */
+	int64_t parent;	/** ukazatel na otce */
+	int64_t symbol;	/** symbol listu */
+};
+
+/**
+ * Struktura popisujici pruchod stromem od korene k uzlu
+ */
+struct path {
+	int32_t path;	/** cesta */
+	int8_t bits;	/** kolik bitu cesty je vyznamovych */
+};
+
+/**
+ * Kruhový buffer bloků mezi dvěma vlákny, jedno bloky plní a druhé je
+ * vyprazdňuje. Počty bloků si vlákna předávají bez zámku, zámek
+ * s podmínkou slouží jen k uspání vlákna, které čeká na prázdný nebo plný
+ * buffer.
+ */
+struct ring {
+	unsigned char* data[AHEDringSlots];	/** bloky */
+	size_t length[AHEDringSlots];	/** počet platných byte v bloku */
+	u_int32_t head;			/** počet naplněných bloků (mění jen plnící) */
+	u_int32_t tail;			/** počet uvolněných bloků (mění jen čtoucí) */
+	int closed;				/** plnící vlákno skončilo */
+	int aborted;			/** čtoucí vlákno skončilo, další bloky nechce */
+	int sleepers;			/** počet vláken čekajících na podmínce */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/**
+ * Vlákno čtoucí vstup do kruhového bufferu, nebo zapisující výstup z něj
+ */
+struct stage {
+	struct ring ring;
+	FILE* file;
+	pthread_t thread;
+};
+
+/**
+ * Jeden blok transformace
+ */
+struct block {
+	unsigned char* data;	/** původní data bloku */
+	size_t length;
+	unsigned char* coded;	/** transformovaná data (při kódování s rámcem) */
+	size_t codedLength;
+	int32_t* index;			/** pole přípon nebo přechodů zpětné BWT */
+	unsigned char* bwt;		/** poslední sloupec BWT */
+	int32_t primary;		/** řádek BWT s původním řetězcem */
+	int result;				/** výsledek (zpětné) transformace */
+	int started;			/** blok transformuje vlastní vlákno */
+	pthread_t thread;
+	struct budget* budget;	/** limit převodu sdílený vlákny skupiny */
+};
+
+/**
+ * Stav transformace po blocích. Kódování načte skupinu bloků, transformuje
+ * je současně a předá kodéru jejich výstup. Dekódování skládá dekódované
+ * byte do bloků a plnou skupinu zpětně transformuje současně.
+ */
+struct blocks {
+	int32_t blockSize;		/** velikost bloku */
+	int threads;			/** počet bloků ve skupině */
+	struct block* block;	/** bloky skupiny */
+	int count;				/** počet naplněných bloků skupiny */
+	int current;			/** blok, jehož výstup se kóduje */
+	size_t position;		/** pozice v kódovaném nebo skládaném bloku */
+	unsigned char frame[AHEDframeSize];	/** rozpracovaný rámec bloku */
+	size_t frameLength;
+	int eof;				/** vstup je načten celý */
+	int error;				/** transformace selhala */
+	int64_t raw;			/** počet byte netransformovaných dat */
+};
+
+/**
+ * Kódovaný proud rozdělený na bloky s kontrolním součtem. Záhlaví bloku
+ * nese jeho délku a CRC32C délky a dat, konec proudu označuje blok nulové
+ * délky, za kterým následuje délka původních dat. Dekodér blok nejprve
+ * celý načte a ověří, poškozená data se tak nikdy nedekódují.
+ */
+struct check {
+	unsigned char* data;	/** data rozpracovaného bloku */
+	size_t length;			/** počet byte v bloku */
+	size_t position;		/** pozice čtení v bloku */
+	int64_t offset;			/** pozice následujícího bloku v kódovaném proudu */
+	int64_t overhead;		/** počet byte záhlaví bloků a konce proudu */
+	int64_t original;		/** délka původních dat z konce proudu */
+	int end;				/** konec proudu je načten */
+	int corrupt;			/** blok na pozici offset je poškozený */
+};
+
+/**
+ * Limit doby a velikosti jednoho převodu. Kódovací a dekódovací smyčka
+ * porovnává velikost nekódovaných dat s next, limit se tak kontroluje jen
+ * jednou za AHEDbudgetBytes byte. Při transformaci po blocích smyčka počítá
+ * transformovaná data, velikost původních se kontroluje po skupinách bloků;
+ * dobu a zrušení kontrolují i vlákna transformace bloků, příznak expired
+ * se proto čte a nastavuje atomicky.
+ */
+struct budget {
+	int64_t deadline;		/** čas konce převodu, 0 = bez limitu */
+	int64_t start;			/** velikost nekódovaných dat na začátku převodu */
+	int64_t limit;			/** největší velikost nekódovaných dat */
+	int64_t next;			/** velikost nekódovaných dat při příští kontrole */
+	const int* cancel;		/** příznak zrušení převodu, případně NULL */
+	int expired;			/** limit byl překročen nebo převod zrušen */
+};
+
+/**
+ * Stav ponechaný mezi převody (tAHEDContext) -- strom a bloky transformace
+ * posledního převodu. Převod si je na začátku převezme a na konci vrátí,
+ * další převod tak nealokuje a nenuluje stránky znovu.
+ */
+struct AHEDContext {
+	struct node* nodes;		/** uzly stromu */
+	int32_t* ranks;
+	int64_t capacity;		/** počet alokovaných uzlů */
+	int32_t* leaves;		/** listy symbolů */
+	int64_t symbols;		/** počet alokovaných listů */
+	struct blocks blocks;	/** bloky transformace, block = NULL bez nich */
+};
+
+/**
+ * Parametry proudu uložené v hlavičce formátu AHEDFormatFramed
+ */
+struct header {
+	int32_t blockSize;		/** velikost bloku transformace, 0 = bez ní */
+	int runs;				/** abeceda obsahuje symboly běhů */
+	int width;				/** šířka vzorku */
+	int check;				/** kódovaný proud má bloky s kontrolním součtem */
+};
+
+/**
+ * Stav jednoho kódování nebo dekódování mezi voláními funkcí pro zápis
+ * a čtení bitů; každý převod má vlastní, lze tak převádět více souborů
+ * současně
+ */
+struct coder {
+	unsigned char output;	/** výstup k zapsání */
+	char bit;				/** kolik bitů výstupu je již obsazeno */
+	unsigned char readed;	/** naposledy načtený byte */
+	char bits;				/** kolik bitů načteného byte zbývá */
+	int width;				/** bitová šířka vzorku */
+	int64_t symbols;		/** počet symbolů abecedy */
+	int64_t runSymbol;		/** první symbol běhu, AHEDnullNode = bez běhů */
+	int64_t tailSymbol;		/** symbol lichého byte, AHEDnullNode = není */
+	unsigned char tail;		/** lichý poslední byte vstupu */
+	int symbolBits;			/** počet bitů zápisu nového symbolu */
+	struct node* nodes;		/** uzly stromu v pořadí přidání */
+	int64_t length;			/** počet uzlů */
+	int64_t capacity;		/** počet alokovaných uzlů */
+	int32_t* leaves;		/** list každého symbolu, 0 = symbol není ve stromu */
+	int64_t leafCapacity;	/** počet alokovaných listů */
+	int32_t* ranks;			/** uzly podle klesajícího pořadí */
+	struct ring* input;		/** vstup z vlákna čtení, NULL = přímo ze souboru */
+	unsigned char* inData;	/** rozpracovaný blok vstupu */
+	size_t inLength;
+	size_t inPosition;
+	struct ring* outputRing;	/** výstup do vlákna zápisu, NULL = přímo do
+								 * souboru */
+	unsigned char* outData;	/** rozpracovaný blok výstupu */
+	size_t outLength;
+	struct blocks* blocks;	/** transformace po blocích, NULL = bez transformace */
+	struct check* check;	/** bloky s kontrolním součtem, NULL = bez nich */
+	struct budget budget;	/** limit doby a velikosti převodu */
+	struct AHEDContext* context;	/** stav ponechaný mezi převody, případně
+									 * NULL */
+};
+
+/** tabulky CRC32C pro výpočet po osmi byte bez instrukce SSE4.2 */
+static u_int32_t crcTable[8][256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Inicializace kruhového bufferu
+ * @param r kruhový buffer
+ * @return AHEDOK pokud se podařilo alokovat bloky, jinak AHEDFail
+ */
+static int ringInit(struct ring* r) {
+	memset(r, 0, sizeof(*r));
+	for (int i = 0; i < AHEDringSlots; i++) {
+		if ((r->data[i] = malloc(AHEDringSlotSize)) == NULL) {
+			for (int j = 0; j < i; j++) {
+				free(r->data[j]);
+			}
+			return(AHEDFail);
+		}
+	}
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	return(AHEDOK);
+}
+
+/**
+ * Uvolnění kruhového bufferu
+ * @param r kruhový buffer
+ */
+static void ringFree(struct ring* r) {
+	for (int i = 0; i < AHEDringSlots; i++) {
+		free(r->data[i]);
+	}
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->cond);
+}
+
+/**
+ * Může vlákno pokračovat -- plnící má volný blok, čtoucí naplněný blok,
+ * nebo druhá strana skončila
+ * @param r kruhový buffer
+ * @param producer nenulové pro plnící vlákno
+ */
+static int ringReady(struct ring* r, int producer) {
+	if (producer) {
+		return(r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) <
+			AHEDringSlots || __atomic_load_n(&r->aborted, __ATOMIC_ACQUIRE));
+	}
+	return(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != r->tail ||
+		__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Čekání, až může vlákno pokračovat; nejdříve krátce aktivně, potom na
+ * podmínce
+ * @param r kruhový buffer
+ * @param producer nenulové pro plnící vlákno
+ */
+static void ringWait(struct ring* r, int producer) {
+	for (int i = 0; i < AHEDringSpin; i++) {
+		if (ringReady(r, producer)) {
+			return;
+		}
+	}
+	pthread_mutex_lock(&r->lock);
+	__atomic_add_fetch(&r->sleepers, 1, __ATOMIC_SEQ_CST);
+	while (!ringReady(r, producer)) {
+		pthread_cond_wait(&r->cond, &r->lock);
+	}
+	__atomic_sub_fetch(&r->sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * Probuzení vlákna čekajícího na podmínce po změně stavu bufferu
+ * @param r kruhový buffer
+ */
+static void ringWake(struct ring* r) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->sleepers, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+	}
+}
+
+/**
+ * Volný blok pro plnící vlákno
+ * @param r kruhový buffer
+ * @return blok o velikosti AHEDringSlotSize, NULL pokud čtoucí vlákno skončilo
+ */
+static unsigned char* ringProduce(struct ring* r) {
+	ringWait(r, 1);
+	if (__atomic_load_n(&r->aborted, __ATOMIC_ACQUIRE)) {
+		return(NULL);
+	}
+	return(r->data[r->head % AHEDringSlots]);
+}
+
+/**
+ * Předání naplněného bloku čtoucímu vláknu
+ * @param r kruhový buffer
+ * @param length počet platných byte v bloku
+ */
+static void ringPublish(struct ring* r, size_t length) {
+	r->length[r->head % AHEDringSlots] = length;
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+	ringWake(r);
+}
+
+/**
+ * Ukončení plnění, čtoucí vlákno dočte zbývající bloky
+ * @param r kruhový buffer
+ */
+static void ringClose(struct ring* r) {
+	__atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+	ringWake(r);
+}
+
+/**
+ * Další naplněný blok pro čtoucí vlákno
+ * @param r kruhový buffer
+ * @param length počet platných byte v bloku
+ * @return blok, NULL pokud plnící vlákno skončilo a všechny bloky jsou
+ *   přečtené
+ */
+static unsigned char* ringConsume(struct ring* r, size_t* length) {
+	ringWait(r, 0);
+	if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail) {
+		*length = 0;
+		return(NULL);
+	}
+	*length = r->length[r->tail % AHEDringSlots];
+	return(r->data[r->tail % AHEDringSlots]);
+}
+
+/**
+ * Vrácení přečteného bloku plnícímu vláknu
+ * @param r kruhový buffer
+ */
+static void ringRelease(struct ring* r) {
+	__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+	ringWake(r);
+}
+
+/**
+ * Ukončení čtení, plnící vlákno přestane bloky plnit
+ * @param r kruhový buffer
+ */
+static void ringAbort(struct ring* r) {
+	__atomic_store_n(&r->aborted, 1, __ATOMIC_RELEASE);
+	ringWake(r);
+}
+
+/**
+ * Vlákno čtení -- plní kruhový buffer celými bloky vstupu
+ * @param arg vlákno se vstupním souborem (struct stage)
+ */
+static void* readerThread(void* arg) {
+	struct stage* s = arg;
+	unsigned char* data;
+	
+	while ((data = ringProduce(&s->ring)) != NULL) {
+		size_t length = fread(data, 1, AHEDringSlotSize, s->file);
+		if (length > 0) {
+			ringPublish(&s->ring, length);
+		}
+		/** konec souboru nebo chyba čtení */
+		if (length < AHEDringSlotSize) {
+			break;
+		}
+	}
+	ringClose(&s->ring);
+	return(NULL);
+}
+
+/**
+ * Vlákno zápisu -- zapisuje bloky z kruhového bufferu do výstupu, při chybě
+ * zápisu buffer uzavře a kódování tak skončí chybou
+ * @param arg vlákno s výstupním souborem (struct stage)
+ */
+static void* writerThread(void* arg) {
+	struct stage* s = arg;
+	unsigned char* data;
+	size_t length;
+	
+	while ((data = ringConsume(&s->ring, &length)) != NULL) {
+		if (fwrite(data, 1, length, s->file) != length) {
+			ringAbort(&s->ring);
+			break;
+		}
+		ringRelease(&s->ring);
+	}
+	return(NULL);
+}
+
+/**
+ * Spuštění vláken čtení a zápisu pro převod. Pokud se vlákna nepodaří
+ * spustit, převod čte a zapisuje soubory sám.
+ * @param c stav převodu
+ * @param reader vlákno čtení
+ * @param writer vlákno zápisu
+ * @param inputFile vstupní soubor
+ * @param outputFile výstupní soubor
+ * @return AHEDOK pokud vlákna běží, jinak AHEDFail
+ */
+static int pipelineStart(struct coder* c, struct stage* reader,
+	struct stage* writer, FILE* inputFile, FILE* outputFile) {
+	if (ringInit(&writer->ring) == AHEDFail) {
+		return(AHEDFail);
+	}
+	if (ringInit(&reader->ring) == AHEDFail) {
+		ringFree(&writer->ring);
+		return(AHEDFail);
+	}
+	reader->file = inputFile;
+	writer->file = outputFile;
+	if (pthread_create(&writer->thread, NULL, writerThread, writer) != 0) {
+		ringFree(&reader->ring);
+		ringFree(&writer->ring);
+		return(AHEDFail);
+	}
+	/** vlákno zápisu zatím nic nedostalo, lze je ukončit bez následků */
+	if (pthread_create(&reader->thread, NULL, readerThread, reader) != 0) {
+		ringClose(&writer->ring);
+		pthread_join(writer->thread, NULL);
+		ringFree(&reader->ring);
+		ringFree(&writer->ring);
+		return(AHEDFail);
+	}
+	c->input = &reader->ring;
+	c->outputRing = &writer->ring;
+	return(AHEDOK);
+}
+
+/**
+ * Dokončení převodu s vlákny čtení a zápisu -- předá rozpracovaný blok
+ * výstupu, počká na zapsání všech bloků a ukončí čtení
+ * @param c stav převodu
+ * @param reader vlákno čtení
+ * @param writer vlákno zápisu
+ * @param retval výsledek převodu
+ * @return výsledek převodu, AHEDFail pokud selhal zápis
+ */
+static int pipelineFinish(struct coder* c, struct stage* reader,
+	struct stage* writer, int retval) {
+	if (c->outData != NULL && c->outLength > 0) {
+		ringPublish(&writer->ring, c->outLength);
+	}
+	ringClose(&writer->ring);
+	ringAbort(&reader->ring);
+	pthread_join(writer->thread, NULL);
+	pthread_join(reader->thread, NULL);
+	if (writer->ring.aborted) {
+		retval = AHEDFail;
+	}
+	ringFree(&reader->ring);
+	ringFree(&writer->ring);
+	return(retval);
+}
+
+/**
+ * Načtení jednoho byte vstupu, ze souboru nebo z bloku vlákna čtení
+ * @param c stav převodu
+ * @param file vstupní soubor
+ * @param byte načtený byte
+ * @return AHEDOK pokud byl byte načten, AHEDFail na konci vstupu
+ */
+static int getByte(struct coder* c, FILE* file, unsigned char* byte) {
+	if (c->input == NULL) {
+		return(fread(byte, sizeof(char), 1, file) == 1 ? AHEDOK : AHEDFail);
+	}
+	if (c->inPosition == c->inLength) {
+		if (c->inData != NULL) {
+			ringRelease(c->input);
+		}
+		c->inData = ringConsume(c->input, &c->inLength);
+		c->inPosition = 0;
+		if (c->inData == NULL) {
+			return(AHEDFail);
+		}
+	}
+	*byte = c->inData[c->inPosition++];
+	return(AHEDOK);
+}
+
+/**
+ * Zápis jednoho byte výstupu, do souboru nebo do bloku vlákna zápisu
+ * @param c stav převodu
+ * @param file výstupní soubor
+ * @param byte zapisovaný byte
+ * @return AHEDOK pokud byl byte zapsán, jinak AHEDFail
+ */
+static int putByte(struct coder* c, FILE* file, unsigned char byte) {
+	if (c->outputRing == NULL) {
+		return(fwrite(&byte, sizeof(char), 1, file) == 1 ? AHEDOK : AHEDFail);
+	}
+	if (c->outData == NULL) {
+		c->outLength = 0;
+		if ((c->outData = ringProduce(c->outputRing)) == NULL) {
+			return(AHEDFail);
+		}
+	}
+	c->outData[c->outLength++] = byte;
+	if (c->outLength == AHEDringSlotSize) {
+		ringPublish(c->outputRing, c->outLength);
+		c->outData = NULL;
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Zápis 32bitového čísla v pořadí little-endian
+ * @param p buffer
+ * @param value zapisovaná hodnota
+ */
+static void putWord(unsigned char* p, u_int32_t value) {
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+/**
+ * Načtení 32bitového čísla v pořadí little-endian
+ * @param p buffer
+ * @return načtená hodnota
+ */
+static u_int32_t getWord(const unsigned char* p) {
+	return(p[0] | (u_int32_t)p[1] << 8 | (u_int32_t)p[2] << 16 |
+		(u_int32_t)p[3] << 24);
+}
+
+/**
+ * Načtení až length byte vstupu najednou, ze souboru nebo z bloků vlákna
+ * čtení
+ * @param c stav převodu
+ * @param file vstupní soubor
+ * @param data buffer pro data
+ * @param length velikost bufferu
+ * @return počet načtených byte, méně než length jen na konci vstupu
+ */
+static size_t getBytes(struct coder* c, FILE* file, unsigned char* data,
+	size_t length) {
+	size_t count = 0;
+	
+	if (c->input == NULL) {
+		return(fread(data, 1, length, file));
+	}
+	while (count < length) {
+		size_t part;
+		
+		if (c->inPosition == c->inLength) {
+			if (c->inData != NULL) {
+				ringRelease(c->input);
+			}
+			c->inData = ringConsume(c->input, &c->inLength);
+			c->inPosition = 0;
+			if (c->inData == NULL) {
+				break;
+			}
+		}
+		part = c->inLength - c->inPosition < length - count ?
+			c->inLength - c->inPosition : length - count;
+		memcpy(data + count, c->inData + c->inPosition, part);
+		c->inPosition += part;
+		count += part;
+	}
+	return(count);
+}
+
+/**
+ * Zápis length byte výstupu najednou, do souboru nebo do bloků vlákna zápisu
+ * @param c stav převodu
+ * @param file výstupní soubor
+ * @param data zapisovaná data
+ * @param length počet byte
+ * @return AHEDOK pokud byla data zapsána, jinak AHEDFail
+ */
+static int putBytes(struct coder* c, FILE* file, const unsigned char* data,
+	size_t length) {
+	if (c->outputRing == NULL) {
+		return(fwrite(data, 1, length, file) == length ? AHEDOK : AHEDFail);
+	}
+	for (size_t i = 0; i < length; i++) {
+		if (putByte(c, file, data[i]) == AHEDFail) {
+			return(AHEDFail);
+		}
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Monotónní čas pro limit doby převodu
+ * @return čas v nanosekundách
+ */
+static int64_t clockNow(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/**
+ * Nastavení limitu převodu podle voleb
+ * @param c stav převodu
+ * @param options volby převodu, případně NULL
+ * @param uncodedSize velikost nekódovaných dat na začátku převodu
+ */
+static void budgetInit(struct coder* c, const tAHEDOptions* options,
+	int64_t uncodedSize) {
+	struct budget* b = &c->budget;
+	
+	memset(b, 0, sizeof(*b));
+	b->start = uncodedSize;
+	b->limit = INT64_MAX;
+	b->next = INT64_MAX;
+	if (options == NULL) {
+		return;
+	}
+	if (options->timeLimit > 0) {
+		b->deadline = clockNow() + options->timeLimit;
+	}
+	if (options->byteLimit > 0) {
+		b->limit = uncodedSize + options->byteLimit;
+	}
+	b->cancel = options->cancel;
+	/** první kontrola hned na začátku převodu */
+	if (b->deadline > 0 || b->limit != INT64_MAX || b->cancel != NULL) {
+		b->next = uncodedSize;
+	}
+}
+
+/**
+ * Kontrola doby a zrušení převodu, lze volat i z vláken transformace bloků
+ * @param b limit převodu
+ * @return nenulové pokud byl limit překročen nebo převod zrušen
+ */
+static int budgetExpired(struct budget* b) {
+	if (__atomic_load_n(&b->expired, __ATOMIC_RELAXED)) {
+		return(1);
+	}
+	if ((b->cancel != NULL && __atomic_load_n(b->cancel, __ATOMIC_RELAXED)) ||
+			(b->deadline > 0 && clockNow() >= b->deadline)) {
+		__atomic_store_n(&b->expired, 1, __ATOMIC_RELAXED);
+		return(1);
+	}
+	return(0);
+}
+
+/**
+ * Kontrola limitu v kroku step smyčky transformace bloku, skutečně se
+ * kontroluje jen jednou za AHEDbudgetSteps kroků
+ * @param b limit převodu
+ * @param step pořadí kroku smyčky
+ * @return nenulové pokud má transformace skončit
+ */
+static inline int budgetStep(struct budget* b, int64_t step) {
+	return(__builtin_expect((step & (AHEDbudgetSteps - 1)) == 0, 0) &&
+		budgetExpired(b));
+}
+
+/**
+ * Kontrola doby a zrušení převodu
+ * @param c stav převodu
+ * @return AHEDOK pokud lze pokračovat, jinak AHEDFail
+ */
+static int budgetPoll(struct coder* c) {
+	return(budgetExpired(&c->budget) ? AHEDFail : AHEDOK);
+}
+
+/**
+ * Kontrola limitu převodu, volá se při dosažení velikosti budget.next
+ * @param c stav převodu
+ * @param uncodedSize velikost dosud (de)kódovaných nekódovaných dat
+ * @return AHEDOK pokud lze pokračovat, jinak AHEDFail
+ */
+static int budgetCheck(struct coder* c, int64_t uncodedSize) {
+	struct budget* b = &c->budget;
+	
+	b->next = uncodedSize + AHEDbudgetBytes;
+	if (c->blocks == NULL) {
+		if (uncodedSize > b->limit) {
+			b->expired = 1;
+		}
+		/** další kontrola nejpozději za prvním byte přes limit velikosti */
+		if (b->limit != INT64_MAX && b->next > b->limit) {
+			b->next = b->limit + 1;
+		}
+	}
+	return(budgetPoll(c));
+}
+
+/**
+ * Kontrola limitu převodu před transformací skupiny bloků
+ * @param c stav převodu
+ * @param raw počet byte netransformovaných dat včetně skupiny
+ * @return AHEDOK pokud lze pokračovat, jinak AHEDFail
+ */
+static int budgetBlocks(struct coder* c, int64_t raw) {
+	struct budget* b = &c->budget;
+	
+	if (b->next == INT64_MAX) {
+		return(AHEDOK);
+	}
+	if (raw > b->limit - b->start) {
+		b->expired = 1;
+	}
+	return(budgetPoll(c));
+}
+
+/**
+ * Znak řetězce při řazení přípon -- na nejvyšší úrovni byte bloku zvětšený
+ * o jedna a za posledním byte nulová zarážka, na nižších úrovních jména
+ * podřetězců
+ * @param s řetězec
+ * @param bytes nenulové pro nejvyšší úroveň (s jsou byte bloku)
+ * @param n délka řetězce včetně zarážky
+ * @param i pozice znaku
+ */
+static inline int32_t saChar(const void* s, int bytes, int32_t n, int32_t i) {
+	if (bytes) {
+		return(i == n - 1 ? 0 : ((const unsigned char*)s)[i] + 1);
+	}
+	return(((const int32_t*)s)[i]);
+}
+
+/** je přípona na pozici i typu S (menší než následující přípona)? */
+static inline int saTypeS(const unsigned char* types, int32_t i) {
+	return((types[i >> 3] >> (i & 7)) & 1);
+}
+
+/** je přípona na pozici i nejlevější příponou typu S (LMS)? */
+static inline int saLMS(const unsigned char* types, int32_t i) {
+	return(i > 0 && saTypeS(types, i) && !saTypeS(types, i - 1));
+}
+
+/**
+ * Začátky nebo konce přihrádek jednotlivých znaků v poli přípon
+ * @param s řetězec
+ * @param bytes nenulové pro nejvyšší úroveň
+ * @param buckets pole K + 1 přihrádek
+ * @param n délka řetězce
+ * @param K největší znak
+ * @param end nenulové pro konce přihrádek
+ */
+static void saBuckets(const void* s, int bytes, int32_t* buckets, int32_t n,
+	int32_t K, int end) {
+	int32_t sum = 0;
+	
+	memset(buckets, 0, sizeof(*buckets) * (K + 1));
+	for (int32_t i = 0; i < n; i++) {
+		buckets[saChar(s, bytes, n, i)]++;
+	}
+	for (int32_t i = 0; i <= K; i++) {
+		sum += buckets[i];
+		buckets[i] = end ? sum : sum - buckets[i];
+	}
+}
+
+/**
+ * Indukované řazení -- z seřazených přípon odvodí přípony typu L zleva
+ * a potom přípony typu S zprava
+ * @return AHEDOK, AHEDFail při překročení limitu převodu
+ */
+static int saInduce(const unsigned char* types, int32_t* SA, const void* s,
+	int bytes, int32_t* buckets, int32_t n, int32_t K, struct budget* budget) {
+	saBuckets(s, bytes, buckets, n, K, 0);
+	for (int32_t i = 0; i < n; i++) {
+		int32_t j = SA[i] - 1;
+		if (budgetStep(budget, i)) {
+			return(AHEDFail);
+		}
+		if (SA[i] > 0 && !saTypeS(types, j)) {
+			SA[buckets[saChar(s, bytes, n, j)]++] = j;
+		}
+	}
+	saBuckets(s, bytes, buckets, n, K, 1);
+	for (int32_t i = n - 1; i >= 0; i--) {
+		int32_t j = SA[i] - 1;
+		if (budgetStep(budget, i)) {
+			return(AHEDFail);
+		}
+		if (SA[i] > 0 && saTypeS(types, j)) {
+			SA[--buckets[saChar(s, bytes, n, j)]] = j;
+		}
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Pole přípon v lineárním čase (SA-IS, Nong, Zhang a Chan). Řetězec končí
+ * jedinečnou nejmenší zarážkou; podřetězce mezi příponami LMS se seřadí
+ * indukovaně, pojmenují a pokud jména nejsou jedinečná, seřadí se
+ * rekurzivně zkrácený řetězec jmen.
+ * @param s řetězec
+ * @param bytes nenulové pro nejvyšší úroveň (byte bloku s virtuální zarážkou)
+ * @param SA pole přípon, n prvků
+ * @param n délka řetězce včetně zarážky, alespoň 2
+ * @param K největší znak
+ * @param budget limit převodu
+ * @return AHEDOK, AHEDFail pokud se nepodařilo alokovat paměť nebo byl
+ *   překročen limit převodu
+ */
+static int saSort(const void* s, int bytes, int32_t* SA, int32_t n, int32_t K,
+	struct budget* budget) {
+	unsigned char* types = calloc(n / 8 + 1, 1);
+	int32_t* buckets = malloc(sizeof(*buckets) * (K + 1));
+	int32_t n1 = 0;
+	int32_t name = 0;
+	int32_t prev = -1;
+	int32_t* s1;
+	int32_t j;
+	
+	if (types == NULL || buckets == NULL) {
+		free(types);
+		free(buckets);
+		return(AHEDFail);
+	}
+	/** typy přípon, zarážka je typu S a znak před ní typu L */
+	types[(n - 1) >> 3] |= 1 << ((n - 1) & 7);
+	for (int32_t i = n - 3; i >= 0; i--) {
+		int32_t a = saChar(s, bytes, n, i);
+		int32_t b = saChar(s, bytes, n, i + 1);
+		if (budgetStep(budget, i)) {
+			free(types);
+			free(buckets);
+			return(AHEDFail);
+		}
+		if (a < b || (a == b && saTypeS(types, i + 1))) {
+			types[i >> 3] |= 1 << (i & 7);
+		}
+	}
+	
+	/** seřazení podřetězců LMS */
+	saBuckets(s, bytes, buckets, n, K, 1);
+	for (int32_t i = 0; i < n; i++) {
+		SA[i] = -1;
+	}
+	for (int32_t i = 1; i < n; i++) {
+		if (saLMS(types, i)) {
+			SA[--buckets[saChar(s, bytes, n, i)]] = i;
+		}
+	}
+	if (saInduce(types, SA, s, bytes, buckets, n, K, budget) == AHEDFail) {
+		free(types);
+		free(buckets);
+		return(AHEDFail);
+	}
+	
+	/** seřazené podřetězce LMS na začátek pole, jejich počet je nejvýše n/2 */
+	for (int32_t i = 0; i < n; i++) {
+		if (saLMS(types, SA[i])) {
+			SA[n1++] = SA[i];
+		}
+	}
+	/** pojmenování podřetězců, stejné podřetězce dostanou stejné jméno */
+	for (int32_t i = n1; i < n; i++) {
+		SA[i] = -1;
+	}
+	for (int32_t i = 0; i < n1; i++) {
+		int32_t pos = SA[i];
+		int diff = 0;
+		
+		if (budgetStep(budget, i)) {
+			free(types);
+			free(buckets);
+			return(AHEDFail);
+		}
+		for (int32_t d = 0; d < n; d++) {
+			if (prev == -1 ||
+					saChar(s, bytes, n, pos + d) != saChar(s, bytes, n, prev + d) ||
+					saTypeS(types, pos + d) != saTypeS(types, prev + d)) {
+				diff = 1;
+				break;
+			}
+			if (d > 0 && (saLMS(types, pos + d) || saLMS(types, prev + d))) {
+				break;
+			}
+		}
+		if (diff) {
+			name++;
+			prev = pos;
+		}
+		SA[n1 + pos / 2] = name - 1;
+	}
+	j = n - 1;
+	for (int32_t i = n - 1; i >= n1; i--) {
+		if (SA[i] >= 0) {
+			SA[j--] = SA[i];
+		}
+	}
+	
+	/** pole přípon zkráceného řetězce, rekurzivně jen pro opakovaná jména */
+	s1 = SA + n - n1;
+	if (name < n1) {
+		if (saSort(s1, 0, SA, n1, name - 1, budget) == AHEDFail) {
+			free(types);
+			free(buckets);
+			return(AHEDFail);
+		}
+	} else {
+		for (int32_t i = 0; i < n1; i++) {
+			SA[s1[i]] = i;
+		}
+	}
+	
+	/** přípony LMS na konce svých přihrádek v pořadí zkráceného řetězce
+	 * a indukované seřazení všech přípon */
+	saBuckets(s, bytes, buckets, n, K, 1);
+	j = 0;
+	for (int32_t i = 1; i < n; i++) {
+		if (saLMS(types, i)) {
+			s1[j++] = i;
+		}
+	}
+	for (int32_t i = 0; i < n1; i++) {
+		SA[i] = s1[SA[i]];
+	}
+	for (int32_t i = n1; i < n; i++) {
+		SA[i] = -1;
+	}
+	for (int32_t i = n1 - 1; i >= 0; i--) {
+		j = SA[i];
+		SA[i] = -1;
+		SA[--buckets[saChar(s, bytes, n, j)]] = j;
+	}
+	j = saInduce(types, SA, s, bytes, buckets, n, K, budget);
+	free(types);
+	free(buckets);
+	return(j);
+}
+
+/**
+ * Zápis běhu nul po MTF v bijektivní dvojkové soustavě číslicemi 0 a 1
+ * (jako RUNA a RUNB v bzip2)
+ * @param out výstup
+ * @param run délka běhu
+ * @return nová pozice ve výstupu
+ */
+static unsigned char* putRun(unsigned char* out, size_t run) {
+	while (run > 0) {
+		if (run & 1) {
+			*out++ = 0;
+			run = (run - 1) / 2;
+		} else {
+			*out++ = 1;
+			run = (run - 2) / 2;
+		}
+	}
+	return(out);
+}
+
+/**
+ * Transformace bloku -- BWT z pole přípon, move-to-front a kódování běhů
+ * nul. Výstup začíná rámcem s délkou bloku, primárním indexem a délkou
+ * transformovaných dat.
+ * @param b blok, data a length jsou vstup, coded a codedLength výstup
+ * @return AHEDOK, AHEDFail pokud se nepodařilo alokovat paměť nebo byl
+ *   překročen limit převodu
+ */
+static int blockForward(struct block* b) {
+	int32_t n = b->length;
+	int32_t* SA = b->index;
+	unsigned char* bwt = b->bwt;
+	unsigned char order[256];
+	unsigned char* out;
+	int32_t primary = 0;
+	size_t run = 0;
+	int32_t k = 0;
+	
+	if (saSort(b->data, 1, SA, n + 1, 256, b->budget) == AHEDFail) {
+		return(AHEDFail);
+	}
+	/** poslední sloupec seřazených rotací, řádek se zarážkou se vynechá */
+	for (int32_t i = 0; i <= n; i++) {
+		if (budgetStep(b->budget, i)) {
+			return(AHEDFail);
+		}
+		if (SA[i] == 0) {
+			primary = i;
+		} else {
+			bwt[k++] = b->data[SA[i] - 1];
+		}
+	}
+	
+	/** move-to-front, nuly se sčítají do běhů; hodnoty 1 až 253 se posunou
+	 * o jedna, 254 a 255 se zapíší jako 255 a rozlišující byte */
+	for (int i = 0; i < 256; i++) {
+		order[i] = i;
+	}
+	out = b->coded + AHEDframeSize;
+	for (int32_t i = 0; i < n; i++) {
+		unsigned char c = bwt[i];
+		int v = 0;
+		
+		if (budgetStep(b->budget, i)) {
+			return(AHEDFail);
+		}
+		while (order[v] != c) {
+			v++;
+		}
+		if (v == 0) {
+			run++;
+			continue;
+		}
+		memmove(order + 1, order, v);
+		order[0] = c;
+		out = putRun(out, run);
+		run = 0;
+		if (v < 254) {
+			*out++ = v + 1;
+		} else {
+			*out++ = 255;
+			*out++ = v - 254;
+		}
+	}
+	out = putRun(out, run);
+	
+	b->codedLength = out - b->coded;
+	putWord(b->coded, n);
+	putWord(b->coded + 4, primary);
+	putWord(b->coded + 8, b->codedLength - AHEDframeSize);
+	return(AHEDOK);
+}
+
+/**
+ * Zpětná transformace bloku -- běhy nul, move-to-front a zpětná BWT
+ * @param b blok, coded a codedLength (bez rámce), length a primary jsou
+ *   vstup, data výstup
+ * @return AHEDOK, AHEDFail pro poškozený blok, nedostatek paměti nebo
+ *   překročení limitu převodu
+ */
+static int blockInverse(struct block* b) {
+	int32_t n = b->length;
+	int32_t p = b->primary;
+	unsigned char* bwt = b->bwt;
+	int32_t* lf = b->index;
+	int32_t start[256];
+	int32_t count[256];
+	unsigned char order[256];
+	size_t run = 0;
+	size_t weight = 1;
+	int valid = 1;
+	int32_t k = 0;
+	int32_t row;
+	
+	for (int i = 0; i < 256; i++) {
+		order[i] = i;
+	}
+	/** běhy nul a move-to-front; běh nebo hodnota za koncem bloku
+	 * znamená poškozená data */
+	for (size_t i = 0; i < b->codedLength && valid; i++) {
+		unsigned char c = b->coded[i];
+		int v;
+		
+		if (budgetStep(b->budget, i)) {
+			valid = 0;
+			break;
+		}
+		if (c <= 1) {
+			run += (c + 1) * weight;
+			weight <<= 1;
+			valid = run <= (size_t)(n - k);
+			continue;
+		}
+		memset(bwt + k, order[0], run);
+		k += run;
+		run = 0;
+		weight = 1;
+		if (c < 255) {
+			v = c - 1;
+		} else if (++i < b->codedLength && b->coded[i] <= 1) {
+			v = 254 + b->coded[i];
+		} else {
+			valid = 0;
+			break;
+		}
+		if (k == n) {
+			valid = 0;
+			break;
+		}
+		c = order[v];
+		memmove(order + 1, order, v);
+		order[0] = c;
+		bwt[k++] = c;
+	}
+	if (valid) {
+		memset(bwt + k, order[0], run);
+		k += run;
+	}
+	if (!valid || k != n || p < 1 || p > n) {
+		return(AHEDFail);
+	}
+	
+	/** zpětná BWT: řádek i posledního sloupce (se zarážkou v řádku p)
+	 * přechází na řádek, kde jeho znak začíná rotaci */
+	memset(count, 0, sizeof(count));
+	for (int32_t i = 0; i < n; i++) {
+		count[bwt[i]]++;
+	}
+	start[0] = 1;
+	for (int i = 1; i < 256; i++) {
+		start[i] = start[i - 1] + count[i - 1];
+	}
+	for (int32_t i = 0; i <= n; i++) {
+		if (budgetStep(b->budget, i)) {
+			return(AHEDFail);
+		}
+		if (i == p) {
+			lf[i] = 0;
+		} else {
+			lf[i] = start[bwt[i < p ? i : i - 1]]++;
+		}
+	}
+	row = 0;
+	for (int32_t i = n - 1; i >= 0; i--) {
+		if (row == p || budgetStep(b->budget, i)) {
+			break;
+		}
+		b->data[i] = bwt[row < p ? row : row - 1];
+		row = lf[row];
+		k = i;
+	}
+	return(row == p && k == 0 ? AHEDOK : AHEDFail);
+}
+
 /**
- * Struktura jednoho uzlu v poli
+ * Vlákno transformace jednoho bloku
+ * @param arg blok (struct block)
  */
-struct node {
-	int64_t count;	/** kolikrát se znak objevil ve vstupním řetězci */
-	int64_t order;	/** pořadí ve stromu pro případný přesun */
-	int64_t	left;	/** ukazatel na levého syna */
-	int64_t right;	/** ukazatel na pravého syna */
-	int64_t parent;	/** ukazatel na otce */
-};
+static void* forwardThread(void* arg) {
+	struct block* b = arg;
+	
+	b->result = blockForward(b);
+	return(NULL);
+}
 
 /**
- * Struktura popisujici pruchod stromem od korene k uzlu
+ * Vlákno zpětné transformace jednoho bloku
+ * @param arg blok (struct block)
  */
-struct path {
-	int32_t path;	/** cesta */
-	int8_t bits;	/** kolik bitu cesty je vyznamovych */
-};
+static void* inverseThread(void* arg) {
+	struct block* b = arg;
+	
+	b->result = blockInverse(b);
+	return(NULL);
+}
 
-/** 
- * Nastavení všech uzlů na výchozí hodnoty
- * @param nodes	pole uzlů které mají být nastaveny
+/**
+ * Transformace skupiny bloků, každý blok kromě prvního ve vlastním vlákně;
+ * blok, pro který se vlákno nepodařilo spustit, transformuje volající
+ * @param blocks bloky
+ * @param count počet bloků
+ * @param run transformace jednoho bloku
+ * @return AHEDOK pokud se podařilo transformovat všechny bloky, jinak AHEDFail
+ */
+static int runBlocks(struct block* blocks, int count, void* (*run)(void*)) {
+	int retval = AHEDOK;
+	
+	for (int i = 1; i < count; i++) {
+		blocks[i].started = pthread_create(&blocks[i].thread, NULL, run,
+			&blocks[i]) == 0;
+	}
+	run(&blocks[0]);
+	for (int i = 1; i < count; i++) {
+		if (blocks[i].started) {
+			pthread_join(blocks[i].thread, NULL);
+		} else {
+			run(&blocks[i]);
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		if (blocks[i].result == AHEDFail) {
+			retval = AHEDFail;
+		}
+	}
+	return(retval);
+}
+
+/**
+ * Uvolnění bloků transformace, úplně alokované bloky se ponechají
+ * v kontextu pro další převod
+ * @param s stav transformace
+ * @param context stav ponechaný mezi převody, případně NULL
+ */
+static void blocksFree(struct blocks* s, struct AHEDContext* context) {
+	int complete = s->block != NULL;
+	
+	for (int i = 0; complete && i < s->threads; i++) {
+		complete = s->block[i].data != NULL && s->block[i].coded != NULL &&
+			s->block[i].index != NULL && s->block[i].bwt != NULL;
+	}
+	if (context != NULL && complete) {
+		context->blocks = *s;
+		return;
+	}
+	for (int i = 0; s->block != NULL && i < s->threads; i++) {
+		free(s->block[i].data);
+		free(s->block[i].coded);
+		free(s->block[i].index);
+		free(s->block[i].bwt);
+	}
+	free(s->block);
+}
+
+/**
+ * Příprava bloků transformace; bloky stejné velikosti a počtu z kontextu
+ * se použijí znovu
+ * @param s stav transformace
+ * @param blockSize velikost bloku
+ * @param threads počet bloků transformovaných současně, 0 = podle počtu
+ *   procesorů
+ * @param context stav ponechaný mezi převody, případně NULL
+ * @return AHEDOK pokud se podařilo alokovat buffery, jinak AHEDFail
+ */
+static int blocksInit(struct blocks* s, int32_t blockSize, int threads,
+	struct AHEDContext* context) {
+	memset(s, 0, sizeof(*s));
+	s->blockSize = blockSize;
+	s->threads = threads > 0 ? threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (s->threads < 1) {
+		s->threads = 1;
+	}
+	if (context != NULL && context->blocks.block != NULL) {
+		if (context->blocks.blockSize == blockSize &&
+				context->blocks.threads == s->threads) {
+			s->block = context->blocks.block;
+			context->blocks.block = NULL;
+			return(AHEDOK);
+		}
+		blocksFree(&context->blocks, NULL);
+		context->blocks.block = NULL;
+	}
+	if ((s->block = calloc(s->threads, sizeof(*s->block))) == NULL) {
+		return(AHEDFail);
+	}
+	for (int i = 0; i < s->threads; i++) {
+		s->block[i].data = malloc(blockSize);
+		s->block[i].coded = malloc((size_t)blockSize * 2 + AHEDframeSize);
+		s->block[i].index = malloc(sizeof(int32_t) * ((size_t)blockSize + 1));
+		s->block[i].bwt = malloc(blockSize);
+		if (s->block[i].data == NULL || s->block[i].coded == NULL ||
+				s->block[i].index == NULL || s->block[i].bwt == NULL) {
+			return(AHEDFail);
+		}
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Načtení a transformace další skupiny bloků vstupu
+ * @param c stav kódování
+ * @param file vstupní soubor
+ * @return AHEDOK pokud je k dispozici alespoň jeden blok, AHEDFail na konci
+ *   vstupu nebo při chybě (nastaví error)
+ */
+static int readBlocks(struct coder* c, FILE* file) {
+	struct blocks* s = c->blocks;
+	
+	s->count = 0;
+	s->current = 0;
+	s->position = 0;
+	while (!s->eof && s->count < s->threads) {
+		struct block* b = &s->block[s->count];
+		
+		b->budget = &c->budget;
+		b->length = getBytes(c, file, b->data, s->blockSize);
+		s->eof = b->length < (size_t)s->blockSize;
+		s->raw += b->length;
+		if (b->length > 0) {
+			s->count++;
+		}
+	}
+	if (s->count == 0) {
+		return(AHEDFail);
+	}
+	if (budgetBlocks(c, s->raw) == AHEDFail) {
+		s->error = 1;
+		return(AHEDFail);
+	}
+	if (runBlocks(s->block, s->count, forwardThread) == AHEDFail) {
+		s->error = 1;
+		return(AHEDFail);
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Načtení jednoho byte transformovaného vstupu pro kódování
+ * @param c stav kódování
+ * @param file vstupní soubor
+ * @param byte načtený byte
+ * @return AHEDOK pokud byl byte načten, AHEDFail na konci vstupu
+ */
+static int blockRead(struct coder* c, FILE* file, unsigned char* byte) {
+	struct blocks* s = c->blocks;
+	
+	while (s->current == s->count ||
+			s->position == s->block[s->current].codedLength) {
+		if (s->current < s->count) {
+			s->current++;
+			s->position = 0;
+		} else if (readBlocks(c, file) == AHEDFail) {
+			return(AHEDFail);
+		}
+	}
+	*byte = s->block[s->current].coded[s->position++];
+	return(AHEDOK);
+}
+
+/**
+ * Zpětná transformace nashromážděných bloků a zápis jejich dat do výstupu
+ * @param c stav dekódování
+ * @param file výstupní soubor
+ * @return AHEDOK pokud se bloky podařilo zpracovat a zapsat, jinak AHEDFail
+ */
+static int flushBlocks(struct coder* c, FILE* file) {
+	struct blocks* s = c->blocks;
+	int count = s->count;
+	
+	int64_t raw = s->raw;
+	
+	s->count = 0;
+	if (count == 0) {
+		return(AHEDOK);
+	}
+	for (int i = 0; i < count; i++) {
+		raw += s->block[i].length;
+		s->block[i].budget = &c->budget;
+	}
+	if (budgetBlocks(c, raw) == AHEDFail ||
+			runBlocks(s->block, count, inverseThread) == AHEDFail) {
+		return(AHEDFail);
+	}
+	for (int i = 0; i < count; i++) {
+		if (putBytes(c, file, s->block[i].data, s->block[i].length) == AHEDFail) {
+			return(AHEDFail);
+		}
+		s->raw += s->block[i].length;
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Zápis jednoho dekódovaného byte transformovaného proudu -- byte se
+ * skládají do rámců a bloků, plná skupina bloků se zpětně transformuje
+ * @param c stav dekódování
+ * @param file výstupní soubor
+ * @param byte dekódovaný byte
+ * @return AHEDOK, AHEDFail pro poškozený rámec nebo chybu zápisu
+ */
+static int blockWrite(struct coder* c, FILE* file, unsigned char byte) {
+	struct blocks* s = c->blocks;
+	struct block* b = &s->block[s->count];
+	
+	if (s->frameLength < AHEDframeSize) {
+		s->frame[s->frameLength++] = byte;
+		if (s->frameLength == AHEDframeSize) {
+			u_int32_t n = getWord(s->frame);
+			u_int32_t m = getWord(s->frame + 8);
+			
+			if (n < 1 || n > (u_int32_t)s->blockSize || m < 1 || m > 2 * n) {
+				return(AHEDFail);
+			}
+			b->length = n;
+			b->primary = getWord(s->frame + 4);
+			b->codedLength = m;
+			s->position = 0;
+		}
+		return(AHEDOK);
+	}
+	b->coded[s->position++] = byte;
+	if (s->position == b->codedLength) {
+		s->frameLength = 0;
+		if (++s->count == s->threads) {
+			return(flushBlocks(c, file));
+		}
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Načtení vstupu pro kódování, případně přes transformaci bloků
+ */
+static int getInput(struct coder* c, FILE* file, unsigned char* byte) {
+	if (c->blocks != NULL) {
+		return(blockRead(c, file, byte));
+	}
+	return(getByte(c, file, byte));
+}
+
+/**
+ * Zápis dekódovaného výstupu, případně přes zpětnou transformaci bloků
+ */
+static int putOutput(struct coder* c, FILE* file, unsigned char byte) {
+	if (c->blocks != NULL) {
+		return(blockWrite(c, file, byte));
+	}
+	return(putByte(c, file, byte));
+}
+
+/**
+ * Načtení vzorku ze vstupu převodu, vzorek širší než 8 bitů je uložen ve
+ * dvou byte little-endian; lichý poslední byte vrátí jako symbol zbytku
+ * @param c stav kódování
+ * @param file vstupní soubor
+ * @param width šířka vzorku, konstanta u specializovaných smyček
+ * @param symbol načtený symbol, AHEDnullNode = vzorek je příliš velký
+ * @param uncodedSize velikost nekódovaného vstupu
+ * @return AHEDOK pokud se vzorek podařilo načíst, AHEDFail na konci vstupu
+ */
+static inline int getSymbol(struct coder* c, FILE* file, int width,
+	int64_t* symbol, int64_t* uncodedSize) {
+	unsigned char byte;
+	
+	if (getInput(c, file, &byte) == AHEDFail) {
+		return(AHEDFail);
+	}
+	(*uncodedSize)++;
+	*symbol = byte;
+	if (width == AHEDbitness) {
+		return(AHEDOK);
+	}
+	if (getInput(c, file, &byte) == AHEDFail) {
+		c->tail = *symbol;
+		*symbol = c->tailSymbol;
+		return(AHEDOK);
+	}
+	(*uncodedSize)++;
+	*symbol |= byte << 8;
+	if (width < AHEDmaxWidth && (*symbol >> width) != 0) {
+		*symbol = AHEDnullNode;
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Zápis vzorku na výstup převodu
+ * @param c stav dekódování
+ * @param file výstupní soubor
+ * @param width šířka vzorku, konstanta u specializovaných smyček
+ * @param symbol zapisovaný vzorek
+ * @return AHEDOK pokud se zápis podařil, jinak AHEDFail
+ */
+static inline int putSymbol(struct coder* c, FILE* file, int width,
+	int64_t symbol) {
+	if (putOutput(c, file, symbol & 0xff) == AHEDFail) {
+		return(AHEDFail);
+	}
+	if (width == AHEDbitness) {
+		return(AHEDOK);
+	}
+	return(putOutput(c, file, symbol >> 8));
+}
+
+/**
+ * Zápis vzorku opakovaného count-krát na výstup převodu, mimo transformaci
+ * po blocích se zapisuje po úsecích najednou
+ * @param c stav dekódování
+ * @param file výstupní soubor
+ * @param width šířka vzorku
+ * @param symbol opakovaný vzorek
+ * @param count počet opakování
+ * @return AHEDOK pokud se zápis podařil, jinak AHEDFail
+ */
+static int putRepeat(struct coder* c, FILE* file, int width, int64_t symbol,
+	int64_t count) {
+	unsigned char data[4096];
+	int bytes = width == AHEDbitness ? 1 : 2;
+	
+	if (c->blocks != NULL) {
+		for (; count > 0; count--) {
+			if (putSymbol(c, file, width, symbol) == AHEDFail ||
+					((count & (AHEDbudgetBytes - 1)) == 0 &&
+					c->budget.next != INT64_MAX && budgetPoll(c) == AHEDFail)) {
+				return(AHEDFail);
+			}
+		}
+		return(AHEDOK);
+	}
+	for (size_t i = 0; i < sizeof(data); i += bytes) {
+		data[i] = symbol & 0xff;
+		if (bytes == 2) {
+			data[i + 1] = symbol >> 8;
+		}
+	}
+	while (count > 0) {
+		int64_t n = count < (int64_t)sizeof(data)/bytes ?
+			count : (int64_t)sizeof(data)/bytes;
+		/** dlouhý běh kontroluje dobu a zrušení průběžně */
+		if (putBytes(c, file, data, n*bytes) == AHEDFail ||
+				(c->budget.next != INT64_MAX && budgetPoll(c) == AHEDFail)) {
+			return(AHEDFail);
+		}
+		count -= n;
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Výpočet tabulek CRC32C, tabulka t obsahuje CRC byte následovaného t
+ * nulovými byte
+ */
+static void crcInit(void) {
+	for (int i = 0; i < 256; i++) {
+		u_int32_t crc = i;
+		for (int j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ ((crc & 1) ? AHEDcrcPolynomial : 0);
+		}
+		crcTable[0][i] = crc;
+	}
+	for (int i = 0; i < 256; i++) {
+		for (int t = 1; t < 8; t++) {
+			crcTable[t][i] = (crcTable[t - 1][i] >> 8) ^
+				crcTable[0][crcTable[t - 1][i] & 0xff];
+		}
+	}
+}
+
+/**
+ * Aktualizace CRC32C o data, po osmi byte podle tabulek (skalární verze)
+ * @param crc průběžná hodnota CRC
+ * @param data data
+ * @param length počet byte dat
+ * @return nová průběžná hodnota CRC
+ */
+static u_int32_t crcUpdateScalar(u_int32_t crc, const unsigned char* data,
+	size_t length) {
+	for (; length >= 8; data += 8, length -= 8) {
+		u_int32_t low = crc ^ getWord(data);
+		u_int32_t high = getWord(data + 4);
+		crc = crcTable[7][low & 0xff] ^ crcTable[6][(low >> 8) & 0xff] ^
+			crcTable[5][(low >> 16) & 0xff] ^ crcTable[4][low >> 24] ^
+			crcTable[3][high & 0xff] ^ crcTable[2][(high >> 8) & 0xff] ^
+			crcTable[1][(high >> 16) & 0xff] ^ crcTable[0][high >> 24];
+	}
+	for (; length > 0; data++, length--) {
+		crc = (crc >> 8) ^ crcTable[0][(crc ^ *data) & 0xff];
+	}
+	return(crc);
+}
+
+#ifdef HAVE_CRC32C_KERNEL
+/**
+ * Aktualizace CRC32C o data -- verze SSE4.2, instrukce crc32 zpracuje
+ * osm byte najednou
+ */
+__attribute__((target("sse4.2")))
+static u_int32_t crcUpdateSSE42(u_int32_t crc, const unsigned char* data,
+	size_t length) {
+	u_int64_t crc64 = crc;
+	
+	for (; length >= 8; data += 8, length -= 8) {
+		u_int64_t word;
+		memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = crc64;
+	for (; length > 0; data++, length--) {
+		crc = _mm_crc32_u8(crc, *data);
+	}
+	return(crc);
+}
+#endif
+
+/**
+ * Aktualizace CRC32C o data s výběrem nejrychlejší verze; výpočet začíná
+ * hodnotou ~0 a výsledné CRC je negace průběžné hodnoty
+ * @param crc průběžná hodnota CRC
+ * @param data data
+ * @param length počet byte dat
+ * @return nová průběžná hodnota CRC
+ */
+static u_int32_t crcUpdate(u_int32_t crc, const unsigned char* data,
+	size_t length) {
+#ifdef HAVE_CRC32C_KERNEL
+	if (__builtin_cpu_supports("sse4.2")) {
+		return(crcUpdateSSE42(crc, data, length));
+	}
+#endif
+	pthread_once(&crcOnce, crcInit);
+	return(crcUpdateScalar(crc, data, length));
+}
+
+/**
+ * Inicializace bloků s kontrolním součtem
+ * @param s stav bloků
+ * @param offset pozice prvního bloku v kódovaném proudu
+ * @return AHEDOK pokud se podařilo alokovat blok, jinak AHEDFail
+ */
+static int checkInit(struct check* s, int64_t offset) {
+	memset(s, 0, sizeof(*s));
+	s->offset = offset;
+	s->data = malloc(AHEDchunkSize);
+	return(s->data != NULL ? AHEDOK : AHEDFail);
+}
+
+/**
+ * Uvolnění bloků s kontrolním součtem
+ * @param s stav bloků
+ */
+static void checkFree(struct check* s) {
+	free(s->data);
+	s->data = NULL;
+}
+
+/**
+ * Zápis rozpracovaného bloku se záhlavím
+ * @param c stav kódování
+ * @param file výstupní soubor
+ * @return AHEDOK pokud se blok podařilo zapsat, jinak AHEDFail
+ */
+static int checkWrite(struct coder* c, FILE* file) {
+	struct check* s = c->check;
+	unsigned char header[AHEDchunkHeader];
+	
+	putWord(header, s->length);
+	putWord(header + 4, ~crcUpdate(crcUpdate(~0u, header, 4), s->data,
+		s->length));
+	s->overhead += AHEDchunkHeader;
+	if (putBytes(c, file, header, AHEDchunkHeader) == AHEDFail ||
+			putBytes(c, file, s->data, s->length) == AHEDFail) {
+		return(AHEDFail);
+	}
+	s->length = 0;
+	return(AHEDOK);
+}
+
+/**
+ * Zápis posledního bloku a konce proudu s délkou původních dat
+ * @param c stav kódování
+ * @param file výstupní soubor
+ * @param original délka původních dat
+ * @return AHEDOK pokud se zápis podařil, jinak AHEDFail
+ */
+static int checkFinish(struct coder* c, FILE* file, int64_t original) {
+	unsigned char end[AHEDchunkEnd];
+	
+	if (c->check->length > 0 && checkWrite(c, file) == AHEDFail) {
+		return(AHEDFail);
+	}
+	putWord(end, 0);
+	putWord(end + 8, original);
+	putWord(end + 12, original >> 32);
+	putWord(end + 4, ~crcUpdate(crcUpdate(~0u, end, 4), end + 8, 8));
+	c->check->overhead += AHEDchunkEnd;
+	return(putBytes(c, file, end, AHEDchunkEnd));
+}
+
+/**
+ * Načtení a ověření dalšího bloku. Při chybě zůstane v offset pozice
+ * poškozeného bloku.
+ * @param c stav dekódování
+ * @param file vstupní soubor
+ * @return AHEDOK pokud je k dispozici další blok, AHEDFail na konci proudu
+ * 		nebo u poškozeného bloku
+ */
+static int checkRead(struct coder* c, FILE* file) {
+	struct check* s = c->check;
+	unsigned char header[AHEDchunkEnd];
+	u_int32_t length;
+	
+	if (s->end || s->corrupt) {
+		return(AHEDFail);
+	}
+	s->corrupt = 1;
+	if (getBytes(c, file, header, AHEDchunkHeader) != AHEDchunkHeader) {
+		return(AHEDFail);
+	}
+	/** konec proudu */
+	if ((length = getWord(header)) == 0) {
+		if (getBytes(c, file, header + 8, 8) != 8 || getWord(header + 4) !=
+				~crcUpdate(crcUpdate(~0u, header, 4), header + 8, 8)) {
+			return(AHEDFail);
+		}
+		s->original = getWord(header + 8) |
+			((int64_t)getWord(header + 12) << 32);
+		s->overhead += AHEDchunkEnd;
+		s->corrupt = 0;
+		s->end = 1;
+		return(AHEDFail);
+	}
+	if (length > AHEDchunkSize ||
+			getBytes(c, file, s->data, length) != length ||
+			getWord(header + 4) !=
+			~crcUpdate(crcUpdate(~0u, header, 4), s->data, length)) {
+		return(AHEDFail);
+	}
+	s->overhead += AHEDchunkHeader;
+	s->offset += AHEDchunkHeader + length;
+	s->length = length;
+	s->position = 0;
+	s->corrupt = 0;
+	return(AHEDOK);
+}
+
+/**
+ * Zápis byte kódovaného proudu, s kontrolními součty do bloku
+ * @param c stav kódování
+ * @param file výstupní soubor
+ * @param byte zapisovaný byte
+ * @return AHEDOK pokud se zápis podařil, jinak AHEDFail
+ */
+static int putCoded(struct coder* c, FILE* file, unsigned char byte) {
+	if (c->check == NULL) {
+		return(putByte(c, file, byte));
+	}
+	c->check->data[c->check->length++] = byte;
+	if (c->check->length == AHEDchunkSize) {
+		return(checkWrite(c, file));
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Načtení byte kódovaného proudu, s kontrolními součty z ověřeného bloku
+ * @param c stav dekódování
+ * @param file vstupní soubor
+ * @param byte načtený byte
+ * @return AHEDOK pokud se byte podařilo načíst, jinak AHEDFail
+ */
+static int getCoded(struct coder* c, FILE* file, unsigned char* byte) {
+	struct check* s = c->check;
+	
+	if (s == NULL) {
+		return(getByte(c, file, byte));
+	}
+	if (s->position == s->length && checkRead(c, file) == AHEDFail) {
+		return(AHEDFail);
+	}
+	*byte = s->data[s->position++];
+	return(AHEDOK);
+}
+
+/**
+ * Nastavení abecedy převodu a založení stromu s jediným uzlem zero.
+ * Abecedu tvoří vzorky dané šířky, s běhy AHEDrunSymbols symbolů běhů
+ * a u vzorků širších než byte symbol lichého posledního byte. Nový symbol
+ * se zapisuje nejmenším počtem bitů, který pojme celou abecedu. Pole uzlů
+ * a pole uzlů podle pořadí rostou podle počtu symbolů ve stromu, tabulka
+ * listů má pro každý symbol jen index. Pořadí uzlů tvoří souvislý úsek
+ * klesající od pořadí kořene, index v poli podle pořadí je tak rozdíl od
+ * počátečního pořadí uzlu zero. Převod s kontextem převezme pole
+ * předchozího převodu a jen vynuluje listy.
+ * @param c stav převodu
+ * @param width šířka vzorku
+ * @param runs abeceda obsahuje symboly běhů
+ * @return AHEDOK pokud se strom podařilo alokovat, jinak AHEDFail
+ */
+static int initTree(struct coder* c, int width, int runs) {
+	struct AHEDContext* x = c->context;
+	struct node* nodes;
+	int32_t* ranks;
+	int32_t* leaves;
+	int64_t capacity;
+	
+	c->width = width;
+	c->symbols = ((int64_t)1) << width;
+	c->runSymbol = runs ? c->symbols : AHEDnullNode;
+	c->symbols += runs ? AHEDrunSymbols : 0;
+	c->tailSymbol = width > AHEDbitness ? c->symbols++ : AHEDnullNode;
+	for (c->symbolBits = 0; ((c->symbols - 1) >> c->symbolBits) != 0;
+		c->symbolBits++);
+	
+	capacity = c->symbols*2 + 1 < AHEDnodeChunk ?
+		c->symbols*2 + 1 : AHEDnodeChunk;
+	/** strom předchozího převodu se převezme a případně zvětší */
+	if (x != NULL) {
+		c->nodes = x->nodes;
+		c->ranks = x->ranks;
+		c->capacity = x->capacity;
+		c->leaves = x->leaves;
+		c->leafCapacity = x->symbols;
+		x->nodes = NULL;
+		x->ranks = NULL;
+		x->leaves = NULL;
+	}
+	if (c->capacity < capacity) {
+		if ((nodes = realloc(c->nodes, capacity*sizeof(struct node))) == NULL) {
+			return(AHEDFail);
+		}
+		c->nodes = nodes;
+		if ((ranks = realloc(c->ranks, capacity*sizeof(int32_t))) == NULL) {
+			return(AHEDFail);
+		}
+		c->ranks = ranks;
+		c->capacity = capacity;
+	}
+	if (c->leafCapacity < c->symbols) {
+		if ((leaves = realloc(c->leaves, c->symbols*sizeof(int32_t))) == NULL) {
+			return(AHEDFail);
+		}
+		c->leaves = leaves;
+		c->leafCapacity = c->symbols;
+	}
+	memset(c->leaves, 0, c->symbols*sizeof(int32_t));
+	/** uzel zero má zatím nejvyšší pořadí */
+	c->length = 1;
+	c->nodes[AHEDzeroNode].count = 0;
+	c->nodes[AHEDzeroNode].order = c->symbols*2;
+	c->nodes[AHEDzeroNode].left = AHEDnullNode;
+	c->nodes[AHEDzeroNode].right = AHEDnullNode;
+	c->nodes[AHEDzeroNode].parent = AHEDnullNode;
+	c->nodes[AHEDzeroNode].symbol = AHEDnullNode;
+	c->ranks[0] = AHEDzeroNode;
+	return(AHEDOK);
+}
+
+/**
+ * Uvolnění stromu převodu
+ * @param c stav převodu
  */
-void initNodes(struct node nodes[]) {
-	for (int i = 0; i < AHEDlength; i++) {
-		nodes[i].count = 0;
-		nodes[i].left = AHEDnullNode;
-		nodes[i].right = AHEDnullNode;
-		nodes[i].parent = AHEDnullNode;
-		nodes[i].order = 0;
+static void freeTree(struct coder* c) {
+	struct AHEDContext* x = c->context;
+	
+	if (x != NULL && c->nodes != NULL && c->ranks != NULL && c->leaves != NULL) {
+		x->nodes = c->nodes;
+		x->ranks = c->ranks;
+		x->capacity = c->capacity;
+		x->leaves = c->leaves;
+		x->symbols = c->leafCapacity;
+	} else {
+		free(c->nodes);
+		free(c->ranks);
+		free(c->leaves);
 	}
+	c->nodes = NULL;
+	c->ranks = NULL;
+	c->leaves = NULL;
 }
 
 /**
@@ -48,7 +1890,7 @@ void initNodes(struct node nodes[]) {
  * @param path	informace o nalezene ceste a poctu bitu
  * @return	AHEDOK
  */
-char getNodePath(struct node nodes[], int64_t node, int64_t root, struct path* path) {
+static char getNodePath(struct node nodes[], int64_t node, int64_t root, struct path* path) {
 	int actual = node;
 	int parent;
 	path->path = 0;
@@ -74,34 +1916,31 @@ char getNodePath(struct node nodes[], int64_t node, int64_t root, struct path* p
  * zápis do výstupního proudu
  * uchovává si zapisovanou hodnotu a počet bitů, který je ještě volný
  * v okamžiku, kdy klesne počet volných bitů, provede zápis do souboru
+ * @param c		stav kódování (rozpracovaný výstupní byte)
  * @param file	výstupní proudu
  * @param path	informace o počtu bitů k zapsání
  */
-int wos(FILE* file, struct path* path, int64_t* codedSize) {
-	/** data uchovavane mezi jednotlivymi volanimi funkce */
-	static unsigned char output;	/** vystup k zapsani */
-	static char bit;				/** kolik bitu vystupu je jiz obsazeno */
-	
+static int wos(struct coder* c, FILE* file, struct path* path, int64_t* codedSize) {
 	/** projdi vsechny bity vstupu */
 	for (int i = path->bits-1; i >= 0; i--) {
 		/** pokud vstup obsahuje na dane pozici 1 */
 		if (path->path & (1 << i)) {
 			/** uloz ji do vystupu */
-			output |= 1 << (8-bit-1);
+			c->output |= 1 << (8-c->bit-1);
 		}
 		
 		/** inkrementuj pocet pouzitych bitu vystupu */
-		bit++;
+		c->bit++;
 		
 		/** pokud jsi vyuzil cely vystup */
-		if (bit == 8) {
+		if (c->bit == 8) {
 			/** zapis vystup do souboru */
-			if (fprintf(file, "%c", output) == 0) {
+			if (putCoded(c, file, c->output) == AHEDFail) {
 				return(AHEDFail);
 			}
 			/** a vynuluj vystup a pocet pouzitich bitu */
-			output = 0;
-			bit = 0;
+			c->output = 0;
+			c->bit = 0;
 			(*codedSize)++;
 		}
 	}
@@ -112,47 +1951,76 @@ int wos(FILE* file, struct path* path, int64_t* codedSize) {
 /**
  * Zapsání zbývajících znaků do souboru + znak EOF (EOF je složen ze
  * značky nového znaku a nedostatečného počtu bitů pro nový znak)
+ * @param c		stav kódování
  * @param file	ukazatel na výstupní soubor
  * @return informace o tom, zda se povedl zápis
  */
-int flushWos(FILE* file, int64_t* codeSize, struct node nodes[], int64_t root) {
+static int flushWos(struct coder* c, FILE* file, int64_t* codeSize, struct node nodes[],
+	int64_t root) {
 	//TODO zajistit vypsani zbytku uloženému ve výstupu
 	struct path p;
 	
 	/** vynuceni zapsani konce souboru */
 	getNodePath(nodes, AHEDzeroNode, root, &p);
-	wos(file, &p, codeSize);
+	wos(c, file, &p, codeSize);
 	
 	p.path = 0;
 	p.bits = 7;
 	
-	return(wos(file, &p, codeSize));
+	return(wos(c, file, &p, codeSize));
 }
 
 /**
- * zápis znaku do výstupního proudu
+ * zápis nového symbolu do výstupního proudu
+ * @param coder	stav kódování (počet bitů symbolu)
  * @param file	výstupní stream
- * @param c		znak k zapsání
+ * @param c		symbol k zapsání
  */
-int wch(FILE* file, char c, int64_t* codeSize) {
-	struct path p = {c, 8};
-	/** zavoláme zápis do výstupního proudu pro hodnotu s platnými 8mi bity */
-	return(wos(file, &p, codeSize));
+static int wch(struct coder* coder, FILE* file, int64_t c, int64_t* codeSize) {
+	struct path p = {c, coder->symbolBits};
+	/** zavoláme zápis do výstupního proudu pro hodnotu s platnými bity symbolu */
+	return(wos(coder, file, &p, codeSize));
 }
 
 /** 
- * přidání uzlu do stromu 
- * @param nodes	prvky stromu
- * @param ncnt	počet uzlů
- * @param left	index levého syna
- * @param right	index pravého syna
- * @return index pridaného uzlu
- */
-int addNewNode(struct node nodes[], int64_t left, int64_t right) {
-	static int64_t ncnt = 0;
-	
-	/** výpočet aktuálního volného uzlu */
-	int u = (1 << AHEDbitness) + ncnt;
+ * přidání uzlu do stromu, nový vnitřní uzel nahradí uzel zero a jeho
+ * syny jsou uzel zero a list nového symbolu
+ * @param c		stav převodu se stromem
+ * @param left	index levého syna (uzel zero)
+ * @param symbol	nový symbol
+ * @return index pridaného vnitřního uzlu, AHEDFail pokud se nepodařilo
+ * 		zvětšit pole uzlů
+ */
+static int64_t addNewNode(struct coder* c, int64_t left, int64_t symbol) {
+	struct node* nodes;
+	int32_t* ranks;
+	int64_t top = c->symbols*2;
+	int64_t u = c->length;
+	int64_t right = u + 1;
+	
+	/** zvětšení pole uzlů */
+	if (c->length + 2 > c->capacity) {
+		int64_t capacity = c->capacity*2 < c->symbols*2 + 1 ?
+			c->capacity*2 : c->symbols*2 + 1;
+		if ((nodes = realloc(c->nodes, capacity*sizeof(struct node))) == NULL) {
+			return(AHEDFail);
+		}
+		c->nodes = nodes;
+		if ((ranks = realloc(c->ranks, capacity*sizeof(int32_t))) == NULL) {
+			return(AHEDFail);
+		}
+		c->ranks = ranks;
+		c->capacity = capacity;
+	}
+	nodes = c->nodes;
+	/** nový vnitřní uzel a list */
+	nodes[u].count = 0;
+	nodes[u].parent = AHEDnullNode;
+	nodes[u].symbol = AHEDnullNode;
+	nodes[right].left = AHEDnullNode;
+	nodes[right].right = AHEDnullNode;
+	nodes[right].symbol = symbol;
+	c->leaves[symbol] = right;
 	/** pokud původní uzel neukazuje na kořen stromu */
 	if (nodes[left].parent != AHEDnullNode) {
 		/** nastav si ukazetele u rodiče a u sebe*/
@@ -173,49 +2041,60 @@ int addNewNode(struct node nodes[], int64_t left, int64_t right) {
 	/** nastav rodiči správné ukazatele */
 	nodes[u].left = left;
 	nodes[u].right = right;
+	c->ranks[top - nodes[u].order] = u;
+	c->ranks[top - nodes[left].order] = left;
+	c->ranks[top - nodes[right].order] = right;
 	/** zvyš počet obsazených uzlů */
-	(ncnt)++;
+	c->length += 2;
 	
 	return(u);
 }
 
 /**
- * Nalezení uzlu s odpovídajícími vlastnostmi
- * @param nodes	pole uzlů v kterých je uložen strom
+ * Nalezení uzlu se stejným počtem výskytů a nejvyšším pořadím, které je
+ * vyšší než zadané. Počty uzlů s rostoucím pořadím neklesají (sourozenecká
+ * vlastnost stromu), uzel se proto najde půlením pole uzlů seřazených
+ * podle pořadí.
+ * @param c		stav převodu se stromem
  * @param count	hledáme uzel se stejným obsahem count
  * @param order	hledáme uzel jehož order je vyšší než naše
- * @return index nalezeného pole, jinak AHEDFail
- */
-int findNode(struct node nodes[], int64_t count, int64_t order) {
-	/** projdi celé pole v kterém jsou uloženy uzly */
-	for (int64_t i = 0; i < AHEDlength; i++) {
-		/** a najdi uzel se stejnou hodnotou a vyšším pořadím */
-		if ((nodes[i].count == count) && (nodes[i].order > order)) {
-			/** rekurzivně najdi nejvyšší pořadí */
-			int i2 = findNode(nodes, count, order+1);
-			if (i2 != AHEDFail) {
-				return(i2);
-			}
-			return(i);
+ * @return index nalezeného uzlu, jinak AHEDFail
+ */
+static int64_t findNode(struct coder* c, int64_t count, int64_t order) {
+	int64_t low = 0;
+	int64_t high = c->symbols*2 - order;
+	
+	/** první uzel s počtem nejvýše count mezi uzly s vyšším pořadím */
+	while (low < high) {
+		int64_t middle = (low + high)/2;
+		if (c->nodes[c->ranks[middle]].count > count) {
+			low = middle + 1;
+		} else {
+			high = middle;
 		}
 	}
-	return(AHEDFail);
+	if (low == c->symbols*2 - order || c->nodes[c->ranks[low]].count != count) {
+		return(AHEDFail);
+	}
+	return(c->ranks[low]);
 }
 
 /**
  * aktualizace stromu
- * @param nodes	prvky stromu
+ * @param c		stav převodu se stromem
  * @param u vuci kteremu uzlu
  * @param root koren uzlu
  */
-void updateTree(struct node nodes[], int64_t u, int64_t root) {
+static void updateTree(struct coder* c, int64_t u, int64_t root) {
+	struct node* nodes = c->nodes;
+	int64_t top = c->symbols*2;
 	int64_t actual = u;
 	
 	/** dokud se nedopracuješ ke kořeni stromu */
 	while (actual != root) {
 		int64_t id;
 		/** nalezneme uzel vůči kterému se budeme vyměňovat */
-		if ((id = findNode(nodes, nodes[actual].count, nodes[actual].order)) 
+		if ((id = findNode(c, nodes[actual].count, nodes[actual].order)) 
 			!= AHEDFail && id != root &&
 				nodes[actual].parent != id) {
 			
@@ -236,6 +2115,8 @@ void updateTree(struct node nodes[], int64_t u, int64_t root) {
 			/** nastav vyměňovanému uzlu svoje hodnoty */
 			nodes[actual].parent = idx;
 			nodes[actual].order = order;
+			c->ranks[top - nodes[id].order] = id;
+			c->ranks[top - order] = actual;
 			if (nodes[idx].right == id) {
 				nodes[idx].right = actual;
 			} else {
@@ -251,6 +2132,258 @@ void updateTree(struct node nodes[], int64_t u, int64_t root) {
 	nodes[actual].count++;
 }
 
+/**
+ * Zakódování jednoho symbolu a aktualizace stromu
+ * @param c stav kódování se stromem
+ * @param outputFile výstupní soubor
+ * @param root kořen stromu, mění se po prvním symbolu
+ * @param ch kódovaný symbol
+ * @param codedSize velikost kódovaného výstupu
+ * @return AHEDOK pokud se symbol podařilo zapsat, jinak AHEDFail
+ */
+static int encodeSymbol(struct coder* c, FILE* outputFile, int64_t* root,
+	int64_t ch, int64_t* codedSize) {
+	struct path path;
+	
+	/** pokud jsi symbol načetl poprvé */
+	if (c->leaves[ch] == 0) {
+		int64_t i;
+		/** získej cestu od uzlu zero ke kořeni */
+		getNodePath(c->nodes, AHEDzeroNode, *root, &path);
+		
+		/** zapiš cestu k uzlu zero a zapiš symbol */ 
+		if (wos(c, outputFile, &path, codedSize) == AHEDFail ||
+			wch(c, outputFile, ch, codedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
+		
+		/** proveď přidání nového uzlu */
+		if ((i = addNewNode(c, AHEDzeroNode, ch)) == AHEDFail) {
+			return(AHEDFail);
+		}
+		/** a pokud byl kořen shodný s uzlem zero, změň kořen */
+		if (*root == AHEDzeroNode) {
+			*root = i;
+		}
+		/** aktualizuj strom */
+		updateTree(c, i, *root);
+	} else {
+		/** jinak jsi symbol již viděl, získej cestu od symbolu ke kořeni  */
+		getNodePath(c->nodes, c->leaves[ch], *root, &path);
+		/** a zapiš cestu */
+		if (wos(c, outputFile, &path, codedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
+		/** aktualizuj strom */
+		updateTree(c, c->leaves[ch], *root);
+	}
+	return(AHEDOK);
+}
+
+/**
+ * Zakódování odloženého běhu opakování posledního vzorku, krátký běh se
+ * kóduje po vzorcích, delší symbolem běhu a nižšími bity délky
+ * @param c stav kódování
+ * @param outputFile výstupní soubor
+ * @param root kořen stromu
+ * @param last opakovaný vzorek
+ * @param run délka běhu, po zakódování je nulová
+ * @param codedSize velikost kódovaného výstupu
+ * @return AHEDOK pokud se běh podařilo zapsat, jinak AHEDFail
+ */
+static int encodeRun(struct coder* c, FILE* outputFile, int64_t* root,
+	int64_t last, int64_t* run, int64_t* codedSize) {
+	if (*run >= AHEDminRun) {
+		int64_t v = *run - AHEDminRun + 1;
+		int k = 0;
+		struct path path;
+		
+		while ((v >> (k + 1)) != 0) {
+			k++;
+		}
+		path.path = v & ((((int64_t)1) << k) - 1);
+		path.bits = k;
+		if (encodeSymbol(c, outputFile, root, c->runSymbol + k, codedSize) ==
+				AHEDFail || wos(c, outputFile, &path, codedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
+	} else {
+		for (int64_t i = 0; i < *run; i++) {
+			if (encodeSymbol(c, outputFile, root, last, codedSize) ==
+					AHEDFail) {
+				return(AHEDFail);
+			}
+		}
+	}
+	*run = 0;
+	return(AHEDOK);
+}
+
+/**
+ * Kódovací smyčka pro vzorky dané šířky; vkládá se do encode zvlášť pro
+ * každou běžnou šířku, čtení vzorku se tak přeloží bez větvení podle šířky
+ * @param c stav kódování
+ * @param ahed záznam o kódování
+ * @param inputFile vstupní soubor
+ * @param outputFile výstupní soubor
+ * @param width šířka vzorku
+ * @return AHEDOK pokud kódování proběhlo v pořádku, jinak AHEDFail
+ */
+static inline __attribute__((always_inline)) int encodeSymbols(
+	struct coder* c, tAHED *ahed, FILE *inputFile, FILE *outputFile,
+	int width) {
+	int64_t ch;
+	int64_t root = AHEDzeroNode;
+	/** poslední zakódovaný vzorek a počet jeho odložených opakování */
+	int64_t last = AHEDnullNode;
+	int64_t run = 0;
+	int runs = c->runSymbol != AHEDnullNode;
+	
+	/** dokud se daří načítat vstup */
+	while (getSymbol(c, inputFile, width, &ch, &ahed->uncodedSize) == AHEDOK) {
+		/** limit převodu */
+		if (ahed->uncodedSize >= c->budget.next &&
+				budgetCheck(c, ahed->uncodedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
+		/** vzorek se nevejde do šířky */
+		if (ch == AHEDnullNode) {
+			return(AHEDFail);
+		}
+		/** opakování posledního vzorku se odloží do běhu, nejdelší běh se
+		 * zakóduje a počítá se další */
+		if (runs && ch == last) {
+			if (run == AHEDmaxRun && encodeRun(c, outputFile, &root, last,
+					&run, &ahed->codedSize) == AHEDFail) {
+				return(AHEDFail);
+			}
+			run++;
+			continue;
+		}
+		if (run > 0 && encodeRun(c, outputFile, &root, last, &run,
+				&ahed->codedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
+		if (encodeSymbol(c, outputFile, &root, ch, &ahed->codedSize)
+				== AHEDFail) {
+			return(AHEDFail);
+		}
+		/** za symbolem zbytku následuje lichý byte */
+		if (ch == c->tailSymbol) {
+			struct path path = {c->tail, 8};
+			if (wos(c, outputFile, &path, &ahed->codedSize) == AHEDFail) {
+				return(AHEDFail);
+			}
+		}
+		last = ch;
+	}
+	/** zakóduj zbývající běh */
+	if (encodeRun(c, outputFile, &root, last, &run, &ahed->codedSize)
+			== AHEDFail) {
+		return(AHEDFail);
+	}
+	/** vyprázdni případné zbývající znaky, zapiš konec souboru */
+	return(flushWos(c, outputFile, &ahed->codedSize, c->nodes, root));
+}
+
+/**
+ * Kódování vstupu do výstupu
+ * @param c stav kódování
+ * @param ahed záznam o kódování
+ * @param inputFile vstupní soubor
+ * @param outputFile výstupní soubor
+ * @return AHEDOK pokud kódování proběhlo v pořádku, jinak AHEDFail
+ */
+static int encode(struct coder* c, tAHED *ahed, FILE *inputFile,
+	FILE *outputFile) {
+	/** byte a 16bitové vzorky mají vlastní specializovanou smyčku */
+	switch (c->width) {
+		case AHEDbitness:
+			return(encodeSymbols(c, ahed, inputFile, outputFile, AHEDbitness));
+		case AHEDmaxWidth:
+			return(encodeSymbols(c, ahed, inputFile, outputFile, AHEDmaxWidth));
+		default:
+			return(encodeSymbols(c, ahed, inputFile, outputFile, c->width));
+	}
+}
+
+/**
+ * Zápis hlavičky formátu AHEDFormatFramed, příznaky a parametry rozšíření
+ * se odvodí z hodnot parametrů
+ * @param c stav kódování
+ * @param file výstupní soubor
+ * @param ahed záznam o kódování
+ * @param h parametry proudu
+ * @return AHEDOK pokud se hlavičku podařilo zapsat, jinak AHEDFail
+ */
+static int writeHeader(struct coder* c, FILE* file, tAHED* ahed,
+	struct header* h) {
+	unsigned char header[AHEDheaderSize + 5];
+	size_t length = AHEDheaderSize;
+	
+	memcpy(header, AHEDmagic, 3);
+	header[3] = AHEDversion;
+	header[4] = (h->blockSize > 0 ? AHEDflagBlocks : 0) |
+		(h->runs ? AHEDflagRuns : 0) |
+		(h->width != AHEDbitness ? AHEDflagWidth : 0) |
+		(h->check ? AHEDflagCheck : 0);
+	if (h->blockSize > 0) {
+		putWord(header + length, h->blockSize);
+		length += 4;
+	}
+	if (h->width != AHEDbitness) {
+		header[length++] = h->width;
+	}
+	ahed->codedSize += length;
+	return(putBytes(c, file, header, length));
+}
+
+/**
+ * Načtení hlavičky formátu AHEDFormatFramed
+ * @param c stav dekódování
+ * @param file vstupní soubor
+ * @param ahed záznam o dekódování
+ * @param h načtené parametry proudu
+ * @return AHEDOK pokud je hlavička platná, jinak AHEDFail
+ */
+static int readHeader(struct coder* c, FILE* file, tAHED* ahed,
+	struct header* h) {
+	unsigned char header[AHEDheaderSize + 5];
+	int flags;
+	
+	if (getBytes(c, file, header, AHEDheaderSize) != AHEDheaderSize ||
+			memcmp(header, AHEDmagic, 3) != 0 || header[3] != AHEDversion ||
+			(header[4] & ~(AHEDflagBlocks | AHEDflagRuns | AHEDflagWidth |
+			AHEDflagCheck)) != 0) {
+		return(AHEDFail);
+	}
+	flags = header[4];
+	h->runs = (flags & AHEDflagRuns) != 0;
+	h->check = (flags & AHEDflagCheck) != 0;
+	ahed->codedSize += AHEDheaderSize;
+	if (flags & AHEDflagBlocks) {
+		if (getBytes(c, file, header, 4) != 4) {
+			return(AHEDFail);
+		}
+		ahed->codedSize += 4;
+		h->blockSize = getWord(header);
+		if (h->blockSize < 1 || h->blockSize > AHEDmaxBlock) {
+			return(AHEDFail);
+		}
+	}
+	if (flags & AHEDflagWidth) {
+		if (getBytes(c, file, header, 1) != 1) {
+			return(AHEDFail);
+		}
+		ahed->codedSize++;
+		h->width = header[0];
+		if (h->width <= AHEDbitness || h->width > AHEDmaxWidth) {
+			return(AHEDFail);
+		}
+	}
+	return(AHEDOK);
+}
+
 /* Nazev:
  *   AHEDEncoding
  * Cinnost:
@@ -265,111 +2398,164 @@ void updateTree(struct node nodes[], int64_t u, int64_t root) {
  *    -1 - pri kodovani nastala chyba
  */
 int AHEDEncoding(tAHED *ahed, FILE *inputFile, FILE *outputFile) {
-	int64_t ch = 0;
-	int64_t root = AHEDzeroNode;
-	struct path path;
-	
-	/** pole pro uzly stromu */
-	struct node nodes[AHEDlength];
-	/** inicializace uzlů */
-	initNodes(nodes);
-	/** nastav nejvyšší skóre zatím jedinému uzlu zero */
-	nodes[AHEDzeroNode].order = AHEDzeroNode;
+	return(AHEDEncodingEx(ahed, inputFile, outputFile, NULL));
+}
+
+/* Nazev:
+ *   AHEDEncodingEx
+ * Cinnost:
+ *   Funkce koduje vstupni soubor do vystupniho souboru podle zadanych voleb
+ *   a porizuje zaznam o kodovani.
+ * Parametry:
+ *   ahed - zaznam o kodovani
+ *   inputFile - vstupni soubor (nekodovany)
+ *   outputFile - vystupni soubor (kodovany)
+ *   options - volby kodovani, NULL znamena vychozi volby
+ * Navratova hodnota:
+ *    0 - kodovani probehlo v poradku
+ *    -1 - pri kodovani nastala chyba
+ *    -2 - kodovani prekrocilo limit doby nebo velikosti, prip. bylo zruseno
+ */
+int AHEDEncodingEx(tAHED *ahed, FILE *inputFile, FILE *outputFile,
+	const tAHEDOptions *options) {
+	struct coder c;
+	struct stage reader;
+	struct stage writer;
+	struct blocks blocks;
+	struct check check;
+	struct header h = {0, 0, AHEDbitness, 0};
+	int64_t uncoded = ahed->uncodedSize;
+	int pipelined;
+	int retval = AHEDOK;
 	
-	/** dokud se daří načítat vstup */
-	while ((fread(&ch, sizeof(char), 1, inputFile)) != 0) {
-		/** zvětši velikost nekódovaného vstupu */
-		ahed->uncodedSize++;
-		/** pokud jsi znak načetl poprvé */
-		if (nodes[ch].count == 0) {
-			int64_t i;
-			/** získej cestu od uzlu zero ke kořeni */
-			getNodePath(nodes, AHEDzeroNode, root, &path);
-			
-			/** zapiš cestu k uzlu zero a zapiš znak */ 
-			if (wos(outputFile, &path, &ahed->codedSize) == AHEDFail ||
-				wch(outputFile, ch, &ahed->codedSize) == AHEDFail) {
-				return(AHEDFail);
-			}
-			
-			/** proveď přidání nového uzlu */
-			i = addNewNode(nodes, AHEDzeroNode, ch);
-			/** a pokud byl kořen shodný s uzlem zero, změň kořen */
-			if (root == AHEDzeroNode) {
-				root = i;
-			}
-			/** aktualizuj strom */
-			updateTree(nodes, i, root);
-		} else {
-			/** jinak jsi znak již viděl, získej cestu od znaku ke kořeni  */
-			getNodePath(nodes, ch, root, &path);
-			/** a zapiš cestu */
-			if (wos(outputFile, &path, &ahed->codedSize) == AHEDFail) {
-				return(AHEDFail);
-			}
-			/** aktualizuj strom */
-			updateTree(nodes, ch, root);
+	memset(&c, 0, sizeof(c));
+	c.context = options != NULL ? options->context : NULL;
+	if (options != NULL) {
+		h.blockSize = options->blockSize;
+		h.runs = options->runs != 0;
+		h.width = options->width != 0 ? options->width : AHEDbitness;
+		h.check = options->check != 0;
+	}
+	/** výstup transformace jsou libovolné byte, dvojice z nich se vejde
+	 * jen do vzorku šířky 16 bitů */
+	if (h.blockSize < 0 || h.blockSize > AHEDmaxBlock ||
+			h.width < AHEDbitness || h.width > AHEDmaxWidth ||
+			(h.blockSize > 0 && h.width != AHEDbitness &&
+			h.width != AHEDmaxWidth)) {
+		return(AHEDFail);
+	}
+	if (initTree(&c, h.width, h.runs) == AHEDFail) {
+		freeTree(&c);
+		return(AHEDFail);
+	}
+	budgetInit(&c, options, ahed->uncodedSize);
+	if (h.blockSize > 0) {
+		if (blocksInit(&blocks, h.blockSize, options->threads, c.context) ==
+				AHEDFail) {
+			blocksFree(&blocks, c.context);
+			freeTree(&c);
+			return(AHEDFail);
 		}
+		c.blocks = &blocks;
 	}
-	/** vyprázdni případné zbývající znaky, zapiš konec souboru */
-	return(flushWos(outputFile, &ahed->codedSize, nodes, root));
+	pipelined = options != NULL && options->pipeline &&
+		pipelineStart(&c, &reader, &writer, inputFile, outputFile) == AHEDOK;
+	/** rozšíření formátu vyžadují hlavičku */
+	if (h.blockSize > 0 || h.runs || h.width != AHEDbitness || h.check ||
+			(options != NULL && options->format == AHEDFormatFramed)) {
+		retval = writeHeader(&c, outputFile, ahed, &h);
+	}
+	if (retval == AHEDOK && h.check) {
+		retval = checkInit(&check, 0);
+		c.check = &check;
+	}
+	if (retval == AHEDOK) {
+		retval = encode(&c, ahed, inputFile, outputFile);
+	}
+	/** kodér počítá transformovaná data, záznam uvádí původní */
+	if (c.blocks != NULL) {
+		if (blocks.error) {
+			retval = AHEDFail;
+		}
+		ahed->uncodedSize = uncoded + blocks.raw;
+		blocksFree(&blocks, c.context);
+	}
+	/** konec proudu nese délku původních dat */
+	if (c.check != NULL) {
+		if (retval == AHEDOK) {
+			retval = checkFinish(&c, outputFile, ahed->uncodedSize - uncoded);
+		}
+		ahed->codedSize += check.overhead;
+		checkFree(&check);
+	}
+	freeTree(&c);
+	if (pipelined) {
+		retval = pipelineFinish(&c, &reader, &writer, retval);
+	}
+	/** chyba způsobená vyčerpáním limitu se odlišuje */
+	if (retval == AHEDFail && c.budget.expired) {
+		retval = AHEDAbort;
+	}
+	return(retval);
 }
 
 /**
  * Načtení jednoho bitu ze vstupního souboru
+ * @param c stav dekódování (rozpracovaný načtený byte)
  * @param inputFile	soubor z kterého probíhá čtení
  * @param ch hodnota načítaného bitu
  * @param codedSize velikost zakódovaného vstupu
  * @return AHEDOK pokud se podařilo načíst byte ze vstupního souboru, jinak
  * 		AHEDfail
  */
-int readBit(FILE* inputFile, unsigned char* ch, int64_t* codedSize) {
-	/** proměnné sdílené mezi jednotlivými voláními funkce */
-	static char readed = 0;
-	static char bits   = 0;
-	
+static int readBit(struct coder* c, FILE* inputFile, unsigned char* ch,
+	int64_t* codedSize) {
 	/** výchozí návratová hodnota */
-	if (bits == 0) {
+	if (c->bits == 0) {
 		/** načti byte */
-		if (fread(&readed, sizeof(char), 1, inputFile) == 0) {
+		unsigned char byte;
+		if (getCoded(c, inputFile, &byte) == AHEDFail) {
 			/** při neúspěšném čtení vrať chybu */
 			return(AHEDFail);
 		}
+		c->readed = byte;
 		/** zvětši velikost kódovaného vstupu */
 		(*codedSize)++;
-		bits = 8;
+		c->bits = 8;
 	}
 
 	/** vypočítej hodnotu daného bitu */
-	*ch = readed & 128;
+	*ch = c->readed & 128;
 	
 	/** aktualizuj bity */	
-	readed = readed << 1;
-	bits--;
+	c->readed = c->readed << 1;
+	c->bits--;
 
 	return(AHEDOK);
 }
 
 /**
- * Načtení znaku
+ * Načtení nového symbolu
+ * @param c stav dekódování (počet bitů symbolu)
  * @param inputFile vstupní soubor
- * @param cc hodnota načteného znaku
+ * @param cc hodnota načteného symbolu
  * @param codedSize velikost zakódovaného vstupu
- * @return AHEDOK pokud se načtení znaku podařilo, jinak AHEDFail
+ * @return AHEDOK pokud se načtení symbolu podařilo, jinak AHEDFail
  */
-char readChar(FILE* inputFile, unsigned char* cc, int64_t* codedSize) {
-	/** načítaný znak */
-	char readed = 0;
+static int readChar(struct coder* c, FILE* inputFile, int64_t* cc,
+	int64_t* codedSize) {
+	/** načítaný symbol */
+	int64_t readed = 0;
 	/** aktuálně načtený bit */
 	unsigned char ch;
-	/** proveď osmkrát načtení bitu */
-	for (int i = 0; i < AHEDbitness; i++) {
-		/** aktualizuj načítaný znak */
+	/** proveď načtení všech bitů symbolu */
+	for (int i = 0; i < c->symbolBits; i++) {
+		/** aktualizuj načítaný symbol */
 		readed = readed << 1;
-		if (readBit(inputFile, &ch, codedSize) == AHEDFail) {
+		if (readBit(c, inputFile, &ch, codedSize) == AHEDFail) {
 			return(AHEDFail);
 		}
-		/** aktualizuj načítaný znak */
+		/** aktualizuj načítaný symbol */
 		if (ch) {
 			readed |= 1;
 		}
@@ -379,48 +2565,109 @@ char readChar(FILE* inputFile, unsigned char* cc, int64_t* codedSize) {
 	return(AHEDOK);
 } 
 
-/* Nazev:
- *   AHEDDecoding
- * Cinnost:
- *   Funkce dekoduje vstupni soubor do vystupniho souboru a porizuje zaznam o
- * 	 dekodovani.
- * Parametry:
- *   ahed - zaznam o dekodovani
- *   inputFile - vstupni soubor (kodovany)
- *   outputFile - vystupni soubor (nekodovany)
- * Navratova hodnota:
- *    0 - dekodovani probehlo v poradku
- *    -1 - pri dekodovani nastala chyba
+/**
+ * Zápis dekódovaného symbolu; vzorek se zapíše, symbol zbytku načte
+ * a zapíše lichý byte, symbol běhu načte nižší bity délky a zopakuje
+ * poslední vzorek
+ * @param c stav dekódování
+ * @param ahed záznam o dekódování
+ * @param inputFile vstupní soubor
+ * @param outputFile výstupní soubor
+ * @param width šířka vzorku, konstanta u specializovaných smyček
+ * @param ch dekódovaný symbol
+ * @param last poslední zapsaný vzorek
+ * @return AHEDOK pokud se symbol podařilo zapsat, jinak AHEDFail
  */
-int AHEDDecoding(tAHED *ahed, FILE *inputFile, FILE *outputFile) {
-	int64_t ch;
+static inline int decodeSymbol(struct coder* c, tAHED *ahed, FILE *inputFile,
+	FILE *outputFile, int width, int64_t ch, int64_t* last) {
+	int bytes = width == AHEDbitness ? 1 : 2;
+	int64_t v = 1;
+	unsigned char bit;
+	
+	if ((ch >> width) == 0) {
+		*last = ch;
+		ahed->uncodedSize += bytes;
+		return(putSymbol(c, outputFile, width, ch));
+	}
+	if (ch == c->tailSymbol) {
+		for (int i = 0; i < 8; i++) {
+			if (readBit(c, inputFile, &bit, &ahed->codedSize) == AHEDFail) {
+				return(AHEDFail);
+			}
+			v = (v << 1) | (bit != 0);
+		}
+		ahed->uncodedSize++;
+		return(putOutput(c, outputFile, v & 0xff));
+	}
+	/** běh smí následovat jen za vzorkem */
+	if (*last == AHEDnullNode) {
+		return(AHEDFail);
+	}
+	for (int k = ch - c->runSymbol; k > 0; k--) {
+		if (readBit(c, inputFile, &bit, &ahed->codedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
+		v = (v << 1) | (bit != 0);
+	}
+	v += AHEDminRun - 1;
+	ahed->uncodedSize += v*bytes;
+	/** běh přes limit velikosti se vůbec nezapíše */
+	if (ahed->uncodedSize >= c->budget.next &&
+			budgetCheck(c, ahed->uncodedSize) == AHEDFail) {
+		return(AHEDFail);
+	}
+	return(putRepeat(c, outputFile, width, *last, v));
+}
+
+/**
+ * Dekódovací smyčka pro vzorky dané šířky; vkládá se do decode zvlášť pro
+ * každou běžnou šířku
+ * @param c stav dekódování
+ * @param ahed záznam o dekódování
+ * @param inputFile vstupní soubor
+ * @param outputFile výstupní soubor
+ * @param width šířka vzorku
+ * @return AHEDOK pokud dekódování proběhlo v pořádku, jinak AHEDFail
+ */
+static inline __attribute__((always_inline)) int decodeSymbols(
+	struct coder* c, tAHED *ahed, FILE *inputFile, FILE *outputFile,
+	int width) {
+	int64_t ch = 0;
 	unsigned char bit;
 	int64_t root;
 	int64_t actual;
 	int64_t anode;
-	struct node nodes[AHEDlength];
+	int64_t last = AHEDnullNode;
 	
-	initNodes(nodes);
-	nodes[AHEDzeroNode].order = AHEDzeroNode;
-	
-	/** načtení a zpracování prvního znaku */
-	if (readChar(inputFile, &bit, &ahed->codedSize) == AHEDFail) {
+	/** načtení a zpracování prvního symbolu */
+	if (readChar(c, inputFile, &ch, &ahed->codedSize) == AHEDFail ||
+			ch >= c->symbols) {
 		return(AHEDFail);
 	}
 	/** nastavení kořene, aktuálního prvku, aktualizace stromu, zápis výsledku */
-	actual = root = addNewNode(nodes, AHEDzeroNode, bit);
-	updateTree(nodes, actual, root);
-	fwrite(&bit, sizeof(char), 1, outputFile);
-	ahed->uncodedSize++;
+	if ((actual = root = addNewNode(c, AHEDzeroNode, ch)) == AHEDFail) {
+		return(AHEDFail);
+	}
+	updateTree(c, actual, root);
+	if (decodeSymbol(c, ahed, inputFile, outputFile, width, ch, &last) ==
+			AHEDFail) {
+		return(AHEDFail);
+	}
 	
 	/** nekonečněkrát opakuj (ukončení returnem v cyklu) */
 	while (1) {
+		struct node* nodes = c->nodes;
+		/** limit převodu */
+		if (ahed->uncodedSize >= c->budget.next &&
+				budgetCheck(c, ahed->uncodedSize) == AHEDFail) {
+			return(AHEDFail);
+		}
 		/** nastav aktuální prvek na kořen */
 		actual = root;
 		/** dokud klesáš ve stromu */
 		while (actual != AHEDzeroNode && nodes[actual].left != AHEDnullNode) {
 			/** načti bit */
-			if (readBit(inputFile, &bit, &ahed->codedSize) == AHEDFail) {
+			if (readBit(c, inputFile, &bit, &ahed->codedSize) == AHEDFail) {
 				/** 
 				 * chyba při čtení jednoho bitu, to se nemělo stát -> chybný
 				 * konec
@@ -433,32 +2680,203 @@ int AHEDDecoding(tAHED *ahed, FILE *inputFile, FILE *outputFile) {
 			} else {
 				actual = nodes[actual].left;
 			}
-			/** kterému znaku odpovídá aktuální pozice */
-			ch = actual;
 		}
 		
 		/** pokud jsme se dostali k uzlu zero */
 		if (actual == AHEDzeroNode) {
-			/** proveď načtení znaku */
-			if (readChar(inputFile, &bit, &ahed->codedSize) == AHEDFail) {
+			/** proveď načtení symbolu */
+			if (readChar(c, inputFile, &ch, &ahed->codedSize) == AHEDFail) {
 				/** 
-				 * při čtení znaku jsme se dostali na konec souboru -> 
+				 * při čtení symbolu jsme se dostali na konec souboru -> 
 				 * takto máme zaveden konec kódovaného souboru, předpokládáme
 				 * správné zpracování
 				 */
 				return(AHEDOK);
 			}
+			/** nový symbol musí patřit do abecedy a nesmí být ve stromu */
+			if (ch >= c->symbols || c->leaves[ch] != 0) {
+				return(AHEDFail);
+			}
 			/** přidej uzel */
-			anode = addNewNode(nodes, AHEDzeroNode, bit);
-			ch = bit;
+			if ((anode = addNewNode(c, AHEDzeroNode, ch)) == AHEDFail) {
+				return(AHEDFail);
+			}
 		} else {
-			anode = ch;
+			/** kterému symbolu odpovídá dosažený list */
+			ch = nodes[actual].symbol;
+			anode = actual;
 		}
 		/** aktualizuj strom */
-		updateTree(nodes, anode, root);
+		updateTree(c, anode, root);
 		
 		/** zapiš výsledek */
-		fwrite(&ch, sizeof(char), 1, outputFile);
-		ahed->uncodedSize++;
+		if (decodeSymbol(c, ahed, inputFile, outputFile, width, ch, &last) ==
+				AHEDFail) {
+			return(AHEDFail);
+		}
+	}
+}
+
+/**
+ * Dekódování vstupu do výstupu
+ * @param c stav dekódování
+ * @param ahed záznam o dekódování
+ * @param inputFile vstupní soubor
+ * @param outputFile výstupní soubor
+ * @return AHEDOK pokud dekódování proběhlo v pořádku, jinak AHEDFail
+ */
+static int decode(struct coder* c, tAHED *ahed, FILE *inputFile,
+	FILE *outputFile) {
+	/** byte a 16bitové vzorky mají vlastní specializovanou smyčku */
+	switch (c->width) {
+		case AHEDbitness:
+			return(decodeSymbols(c, ahed, inputFile, outputFile, AHEDbitness));
+		case AHEDmaxWidth:
+			return(decodeSymbols(c, ahed, inputFile, outputFile, AHEDmaxWidth));
+		default:
+			return(decodeSymbols(c, ahed, inputFile, outputFile, c->width));
+	}
+}
+
+/* Nazev:
+ *   AHEDDecoding
+ * Cinnost:
+ *   Funkce dekoduje vstupni soubor do vystupniho souboru a porizuje zaznam o
+ * 	 dekodovani.
+ * Parametry:
+ *   ahed - zaznam o dekodovani
+ *   inputFile - vstupni soubor (kodovany)
+ *   outputFile - vystupni soubor (nekodovany)
+ * Navratova hodnota:
+ *    0 - dekodovani probehlo v poradku
+ *    -1 - pri dekodovani nastala chyba
+ */
+int AHEDDecoding(tAHED *ahed, FILE *inputFile, FILE *outputFile) {
+	return(AHEDDecodingEx(ahed, inputFile, outputFile, NULL));
+}
+
+/* Nazev:
+ *   AHEDDecodingEx
+ * Cinnost:
+ *   Funkce dekoduje vstupni soubor do vystupniho souboru podle zadanych voleb
+ *   a porizuje zaznam o dekodovani.
+ * Parametry:
+ *   ahed - zaznam o dekodovani
+ *   inputFile - vstupni soubor (kodovany)
+ *   outputFile - vystupni soubor (nekodovany)
+ *   options - volby dekodovani, NULL znamena vychozi volby
+ * Navratova hodnota:
+ *    0 - dekodovani probehlo v poradku
+ *    -1 - pri dekodovani nastala chyba
+ *    -2 - dekodovani prekrocilo limit doby nebo velikosti, prip. bylo zruseno
+ */
+int AHEDDecodingEx(tAHED *ahed, FILE *inputFile, FILE *outputFile,
+	const tAHEDOptions *options) {
+	struct coder c;
+	struct stage reader;
+	struct stage writer;
+	struct blocks blocks;
+	struct check check;
+	int64_t uncoded = ahed->uncodedSize;
+	int64_t coded = ahed->codedSize;
+	struct header h = {0, 0, AHEDbitness, 0};
+	int framed = options != NULL && options->format == AHEDFormatFramed;
+	int pipelined;
+	int retval = AHEDOK;
+	
+	memset(&c, 0, sizeof(c));
+	c.context = options != NULL ? options->context : NULL;
+	pipelined = options != NULL && options->pipeline &&
+		pipelineStart(&c, &reader, &writer, inputFile, outputFile) == AHEDOK;
+	if (framed) {
+		retval = readHeader(&c, inputFile, ahed, &h);
+	}
+	if (retval == AHEDOK) {
+		retval = initTree(&c, h.width, h.runs);
+	}
+	budgetInit(&c, options, ahed->uncodedSize);
+	if (retval == AHEDOK && h.blockSize > 0) {
+		retval = blocksInit(&blocks, h.blockSize, options->threads, c.context);
+		c.blocks = &blocks;
+	}
+	/** pozice bloků s kontrolním součtem se počítají od začátku proudu */
+	if (retval == AHEDOK && h.check) {
+		retval = checkInit(&check, ahed->codedSize - coded);
+		c.check = &check;
+	}
+	if (retval == AHEDOK) {
+		coded = ahed->codedSize;
+		retval = decode(&c, ahed, inputFile, outputFile);
+		/** proud s hlavičkou smí být prázdný */
+		if (framed && retval == AHEDFail && ahed->codedSize == coded) {
+			retval = AHEDOK;
+		}
+	}
+	/** poškozený blok ukončí dekódování jako konec proudu */
+	if (c.check != NULL && check.corrupt) {
+		retval = AHEDFail;
+	}
+	/** nedokončený blok znamená zkrácený proud, dekodér počítá
+	 * transformovaná data, záznam uvádí původní */
+	if (c.blocks != NULL) {
+		if (retval == AHEDOK) {
+			retval = blocks.frameLength != 0 ? AHEDFail : flushBlocks(&c, outputFile);
+		}
+		ahed->uncodedSize = uncoded + blocks.raw;
+		blocksFree(&blocks, c.context);
+	}
+	/** dekódovaná data musí mít délku uloženou na konci proudu, jinak je
+	 * poškozený jeho konec */
+	if (c.check != NULL) {
+		if (retval == AHEDOK && (!check.end ||
+				check.original != ahed->uncodedSize - uncoded)) {
+			check.corrupt = 1;
+			retval = AHEDFail;
+		}
+		if (check.corrupt) {
+			ahed->corruptOffset = check.offset;
+		}
+		ahed->codedSize += check.overhead;
+		checkFree(&check);
+	}
+	freeTree(&c);
+	if (pipelined) {
+		retval = pipelineFinish(&c, &reader, &writer, retval);
+	}
+	/** chyba způsobená vyčerpáním limitu se odlišuje */
+	if (retval == AHEDFail && c.budget.expired) {
+		retval = AHEDAbort;
+	}
+	return(retval);
+}
+
+/* Nazev:
+ *   AHEDContextCreate
+ * Cinnost:
+ *   Funkce vytvori prazdny stav pro opakovane (de)kodovani; prevody s nim
+ *   si ponechavaji alokovany strom a bloky transformace.
+ * Navratova hodnota:
+ *   stav pro tAHEDOptions.context, NULL pri nedostatku pameti
+ */
+tAHEDContext *AHEDContextCreate(void) {
+	return(calloc(1, sizeof(tAHEDContext)));
+}
+
+/* Nazev:
+ *   AHEDContextFree
+ * Cinnost:
+ *   Funkce uvolni stav pro opakovane (de)kodovani i pamet, kterou si
+ *   ponechal.
+ * Parametry:
+ *   context - stav, NULL se ignoruje
+ */
+void AHEDContextFree(tAHEDContext *context) {
+	if (context == NULL) {
+		return;
 	}
+	free(context->nodes);
+	free(context->ranks);
+	free(context->leaves);
+	blocksFree(&context->blocks, NULL);
+	free(context);
 }
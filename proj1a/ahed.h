@@ -13,25 +13,77 @@
 
 #define AHEDOK 0
 #define AHEDFail -1
+#define AHEDAbort -2
 
 #define AHEDCompress 0
 #define AHEDDecompress 1
 #define AHEDUndefined -1
 
 
-#define AHEDbitness 8
-#define AHEDzeroNode (1 << AHEDbitness)*2
-#define AHEDlength AHEDzeroNode + 1
-#define AHEDnullNode -1
-
 /* Datovy typ zaznamu o (de)kodovani */
 typedef struct{
 	/* velikost nekodovaneho retezce */
 	int64_t uncodedSize;
 	/* velikost kodovaneho retezce */
 	int64_t codedSize;
+	/* pozice poskozeneho bloku od zacatku kodovaneho proudu (dekodovani
+	 * s kontrolnimi soucty), 0 = zadny */
+	int64_t corruptOffset;
 } tAHED;
 
+/* Formaty kodovaneho proudu */
+#define AHEDFormatRaw 0		/* puvodni proud bez hlavicky */
+#define AHEDFormatFramed 1	/* proud s hlavickou popisujici rozsireni */
+
+/* Datovy typ stavu, ktery si mezi (de)kodovanimi ponechava alokovany strom
+ * a bloky transformace */
+typedef struct AHEDContext tAHEDContext;
+
+/* Datovy typ s volbami (de)kodovani */
+typedef struct{
+	/* cteni vstupu a zapis vystupu ve vlastnich vlaknech, s (de)kodovanim
+	 * je spojuji kruhove buffery velkych bloku */
+	int pipeline;
+	/* format proudu (AHEDFormatRaw, ...); kodovani s rozsirenim zapisuje
+	 * vzdy AHEDFormatFramed, dekodovani cte hlavicku jen pri
+	 * AHEDFormatFramed a rozsireni urcuje hlavicka */
+	int format;
+	/* velikost bloku transformace pred kodovanim v byte (BWT, move-to-front
+	 * a kodovani behu nul), nejvyse 64 MiB, 0 = bez transformace */
+	int blockSize;
+	/* pocet bloku (zpetne) transformovanych soubezne, 0 = podle poctu
+	 * procesoru */
+	int threads;
+	/* kodovani behu opakovaneho vzorku: abeceda obsahuje i symboly behu,
+	 * beh delsi nez 3 vzorky se zakoduje jedinym symbolem a nizsimi bity
+	 * sve delky (vyzaduje AHEDFormatFramed) */
+	int runs;
+	/* sirka vzorku v bitech: 0 nebo 8 = byte, 9 az 16 = vzorky ulozene
+	 * ve dvou byte little-endian, mensi nez 2^sirka; lichy posledni byte
+	 * se zakoduje zvlast (vyzaduje AHEDFormatFramed); s transformaci
+	 * po blocich jen 8 nebo 16 */
+	int width;
+	/* kodovany proud rozdeleny na bloky 64 KiB s kontrolnim souctem
+	 * CRC32C a konec proudu s delkou puvodnich dat; dekodovani kazdy blok
+	 * pred dekodovanim overi (vyzaduje AHEDFormatFramed) */
+	int check;
+	/* nejdelsi doba (de)kodovani v nanosekundach, 0 = bez limitu;
+	 * kontroluje se po kazdych 64 KiB nekodovanych dat a prubezne behem
+	 * transformace bloku */
+	int64_t timeLimit;
+	/* nejvyssi velikost nekodovanych dat (vstup kodovani, vystup
+	 * dekodovani) v byte, 0 = bez limitu */
+	int64_t byteLimit;
+	/* priznak zruseni (de)kodovani, ktery muze nastavit jine vlakno
+	 * (nenulova hodnota prevod ukonci), NULL = prevod nelze zrusit */
+	const int *cancel;
+	/* stav ponechany mezi prevody (AHEDContextCreate): prevod z nej
+	 * prevezme strom a bloky transformace predchoziho prevodu a na konci
+	 * mu je vrati; stav smi pouzivat jen jeden prevod najednou, NULL =
+	 * prevod alokuje vlastni */
+	tAHEDContext *context;
+} tAHEDOptions;
+
 
 /* Nazev:
  *   AHEDEncoding
@@ -62,4 +114,64 @@ int AHEDEncoding(tAHED *ahed, FILE *inputFile, FILE *outputFile);
  */
 int AHEDDecoding(tAHED *ahed, FILE *inputFile, FILE *outputFile);
 
+
+/* Nazev:
+ *   AHEDEncodingEx
+ * Cinnost:
+ *   Funkce koduje vstupni soubor do vystupniho souboru podle zadanych voleb
+ *   a porizuje zaznam o kodovani.
+ * Parametry:
+ *   ahed - zaznam o kodovani
+ *   inputFile - vstupni soubor (nekodovany)
+ *   outputFile - vystupni soubor (kodovany)
+ *   options - volby kodovani, NULL znamena vychozi volby
+ * Navratova hodnota: 
+ *    0 - kodovani probehlo v poradku
+ *    -1 - pri kodovani nastala chyba
+ *    -2 - kodovani prekrocilo limit doby nebo velikosti, prip. bylo zruseno
+ */
+int AHEDEncodingEx(tAHED *ahed, FILE *inputFile, FILE *outputFile,
+	const tAHEDOptions *options);
+
+
+/* Nazev:
+ *   AHEDDecodingEx
+ * Cinnost:
+ *   Funkce dekoduje vstupni soubor do vystupniho souboru podle zadanych voleb
+ *   a porizuje zaznam o dekodovani.
+ * Parametry:
+ *   ahed - zaznam o dekodovani
+ *   inputFile - vstupni soubor (kodovany)
+ *   outputFile - vystupni soubor (nekodovany)
+ *   options - volby dekodovani, NULL znamena vychozi volby
+ * Navratova hodnota: 
+ *    0 - dekodovani probehlo v poradku
+ *    -1 - pri dekodovani nastala chyba
+ *    -2 - dekodovani prekrocilo limit doby nebo velikosti, prip. bylo zruseno
+ */
+int AHEDDecodingEx(tAHED *ahed, FILE *inputFile, FILE *outputFile,
+	const tAHEDOptions *options);
+
+
+/* Nazev:
+ *   AHEDContextCreate
+ * Cinnost:
+ *   Funkce vytvori prazdny stav pro opakovane (de)kodovani; prevody s nim
+ *   si ponechavaji alokovany strom a bloky transformace.
+ * Navratova hodnota:
+ *   stav pro tAHEDOptions.context, NULL pri nedostatku pameti
+ */
+tAHEDContext *AHEDContextCreate(void);
+
+
+/* Nazev:
+ *   AHEDContextFree
+ * Cinnost:
+ *   Funkce uvolni stav pro opakovane (de)kodovani i pamet, kterou si
+ *   ponechal.
+ * Parametry:
+ *   context - stav, NULL se ignoruje
+ */
+void AHEDContextFree(tAHEDContext *context);
+
 #endif
@@ -5,14 +5,38 @@
  * Komentar:
  */ 
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h> /** C99 getopt */
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "ahed.h"
 
 /** Informace o tom zda se poradilo zpracovat parametry prikazove radky, pouzito
- * jako navratova hodnota */
+ * jako navratova hodnota; COMMAND_LINE_HELP je vyzadana napoveda */
 #define COMMAND_LINE_OK 1
 #define COMMAND_LINE_ERR 0
+#define COMMAND_LINE_HELP 2
+
+/** dlouhé volby bez jednopísmenné varianty */
+#define OPTION_IN_DIR 256
+#define OPTION_OUT_DIR 257
+#define OPTION_SERVE 258
+#define OPTION_CONNECT 259
+#define OPTION_REPEAT 260
+#define OPTION_SEND_PATH 261
+
+/** přípona komprimovaných souborů dávky */
+#define AHED_SUFFIX ".ahed"
+
+/** značka hlavičky požadavku a odpovědi serveru ("AHDR") */
+#define SERVE_MAGIC 0x41484452
+/** příznak požadavku: data jsou cesta k souboru na straně serveru */
+#define SERVE_PATH 1
 
 /** jmeno pouzite ve vystupu do logovaciho souboru */
 const char* username = "xbarto42";
@@ -28,6 +52,42 @@ struct configuration {
 	char* log;			/** jméno pro uložení informací o de/kompresi*/
 	FILE* lfile;
 	char direction;		/** de/komprese */
+	tAHEDOptions options;	/** volby de/komprese */
+	int jobs;			/** vlákna dávkového převodu, 0 = podle počtu procesorů,
+						 * -1 = jediný soubor */
+	char* inDir;		/** adresář se vstupními soubory dávky */
+	char* outDir;		/** adresář pro výstupní soubory dávky */
+	char* serve;		/** socket, na kterém běží server (--serve) */
+	char* connect;		/** socket serveru, kterému se převod pošle */
+	int repeat;			/** kolikrát klient požadavek pošle */
+	int sendPath;		/** klient posílá místo obsahu cestu k souboru */
+};
+
+/**
+ * Hlavička požadavku na server. Za ní následuje length byte dat: obsah
+ * souboru, nebo jeho cesta (SERVE_PATH). Socket je lokální, čísla jsou
+ * v pořadí byte stroje.
+ */
+struct serveRequest {
+	u_int32_t magic;		/** SERVE_MAGIC */
+	int32_t direction;		/** AHEDCompress nebo AHEDDecompress */
+	int32_t flags;			/** SERVE_PATH */
+	int32_t format;			/** formát proudu (AHEDFormatRaw, ...) */
+	int64_t length;			/** délka dat za hlavičkou */
+	int32_t blockSize;		/** velikost bloku transformace, 0 = bez ní */
+	int32_t runs;			/** kódování běhů opakovaného vzorku */
+	int32_t width;			/** šířka vzorku v bitech, 0 = byte */
+	int32_t check;			/** kontrolní součty bloků */
+};
+
+/**
+ * Hlavička odpovědi serveru, za ní následuje length byte výstupu
+ */
+struct serveResponse {
+	u_int32_t magic;		/** SERVE_MAGIC */
+	int32_t retval;			/** návratová hodnota de/komprese */
+	tAHED result;			/** záznam o de/kompresi */
+	int64_t length;			/** délka výstupu za hlavičkou */
 };
 
 /**
@@ -56,8 +116,11 @@ void openFiles(struct configuration* config) {
 		config->ifile = stdin;
 	}
 	
-	/** otevřeme výstupní soubor */
-	if (config->output) {
+	/** otevřeme výstupní soubor, soubory dávky si otevírá převod sám,
+	 * server výstup nemá */
+	if (config->jobs >= 0 || config->serve != NULL) {
+		config->ofile = NULL;
+	} else if (config->output) {
 		openOneFile(config->output, &config->ofile, "wb");
 	} else {
 		config->ofile = stdout;
@@ -83,7 +146,7 @@ void closeFiles(struct configuration* config) {
 	config->ifile = NULL;
 	
 	/** zavřeme výstupní soubor */
-	if (config->ofile != stdout) {
+	if (config->ofile != stdout && config->ofile != NULL) {
 		fclose(config->ofile);
 	}
 	config->ofile = NULL;
@@ -109,6 +172,11 @@ void writeResults(struct configuration* config, tAHED* result) {
 		fprintf(config->lfile, "uncodedSize = %lld\n", (long long int)result->uncodedSize);
 		/** velikost zakódovaného souboru */
 		fprintf(config->lfile, "codedSize = %lld\n", (long long int)result->codedSize);
+		/** pozice poškozeného bloku */
+		if (result->corruptOffset != 0) {
+			fprintf(config->lfile, "corruptOffset = %lld\n",
+				(long long int)result->corruptOffset);
+		}
 	}
 }
 
@@ -117,19 +185,38 @@ void writeResults(struct configuration* config, tAHED* result) {
  * @param argc	počet parametrů příkazové řádky
  * @param argv	pole ukazatelů na parametry příkazové řádky
  * @param config	struktura do které se uloží konfigurační hodnoty
+ * @return COMMAND_LINE_OK, COMMAND_LINE_HELP pro -h, jinak COMMAND_LINE_ERR
  */
 int commandline(int argc, char **argv, struct configuration* config) {
 	int c;
 	extern char *optarg;
+	static const struct option longOptions[] = {
+		{"in-dir", required_argument, NULL, OPTION_IN_DIR},
+		{"out-dir", required_argument, NULL, OPTION_OUT_DIR},
+		{"serve", required_argument, NULL, OPTION_SERVE},
+		{"connect", required_argument, NULL, OPTION_CONNECT},
+		{"repeat", required_argument, NULL, OPTION_REPEAT},
+		{"send-path", no_argument, NULL, OPTION_SEND_PATH},
+		{NULL, 0, NULL, 0}
+	};
 	
 	/** výchozí směr komprese je nedefinováno */
 	config->direction = AHEDUndefined;
 	config->log = NULL;
 	config->input = NULL;
 	config->output = NULL;
+	config->jobs = -1;
+	config->inDir = NULL;
+	config->outDir = NULL;
+	config->serve = NULL;
+	config->connect = NULL;
+	config->repeat = 1;
+	config->sendPath = 0;
+	memset(&config->options, 0, sizeof(config->options));
 	
 	/** zpracování parametrů příkazové rádky */
-	while ((c = getopt(argc, argv, "i:o:l:cxh")) != -1) {
+	while ((c = getopt_long(argc, argv, "i:o:l:cxpfrkw:b:t:d:m:j:h", longOptions,
+			NULL)) != -1) {
 		switch (c) {
 			case 'i':	/** parametr specifikující vstupní soubor */
 				config->input = optarg; 
@@ -146,21 +233,743 @@ int commandline(int argc, char **argv, struct configuration* config) {
 			case 'x':	/** dekomprimuj výstupní soubor */
 				config->direction = AHEDDecompress;
 				break;
+			case 'p':	/** čtení a zápis ve vlastních vláknech */
+				config->options.pipeline = 1;
+				break;
+			case 'f':	/** proud s hlavičkou */
+				config->options.format = AHEDFormatFramed;
+				break;
+			case 'r':	/** kódování běhů opakovaného byte */
+				config->options.runs = 1;
+				config->options.format = AHEDFormatFramed;
+				break;
+			case 'k':	/** kontrolní součty bloků */
+				config->options.check = 1;
+				config->options.format = AHEDFormatFramed;
+				break;
+			case 'w':	/** šířka vzorku v bitech */
+				config->options.width = atoi(optarg);
+				if (config->options.width < 8 || config->options.width > 16) {
+					return(COMMAND_LINE_ERR);
+				}
+				config->options.format = AHEDFormatFramed;
+				break;
+			case 'b':	/** transformace po blocích velikosti v KiB */
+				config->options.blockSize = atoi(optarg) << 10;
+				if (config->options.blockSize < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				config->options.format = AHEDFormatFramed;
+				break;
+			case 't':	/** vlákna transformace bloků */
+				config->options.threads = atoi(optarg);
+				if (config->options.threads < 0) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case 'd':	/** limit doby převodu v ms */
+				config->options.timeLimit = atoll(optarg) * 1000000;
+				if (config->options.timeLimit < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case 'm':	/** limit velikosti nekódovaných dat v MiB */
+				config->options.byteLimit = atoll(optarg) << 20;
+				if (config->options.byteLimit < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case 'j':	/** dávkový převod N vlákny */
+				config->jobs = atoi(optarg);
+				if (config->jobs < 0) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_IN_DIR:	/** dávka ze souborů v adresáři */
+				config->inDir = optarg;
+				break;
+			case OPTION_OUT_DIR:	/** adresář pro výstupy dávky */
+				config->outDir = optarg;
+				break;
+			case OPTION_SERVE:	/** server na lokálním socketu */
+				config->serve = optarg;
+				break;
+			case OPTION_CONNECT:	/** de/komprese na serveru */
+				config->connect = optarg;
+				break;
+			case OPTION_REPEAT:	/** opakování požadavku klientem */
+				config->repeat = atoi(optarg);
+				if (config->repeat < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_SEND_PATH:	/** klient posílá cestu k souboru */
+				config->sendPath = 1;
+				break;
 			case 'h':	/** zobraz nápovědu */
-				return(COMMAND_LINE_ERR);
+				return(COMMAND_LINE_HELP);
 			case '?':
 				exit(-1);
 		}		
 	}
+	/** výstup transformace bloků jsou libovolné byte, dvojice z nich se
+	 * vejde jen do vzorku šířky 16 bitů */
+	if (config->options.blockSize > 0 && config->options.width > 8 &&
+			config->options.width < 16) {
+		fprintf(stderr, "ahed: -w %d cannot be combined with -b, use -w 16\n",
+				config->options.width);
+		exit(-1);
+	}
+	/** server obsluhuje klienty skupinou vláken a směr převodu určuje
+	 * každý požadavek, klient převádí jediný soubor */
+	if (config->serve != NULL) {
+		if (config->connect != NULL || config->inDir != NULL) {
+			return(COMMAND_LINE_ERR);
+		}
+		if (config->jobs < 0) {
+			config->jobs = 0;
+		}
+		return(COMMAND_LINE_OK);
+	}
+	/** formát proudu posílá klient v požadavku, vlákna převodu určuje
+	 * server */
+	if (config->connect != NULL && (config->jobs >= 0 ||
+			config->inDir != NULL || (config->sendPath && config->input == NULL) ||
+			config->options.pipeline || config->options.threads > 0)) {
+		return(COMMAND_LINE_ERR);
+	}
+	if (config->inDir != NULL && config->jobs < 0) {
+		config->jobs = 0;
+	}
 	return(COMMAND_LINE_OK);
 }
 
+/**
+ * Jeden soubor dávkového převodu
+ */
+struct batchItem {
+	char* input;			/** jméno vstupního souboru */
+	char* output;			/** jméno výstupního souboru */
+	tAHED result;			/** záznam o de/kompresi */
+	int retval;				/** návratová hodnota de/komprese */
+};
+
+/**
+ * Sdílený stav dávkového převodu
+ */
+struct batch {
+	struct configuration* config;
+	struct batchItem* items;	/** všechny soubory dávky */
+	int32_t count;
+	int32_t next;			/** další nepřevedený soubor (atomicky) */
+};
+
+/**
+ * Argument vlákna dávkového převodu
+ */
+struct batchWorker {
+	struct batch* batch;
+	tAHEDContext* context;	/** stav převodů vlákna, NULL = každý převod
+							 * alokuje vlastní */
+	pthread_t thread;
+};
+
+/**
+ * Přidání souboru do dávky. Komprimovaný soubor dostane příponu .ahed,
+ * dekomprimovaný ji ztratí (jinak dostane příponu .out).
+ * @param config struktura s konfigurací aplikace
+ * @param items pole souborů, případně zvětšené
+ * @param count počet souborů
+ * @param capacity velikost pole
+ * @param input jméno vstupního souboru (převezme se), NULL pokud se jej
+ *   nepodařilo alokovat
+ * @return AHEDOK pokud nedošlo k chybě, jinak AHEDFail
+ */
+int addBatchItem(struct configuration* config, struct batchItem** items,
+	int32_t* count, int32_t* capacity, char* input) {
+	const char* name = input;
+	size_t length;
+	size_t suffix = strlen(AHED_SUFFIX);
+	struct batchItem* item;
+	
+	if (input == NULL) {
+		return(AHEDFail);
+	}
+	if (*count == *capacity) {
+		int32_t newCapacity = *capacity ? *capacity * 2 : 256;
+		struct batchItem* tmp = realloc(*items, sizeof(**items) * newCapacity);
+		if (tmp == NULL) {
+			free(input);
+			return(AHEDFail);
+		}
+		*items = tmp;
+		*capacity = newCapacity;
+	}
+	
+	/** ve výstupním adresáři se použije jen jméno souboru bez cesty */
+	if (config->outDir != NULL && strrchr(input, '/') != NULL) {
+		name = strrchr(input, '/') + 1;
+	}
+	length = strlen(name);
+	item = &(*items)[*count];
+	memset(item, 0, sizeof(*item));
+	item->input = input;
+	item->output = malloc((config->outDir ? strlen(config->outDir) : 0) +
+		length + suffix + 2);
+	if (item->output == NULL) {
+		free(input);
+		return(AHEDFail);
+	}
+	if (config->direction == AHEDCompress) {
+		sprintf(item->output, "%s%s%s%s", config->outDir ? config->outDir : "",
+			config->outDir ? "/" : "", name, AHED_SUFFIX);
+	} else if (length > suffix && strcmp(name + length - suffix, AHED_SUFFIX) == 0) {
+		sprintf(item->output, "%s%s%.*s", config->outDir ? config->outDir : "",
+			config->outDir ? "/" : "", (int)(length - suffix), name);
+	} else {
+		sprintf(item->output, "%s%s%s.out", config->outDir ? config->outDir : "",
+			config->outDir ? "/" : "", name);
+	}
+	(*count)++;
+	return(AHEDOK);
+}
+
+/**
+ * Porovnání souborů dávky podle jména vstupu (pro qsort)
+ */
+int compareItems(const void* a, const void* b) {
+	return(strcmp(((const struct batchItem*)a)->input,
+		((const struct batchItem*)b)->input));
+}
+
+/**
+ * Seznam souborů dávky -- obyčejné soubory z adresáře inDir seřazené podle
+ * jména, jinak jména po řádcích ze vstupu (-i nebo stdin)
+ * @param config struktura s konfigurací aplikace
+ * @param items nalezené soubory
+ * @param count počet souborů
+ * @return AHEDOK pokud se seznam podařilo sestavit, jinak AHEDFail
+ */
+int listBatch(struct configuration* config, struct batchItem** items,
+	int32_t* count) {
+	int32_t capacity = 0;
+	
+	*items = NULL;
+	*count = 0;
+	if (config->inDir != NULL) {
+		DIR* dir = opendir(config->inDir);
+		struct dirent* entry;
+		
+		if (dir == NULL) {
+			perror("opendir");
+			return(AHEDFail);
+		}
+		while ((entry = readdir(dir)) != NULL) {
+			char* input = malloc(strlen(config->inDir) +
+				strlen(entry->d_name) + 2);
+			struct stat st;
+			
+			if (input != NULL) {
+				sprintf(input, "%s/%s", config->inDir, entry->d_name);
+				if (stat(input, &st) != 0 || !S_ISREG(st.st_mode)) {
+					free(input);
+					continue;
+				}
+			}
+			if (addBatchItem(config, items, count, &capacity, input) ==
+					AHEDFail) {
+				closedir(dir);
+				return(AHEDFail);
+			}
+		}
+		closedir(dir);
+		qsort(*items, *count, sizeof(**items), compareItems);
+	} else {
+		char* line = NULL;
+		size_t size = 0;
+		ssize_t length;
+		
+		while ((length = getline(&line, &size, config->ifile)) != -1) {
+			while (length > 0 && (line[length - 1] == '\n' ||
+					line[length - 1] == '\r')) {
+				line[--length] = '\0';
+			}
+			if (length > 0 && addBatchItem(config, items, count, &capacity,
+					strdup(line)) == AHEDFail) {
+				free(line);
+				return(AHEDFail);
+			}
+		}
+		free(line);
+	}
+	return(AHEDOK);
+}
+
+/**
+ * De/komprese jednoho souboru dávky
+ * @param config struktura s konfigurací aplikace (směr převodu)
+ * @param options volby převodu se stavem vlákna
+ * @param item převáděný soubor
+ */
+void convertBatchItem(struct configuration* config,
+	const tAHEDOptions* options, struct batchItem* item) {
+	FILE* input;
+	FILE* output;
+	
+	item->retval = AHEDFail;
+	if ((input = fopen(item->input, "rb")) == NULL) {
+		return;
+	}
+	if ((output = fopen(item->output, "wb")) == NULL) {
+		fclose(input);
+		return;
+	}
+	if (config->direction == AHEDCompress) {
+		item->retval = AHEDEncodingEx(&item->result, input, output, options);
+	} else {
+		item->retval = AHEDDecodingEx(&item->result, input, output, options);
+	}
+	fclose(input);
+	if (fclose(output) != 0) {
+		item->retval = AHEDFail;
+	}
+}
+
+/**
+ * Vlákno dávkového převodu, bere soubory v pořadí seznamu
+ * @param arg vlákno a sdílený stav (struct batchWorker)
+ */
+void* batchWorker(void* arg) {
+	struct batchWorker* worker = arg;
+	struct batch* batch = worker->batch;
+	tAHEDOptions options = batch->config->options;
+	int32_t item;
+	
+	options.context = worker->context;
+	while ((item = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) <
+			batch->count) {
+		convertBatchItem(batch->config, &options, &batch->items[item]);
+	}
+	return(NULL);
+}
+
+/**
+ * Dávková de/komprese souborů skupinou vláken. Vlákno si drží strom a bloky
+ * transformace mezi soubory, takže dávka malých souborů nealokuje pro každý
+ * soubor znovu.
+ * @param config struktura s konfigurací aplikace
+ * @param total součet velikostí všech souborů
+ * @return AHEDOK pokud se všechny soubory podařilo převést, jinak AHEDFail
+ */
+int convertBatch(struct configuration* config, tAHED* total) {
+	struct batch batch;
+	struct batchWorker* workers;
+	int32_t count;
+	int32_t started = 1;
+	int retval = AHEDOK;
+	
+	if (listBatch(config, &batch.items, &batch.count) == AHEDFail) {
+		return(AHEDFail);
+	}
+	batch.config = config;
+	batch.next = 0;
+	count = config->jobs > 0 ? config->jobs :
+		(int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	if (count > batch.count) {
+		count = batch.count > 0 ? batch.count : 1;
+	}
+	if ((workers = calloc(count, sizeof(*workers))) == NULL) {
+		free(batch.items);
+		return(AHEDFail);
+	}
+	for (int32_t i = 0; i < count; i++) {
+		workers[i].batch = &batch;
+		workers[i].context = AHEDContextCreate();
+	}
+	/** volající vlákno převádí také */
+	for (; started < count; started++) {
+		if (pthread_create(&workers[started].thread, NULL, batchWorker,
+				&workers[started]) != 0) {
+			break;
+		}
+	}
+	batchWorker(&workers[0]);
+	for (int32_t i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	for (int32_t i = 0; i < count; i++) {
+		AHEDContextFree(workers[i].context);
+	}
+	
+	/** záznam o každém souboru na jeden řádek, na konci souhrn */
+	for (int32_t i = 0; i < batch.count; i++) {
+		struct batchItem* item = &batch.items[i];
+		
+		if (item->retval != AHEDOK) {
+			retval = AHEDFail;
+		}
+		total->uncodedSize += item->result.uncodedSize;
+		total->codedSize += item->result.codedSize;
+		if (config->lfile != NULL) {
+			fprintf(config->lfile, "%s %s uncodedSize=%lld codedSize=%lld",
+				item->input, item->retval == AHEDOK ? "ok" :
+				item->retval == AHEDAbort ? "aborted" : "error",
+				(long long int)item->result.uncodedSize,
+				(long long int)item->result.codedSize);
+			if (item->result.corruptOffset != 0) {
+				fprintf(config->lfile, " corruptOffset=%lld",
+					(long long int)item->result.corruptOffset);
+			}
+			fprintf(config->lfile, "\n");
+		}
+		free(item->input);
+		free(item->output);
+	}
+	free(batch.items);
+	free(workers);
+	return(retval);
+}
+
+/**
+ * Přečtení přesně length byte ze socketu
+ * @param fd socket
+ * @param data buffer pro data
+ * @param length počet byte
+ * @return 0 pokud se data podařilo přečíst, jinak -1 (chyba nebo konec
+ *   spojení)
+ */
+int readFull(int fd, void* data, size_t length) {
+	u_int8_t* position = data;
+	
+	while (length > 0) {
+		ssize_t count = recv(fd, position, length, 0);
+		if (count <= 0) {
+			return(-1);
+		}
+		position += count;
+		length -= count;
+	}
+	return(0);
+}
+
+/**
+ * Zápis přesně length byte do socketu, ukončené spojení nevyvolá SIGPIPE
+ * @param fd socket
+ * @param data zapisovaná data
+ * @param length počet byte
+ * @return 0 pokud se data podařilo zapsat, jinak -1
+ */
+int writeFull(int fd, const void* data, size_t length) {
+	const u_int8_t* position = data;
+	
+	while (length > 0) {
+		ssize_t count = send(fd, position, length, MSG_NOSIGNAL);
+		if (count <= 0) {
+			return(-1);
+		}
+		position += count;
+		length -= count;
+	}
+	return(0);
+}
+
+/**
+ * Adresa lokálního socketu
+ * @param address vyplněná adresa
+ * @param path cesta k socketu
+ * @return 0 pokud se cesta do adresy vejde, jinak -1
+ */
+int socketAddress(struct sockaddr_un* address, const char* path) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) {
+		return(-1);
+	}
+	strcpy(address->sun_path, path);
+	return(0);
+}
+
+/**
+ * Vlákno serveru, jeho buffer pro data požadavku a strom a bloky
+ * transformace převodů zůstávají mezi požadavky alokované
+ */
+struct serveWorker {
+	struct configuration* config;
+	int socket;				/** naslouchající socket */
+	u_int8_t* buffer;		/** data posledního požadavku */
+	size_t capacity;
+	tAHEDContext* context;	/** stav převodů vlákna, NULL = každý převod
+							 * alokuje vlastní */
+	pthread_t thread;
+};
+
+/**
+ * Obsluha jednoho požadavku klienta
+ * @param worker vlákno serveru
+ * @param fd spojení s klientem
+ * @return 0 pokud lze spojení použít pro další požadavek, jinak -1
+ */
+int serveRequest(struct serveWorker* worker, int fd) {
+	struct serveRequest request;
+	struct serveResponse response;
+	tAHEDOptions options;
+	FILE* input;
+	FILE* output;
+	char* data = NULL;
+	size_t size = 0;
+	
+	if (readFull(fd, &request, sizeof(request)) != 0 ||
+			request.magic != SERVE_MAGIC || request.length < 0 ||
+			(request.direction != AHEDCompress &&
+			request.direction != AHEDDecompress)) {
+		return(-1);
+	}
+	/** buffer se jen zvětšuje, cesta potřebuje ukončovací nulu */
+	if ((size_t)request.length + 1 > worker->capacity) {
+		u_int8_t* buffer = realloc(worker->buffer, request.length + 1);
+		if (buffer == NULL) {
+			return(-1);
+		}
+		worker->buffer = buffer;
+		worker->capacity = request.length + 1;
+	}
+	if (readFull(fd, worker->buffer, request.length) != 0) {
+		return(-1);
+	}
+	worker->buffer[request.length] = '\0';
+	
+	memset(&response, 0, sizeof(response));
+	response.magic = SERVE_MAGIC;
+	response.retval = AHEDFail;
+	if (request.flags & SERVE_PATH) {
+		input = fopen((char*)worker->buffer, "rb");
+	} else {
+		input = fmemopen(worker->buffer, request.length, "rb");
+	}
+	output = open_memstream(&data, &size);
+	/** formát proudu určuje požadavek, vlákna a limity převodu server */
+	memset(&options, 0, sizeof(options));
+	options.format = request.format;
+	options.blockSize = request.blockSize;
+	options.runs = request.runs;
+	options.width = request.width;
+	options.check = request.check;
+	options.pipeline = worker->config->options.pipeline;
+	options.threads = worker->config->options.threads;
+	options.timeLimit = worker->config->options.timeLimit;
+	options.byteLimit = worker->config->options.byteLimit;
+	options.context = worker->context;
+	if (input != NULL && output != NULL) {
+		if (request.direction == AHEDCompress) {
+			response.retval = AHEDEncodingEx(&response.result, input, output,
+				&options);
+		} else {
+			response.retval = AHEDDecodingEx(&response.result, input, output,
+				&options);
+		}
+	}
+	if (input != NULL) {
+		fclose(input);
+	}
+	if (output != NULL && fclose(output) != 0) {
+		response.retval = AHEDFail;
+	}
+	if (response.retval == AHEDOK) {
+		response.length = size;
+	}
+	if (writeFull(fd, &response, sizeof(response)) != 0 ||
+			writeFull(fd, data, response.length) != 0) {
+		free(data);
+		return(-1);
+	}
+	free(data);
+	return(0);
+}
+
+/**
+ * Vlákno serveru -- přijímá spojení a obsluhuje jejich požadavky, dokud je
+ * klient neukončí
+ * @param arg vlákno serveru (struct serveWorker)
+ */
+void* serveWorker(void* arg) {
+	struct serveWorker* worker = arg;
+	
+	for (;;) {
+		int fd = accept(worker->socket, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+		while (serveRequest(worker, fd) == 0) {
+		}
+		close(fd);
+	}
+	return(NULL);
+}
+
+/**
+ * Server de/komprimující soubory pro klienty na lokálním socketu. Spojení
+ * přijímá pevný počet vláken, každé obsluhuje jedno spojení, dokud je
+ * klient neukončí. Funkce se vrací jen při chybě.
+ * @param config struktura s konfigurací aplikace
+ * @return AHEDFail
+ */
+int serve(struct configuration* config) {
+	struct sockaddr_un address;
+	struct serveWorker* workers;
+	int32_t count = config->jobs > 0 ? config->jobs :
+		(int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	struct stat st;
+	int fd;
+	
+	if (socketAddress(&address, config->serve) != 0) {
+		fprintf(stderr, "serve: socket path too long\n");
+		return(AHEDFail);
+	}
+	/** socket po předchozím běhu serveru odstraníme */
+	if (lstat(config->serve, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(config->serve);
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+			listen(fd, SOMAXCONN) != 0) {
+		perror("serve");
+		return(AHEDFail);
+	}
+	if (count < 1) {
+		count = 1;
+	}
+	if ((workers = calloc(count, sizeof(*workers))) == NULL) {
+		close(fd);
+		return(AHEDFail);
+	}
+	for (int32_t i = 0; i < count; i++) {
+		workers[i].config = config;
+		workers[i].socket = fd;
+		workers[i].context = AHEDContextCreate();
+		if (i > 0 && pthread_create(&workers[i].thread, NULL, serveWorker,
+				&workers[i]) != 0) {
+			break;
+		}
+	}
+	serveWorker(&workers[0]);
+	return(AHEDFail);
+}
+
+/**
+ * Data požadavku klienta -- absolutní cesta k ifile, nebo celý vstup
+ * @param config struktura s konfigurací aplikace
+ * @param request hlavička požadavku, doplní se příznak a délka dat
+ * @param data alokovaná data požadavku
+ * @return 0 pokud se data podařilo připravit, jinak -1
+ */
+int clientData(struct configuration* config, struct serveRequest* request,
+	u_int8_t** data) {
+	size_t capacity = 0;
+	size_t count;
+	
+	if (config->sendPath) {
+		if ((*data = (u_int8_t*)realpath(config->input, NULL)) == NULL) {
+			perror("realpath");
+			return(-1);
+		}
+		request->flags |= SERVE_PATH;
+		request->length = strlen((char*)*data);
+		return(0);
+	}
+	do {
+		if ((size_t)request->length == capacity) {
+			u_int8_t* buffer;
+			capacity = capacity ? capacity * 2 : 65536;
+			if ((buffer = realloc(*data, capacity)) == NULL) {
+				return(-1);
+			}
+			*data = buffer;
+		}
+		count = fread(*data + request->length, 1, capacity - request->length,
+			config->ifile);
+		request->length += count;
+	} while (count > 0);
+	return(0);
+}
+
+/**
+ * De/komprese souboru na serveru. Požadavek se pošle repeat-krát po jednom
+ * spojení (pro měření), do výstupu se zapíše poslední odpověď.
+ * @param config struktura s konfigurací aplikace
+ * @param result záznam o převodu
+ * @return návratová hodnota de/komprese na serveru, AHEDFail při chybě spojení
+ */
+int runClient(struct configuration* config, tAHED* result) {
+	struct sockaddr_un address;
+	struct serveRequest request;
+	struct serveResponse response;
+	u_int8_t* data = NULL;
+	u_int8_t* output = NULL;
+	int retval = AHEDFail;
+	int fd = -1;
+	int i;
+	
+	memset(&request, 0, sizeof(request));
+	request.magic = SERVE_MAGIC;
+	request.direction = config->direction;
+	request.format = config->options.format;
+	request.blockSize = config->options.blockSize;
+	request.runs = config->options.runs;
+	request.width = config->options.width;
+	request.check = config->options.check;
+	
+	if (clientData(config, &request, &data) != 0) {
+		free(data);
+		return(AHEDFail);
+	}
+	if (socketAddress(&address, config->connect) != 0 ||
+			(fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		perror("connect");
+	} else {
+		for (i = 0; i < config->repeat; i++) {
+			free(output);
+			output = NULL;
+			if (writeFull(fd, &request, sizeof(request)) != 0 ||
+					writeFull(fd, data, request.length) != 0 ||
+					readFull(fd, &response, sizeof(response)) != 0 ||
+					response.magic != SERVE_MAGIC || response.length < 0 ||
+					(output = malloc(response.length + 1)) == NULL ||
+					readFull(fd, output, response.length) != 0) {
+				fprintf(stderr, "connect: request failed\n");
+				break;
+			}
+		}
+		/** odpověď na poslední požadavek zapíšeme jako místní převod */
+		if (i == config->repeat) {
+			*result = response.result;
+			retval = response.retval;
+			if (fwrite(output, 1, response.length, config->ofile) !=
+					(size_t)response.length) {
+				retval = AHEDFail;
+			}
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	free(data);
+	free(output);
+	return(retval);
+}
+
 /**
  * Vypsání nápovědy k aplikaci - její vypsání je zajištěno v případě
  * že zadán parametr -h
  */
 void help(void) {
-	printf("ahead [-i ifile] [-o ofile] [-l logfile] [-c] [-x] [-h]\n\n"
+	printf("ahead [-i ifile] [-o ofile] [-l logfile] [-c] [-x] [-p] [-f] [-r] [-k]\n"
+			"\t[-w bits] [-b KiB] [-t N] [-d ms] [-m MiB] [-h]\n"
+			"ahead -c|-x [-p] [-f] [-r] [-k] [-w bits] [-b KiB] [-d ms] [-m MiB] -j N\n"
+			"\t[--in-dir dir] [--out-dir dir] [-i list] [-l logfile]\n"
+			"ahead --serve socket [-j N] [-p] [-t N] [-d ms] [-m MiB]\n"
+			"ahead -c|-x --connect socket [-f] [-r] [-k] [-w bits] [-b KiB]\n"
+			"\t[--repeat N] [--send-path] [-i ifile] [-o ofile] [-l logfile]\n\n"
 			"\t-i ifile jméno vstupního souboru, pokud není zadán bude se\n"
 			"\t\t za vstup považovat stdin\n"
 			"\t-o ofile jméno výstupního souboru, pokud není zadán bude se\n"
@@ -169,6 +978,45 @@ void help(void) {
 			"\t\t bude výstup ignorován\n"
 			"\t-c\t komprimuj vstupní soubor\n"
 			"\t-x\t dekomprimuj vstupní soubor\n"
+			"\t-p\t vstup čte a výstup zapisuje po blocích 64 KiB vlastní\n"
+			"\t\t vlákno, čekání na disk se tak překrývá s kódováním\n"
+			"\t-f\t proud s hlavičkou popisující rozšíření formátu; při\n"
+			"\t\t dekompresi nutné pro soubory komprimované s -f, -r, -k,\n"
+			"\t\t -w nebo -b\n"
+			"\t-r\t běhy opakovaného vzorku delší než 3 kóduje jediným\n"
+			"\t\t symbolem s délkou běhu, vhodné pro data s dlouhými\n"
+			"\t\t úseky nul; implikuje -f\n"
+			"\t-k\t kódovaný proud rozdělí na bloky 64 KiB s kontrolním\n"
+			"\t\t součtem CRC32C a na konec uloží délku původních dat;\n"
+			"\t\t dekomprese poškozený blok nedekóduje a jeho pozici\n"
+			"\t\t vypíše na stderr a do lfile; implikuje -f\n"
+			"\t-w bits\t kóduje vzorky šířky 9 až 16 bitů uložené ve dvou\n"
+			"\t\t byte little-endian místo jednotlivých byte; implikuje -f;\n"
+			"\t\t s -b jen -w 16\n"
+			"\t-b KiB\t před kódováním transformuje bloky dané velikosti\n"
+			"\t\t (BWT, move-to-front a kódování běhů nul), vhodné pro\n"
+			"\t\t text; implikuje -f\n"
+			"\t-t N\t počet bloků (zpětně) transformovaných současně\n"
+			"\t\t (0 = podle počtu procesorů)\n"
+			"\t-d ms\t nejdelší doba de/komprese; po jejím uplynutí převod\n"
+			"\t\t skončí s návratovou hodnotou -2 (254), dávka zapíše\n"
+			"\t\t aborted; u serveru platí pro každý požadavek\n"
+			"\t-m MiB\t nejvyšší velikost nekomprimovaných dat (vstupu\n"
+			"\t\t komprese, výstupu dekomprese), jinak jako -d\n"
+			"\t-j N\t dávková de/komprese N vlákny (0 = podle počtu\n"
+			"\t\t procesorů); jména souborů se čtou po řádcích z ifile\n"
+			"\t\t nebo stdin, komprimovaný soubor dostane příponu .ahed,\n"
+			"\t\t dekomprimovaný ji ztratí (jinak dostane .out); lfile\n"
+			"\t\t obsahuje řádek o každém souboru a souhrn\n"
+			"\t--in-dir dir dávka ze všech souborů v adresáři\n"
+			"\t--out-dir dir adresář pro výstupy dávky\n"
+			"\t--serve socket server na lokálním socketu; spojení obsluhuje\n"
+			"\t\t N vláken (výchozí podle počtu procesorů)\n"
+			"\t--connect socket de/komprese na serveru, výstup a lfile\n"
+			"\t\t jako u místního převodu; formát proudu se posílá\n"
+			"\t\t s požadavkem, -p a -t určuje server\n"
+			"\t--repeat N pošle požadavek N-krát po jednom spojení\n"
+			"\t--send-path pošle serveru místo obsahu cestu k ifile\n"
 			"\t-h\t zobrazí tuto nápovědu\n");
 }
 
@@ -178,18 +1026,48 @@ void help(void) {
 int main(int argc, char **argv) {
 	struct	configuration configuration; /** konfigurace zpracování */
 	int		retval=0;						 /** návratová hodnota */
+	int		parsed;							 /** výsledek zpracování příkazové řádky */
 	
 	/** pokud se podari zpracovani prikazove radky */
-	if (commandline(argc, argv, &configuration)) {
-		tAHED	result = {0, 0};			/** výsledky de/komprese */
+	parsed = commandline(argc, argv, &configuration);
+	if (parsed == COMMAND_LINE_OK) {
+		tAHED	result = {0, 0, 0};			/** výsledky de/komprese */
 		
 		/** kontrola kterym smerem se ma provadet prevod */
-		if (configuration.direction == AHEDCompress) {
+		if (configuration.serve != NULL) {
+			/** server, smer prevodu urcuje kazdy pozadavek */
+			openFiles(&configuration);
+			retval = serve(&configuration);
+			closeFiles(&configuration);
+		} else if (configuration.connect != NULL &&
+				configuration.direction != AHEDUndefined) {
+			/** prevod na serveru */
+			openFiles(&configuration);
+			retval = runClient(&configuration, &result);
+			if (result.corruptOffset != 0) {
+				fprintf(stderr, "ahed: corrupt chunk at offset %lld\n",
+						(long long int)result.corruptOffset);
+			}
+			writeResults(&configuration, &result);
+			closeFiles(&configuration);
+		} else if (configuration.jobs >= 0 &&
+				configuration.direction != AHEDUndefined) {
+			/** davkovy prevod, seznam souboru se cte z ifile */
+			openFiles(&configuration);
+			retval = convertBatch(&configuration, &result);
+			/** zapiseme souhrn prevodu */
+			writeResults(&configuration, &result);
+			/** zavreme soubory */
+			closeFiles(&configuration);
+		} else if (configuration.direction == AHEDCompress) {
 			/** komprese, otevreme soubory */
 			openFiles(&configuration);
 			/** zpracujeme */
-			retval = AHEDEncoding(&result, configuration.ifile,
-									configuration.ofile);
+			retval = AHEDEncodingEx(&result, configuration.ifile,
+									configuration.ofile, &configuration.options);
+			if (retval == AHEDAbort) {
+				fprintf(stderr, "ahed: conversion limit exceeded\n");
+			}
 			/** zapiseme vysledek prevodu */
 			writeResults(&configuration, &result);
 			/** zavreme soubory */
@@ -198,16 +1076,27 @@ int main(int argc, char **argv) {
 			/** dekomprese, otevreme soubory */
 			openFiles(&configuration);
 			/** zpracujeme */
-			retval = AHEDDecoding(&result, configuration.ifile,
-									configuration.ofile);
+			retval = AHEDDecodingEx(&result, configuration.ifile,
+									configuration.ofile, &configuration.options);
+			if (result.corruptOffset != 0) {
+				fprintf(stderr, "ahed: corrupt chunk at offset %lld\n",
+						(long long int)result.corruptOffset);
+			}
+			if (retval == AHEDAbort) {
+				fprintf(stderr, "ahed: conversion limit exceeded\n");
+			}
 			/** zapiseme vysledky prevodu */
 			writeResults(&configuration, &result);
 			/** zavreme soubory */
 			closeFiles(&configuration);
 		}
 	} else {
-		/** zpracovani prikazove radky se nezdarilo, vypiseme ovladani */
+		/** zpracovani prikazove radky se nezdarilo, vypiseme ovladani;
+		 * chybna hodnota volby konci chybou jako neznama volba */
 		help();
+		if (parsed == COMMAND_LINE_ERR) {
+			retval = -1;
+		}
 	}
 	
 	/** ukoncime s navratovou hodnotou, ktera nam byla vracena po zpracovani */
@@ -0,0 +1,126 @@
+/*
+ * Autor:	Jaroslav Bartoň, xbarto42
+ * Datum:	6.4.2008
+ * Soubor:	tests/limits.c
+ * Komentar: limit doby převodu při transformaci velkého bloku
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ahed.h"
+
+/** velikost vstupu transformovaného jediným blokem */
+#define SIZE (32 << 20)
+/** limit doby převodu v ms a nejdelší přípustná doba převodu v ms */
+#define LIMIT 50
+#define ALLOWED 1000
+
+/**
+ * Monotónní čas
+ * @return čas v milisekundách
+ */
+static int64_t now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/**
+ * Náhodný text z malé abecedy, aby řazení přípon nebylo triviální
+ * @param file cílový soubor
+ * @param size počet byte
+ */
+static void randomText(FILE* file, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		putc("abcdefgh \n"[rand() % 10], file);
+	}
+	rewind(file);
+}
+
+/**
+ * Kódování jednoho velkého bloku s limitem doby musí skončit AHEDAbort
+ * zhruba po uplynutí limitu, ne až po transformaci celého bloku
+ * @return počet chyb
+ */
+static int deadline(void) {
+	FILE* input = tmpfile();
+	FILE* output = tmpfile();
+	tAHEDOptions options;
+	tAHED ahed;
+	int64_t start;
+	int retval;
+
+	if (input == NULL || output == NULL) {
+		fprintf(stderr, "limits: nelze vytvořit dočasný soubor\n");
+		return(1);
+	}
+	randomText(input, SIZE);
+	memset(&options, 0, sizeof(options));
+	options.format = AHEDFormatFramed;
+	options.blockSize = 64 << 20;
+	options.threads = 1;
+	options.timeLimit = (int64_t)LIMIT * 1000000;
+	start = now();
+	retval = AHEDEncodingEx(&ahed, input, output, &options);
+	start = now() - start;
+	fclose(input);
+	fclose(output);
+	printf("limits: limit %d ms, převod skončil %d za %lld ms\n", LIMIT,
+		retval, (long long)start);
+	return(retval != AHEDAbort || start > ALLOWED);
+}
+
+/**
+ * Převod menších bloků s limitem, který nevyprší, musí projít beze změny dat
+ * @return počet chyb
+ */
+static int roundtrip(void) {
+	FILE* input = tmpfile();
+	FILE* coded = tmpfile();
+	FILE* output = tmpfile();
+	tAHEDOptions options;
+	tAHED ahed;
+	int errors = 0;
+	int a, b;
+
+	if (input == NULL || coded == NULL || output == NULL) {
+		fprintf(stderr, "limits: nelze vytvořit dočasný soubor\n");
+		return(1);
+	}
+	randomText(input, 3 << 20);
+	memset(&options, 0, sizeof(options));
+	options.format = AHEDFormatFramed;
+	options.blockSize = 1 << 20;
+	options.threads = 2;
+	options.timeLimit = (int64_t)60 * 1000000000;
+	if (AHEDEncodingEx(&ahed, input, coded, &options) != AHEDOK) {
+		errors++;
+	}
+	rewind(coded);
+	rewind(input);
+	if (AHEDDecodingEx(&ahed, coded, output, &options) != AHEDOK) {
+		errors++;
+	}
+	rewind(output);
+	do {
+		a = getc(input);
+		b = getc(output);
+	} while (a == b && a != EOF);
+	errors += a != b;
+	fclose(input);
+	fclose(coded);
+	fclose(output);
+	return(errors);
+}
+
+int main(void) {
+	int errors = deadline() + roundtrip();
+
+	printf("limits: %d chyb\n", errors);
+	return(errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
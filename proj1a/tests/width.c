@@ -0,0 +1,82 @@
+/*
+ * Autor:	Jaroslav Bartoň, xbarto42
+ * Datum:	6.4.2008
+ * Soubor:	tests/width.c
+ * Komentar: šířka vzorku s transformací po blocích a stav sdílený převody
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ahed.h"
+
+/** strom a bloky sdílené převody s různou šířkou vzorku */
+static tAHEDContext* context;
+
+/**
+ * Převod textu se šířkou vzorku width a transformací po blocích
+ * @param width šířka vzorku
+ * @param expected očekávaný výsledek kódování
+ * @return počet chyb
+ */
+static int convert(int width, int expected) {
+	FILE* input = tmpfile();
+	FILE* coded = tmpfile();
+	FILE* output = tmpfile();
+	tAHEDOptions options;
+	tAHED ahed;
+	int errors = 0;
+	int retval;
+	int a, b;
+
+	if (input == NULL || coded == NULL || output == NULL) {
+		fprintf(stderr, "width: nelze vytvořit dočasný soubor\n");
+		return(1);
+	}
+	for (int i = 0; i < 100000; i++) {
+		putc("abcdefgh \n"[rand() % 10], input);
+	}
+	rewind(input);
+	memset(&options, 0, sizeof(options));
+	options.format = AHEDFormatFramed;
+	options.blockSize = 16 << 10;
+	options.width = width;
+	options.context = context;
+	retval = AHEDEncodingEx(&ahed, input, coded, &options);
+	if (retval != expected) {
+		fprintf(stderr, "width: -w %d vrátilo %d\n", width, retval);
+		errors++;
+	} else if (retval == AHEDOK) {
+		rewind(coded);
+		rewind(input);
+		if (AHEDDecodingEx(&ahed, coded, output, &options) != AHEDOK) {
+			errors++;
+		}
+		rewind(output);
+		do {
+			a = getc(input);
+			b = getc(output);
+		} while (a == b && a != EOF);
+		errors += a != b;
+	}
+	fclose(input);
+	fclose(coded);
+	fclose(output);
+	return(errors);
+}
+
+int main(void) {
+	int errors;
+
+	context = AHEDContextCreate();
+	errors = convert(8, AHEDOK) + convert(16, AHEDOK) + convert(8, AHEDOK);
+
+	/** dvojice byte transformace se do užšího vzorku nevejde */
+	for (int width = 9; width < 16; width++) {
+		errors += convert(width, AHEDFail);
+	}
+	AHEDContextFree(context);
+	printf("width: %d chyb\n", errors);
+	return(errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
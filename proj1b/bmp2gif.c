@@ -0,0 +1,502 @@
+/*
+ * Autor:		Jaroslav Bartoň, xbarto42
+ * Datum:		2008-4-16
+ * Soubor:		bmp2gif.c
+ * Komentar:
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include "bmp2gif.h"
+
+#define MAX_BITS 12
+#define MAX_CODES (1 << MAX_BITS)
+
+/** hašovací tabulka slovníku, zaplněná nejvýše ze čtvrtiny (krátké
+ * lineární hledání), stále se vejde do L1/L2 cache */
+#define HASH_BITS 14
+#define HASH_SIZE (1 << HASH_BITS)
+#define HASH_EMPTY 0xffffffffu
+
+/** po kolika pixelech se u BMP2GIFClearAdaptive kontroluje účinnost */
+#define ADAPT_WINDOW 16384
+
+/** maximální délka sub-bloku a kolik sub-bloků se zapisuje najednou */
+#define SUBBLOCK_SIZE 255
+#define RAW_SIZE (SUBBLOCK_SIZE * 256)
+
+/** značky bloků GIF */
+#define IMAGE_BLOCK_BEGIN_MARKER 0x2C
+#define TRAILER_MARKER 0x3B
+
+/** hlavičky BMP souboru (file header + info header) */
+struct bmpHeaders {
+	u_int8_t  bm[2];		/** signatura BM */
+	u_int32_t size;			/** velikost souboru */
+	u_int16_t reserved[2];
+	u_int32_t offset;		/** začátek obrazových dat */
+	u_int32_t biSize;		/** velikost informační hlavičky */
+	int32_t	  biWidth;		/** šířka */
+	int32_t	  biHeight;		/** výška, záporná pro obrázek shora dolů */
+	u_int16_t biPlanes;		/** úrovní */
+	u_int16_t biBitCount;	/** bitů na pixel */
+	u_int32_t biCompression;	/** komprese */
+	u_int32_t biSizeImage;	/** velikost obrázku */
+	int32_t	  biXPelsPerMeter;	/** pixelů na metr v osách */
+	int32_t	  biYPelsPerMeter;
+	u_int32_t biClrUsed;	/** barev v paletě, 0 = 2^biBitCount */
+	u_int32_t biClrImportant;	/** důležitých barev */
+}__attribute__((__packed__));
+
+/** vstupní BMP soubor zpřístupněný v paměti (namapovaný nebo načtený) */
+struct bmpInput {
+	const u_int8_t* data;	/** začátek dat BMP souboru */
+	size_t	  length;		/** délka dat */
+	void*	  map;			/** začátek namapované oblasti (zarovnaný) */
+	size_t	  mapLength;	/** délka namapované oblasti */
+	u_int8_t* buffer;		/** buffer v případě, že mapování nelze použít */
+};
+
+/** stav kodéru LZW */
+struct lzwEncoder {
+	/** slovník: (prefix << 8 | znak) << MAX_BITS | kód; hodnotu HASH_EMPTY
+	 * položka mít nemůže, prefix je vždy menší než přidělovaný kód */
+	u_int32_t table[HASH_SIZE];
+	u_int8_t  initCWlen;	/** počáteční počet bitů */
+	u_int8_t  CWlen;		/** aktuální počet bitů */
+	int32_t	  CC;			/** clear code */
+	int32_t	  EOI;			/** End Of Input */
+	int32_t	  next;			/** následující volný kód */
+	int	  clearPolicy;		/** vkládání clear code */
+	u_int64_t bitBuffer;	/** bity čekající na zápis */
+	u_int8_t  bitCount;		/** počet platných bitů v bitBuffer */
+	int64_t	  bits;			/** počet bitů zapsaných od posledního clear code */
+	int64_t	  fullBits;		/** bity a pixely od clear code do zaplnění */
+	int64_t	  fullPixels;
+	int64_t	  windowBits;	/** bity a pixely na začátku kontrolního okna */
+	int64_t	  windowPixels;
+	int64_t	  clearPixels;	/** pixely před posledním clear code */
+	u_int8_t  raw[RAW_SIZE];	/** LZW data bez rozdělení na sub-bloky */
+	size_t	  rawLength;
+	u_int8_t  blocks[RAW_SIZE + RAW_SIZE / SUBBLOCK_SIZE];	/** sub-bloky */
+	FILE*	  file;			/** výstupní soubor */
+	int64_t	  written;		/** počet zapsaných byte */
+	int8_t	  error;		/** zápis selhal */
+};
+
+/**
+ * Zpřístupnění vstupního souboru v paměti. Běžný soubor se namapuje pomocí
+ * mmap, ostatní vstupy (roura, terminál) se načtou do bufferu.
+ * @param in struktura se vstupem
+ * @param inputFile vstupní soubor
+ * @return BMP2GIFOK pokud nedošlo k chybě, jinak BMP2GIFFail
+ */
+static int8_t bmpInputOpen(struct bmpInput* in, FILE* inputFile) {
+	struct stat st;
+	int fd = fileno(inputFile);
+	off_t offset = ftello(inputFile);
+	size_t capacity = 0;
+
+	memset(in, 0, sizeof(*in));
+
+	/** běžný soubor namapujeme od aktuální pozice až do konce */
+	if (fd >= 0 && offset >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+			st.st_size > offset) {
+		off_t aligned = offset - offset % sysconf(_SC_PAGESIZE);
+
+		in->mapLength = st.st_size - aligned;
+		in->map = mmap(NULL, in->mapLength, PROT_READ, MAP_PRIVATE, fd, aligned);
+		if (in->map != MAP_FAILED) {
+			madvise(in->map, in->mapLength, MADV_SEQUENTIAL);
+			in->data = (u_int8_t*)in->map + (offset - aligned);
+			in->length = st.st_size - offset;
+			fseeko(inputFile, st.st_size, SEEK_SET);
+			return(BMP2GIFOK);
+		}
+		in->map = NULL;
+		in->mapLength = 0;
+	}
+
+	/** mapování nelze použít, načteme celý vstup do bufferu */
+	for (;;) {
+		if (in->length == capacity) {
+			capacity = capacity ? capacity * 2 : 65536;
+			u_int8_t* buffer = realloc(in->buffer, capacity);
+			if (buffer == NULL) {
+				free(in->buffer);
+				in->buffer = NULL;
+				return(BMP2GIFFail);
+			}
+			in->buffer = buffer;
+		}
+		size_t readed = fread(in->buffer + in->length, 1, capacity - in->length,
+								inputFile);
+		if (readed == 0) {
+			break;
+		}
+		in->length += readed;
+	}
+	in->data = in->buffer;
+	return(BMP2GIFOK);
+}
+
+/**
+ * Uvolnění vstupu
+ * @param in struktura se vstupem
+ */
+static void bmpInputClose(struct bmpInput* in) {
+	if (in->map != NULL) {
+		munmap(in->map, in->mapLength);
+	}
+	free(in->buffer);
+}
+
+/**
+ * Zápis dat do výstupního souboru
+ * @param e kodér s výstupním souborem
+ * @param data zapisovaná data
+ * @param length délka dat
+ */
+static void writeData(struct lzwEncoder* e, const void* data, size_t length) {
+	if (fwrite(data, 1, length, e->file) != length) {
+		e->error = 1;
+	}
+	e->written += length;
+}
+
+/**
+ * Rozdělení začátku LZW dat na sub-bloky a jejich zápis, zbytek dat se
+ * přesune na začátek bufferu
+ * @param e kodér
+ * @param length kolik byte LZW dat se má zapsat
+ */
+static void flushBlocks(struct lzwEncoder* e, size_t length) {
+	u_int8_t* dst = e->blocks;
+
+	for (size_t pos = 0; pos < length; pos += SUBBLOCK_SIZE) {
+		size_t size = length - pos < SUBBLOCK_SIZE ? length - pos : SUBBLOCK_SIZE;
+		*dst++ = size;
+		memcpy(dst, &e->raw[pos], size);
+		dst += size;
+	}
+	writeData(e, e->blocks, dst - e->blocks);
+	memmove(e->raw, &e->raw[length], e->rawLength - length);
+	e->rawLength -= length;
+}
+
+/**
+ * Zápis kódového slova aktuální délky. Bity se sbírají v 64bitovém
+ * zásobníku a zapisují se po 32 bitech.
+ * @param e kodér
+ * @param code kódové slovo
+ */
+static void putCode(struct lzwEncoder* e, u_int32_t code) {
+	e->bitBuffer |= (u_int64_t)code << e->bitCount;
+	e->bitCount += e->CWlen;
+	e->bits += e->CWlen;
+	if (e->bitCount >= 32) {
+		u_int8_t* dst = &e->raw[e->rawLength];
+		dst[0] = e->bitBuffer;
+		dst[1] = e->bitBuffer >> 8;
+		dst[2] = e->bitBuffer >> 16;
+		dst[3] = e->bitBuffer >> 24;
+		e->bitBuffer >>= 32;
+		e->bitCount -= 32;
+		/** RAW_SIZE je násobkem 4, buffer se zaplní přesně */
+		e->rawLength += 4;
+		if (e->rawLength == RAW_SIZE) {
+			flushBlocks(e, RAW_SIZE);
+		}
+	}
+}
+
+/**
+ * Zápis zbylých bitů, posledních sub-bloků a terminátoru
+ * @param e kodér
+ */
+static void finishCodes(struct lzwEncoder* e) {
+	u_int8_t terminator = 0;
+
+	while (e->bitCount > 0) {
+		if (e->rawLength == RAW_SIZE) {
+			flushBlocks(e, RAW_SIZE);
+		}
+		e->raw[e->rawLength++] = e->bitBuffer;
+		e->bitBuffer >>= 8;
+		e->bitCount = e->bitCount > 8 ? e->bitCount - 8 : 0;
+	}
+	flushBlocks(e, e->rawLength);
+	writeData(e, &terminator, 1);
+}
+
+/**
+ * Vyprázdnění slovníku a návrat k počátečnímu počtu bitů
+ * @param e kodér
+ * @param pixels počet dosud zakódovaných pixelů
+ */
+static void resetDictionary(struct lzwEncoder* e, int64_t pixels) {
+	memset(e->table, 0xff, sizeof(e->table));
+	e->CWlen = e->initCWlen + 1;
+	e->next = e->CC + 2;
+	e->bits = 0;
+	e->fullPixels = 0;
+	e->clearPixels = pixels;
+}
+
+/**
+ * Přidání řetězce do slovníku, případně rozhodnutí o clear code podle
+ * zvolené strategie, pokud je slovník plný
+ * @param e kodér
+ * @param slot volná položka hašovací tabulky pro řetězec
+ * @param key prefix a znak řetězce
+ * @param pixels počet dosud zakódovaných pixelů
+ */
+static void addString(struct lzwEncoder* e, u_int32_t slot, u_int32_t key,
+	int64_t pixels) {
+	if (e->next < MAX_CODES) {
+		e->table[slot] = key << MAX_BITS | e->next;
+		/** dekodér zvětší počet bitů až s přidáním tohoto kódu */
+		if (e->next++ == (1 << e->CWlen) && e->CWlen < MAX_BITS) {
+			e->CWlen++;
+		}
+		return;
+	}
+
+	if (e->clearPolicy == BMP2GIFClearFull) {
+		putCode(e, e->CC);
+		resetDictionary(e, pixels);
+	} else if (e->clearPolicy == BMP2GIFClearAdaptive) {
+		if (e->fullPixels == 0) {
+			/** účinnost slovníku při jeho zaplnění */
+			e->fullBits = e->bits;
+			e->fullPixels = pixels - e->clearPixels;
+			e->windowBits = e->bits;
+			e->windowPixels = pixels;
+		} else if (pixels - e->windowPixels >= ADAPT_WINDOW) {
+			/** poslední okno se komprimovalo hůře než slovník při zaplnění */
+			if ((e->bits - e->windowBits) * e->fullPixels >
+					e->fullBits * (pixels - e->windowPixels)) {
+				putCode(e, e->CC);
+				resetDictionary(e, pixels);
+			} else {
+				e->windowBits = e->bits;
+				e->windowPixels = pixels;
+			}
+		}
+	}
+}
+
+/**
+ * Komprese obrazových dat algoritmem LZW. Shoda řetězce se hledá
+ * v hašovací tabulce s otevřeným adresováním podle dvojice (prefix, znak).
+ * @param e kodér
+ * @param top první (horní) řádek obrázku
+ * @param stride vzdálenost řádků, záporná pro BMP zdola nahoru
+ * @param width šířka obrázku
+ * @param height výška obrázku
+ */
+static void encodePixels(struct lzwEncoder* e, const u_int8_t* top, ptrdiff_t stride,
+	int32_t width, int32_t height) {
+	int64_t pixels = 0;			///< počet zakódovaných pixelů
+	int32_t prefix = -1;		///< kód dosud nalezeného řetězce
+
+	resetDictionary(e, 0);
+	putCode(e, e->CC);
+	for (int32_t y = 0; y < height; y++) {
+		const u_int8_t* row = top + y * stride;
+		int32_t x = 0;
+
+		if (prefix < 0 && width > 0) {
+			prefix = row[x++];
+		}
+		for (; x < width; x++) {
+			u_int32_t key = (u_int32_t)prefix << 8 | row[x];
+			u_int32_t slot = (key * 2654435761u) >> (32 - HASH_BITS);
+			u_int32_t entry;
+
+			/** lineární hledání volné nebo shodné položky */
+			while ((entry = e->table[slot]) != HASH_EMPTY &&
+					entry >> MAX_BITS != key) {
+				slot = (slot + 1) & (HASH_SIZE - 1);
+			}
+			if (entry != HASH_EMPTY) {
+				prefix = entry & (MAX_CODES - 1);
+				continue;
+			}
+			putCode(e, prefix);
+			addString(e, slot, key, pixels + x);
+			prefix = row[x];
+		}
+		pixels += width;
+	}
+	if (prefix >= 0) {
+		putCode(e, prefix);
+		/** dekodér i po posledním kódu přidá řetězec a případně zvětší počet
+		 * bitů, EOI už čte novou délkou */
+		if (e->next == (1 << e->CWlen) && e->CWlen < MAX_BITS) {
+			e->CWlen++;
+		}
+	}
+	putCode(e, e->EOI);
+	finishCodes(e);
+}
+
+/**
+ * Zápis hlavičky GIF souboru, globální palety a hlavičky bloku obrázku
+ * @param e kodér s výstupním souborem
+ * @param width šířka obrázku
+ * @param height výška obrázku
+ * @param palette paleta BMP (B, G, R, 0)
+ * @param paletteColors počet barev palety BMP
+ * @param bits počet bitů globální palety GIF
+ */
+static void writeGifHeaders(struct lzwEncoder* e, int32_t width, int32_t height,
+	const u_int8_t* palette, int32_t paletteColors, int8_t bits) {
+	u_int8_t header[13] = {'G', 'I', 'F', '8', '9', 'a'};
+	u_int8_t image[10] = {IMAGE_BLOCK_BEGIN_MARKER};
+	u_int8_t colors[256 * 3];
+
+	/** logická obrazovka s globální paletou, bez pozadí a poměru stran */
+	header[6] = width;
+	header[7] = width >> 8;
+	header[8] = height;
+	header[9] = height >> 8;
+	header[10] = 0x80 | (bits - 1) << 4 | (bits - 1);
+	writeData(e, header, sizeof(header));
+
+	/** paleta GIF je RGB, barvy nad rámec palety BMP jsou černé */
+	memset(colors, 0, sizeof(colors));
+	for (int32_t i = 0; i < (1 << bits) && i < paletteColors; i++) {
+		colors[i * 3] = palette[i * 4 + 2];
+		colors[i * 3 + 1] = palette[i * 4 + 1];
+		colors[i * 3 + 2] = palette[i * 4];
+	}
+	writeData(e, colors, 3 << bits);
+
+	/** jediný obrázek přes celou obrazovku, bez lokální palety a prokládání */
+	image[5] = width;
+	image[6] = width >> 8;
+	image[7] = height;
+	image[8] = height >> 8;
+	writeData(e, image, sizeof(image));
+}
+
+/* Nazev:
+ *   bmp2gif
+ * Cinnost:
+ *   Funkce prevadi 8bitovy nekomprimovany soubor BMP na format GIF89a.
+ * Parametry:
+ *   bmp2gif - zaznam o prevodu
+ *   inputFile - vstupni soubor (BMP)
+ *   outputFile - vystupni soubor (GIF)
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nepodporovany format BMP
+ */
+int bmp2gif(tBMP2GIF *bmp2gif, FILE *inputFile, FILE *outputFile) {
+	return(bmp2gifEx(bmp2gif, inputFile, outputFile, NULL));
+}
+
+/* Nazev:
+ *   bmp2gifEx
+ * Cinnost:
+ *   Funkce prevadi 8bitovy nekomprimovany soubor BMP na format GIF89a
+ *   podle zadanych voleb.
+ * Parametry:
+ *   bmp2gif - zaznam o prevodu
+ *   inputFile - vstupni soubor (BMP)
+ *   outputFile - vystupni soubor (GIF)
+ *   options - volby prevodu, NULL znamena vychozi volby
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nepodporovany format BMP
+ */
+int bmp2gifEx(tBMP2GIF *bmp2gif, FILE *inputFile, FILE *outputFile,
+	const tBMP2GIFOptions *options) {
+	struct bmpInput in;				///< vstupní soubor v paměti
+	struct bmpHeaders bmph;			///< hlavičky BMP souboru
+	struct lzwEncoder* e;			///< kodér
+	const u_int8_t* top;			///< horní řádek obrázku
+	ptrdiff_t stride;				///< vzdálenost řádků
+	int32_t width, height;
+	int32_t paletteColors;			///< počet barev palety BMP
+	int8_t bits = 1;				///< počet bitů palety GIF
+	u_int8_t maxIndex = 0;			///< nejvyšší použitý index barvy
+	u_int8_t trailer = TRAILER_MARKER;
+	int8_t retval;
+
+	if (bmpInputOpen(&in, inputFile) == BMP2GIFFail) {
+		return(BMP2GIFFail);
+	}
+	bmp2gif->bmpSize = in.length;
+
+	/** podporovaný je jen výstup gif2bmp: 8 bitů na pixel bez komprese */
+	if (in.length < sizeof(bmph)) {
+		bmpInputClose(&in);
+		return(BMP2GIFFail);
+	}
+	memcpy(&bmph, in.data, sizeof(bmph));
+	width = bmph.biWidth;
+	height = bmph.biHeight < 0 ? -(int64_t)bmph.biHeight : bmph.biHeight;
+	stride = ((int64_t)width * 8 + 31) / 32 * 4;
+	paletteColors = bmph.biClrUsed ? (int32_t)bmph.biClrUsed : 256;
+	if (memcmp(bmph.bm, "BM", 2) != 0 || bmph.biBitCount != 8 ||
+			bmph.biCompression != 0 || width <= 0 || width > 65535 ||
+			height <= 0 || height > 65535 || bmph.biClrUsed > 256 ||
+			14 + (size_t)bmph.biSize + 4 * (size_t)paletteColors > in.length ||
+			bmph.offset > in.length ||
+			(size_t)stride * height > in.length - bmph.offset) {
+		bmpInputClose(&in);
+		return(BMP2GIFFail);
+	}
+
+	/** obrázek zdola nahoru se čte od posledního řádku */
+	top = in.data + bmph.offset;
+	if (bmph.biHeight > 0) {
+		top += (size_t)stride * (height - 1);
+		stride = -stride;
+	}
+
+	/** paleta GIF stačí na nejvyšší použitý index */
+	for (int32_t y = 0; y < height && maxIndex < 255; y++) {
+		const u_int8_t* row = top + y * stride;
+		for (int32_t x = 0; x < width; x++) {
+			maxIndex = row[x] > maxIndex ? row[x] : maxIndex;
+		}
+	}
+	while ((1 << bits) <= maxIndex) {
+		bits++;
+	}
+
+	if ((e = malloc(sizeof(*e))) == NULL) {
+		bmpInputClose(&in);
+		return(BMP2GIFFail);
+	}
+	memset(e, 0, offsetof(struct lzwEncoder, raw));
+	e->file = outputFile;
+	e->clearPolicy = options != NULL ? options->clearPolicy : BMP2GIFClearFull;
+	e->initCWlen = bits < 2 ? 2 : bits;
+	e->CC = 1 << e->initCWlen;
+	e->EOI = e->CC + 1;
+	e->rawLength = 0;
+	e->written = 0;
+	e->error = 0;
+
+	writeGifHeaders(e, width, height, in.data + 14 + bmph.biSize,
+		paletteColors, bits);
+	writeData(e, &e->initCWlen, 1);
+	encodePixels(e, top, stride, width, height);
+	writeData(e, &trailer, 1);
+
+	bmp2gif->gifSize = e->written;
+	retval = e->error ? BMP2GIFFail : BMP2GIFOK;
+	free(e);
+	bmpInputClose(&in);
+	return(retval);
+}
@@ -0,0 +1,68 @@
+/*
+ * Autor:		Jaroslav Bartoň, xbarto42
+ * Datum:		2008-4-16
+ * Soubor:		bmp2gif.h
+ * Komentar:
+ */
+
+#ifndef __KKO_BMP2GIF_H__
+#define __KKO_BMP2GIF_H__
+
+#include <sys/types.h>
+#include <stdio.h>
+
+#define BMP2GIFOK 0
+#define BMP2GIFFail -1
+
+/* Datovy typ zaznamu o konverzi */
+typedef struct{
+	/* velikost souboru BMP */
+	int64_t bmpSize;
+	/* velikost souboru GIF */
+	int64_t gifSize;
+} tBMP2GIF;
+
+/* Kdy se ma pri zaplneni slovniku LZW vlozit clear code */
+#define BMP2GIFClearFull 0		/* hned po zaplneni slovniku */
+#define BMP2GIFClearNever 1		/* nikdy, plny slovnik se dale jen pouziva */
+#define BMP2GIFClearAdaptive 2	/* az kdyz se komprese plnym slovnikem zhorsi */
+
+/* Datovy typ s volbami prevodu */
+typedef struct{
+	/* vkladani clear code (BMP2GIFClearFull, ...) */
+	int clearPolicy;
+} tBMP2GIFOptions;
+
+/* Nazev:
+ *   bmp2gif
+ * Cinnost:
+ *   Funkce prevadi 8bitovy nekomprimovany soubor BMP na format GIF89a.
+ * Parametry:
+ *   bmp2gif - zaznam o prevodu
+ *   inputFile - vstupni soubor (BMP)
+ *   outputFile - vystupni soubor (GIF)
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nepodporovany format BMP
+ */
+int bmp2gif(tBMP2GIF *bmp2gif, FILE *inputFile, FILE *outputFile);
+
+/* Nazev:
+ *   bmp2gifEx
+ * Cinnost:
+ *   Funkce prevadi 8bitovy nekomprimovany soubor BMP na format GIF89a
+ *   podle zadanych voleb.
+ * Parametry:
+ *   bmp2gif - zaznam o prevodu
+ *   inputFile - vstupni soubor (BMP)
+ *   outputFile - vystupni soubor (GIF)
+ *   options - volby prevodu, NULL znamena vychozi volby
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nepodporovany format BMP
+ */
+int bmp2gifEx(tBMP2GIF *bmp2gif, FILE *inputFile, FILE *outputFile,
+	const tBMP2GIFOptions *options);
+
+
+#endif
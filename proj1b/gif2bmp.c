@@ -7,17 +7,31 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
 #include "gif2bmp.h"
 
+/** vektorové verze převodu indexů na barvy (vybírají se za běhu) */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNELS
+#endif
+
 #define MAX_BITS 12
 #define MAX_DICT_SIZE 1 << MAX_BITS
 
 /** hlavička GIF souboru */
 struct gifHeader {
 	u_int8_t id[6];	/** verze GIF */
-	int16_t width;			/** šířka */
-	int16_t height;			/** výška */
+	u_int16_t width;		/** šířka */
+	u_int16_t height;		/** výška */
 	u_int8_t bits;		/** bitovost */
 	u_int8_t bgColor;	/** výchozí barva pozadí */
 	u_int8_t reserved;
@@ -25,10 +39,10 @@ struct gifHeader {
 
 /** hlavička bloku obrázku */
 struct imgHeader {
-	int16_t col0;			/** levý horní roh bloku */
-	int16_t row0;			/** levý horní řádek bloku */
-	int16_t width;			/** šířka */
-	int16_t height;			/** výška */
+	u_int16_t col0;			/** levý horní roh bloku */
+	u_int16_t row0;			/** levý horní řádek bloku */
+	u_int16_t width;		/** šířka */
+	u_int16_t height;		/** výška */
 	u_int8_t flags;	/** vlastnosti palety bloku */
 }__attribute__((__packed__));
 
@@ -73,9 +87,80 @@ struct bmpInfoHeader {
 	int32_t biClrImportant;	/** důležitých barev */
 }__attribute__((__packed__));
 
+/** rostoucí buffer s daty v kódování BI_RLE8 */
+struct rleBuffer {
+	u_int8_t* data;			/** zakódovaná data */
+	int64_t	  length;		/** počet zapsaných byte */
+	int64_t	  capacity;		/** velikost bufferu */
+};
+
+/** limit doby a počtu kódů převodu, sdílený všemi vlákny převodu */
+struct budget {
+	int64_t	  deadline;		/** čas konce převodu (clockNow), 0 = bez limitu */
+	int64_t	  codeLimit;	/** nejvyšší počet kódů LZW, 0 = bez limitu */
+	int64_t	  codes;		/** počet dosud započtených kódů */
+	const int* cancel;		/** příznak zrušení převodu, případně NULL */
+	int8_t	  expired;		/** limit byl překročen nebo převod zrušen */
+};
+
+/** vstupní GIF soubor zpřístupněný v paměti (namapovaný, načtený celý, nebo
+ * čtený postupně z proudu přes buffer s daty dopředu) */
+struct gifInput {
+	const u_int8_t* data;	/** začátek dostupných dat GIF souboru */
+	size_t	  length;		/** délka dostupných dat */
+	size_t	  pos;			/** aktuální pozice čtení v dostupných datech */
+	void*	  map;			/** začátek namapované oblasti (zarovnaný) */
+	size_t	  mapLength;	/** délka namapované oblasti */
+	u_int8_t* buffer;		/** buffer v případě, že mapování nelze použít */
+	FILE*	  stream;		/** proud, ze kterého se data teprve čtou, jinak NULL */
+	size_t	  capacity;		/** velikost bufferu proudu */
+	int64_t	  base;			/** pozice začátku bufferu v proudu */
+	struct budget* budget;	/** limit převodu, NULL = bez limitu */
+	struct decoderInfo* decoder;	/** dekodér se slovníkem ponechaným mezi
+									 * převody, NULL = vlastní pro každý snímek */
+};
+
+/** kam se zapisuje výstupní BMP soubor -- do souboru, nebo do bufferu
+ * v paměti, který převod alokuje a předá volajícímu */
+struct bmpSink {
+	FILE*	  file;			/** výstupní soubor, NULL = výstup do paměti */
+	u_int8_t* data;			/** BMP soubor v paměti */
+	size_t	  size;			/** velikost BMP souboru v paměti */
+	int64_t	  memoryLimit;	/** největší buffer výstupu do proudu, větší výstup
+							 * se připraví v dočasném souboru; 0 = MEMORY_LIMIT */
+};
+
+/** výstupní BMP soubor připravený v paměti (namapovaný nebo v bufferu) */
+struct bmpOutput {
+	u_int8_t* data;			/** začátek dat BMP souboru */
+	size_t	  size;			/** velikost BMP souboru */
+	struct bmpSink* sink;	/** kam se výstup zapíše */
+	off_t	  offset;		/** pozice ve výstupním souboru, kam se zapisuje */
+	void*	  map;			/** začátek namapované oblasti (zarovnaný) */
+	size_t	  mapLength;	/** délka namapované oblasti */
+	FILE*	  spool;		/** dočasný soubor pro výstup do proudu, jinak NULL */
+};
+
+/** cíl dekódovaných pixelů -- řádky rámce v libovolném pořadí v paměti */
+struct imageTarget {
+	u_int8_t* base;			/** ukazatel na první (horní) řádek rámce */
+	ptrdiff_t stride;		/** vzdálenost řádků, záporná pro BMP zdola nahoru */
+	u_int16_t width;		/** šířka rámce */
+	u_int16_t height;		/** výška rámce */
+	u_int16_t visibleWidth;	/** kolik sloupců rámce leží v obrázku */
+	u_int16_t visibleHeight;/** kolik řádků rámce leží v obrázku */
+	u_int8_t  interlaced;	/** řádky přicházejí prokládaně */
+	/** volá se po dokončení každého viditelného řádku, případně NULL */
+	void (*rowDone)(struct imageTarget* target, int32_t y, const u_int8_t* row);
+	/** volá se po dokončení průchodu 1 až 3 prokládaného rámce, případně NULL */
+	void (*passDone)(struct imageTarget* target, int32_t pass);
+	void*	  user;			/** data pro rowDone a passDone */
+};
+
 /** položka slovníku */
 struct dictionaryItem {
 	int16_t	length;			/** délka řetězce aktuální položky */
+	int16_t	capacity;		/** velikost alokovaného řetězce, 0 = nealokován */
 	u_int8_t* string;	/** řetězec */
 };
 
@@ -88,12 +173,193 @@ struct decoderInfo {
 	int16_t		  max;			/** odpovídající maximální hodnota */
 	int16_t		  last;			/** poslední načtený kódový znak */
 	int16_t		  next;			/** index následujícího kódového znaku */
-	tGIF2BMP	  *gif2png;		/** ukazatel na počítadlo */
-	u_int8_t* image;		/** ukazatel na data obrázku */
-	int32_t		  imIndex;		/** index v datech obrázku */
+	struct gifInput* in;		/** vstup, ze kterého se čtou sub-bloky */
+	size_t		  blockLeft;	/** zbývající byte aktuálního sub-bloku */
+	u_int32_t	  bitBuffer;	/** načtené a dosud nepoužité bity */
+	u_int8_t	  bitCount;		/** počet platných bitů v bitBuffer */
+	struct imageTarget* target;	/** kam se zapisují dekódované pixely */
+	u_int8_t*	  row;			/** aktuálně plněný řádek (NULL mimo obrázek) */
+	int32_t		  x;			/** pozice v aktuálním řádku */
+	int32_t		  y;			/** číslo aktuálního řádku rámce */
+	u_int8_t	  pass;			/** průchod prokládaného obrázku */
+	int64_t		  imIndex;		/** počet dekódovaných pixelů */
+	int64_t		  codes;		/** počet načtených kódů */
+	int64_t		  clearCodes;	/** počet načtených clear code */
+	int64_t		  maxString;	/** nejdelší řetězec slovníku */
+	int64_t		  allocations;	/** počet alokací řetězců slovníku */
 	struct dictionaryItem dict[1<<MAX_DICT_SIZE];	/** ukazatel na slovník */
 };
 
+/** stav ponechaný mezi převody (tGIF2BMPContext) -- sekvenční dekodér,
+ * jehož řetězce slovníku zůstávají alokované */
+struct GIF2BMPContext {
+	struct decoderInfo decoder;
+};
+
+/** řetězec tabulky dvoufázového dekodéru -- odkaz na prefix a poslední znak */
+struct lzwEntry {
+	int32_t	  prefix;		/** položka s prefixem řetězce (-1 u kořene) */
+	u_int16_t length;		/** délka řetězce */
+	u_int8_t  suffix;		/** poslední znak řetězce */
+	u_int8_t  first;		/** první znak řetězce */
+};
+
+/** výsledek první fáze dvoufázového dekodéru */
+struct lzwTable {
+	struct lzwEntry* entries;	/** řetězce ze všech slovníků proudu */
+	int64_t	  count;		/** počet řetězců */
+	int64_t	  capacity;		/** alokovaný počet řetězců */
+	int32_t*  codes;		/** posloupnost řetězců na výstupu */
+	int64_t	  codeCount;	/** počet kódů na výstupu */
+	int64_t	  codeCapacity;	/** alokovaný počet kódů */
+	size_t*	  checkpoints;	/** pozice na výstupu každého CHECKPOINT-tého kódu */
+	int64_t	  checkpointCount;	/** počet kontrolních bodů */
+	int64_t	  checkpointCapacity;	/** alokovaný počet kontrolních bodů */
+	size_t	  total;		/** celkový počet pixelů na výstupu */
+	int64_t	  maxLength;	/** nejdelší řetězec */
+	int64_t	  allocations;	/** počet zvětšení polí tabulky */
+};
+
+/** úsek kódů rozvíjený jedním vláknem ve druhé fázi */
+struct expandJob {
+	struct lzwTable* table;	/** tabulka z první fáze */
+	struct imageTarget* target;	/** cíl dekódovaných pixelů */
+	u_int8_t** rows;		/** adresy řádků v pořadí příchodu (NULL mimo obrázek) */
+	int64_t	  from;			/** první kód úseku */
+	int64_t	  to;			/** kód za koncem úseku */
+	size_t	  offset;		/** pozice prvního kódu na výstupu */
+	size_t	  limit;		/** počet pixelů rámce */
+};
+
+/** po kolika kódech se zaznamenává pozice na výstupu */
+#define CHECKPOINT 1024
+
+/** informace o jednom snímku animace získané předběžným průchodem */
+struct frameInfo {
+	size_t	  offset;		/** pozice hlavičky bloku obrázku ve vstupu */
+	struct imgHeader im;	/** hlavička bloku obrázku */
+	u_int8_t  disposal;		/** způsob odstranění snímku po zobrazení */
+	u_int8_t  transparent;	/** je definována průhledná barva? */
+	u_int8_t  transparentIndex;	/** index průhledné barvy */
+	u_int16_t delay;		/** doba zobrazení v setinách sekundy */
+	u_int8_t* data;			/** dekódované indexy pixelů snímku */
+	int8_t	  state;		/** stav dekódování snímku */
+	u_int32_t colors[256];	/** předpočítaná tabulka barev snímku (BGRA) */
+	u_int8_t  mapped;		/** indexy lokální palety se převádí přes map */
+	u_int8_t  map[256];		/** nejbližší barvy lokální palety v paletě výstupu */
+};
+
+/** sdílený stav vláken dekódujících snímky animace */
+struct framePool {
+	pthread_mutex_t lock;	/** zámek sdíleného stavu */
+	pthread_cond_t cond;	/** změna stavu snímku nebo posun okna */
+	struct gifInput* in;	/** vstupní soubor (pouze pro čtení) */
+	const tGIF2BMPOptions* options;	/** volby převodu */
+	const struct qrgb* palette;	/** globální paleta barev */
+	int32_t	  colors;		/** počet barev globální palety */
+	int16_t	  bitCount;		/** barevná hloubka výstupu */
+	const u_int32_t* outputTable;	/** paleta paletového výstupu */
+	int32_t	  outputColors;	/** počet barev palety výstupu */
+	struct frameInfo* frames;	/** nalezené snímky */
+	int32_t	  count;		/** počet snímků */
+	int32_t	  next;			/** další snímek k dekódování */
+	int32_t	  composed;		/** počet již složených snímků */
+	int32_t	  window;		/** kolik snímků smí být dekódováno dopředu */
+	int32_t	  lzwThreads;	/** vlákna dvoufázového dekódování jednoho snímku */
+	int8_t	  abort;		/** ukončení vláken */
+};
+
+/** obrázek zmenšovaný během dekódování */
+struct thumbnail {
+	int32_t	  factor;		/** výstupní pixel pokrývá factor x factor pixelů */
+	int32_t	  width;		/** šířka zmenšeného obrázku */
+	int32_t	  height;		/** výška zmenšeného obrázku */
+	int32_t	  col0;			/** poloha rámce v logické obrazovce */
+	int32_t	  row0;
+	int16_t	  bitCount;		/** barevná hloubka výstupu */
+	u_int32_t background;	/** barva pozadí (BGRA) */
+	const u_int32_t* colors;	/** tabulka barev rámce */
+	u_int8_t* pixels;		/** zmenšený obrázek (indexy nebo BGRA) */
+	u_int64_t* sums;		/** součty složek B, G, R a počet neprůhledných pixelů */
+};
+
+/** jeden výřez obrázku */
+struct cropRegion {
+	int32_t	  x;			/** poloha výřezu v logické obrazovce */
+	int32_t	  y;
+	int32_t	  width;		/** rozměry výřezu (oříznuté na obrazovku) */
+	int32_t	  height;
+	u_int8_t* pixels;		/** pixely výřezu (indexy nebo BGRA) */
+};
+
+/** výřezy vytvářené jedním průchodem dekodéru */
+struct cropSet {
+	struct cropRegion* regions;	/** výřezy */
+	int32_t	  count;		/** počet výřezů */
+	int32_t	  col0;			/** poloha rámce v logické obrazovce */
+	int32_t	  row0;
+	int16_t	  bitCount;		/** barevná hloubka výstupu */
+	const u_int32_t* colors;	/** tabulka barev rámce */
+};
+
+/** první snímek zapisovaný po řádcích přímo do výstupu bez plátna */
+struct rowWriter {
+	int32_t	  width;		/** rozměry logické obrazovky */
+	int32_t	  height;
+	int32_t	  col0;			/** poloha rámce v logické obrazovce */
+	int32_t	  visibleWidth;	/** kolik sloupců rámce leží v obrázku */
+	int32_t	  row0;
+	int16_t	  bitCount;		/** barevná hloubka výstupu */
+	u_int32_t background;	/** pozadí (index nebo barva) */
+	const u_int32_t* colors;	/** tabulka barev rámce */
+	u_int8_t* line;			/** řádek obrazovky ve formátu plátna */
+	u_int8_t* pixels;		/** obrazová data nekomprimovaného výstupu */
+	int32_t	  rowLength;	/** délka řádku výstupu */
+	struct rleBuffer* rows;	/** řádky v kódování BI_RLE8, jinak NULL */
+};
+
+/** náhled prokládaného obrázku, který se dekóduje přímo do výstupu */
+struct preview {
+	const tGIF2BMPOptions* options;	/** volby s funkcí pro předání náhledu */
+	struct bmpOutput* out;	/** výstup, do kterého zapisuje dekodér */
+	u_int8_t* buffer;		/** kopie výstupu s doplněnými řádky */
+	int32_t	  rowLength;	/** délka řádku BMP */
+	int32_t	  height;		/** výška obrázku */
+	int32_t	  row0;			/** první řádek rámce v obrázku */
+};
+
+/** první snímek připravený k dekódování po řádcích */
+struct firstFrame {
+	struct gifHeader gifh;	/** hlavička GIF souboru */
+	struct frameInfo frame;	/** snímek a jeho rozšíření */
+	struct gifInput* data;	/** vstup, pozice za hlavičkou bloku obrázku */
+	u_int32_t table[256];	/** paleta snímku pro BMP */
+	int32_t	  colors;		/** počet barev palety snímku */
+	u_int32_t background;	/** barva pozadí z globální palety (BGRA) */
+	struct imageTarget target;	/** rozměry rámce a jeho viditelná část */
+};
+
+/** stavy dekódování snímku */
+#define FRAME_PENDING 0
+#define FRAME_DECODED 1
+#define FRAME_FAILED -1
+
+/** za posledním blokem obrázku je konec souboru (readNextImage) */
+#define IMAGE_END 1
+
+/** způsoby odstranění snímku (Graphic Control Extension) */
+#define DISPOSE_BACKGROUND 2
+#define DISPOSE_PREVIOUS 3
+
+/** kolik snímků mohou vlákna dekódovat před skládáním */
+#define DECODE_WINDOW 64
+
+/** výchozí limit paměti pro buffery s indexy a plátno */
+#define MEMORY_LIMIT ((int64_t)1 << 30)
+
+/** po kolika kódech dekodér kontroluje limit převodu (mocnina dvou) */
+#define BUDGET_CODES 4096
+
 #ifdef DEBUG
 #define PRINT_DEBUG(s)	fprintf(stderr, s);
 #else
@@ -106,13 +372,344 @@ struct decoderInfo {
 #define PLAIN_TEXT_EXTENSION_BLOCK 0x01
 #define APPLICATION_EXTENSION_BLOCK 0xff
 #define BLOCK_TERMINATOR 0x00
+#define TRAILER_MARKER 0x3b
+
+/** kolik byte se z proudu čte najednou */
+#define READ_AHEAD 65536
+
+/** velikost hlaviček BMP souboru (file header + info header) */
+#define BMP_HEADERS_SIZE (14 + sizeof(struct bmpInfoHeader))
+
+/** komprese BMP (biCompression) */
+#define BI_RGB 0
+#define BI_RLE8 1
+
+/**
+ * Zpřístupnění vstupního souboru v paměti. Běžný soubor se namapuje pomocí
+ * mmap, ostatní vstupy (roura, terminál) se buď čtou postupně jen dopředu,
+ * nebo se načtou celé do bufferu, pokud převod potřebuje náhodný přístup.
+ * @param in struktura se vstupem
+ * @param inputFile vstupní soubor
+ * @param stream nenulové, pokud stačí čtení jen dopředu
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t inputOpen(struct gifInput* in, FILE* inputFile, int8_t stream) {
+	struct stat st;
+	int fd = fileno(inputFile);
+	off_t offset = ftello(inputFile);
+
+	memset(in, 0, sizeof(*in));
+
+	/** běžný soubor namapujeme od aktuální pozice až do konce */
+	if (fd >= 0 && offset >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+			st.st_size > offset) {
+		off_t aligned = offset - offset % sysconf(_SC_PAGESIZE);
+
+		in->mapLength = st.st_size - aligned;
+		in->map = mmap(NULL, in->mapLength, PROT_READ, MAP_PRIVATE, fd, aligned);
+		if (in->map != MAP_FAILED) {
+			madvise(in->map, in->mapLength, MADV_SEQUENTIAL);
+			in->data = (u_int8_t*)in->map + (offset - aligned);
+			in->length = st.st_size - offset;
+			/** posuneme pozici souboru, jako bychom jej přečetli */
+			fseeko(inputFile, st.st_size, SEEK_SET);
+			return(GIF2BMPOK);
+		}
+		in->map = NULL;
+		in->mapLength = 0;
+	}
+
+	/** mapování nelze použít, data se budou načítat až při čtení */
+	if (stream) {
+		in->stream = inputFile;
+		return(GIF2BMPOK);
+	}
+	
+	/** nebo načteme celý vstup do bufferu */
+	size_t capacity = 0;
+	for (;;) {
+		if (in->length == capacity) {
+			capacity = capacity ? capacity * 2 : 65536;
+			u_int8_t* buffer = realloc(in->buffer, capacity);
+			if (buffer == NULL) {
+				free(in->buffer);
+				in->buffer = NULL;
+				return(GIF2BMPFail);
+			}
+			in->buffer = buffer;
+		}
+		size_t readed = fread(in->buffer + in->length, 1, capacity - in->length,
+								inputFile);
+		if (readed == 0) {
+			break;
+		}
+		in->length += readed;
+	}
+	in->data = in->buffer;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Zpřístupnění vstupu, který je celý v paměti volajícího
+ * @param in struktura se vstupem
+ * @param data GIF soubor
+ * @param length délka GIF souboru
+ */
+static void inputMemory(struct gifInput* in, const u_int8_t* data, size_t length) {
+	memset(in, 0, sizeof(*in));
+	in->data = data;
+	in->length = length;
+}
+
+/**
+ * Uvolnění vstupu
+ * @param in struktura se vstupem
+ */
+static void inputClose(struct gifInput* in) {
+	if (in->map != NULL) {
+		munmap(in->map, in->mapLength);
+	}
+	free(in->buffer);
+	memset(in, 0, sizeof(*in));
+}
+
+/**
+ * Zajištění dostupnosti dat na vstupu. U proudu se již přečtená data
+ * zahodí (posunou na začátek bufferu) a buffer se doplní čtením dopředu.
+ * @param in struktura se vstupem
+ * @param length kolik byte musí být od aktuální pozice dostupných
+ * @return GIF2BMPOK pokud jsou data dostupná, jinak GIF2BMPFail
+ */
+static int8_t inputFill(struct gifInput* in, size_t length) {
+	if (in->length - in->pos >= length) {
+		return(GIF2BMPOK);
+	}
+	if (in->stream == NULL) {
+		return(GIF2BMPFail);
+	}
+	
+	/** přečtená data už nebudou potřeba, zbytek přesuneme na začátek */
+	if (in->pos > 0) {
+		memmove(in->buffer, in->buffer + in->pos, in->length - in->pos);
+		in->base += in->pos;
+		in->length -= in->pos;
+		in->pos = 0;
+	}
+	while (in->length < length) {
+		size_t capacity = length > READ_AHEAD ? length : READ_AHEAD;
+		if (in->capacity < capacity) {
+			u_int8_t* buffer = realloc(in->buffer, capacity);
+			if (buffer == NULL) {
+				return(GIF2BMPFail);
+			}
+			in->buffer = buffer;
+			in->capacity = capacity;
+			in->data = buffer;
+		}
+		size_t readed = fread(in->buffer + in->length, 1,
+								in->capacity - in->length, in->stream);
+		if (readed == 0) {
+			return(GIF2BMPFail);
+		}
+		in->length += readed;
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Pozice čtení od začátku vstupu
+ * @param in struktura se vstupem
+ * @return počet byte vstupu před aktuální pozicí
+ */
+static int64_t inputTell(struct gifInput* in) {
+	return(in->base + in->pos);
+}
+
+/**
+ * Délka celého vstupu; zbytek proudu se přečte a zahodí
+ * @param in struktura se vstupem
+ * @return délka vstupu v byte
+ */
+static int64_t inputSize(struct gifInput* in) {
+	in->pos = in->length;
+	while (inputFill(in, 1) == GIF2BMPOK) {
+		in->pos = in->length;
+	}
+	return(in->base + in->length);
+}
+
+/**
+ * Přečtení dat ze vstupu
+ * @param in struktura se vstupem
+ * @param dst kam se mají data uložit
+ * @param length kolik byte se má přečíst
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t inputRead(struct gifInput* in, void* dst, size_t length) {
+	if (inputFill(in, length) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	memcpy(dst, in->data + in->pos, length);
+	in->pos += length;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Přeskočení dat na vstupu
+ * @param in struktura se vstupem
+ * @param length kolik byte se má přeskočit
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t inputSkip(struct gifInput* in, size_t length) {
+	/** proud se přeskakuje po částech, buffer se kvůli tomu nezvětšuje */
+	while (in->length - in->pos < length) {
+		length -= in->length - in->pos;
+		in->pos = in->length;
+		if (inputFill(in, 1) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+	}
+	in->pos += length;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Přeskočení bloků rozšíření -- blok začíná značkou délky bloku (1B) a je
+ * ukončen značkou 0x00
+ * @param in vstupní soubor
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t skipBlocks(struct gifInput* in) {
+	u_int8_t blockSize;
+	do {
+		if (inputRead(in, &blockSize, sizeof(blockSize)) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		#ifdef DEBUG
+		fprintf(stderr, "block size: %d\n", blockSize);
+		#endif
+		/** sub-blok přeskočíme pouhým posunem pozice */
+		if (inputSkip(in, blockSize) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+	} while (blockSize != BLOCK_TERMINATOR);
+	return(GIF2BMPOK);
+}
+
+/**
+ * Příprava výstupního BMP souboru dané velikosti. Běžný soubor se zvětší na
+ * požadovanou velikost a namapuje, jinak se data připraví v bufferu a zapíší
+ * (nebo při výstupu do paměti předají) až při uzavření.
+ * @param out struktura s výstupem
+ * @param sink kam se výstup zapíše
+ * @param size velikost BMP souboru
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t bmpOutputOpen(struct bmpOutput* out, struct bmpSink* sink,
+	size_t size) {
+	FILE* outputFile = sink->file;
+	struct stat st;
+	int fd;
+
+	/** velikost souboru v hlavičce BMP je 32bitová */
+	if (size > UINT32_MAX) {
+		return(GIF2BMPFail);
+	}
+	memset(out, 0, sizeof(*out));
+	out->sink = sink;
+	out->size = size;
+
+	fd = -1;
+	if (outputFile != NULL) {
+		fflush(outputFile);
+		fd = fileno(outputFile);
+		out->offset = ftello(outputFile);
+	}
+	if (fd >= 0 && out->offset >= 0 && fstat(fd, &st) == 0 &&
+			S_ISREG(st.st_mode) && ftruncate(fd, out->offset + size) == 0) {
+		off_t aligned = out->offset - out->offset % sysconf(_SC_PAGESIZE);
+
+		out->mapLength = out->offset + size - aligned;
+		out->map = mmap(NULL, out->mapLength, PROT_READ | PROT_WRITE,
+						MAP_SHARED, fd, aligned);
+		if (out->map != MAP_FAILED) {
+			out->data = (u_int8_t*)out->map + (out->offset - aligned);
+			return(GIF2BMPOK);
+		}
+		out->map = NULL;
+		out->mapLength = 0;
+	}
+
+	/** výstup do proudu (stdout, roura) nad limit paměti připravíme
+	 * v namapovaném dočasném souboru, do proudu se zapíše při uzavření */
+	if (outputFile != NULL && (int64_t)size > (sink->memoryLimit > 0 ?
+			sink->memoryLimit : MEMORY_LIMIT) && (out->spool = tmpfile()) != NULL) {
+		if (ftruncate(fileno(out->spool), size) == 0) {
+			out->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+							fileno(out->spool), 0);
+			if (out->map != MAP_FAILED) {
+				out->mapLength = size;
+				out->data = out->map;
+				return(GIF2BMPOK);
+			}
+			out->map = NULL;
+		}
+		fclose(out->spool);
+		out->spool = NULL;
+	}
+
+	/** mapování nelze použít (stdout, roura, paměť), data připravíme
+	 * v bufferu */
+	out->data = calloc(size, 1);
+	if (out->data == NULL) {
+		return(GIF2BMPFail);
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Dokončení zápisu BMP souboru
+ * @param out struktura s výstupem
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t bmpOutputClose(struct bmpOutput* out) {
+	int8_t retval = GIF2BMPOK;
+
+	if (out->spool != NULL) {
+		/** dočasný soubor přepíšeme do proudu a zrušíme */
+		madvise(out->map, out->mapLength, MADV_SEQUENTIAL);
+		if (fwrite(out->data, 1, out->size, out->sink->file) != out->size) {
+			retval = GIF2BMPFail;
+		}
+		munmap(out->map, out->mapLength);
+		fclose(out->spool);
+	} else if (out->map != NULL) {
+		if (munmap(out->map, out->mapLength) != 0) {
+			retval = GIF2BMPFail;
+		}
+		/** posuneme pozici souboru za zapsaná data */
+		fseeko(out->sink->file, out->offset + out->size, SEEK_SET);
+	} else if (out->data != NULL && out->sink->file == NULL) {
+		/** buffer převezme volající */
+		free(out->sink->data);
+		out->sink->data = out->data;
+		out->sink->size = out->size;
+	} else if (out->data != NULL) {
+		if (fwrite(out->data, 1, out->size, out->sink->file) != out->size) {
+			retval = GIF2BMPFail;
+		}
+		free(out->data);
+	}
+	memset(out, 0, sizeof(*out));
+	return(retval);
+}
 
 /**
  * vrací informace o globální paletě
  * @param bits načtení informace o paletě
  * @param p struktura pro uložení informací o globální paletě
  */
-void getGlobalPaletteInfo(u_int8_t bits, struct globalPaletteInfo* p) {
+static void getGlobalPaletteInfo(u_int8_t bits, struct globalPaletteInfo* p) {
 	p->length = (bits & 0x07);
 	p->sorted = (bits & 0x08) >> 3;
 	p->bpp 	  = ((bits & 0x70) >> 4);
@@ -124,7 +721,7 @@ void getGlobalPaletteInfo(u_int8_t bits, struct globalPaletteInfo* p) {
  * @param bits načtené informace o paletě
  * @param p struktura pro uložení informací o lokální paletě
  */
-void getLocalPaletteInfo(u_int8_t bits, struct localPaletteInfo *p) {
+static void getLocalPaletteInfo(u_int8_t bits, struct localPaletteInfo *p) {
 	p->length     = (bits & 0x07);
 	p->reserved   = (bits & 0x18) >> 3;
 	p->sorted     = (bits & 0x20) >> 5;
@@ -136,248 +733,698 @@ void getLocalPaletteInfo(u_int8_t bits, struct localPaletteInfo *p) {
 	#endif
 }
 
+/**
+ * Výpočet délky řádku BMP souboru včetně výplně na násobek 4 byte
+ * @param width šířka obrázku
+ * @param bitCount počet bitů na pixel
+ * @return délka řádku v byte
+ */
+static int32_t bmpRowLength(int32_t width, int16_t bitCount) {
+	return((((int64_t)width * bitCount + 31) / 32) * 4);
+}
+
+/**
+ * Výpočet velikosti výsledného BMP souboru
+ * @param width šířka BMP obrázku
+ * @param height výška BMP obrázku
+ * @param bitCount počet bitů na pixel
+ * @param colorCount počet barev v paletě BMP (0 pro obrázky bez palety)
+ * @return velikost BMP souboru v byte
+ */
+static size_t bmpFileSize(int32_t width, int32_t height, int16_t bitCount,
+	int32_t colorCount) {
+	return(BMP_HEADERS_SIZE + sizeof(struct qrgb) * colorCount +
+			(size_t)bmpRowLength(width, bitCount) * height);
+}
+
+/**
+ * Předpočítání palety GIF do tabulky barev ve formátu BMP (B, G, R, A
+ * v paměti). Tabulku používá jak paleta BMP souboru, tak převod indexů na
+ * barvy pixelů, prohazování složek se tak provádí jen jednou.
+ * @param table tabulka 256 barev
+ * @param palette paleta GIF
+ * @param colors počet barev palety GIF
+ * @param transparent index průhledné barvy, záporný pokud není definována
+ */
+static void buildColorTable(u_int32_t* table, const struct qrgb* palette,
+	int32_t colors, int32_t transparent) {
+	for (int32_t i = 0; i < 256; i++) {
+		if (i < colors) {
+			table[i] = ((u_int32_t)palette[i].b) | ((u_int32_t)palette[i].g << 8) |
+				((u_int32_t)palette[i].r << 16) | 0xff000000u;
+		} else {
+			table[i] = 0xff000000u;
+		}
+	}
+	/** průhledná barva má nulovou složku alfa */
+	if (transparent >= 0) {
+		table[transparent] &= 0x00ffffffu;
+	}
+}
+
 /**
  * Zápis hlavičky BMP souboru
- * @param outputFile soubor do kterého se provádí zápis
- * @param gifh hlavička s informacemi o původním GIF souboru
- * @param gpi hlavička s informacemi z globální palety
- * @param palette barevná paleta
- */
-int8_t writeBmpHeader(FILE* outputFile, struct gifHeader* gifh,
-				struct globalPaletteInfo* gpi, struct qrgb* palette, 
-				tGIF2BMP* gif2bmp) {
+ * @param out výstup, do kterého se provádí zápis
+ * @param width šířka BMP obrázku
+ * @param height výška BMP obrázku
+ * @param bitCount počet bitů na pixel
+ * @param compression komprese obrazových dat (BI_RGB, BI_RLE8)
+ * @param table předpočítaná tabulka barev palety
+ * @param colorCount počet barev v paletě BMP (0 pro obrázky bez palety)
+ * @param gif2bmp počítadlo přečtených/zapsaných byte
+ */
+static int8_t writeBmpHeader(struct bmpOutput* out, int32_t width, int32_t height,
+				int16_t bitCount, int32_t compression, const u_int32_t* table,
+				int32_t colorCount, tGIF2BMP* gif2bmp) {
 					
 	u_int8_t bm[] = "BM";
 	int16_t res0_1 = 0;
+	u_int8_t* dst = out->data;
 	
-	//POUZE pro 256 barevný GIF!!!!
-	int32_t offset = 1078;
+	/** data začínají za hlavičkami a paletou */
+	int32_t offset = BMP_HEADERS_SIZE + sizeof(struct qrgb) * colorCount;
 
 	/** naplnění struktury s hlavičkou BMP souboru */
 	struct bmpInfoHeader bmpi = {sizeof(struct bmpInfoHeader),	/** velikost hlavičky */ 
-			gifh->width,		/** šířka obrázku */
-			gifh->height,		/** výška obrázku */
+			width,				/** šířka obrázku */
+			height,				/** výška obrázku */
 			1,					/** vždy 1, počet bitových rovin */
-			gpi->bpp+1,			/** barevná hloubka */
-			0, 					/** komprese, není použita */
-			0, 					/** velikost obrázku, lze nula pokud není komprese */
+			bitCount,			/** barevná hloubka */
+			compression,		/** komprese */
+			/** velikost obrázku, lze nula pokud není komprese */
+			compression == BI_RGB ? 0 : (int32_t)(out->size - offset),
 			72, 				/** dpi */
 			72, 				/** dpi */
-			1 << (gpi->bpp+1),	/** barev v paletě */
+			colorCount,			/** barev v paletě */
 			0};					/** použitých barev */
 			
-	/** počet pixelů */
-	int32_t pixels = gifh->width * gifh->height +
-				(((((gifh->width-1)/4)+1)*4) - gifh->width) * gifh->height;
-	
 	/** velikost souboru */
-	int32_t size = pixels + offset;
+	u_int32_t size = out->size;
 	
 	/** zápis hlavičky souboru BMP */
-	fwrite(bm, 2, 1, outputFile);
-	gif2bmp->bmpSize += 2;
-	fwrite(&size, sizeof(size), 1, outputFile);
-	gif2bmp->bmpSize += sizeof(size);
-	fwrite(&res0_1, sizeof(res0_1), 1, outputFile);
-	gif2bmp->bmpSize += sizeof(res0_1);
-	fwrite(&res0_1, sizeof(res0_1), 1, outputFile);
-	gif2bmp->bmpSize += sizeof(res0_1);
-	fwrite(&offset, sizeof(offset), 1, outputFile);
-	gif2bmp->bmpSize += sizeof(offset);
+	memcpy(dst, bm, 2);
+	dst += 2;
+	memcpy(dst, &size, sizeof(size));
+	dst += sizeof(size);
+	memcpy(dst, &res0_1, sizeof(res0_1));
+	dst += sizeof(res0_1);
+	memcpy(dst, &res0_1, sizeof(res0_1));
+	dst += sizeof(res0_1);
+	memcpy(dst, &offset, sizeof(offset));
+	dst += sizeof(offset);
 	
 	/** zápis informační hlavičky */
-	fwrite(&bmpi, sizeof(bmpi), 1, outputFile);
-	gif2bmp->bmpSize += sizeof(bmpi);
-	
-	/** prohození červené a modré barevné složky */
-	u_int8_t tmp;
-	for (int16_t i = 0; i < (1 << (gpi->bpp+1)); i++) {
-		tmp = palette[i].r;
-		palette[i].r = palette[i].b;
-		palette[i].b = tmp;
-		
+	memcpy(dst, &bmpi, sizeof(bmpi));
+	dst += sizeof(bmpi);
+	
+	/** paleta BMP je předpočítaná tabulka s vynulovanou rezervovanou složkou */
+	for (int32_t i = 0; i < colorCount; i++) {
+		u_int32_t color = table[i] & 0x00ffffffu;
+		memcpy(dst, &color, sizeof(color));
+		dst += sizeof(color);
 	}
-	fwrite(&palette[0], sizeof(palette[0]) * (1<<(gpi->bpp+1)), 1, outputFile);
-	gif2bmp->bmpSize += sizeof(palette[0]) * (1<<(gpi->bpp+1));
+	gif2bmp->bmpSize += offset;
 	return(0);
 }
 
 /**
- * zapsání BMP dat
- * @param outputfile výstupní soubor
- * @param gifh hlavička GIF souboru
- * @param gpi informace o globální paletě
- * @param palette barevná paleta
- * @param data data k zapsání do BMP souboru
- * @param interlaced informace o tom zda je obrázek prokládaný nebo ne
- * @param gif2bmp počítadlo přečtených/zapsaných byte
+ * Je k dispozici instrukční sada AVX2?
+ * @return nenulová hodnota pokud procesor podporuje AVX2
  */
-int8_t writeBmpData(FILE* outputFile, struct gifHeader* gifh, struct
-	globalPaletteInfo* gpi, struct qrgb* palette, u_int8_t* data, 
-	u_int8_t interlaced, tGIF2BMP* gif2bmp) {
-		
-	int32_t padlen = ((((gifh->width-1)/4)+1)*4)- gifh->width;
-	u_int8_t padding[] = {0, 0, 0};
-	
-	/** zápis hlavičky BMP souboru */
-	if (writeBmpHeader(outputFile, gifh, gpi, palette, gif2bmp) == GIF2BMPFail) {
-		return(GIF2BMPFail);
-	}
-	
-	/** pokud je obrázek prokládaný */
-	if (interlaced) { /** vytvoříme nový obrázek se správným uspořádáním řádků */
-		u_int8_t* new_data = malloc(sizeof(u_int8_t) * 
-												gifh->width * gifh->height);
-		int32_t j = 0;
-		for (int32_t i = 0; i < gifh->height; i += 8, j++) {
-			memcpy(&(new_data[i*gifh->width]), &(data[j*gifh->width]), gifh->width);
-		}
-		for (int32_t i = 4; i < gifh->height; i += 8, j++) {
-			memcpy(&(new_data[i*gifh->width]), &(data[j*gifh->width]), gifh->width);
-		}
-		for (int32_t i = 2; i < gifh->height; i += 4, j++) {
-			memcpy(&(new_data[i*gifh->width]), &(data[j*gifh->width]), gifh->width);
-		}
-		for (int32_t i = 1; i < gifh->height; i += 2, j++) {
-			memcpy(&(new_data[i*gifh->width]), &(data[j*gifh->width]), gifh->width);
+static int haveAVX2(void) {
+#ifdef HAVE_AVX2_KERNELS
+	return(__builtin_cpu_supports("avx2"));
+#else
+	return(0);
+#endif
+}
+
+/**
+ * Složení řádku indexů do řádku barev BGRA podle tabulky barev (skalární
+ * verze). Pixely s nulovou alfou (průhledná barva) cíl nepřepisují.
+ * @param dst řádek barev
+ * @param src řádek indexů
+ * @param count počet pixelů
+ * @param table tabulka barev
+ */
+static void composeRowScalar(u_int32_t* dst, const u_int8_t* src, int32_t count,
+	const u_int32_t* table) {
+	for (int32_t i = 0; i < count; i++) {
+		u_int32_t color = table[src[i]];
+		if (color & 0xff000000u) {
+			dst[i] = color;
 		}
-		free(data);			/** uvolníme prokládaný obrázek */
-		data = new_data;	/** a nastavíme ukazatel */
 	}
-	
-	for (int32_t row = gifh->height; row > 0; row--) { /** zápis */
-		/** zapisuj řádky od konce bufferru, tím převrátíš obrázek podle osy y */
-		if (fwrite(&data[(row-1) * gifh->width], sizeof(u_int8_t), 
-				gifh->width, outputFile) != gifh->width) {
-			return(GIF2BMPFail);
-		}
-		gif2bmp->bmpSize += gifh->width;
-		
-		/** zapiš případnou výplň (šířka obrázku není násobek 4)*/
-		if (padlen) {
-			if (fwrite(padding, sizeof(u_int8_t), padlen, outputFile) == 0) {
-				return(GIF2BMPFail);
-			}
-			gif2bmp->bmpSize += padlen;
-		}
+}
+
+/**
+ * Zápis řádku barev BGRA jako 24bitových pixelů BGR (skalární verze)
+ * @param dst řádek BMP
+ * @param src řádek barev
+ * @param count počet pixelů
+ */
+static void packRow24Scalar(u_int8_t* dst, const u_int32_t* src, int32_t count) {
+	for (int32_t i = 0; i < count; i++) {
+		dst[3*i] = src[i];
+		dst[3*i + 1] = src[i] >> 8;
+		dst[3*i + 2] = src[i] >> 16;
 	}
-	/** uvolnění paměti s obrázkem */
-	free(data);
-	return(GIF2BMPOK);
 }
 
+#ifdef HAVE_AVX2_KERNELS
 /**
- * Načtení jednoho bitu ze vstupního souboru
- * @param inputFile	soubor z kterého probíhá čtení
- * @param ch hodnota načítaného bitu
- * @param codedSize velikost zakódovaného vstupu
- * @return AHEDOK pokud se podařilo načíst byte ze vstupního souboru, jinak
- * 		AHEDfail
+ * Složení řádku indexů do řádku barev BGRA -- verze AVX2, osm pixelů najednou
+ * vyhledá v tabulce instrukce gather, průhledné pixely odfiltruje maska
+ * odvozená z nejvyššího bitu alfy
  */
-int8_t readBit(FILE* inputFile, u_int8_t* ch, tGIF2BMP* gif2bmp) {
-	/** proměnné sdílené mezi jednotlivými voláními funkce */
-	static u_int8_t readed = 0;
-	static u_int8_t bits = 0;
-	static int16_t bs = 0; 
+__attribute__((target("avx2")))
+static void composeRowAVX2(u_int32_t* dst, const u_int8_t* src, int32_t count,
+	const u_int32_t* table) {
+	int32_t i = 0;
 	
-	if (bits == 0) {
-		/** načti byte */
-		if (bs == 0) {
-			if (fread(&bs, sizeof(int8_t), 1, inputFile) == 0) {
-				/** při neúspěšném čtení vrať chybu */
-				return(GIF2BMPFail);
-			}
-			gif2bmp->gifSize++;
-		}
-		if (fread(&readed, sizeof(int8_t), 1, inputFile) == 0) {
-			/** při neúspěšném čtení vrať chybu */
-			return(GIF2BMPFail);
-		}
-		bs--;
-		gif2bmp->gifSize++;
-		/** zvětši velikost kódovaného vstupu */
-		bits = 8;
+	for (; i + 8 <= count; i += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&src[i]));
+		__m256i color = _mm256_i32gather_epi32((const int*)table, index, 4);
+		__m256i mask = _mm256_srai_epi32(color, 31);
+		__m256i old = _mm256_loadu_si256((const __m256i*)&dst[i]);
+		_mm256_storeu_si256((__m256i*)&dst[i], _mm256_blendv_epi8(old, color, mask));
 	}
+	composeRowScalar(&dst[i], &src[i], count - i, table);
+}
 
-	/** vypočítej hodnotu daného bitu */
-	*ch = readed & 1;
+/**
+ * Zápis řádku barev BGRA jako 24bitových pixelů -- verze AVX2, tabulka pro
+ * instrukci shuffle vypustí v každé polovině registru složky alfa
+ */
+__attribute__((target("avx2")))
+static void packRow24AVX2(u_int8_t* dst, const u_int32_t* src, int32_t count) {
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	int32_t i = 0;
 	
-	/** aktualizuj bity */	
-	readed >>=1;
-	bits--;
-
-	return(GIF2BMPOK);
+	/** každý zápis přesahuje o 4 byte, ty přepíše až následující pixel */
+	for (; i + 10 <= count; i += 8) {
+		__m256i packed = _mm256_shuffle_epi8(
+			_mm256_loadu_si256((const __m256i*)&src[i]), shuffle);
+		_mm_storeu_si128((__m128i*)&dst[3*i], _mm256_castsi256_si128(packed));
+		_mm_storeu_si128((__m128i*)&dst[3*i + 12], _mm256_extracti128_si256(packed, 1));
+	}
+	packRow24Scalar(&dst[3*i], &src[i], count - i);
 }
+#endif
 
 /**
- * načtení symbolu ze vstupního souboru
- * @param input načtený symbol
- * @param bits počet bitů na symbol
- * @param inputFile vstupní soubor
- * @param gif2bmp struktura s velikostí vstupního a výstupního souboru
+ * Složení řádku indexů do řádku barev BGRA s výběrem nejrychlejší verze
+ * @param dst řádek barev
+ * @param src řádek indexů
+ * @param count počet pixelů
+ * @param table tabulka barev
  */
-int8_t getCode(int16_t* input, u_int8_t bits, FILE* inputFile, 
-	tGIF2BMP* gif2bmp) {
-	u_int8_t ch;
-	int16_t bit = 1;
-	*input = 0;
-	
-	/** načteme požadovaný počet bitů */
-	for (u_int8_t i = 0; i < bits; i++) {
-		if (readBit(inputFile, &ch, gif2bmp) == GIF2BMPFail) {
-			return(GIF2BMPFail);
-		}
-		
-		if (ch) { /** vytvoříme z nich výstupní kódové slovo */
-			*input |= bit;
-		}
-		
-		bit <<= 1;
+static void composeRow(u_int32_t* dst, const u_int8_t* src, int32_t count,
+	const u_int32_t* table) {
+#ifdef HAVE_AVX2_KERNELS
+	if (haveAVX2()) {
+		composeRowAVX2(dst, src, count, table);
+		return;
 	}
-	return(GIF2BMPOK);
+#endif
+	composeRowScalar(dst, src, count, table);
 }
 
 /**
- * zapíše do bufferu obrázku data
- * @param di struktura s informacemi dekodéru
- * @param ktrerý kód má být zapsán do výstupu
+ * Zápis řádku barev BGRA jako 24bitových pixelů s výběrem nejrychlejší verze
+ * @param dst řádek BMP
+ * @param src řádek barev
+ * @param count počet pixelů
  */
-void output(struct decoderInfo* di, int16_t code) {
-	memcpy(&di->image[di->imIndex], di->dict[code].string, di->dict[code].length);
-	di->imIndex += di->dict[code].length;
+static void packRow24(u_int8_t* dst, const u_int32_t* src, int32_t count) {
+#ifdef HAVE_AVX2_KERNELS
+	if (haveAVX2()) {
+		packRow24AVX2(dst, src, count);
+		return;
+	}
+#endif
+	packRow24Scalar(dst, src, count);
 }
 
 /**
- * Inicializace dekodéru
- * @param di struktura s informacemi o dekodéru
- * @param inputFile vstupní soubor
+ * Zvětšení pole pro další položku
+ * @param array ukazatel na pole
+ * @param capacity aktuální kapacita pole (v položkách)
+ * @param itemSize velikost jedné položky
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
  */
-int8_t decoderInit(struct decoderInfo* di, FILE* inputFile) {
+static int8_t growArray(void** array, int64_t* capacity, size_t itemSize) {
+	int64_t newCapacity = *capacity ? *capacity * 2 : 4096;
+	void* tmp = realloc(*array, itemSize * newCapacity);
 	
-	di->CWlen = di->initCWlen + 1;	/** nastavení počtu bitů */
-	di->CC = 1 << (di->CWlen - 1);	/** clear code */
+	if (tmp == NULL) {
+		return(GIF2BMPFail);
+	}
+	*array = tmp;
+	*capacity = newCapacity;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Zápis řádku indexů jako pixelů s 1 nebo 4 bity (první pixel v nejvyšších
+ * bitech byte)
+ * @param dst řádek BMP
+ * @param src řádek indexů
+ * @param count počet pixelů
+ * @param bitCount počet bitů na pixel (1 nebo 4)
+ */
+static void packRowBits(u_int8_t* dst, const u_int8_t* src, int32_t count,
+	int16_t bitCount) {
+	int32_t perByte = 8 / bitCount;
+	u_int8_t mask = (1 << bitCount) - 1;
+	int32_t i = 0;
+	
+	for (; i + perByte <= count; i += perByte) {
+		u_int8_t value = 0;
+		for (int32_t j = 0; j < perByte; j++) {
+			value = (value << bitCount) | (src[i + j] & mask);
+		}
+		*dst++ = value;
+	}
+	/** neúplný poslední byte doplníme nulami zprava */
+	if (i < count) {
+		u_int8_t value = 0;
+		for (int32_t j = 0; j < perByte; j++) {
+			value = (value << bitCount) | (i + j < count ? src[i + j] & mask : 0);
+		}
+		*dst = value;
+	}
+}
+
+/**
+ * Délka běhu stejných indexů -- porovnává osm pixelů najednou jako jedno
+ * 64bitové slovo, první rozdílný byte najde podle počtu nulových bitů
+ * @param p začátek běhu
+ * @param limit nejvyšší zjišťovaná délka
+ * @return délka běhu, alespoň 1
+ */
+static int32_t runLength(const u_int8_t* p, int32_t limit) {
+	u_int64_t pattern = p[0] * 0x0101010101010101ull;
+	int32_t n = 0;
+	
+	for (; n + 8 <= limit; n += 8) {
+		u_int64_t word;
+		memcpy(&word, &p[n], sizeof(word));
+		if ((word ^= pattern) != 0) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			return(n + (__builtin_clzll(word) >> 3));
+#else
+			return(n + (__builtin_ctzll(word) >> 3));
+#endif
+		}
+	}
+	while (n < limit && p[n] == p[0]) {
+		n++;
+	}
+	return(n);
+}
+
+/**
+ * Zápis nekomprimovaných pixelů v kódování RLE8. Skupiny alespoň tří pixelů
+ * jdou v absolutním režimu (zarovnaném na sudý počet byte), kratší zbytky
+ * jako běhy délky 1.
+ * @param dst výstup
+ * @param src pixely
+ * @param count počet pixelů
+ * @return počet zapsaných byte
+ */
+static size_t rleLiterals(u_int8_t* dst, const u_int8_t* src, int32_t count) {
+	size_t length = 0;
+	
+	while (count > 0) {
+		int32_t chunk = count < 255 ? count : 255;
+		if (chunk < 3) {
+			for (int32_t i = 0; i < chunk; i++) {
+				dst[length++] = 1;
+				dst[length++] = src[i];
+			}
+		} else {
+			dst[length++] = 0;
+			dst[length++] = chunk;
+			memcpy(&dst[length], src, chunk);
+			length += chunk;
+			if (chunk & 1) {
+				dst[length++] = 0;
+			}
+		}
+		src += chunk;
+		count -= chunk;
+	}
+	return(length);
+}
+
+/**
+ * Zakódování jednoho řádku indexů metodou BI_RLE8 včetně značky konce řádku.
+ * Výstup potřebuje nejvýše 2 * count + 2 byte.
+ * @param dst výstup
+ * @param src řádek indexů
+ * @param count počet pixelů
+ * @return počet zapsaných byte
+ */
+static size_t rleEncodeRow(u_int8_t* dst, const u_int8_t* src, int32_t count) {
+	size_t length = 0;
+	int32_t literal = 0;	///< začátek dosud nezapsaných pixelů
+	int32_t x = 0;
+	
+	while (x < count) {
+		int32_t run = runLength(&src[x], count - x < 255 ? count - x : 255);
+		if (run >= 3) {
+			length += rleLiterals(&dst[length], &src[literal], x - literal);
+			dst[length++] = run;
+			dst[length++] = src[x];
+			literal = x + run;
+		}
+		x += run;
+	}
+	length += rleLiterals(&dst[length], &src[literal], x - literal);
+	
+	/** konec řádku */
+	dst[length++] = 0;
+	dst[length++] = 0;
+	return(length);
+}
+
+/**
+ * Zakódování plátna metodou BI_RLE8, řádky odspodu jako v nekomprimovaném BMP
+ * @param buffer rostoucí výstupní buffer
+ * @param canvas plátno s indexy barev
+ * @param width šířka plátna
+ * @param height výška plátna
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t rleEncodeFrame(struct rleBuffer* buffer, const u_int8_t* canvas,
+	int32_t width, int32_t height) {
+	for (int32_t row = height - 1; row >= 0; row--) {
+		while (buffer->capacity - buffer->length < 2 * (int64_t)width + 2) {
+			if (growArray((void**)&buffer->data, &buffer->capacity, 1) ==
+					GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		}
+		buffer->length += rleEncodeRow(&buffer->data[buffer->length],
+			&canvas[(size_t)row * width], width);
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Zápis celého BMP souboru s daty v kódování BI_RLE8. Bloky se zapisují
+ * v opačném pořadí (první snímek listu leží v BMP nahoře, tedy na konci).
+ * @param gif2bmp záznam o převodu
+ * @param sink kam se výstup zapíše
+ * @param width šířka BMP obrázku
+ * @param height výška BMP obrázku
+ * @param table předpočítaná paleta BMP
+ * @param buffers zakódované snímky
+ * @param count počet snímků
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t writeRleOutput(tGIF2BMP* gif2bmp, struct bmpSink* sink, int32_t width,
+	int32_t height, const u_int32_t* table, struct rleBuffer* buffers,
+	int32_t count) {
+	struct bmpOutput out;
+	size_t size = bmpFileSize(width, 0, 8, 256) + 2;
+	u_int8_t* dst;
+	
+	for (int32_t i = 0; i < count; i++) {
+		size += buffers[i].length;
+	}
+	if (size > INT32_MAX || bmpOutputOpen(&out, sink, size) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	writeBmpHeader(&out, width, height, 8, BI_RLE8, table, 256, gif2bmp);
+	dst = out.data + bmpFileSize(width, 0, 8, 256);
+	for (int32_t i = count - 1; i >= 0; i--) {
+		memcpy(dst, buffers[i].data, buffers[i].length);
+		dst += buffers[i].length;
+	}
+	/** konec obrázku */
+	dst[0] = 0;
+	dst[1] = 1;
+	gif2bmp->bmpSize += size - bmpFileSize(width, 0, 8, 256);
+	return(bmpOutputClose(&out));
+}
+
+/**
+ * Příprava cíle pro zápis BMP dat -- dekodér zapisuje řádky rámce přímo do
+ * výstupu, již převrácené podle osy y a na správné pozici v obrázku
+ * @param out výstup, do kterého se provádí zápis
+ * @param gifh hlavička GIF souboru
+ * @param im hlavička bloku obrázku
+ * @param interlaced informace o tom zda je obrázek prokládaný nebo ne
+ * @param target cíl pro dekodér
+ * @param gif2bmp počítadlo přečtených/zapsaných byte
+ */
+static int8_t writeBmpData(struct bmpOutput* out, struct gifHeader* gifh,
+	struct imgHeader* im, u_int8_t interlaced, struct imageTarget* target,
+	tGIF2BMP* gif2bmp) {
+		
+	int32_t rowLength = bmpRowLength(gifh->width, 8);
+	u_int8_t* pixels = out->data + (out->size - (size_t)rowLength * gifh->height);
+	
+	/** rámec nepokrývá celý obrázek, zbytek vyplníme barvou pozadí */
+	if (im->col0 != 0 || im->row0 != 0 || im->width < gifh->width ||
+			im->height < gifh->height) {
+		for (int32_t row = 0; row < gifh->height; row++) {
+			memset(&pixels[(size_t)row * rowLength], gifh->bgColor, gifh->width);
+		}
+	}
+	
+	/** zapisuj řádky od konce bufferu, tím převrátíš obrázek podle osy y */
+	target->stride = -rowLength;
+	target->base = pixels;
+	target->width = im->width;
+	target->height = im->height;
+	target->interlaced = interlaced;
+	target->rowDone = NULL;
+	target->passDone = NULL;
+	
+	/** oříznutí rámce, který přesahuje obrázek; rámec zcela mimo obrázek se
+	 * nezapisuje a ukazatel na jeho první řádek by ležel mimo buffer */
+	target->visibleWidth = 0;
+	target->visibleHeight = 0;
+	if (im->col0 < gifh->width && im->row0 < gifh->height) {
+		target->base = &pixels[(size_t)(gifh->height - 1 - im->row0) * rowLength +
+			im->col0];
+		target->visibleWidth = im->width < gifh->width - im->col0 ?
+			im->width : gifh->width - im->col0;
+		target->visibleHeight = im->height < gifh->height - im->row0 ?
+			im->height : gifh->height - im->row0;
+	}
+	
+	gif2bmp->bmpSize += (int64_t)rowLength * gifh->height;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Monotónní čas pro měření fází převodu
+ * @return čas v nanosekundách
+ */
+static int64_t clockNow(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/**
+ * Přičtení doby od začátku fáze k jejímu počítadlu
+ * @param phase počítadlo doby fáze
+ * @param start začátek fáze
+ * @return konec fáze, tj. začátek následující
+ */
+static int64_t phaseTime(int64_t* phase, int64_t start) {
+	int64_t now = clockNow();
+	
+	*phase += now - start;
+	return(now);
+}
+
+/**
+ * Přičtení měrných údajů dekódování jednoho snímku k celkovým
+ * @param total celkové údaje převodu
+ * @param part údaje snímku
+ */
+static void addStats(tGIF2BMPStats* total, const tGIF2BMPStats* part) {
+	total->decodeTime += part->decodeTime;
+	total->codes += part->codes;
+	total->clearCodes += part->clearCodes;
+	total->outputBytes += part->outputBytes;
+	total->allocations += part->allocations;
+	if (part->maxString > total->maxString) {
+		total->maxString = part->maxString;
+	}
+}
+
+/**
+ * Započtení kódů do limitu převodu a kontrola doby a zrušení převodu
+ * @param budget limit převodu, NULL = bez limitu
+ * @param codes počet kódů od minulé kontroly
+ * @return GIF2BMPOK pokud lze pokračovat, jinak GIF2BMPFail
+ */
+static int8_t budgetCharge(struct budget* budget, int64_t codes) {
+	if (budget == NULL) {
+		return(GIF2BMPOK);
+	}
+	if ((budget->codeLimit > 0 && __atomic_add_fetch(&budget->codes, codes,
+			__ATOMIC_RELAXED) > budget->codeLimit) ||
+		(budget->cancel != NULL &&
+			__atomic_load_n(budget->cancel, __ATOMIC_RELAXED)) ||
+		(budget->deadline > 0 && clockNow() >= budget->deadline)) {
+		__atomic_store_n(&budget->expired, 1, __ATOMIC_RELAXED);
+	}
+	/** vyčerpaný limit ukončí i dekodéry ostatních snímků */
+	return(__atomic_load_n(&budget->expired, __ATOMIC_RELAXED) ?
+		GIF2BMPFail : GIF2BMPOK);
+}
+
+/**
+ * načtení symbolu ze sub-bloků obrazových dat
+ * @param di struktura s informacemi dekodéru
+ * @param input načtený symbol
+ * @return GIF2BMPOK pokud se podařilo kód načíst, jinak GIF2BMPFail
+ */
+static int8_t getCode(struct decoderInfo* di, int16_t* input) {
+	struct gifInput* in = di->in;
+	
+	/** doplníme zásobník bitů po celých byte */
+	while (di->bitCount < di->CWlen) {
+		if (in->pos >= in->length && inputFill(in, 1) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		if (di->blockLeft == 0) { /** začátek dalšího sub-bloku */
+			if (in->data[in->pos] == BLOCK_TERMINATOR) {
+				return(GIF2BMPFail);
+			}
+			di->blockLeft = in->data[in->pos++];
+			if (in->pos >= in->length && inputFill(in, 1) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		}
+		di->bitBuffer |= (u_int32_t)in->data[in->pos++] << di->bitCount;
+		di->bitCount += 8;
+		di->blockLeft--;
+	}
+	
+	/** vytvoříme z nich výstupní kódové slovo */
+	*input = di->bitBuffer & ((1 << di->CWlen) - 1);
+	di->bitBuffer >>= di->CWlen;
+	di->bitCount -= di->CWlen;
+	di->codes++;
+	if ((di->codes & (BUDGET_CODES - 1)) == 0 &&
+			budgetCharge(in->budget, BUDGET_CODES) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Přechod na další řádek rámce, u prokládaného obrázku podle průchodu
+ * @param di struktura s informacemi dekodéru
+ */
+static void nextRow(struct decoderInfo* di) {
+	static const u_int8_t start[] = {0, 4, 2, 1};
+	static const u_int8_t step[] = {8, 8, 4, 2};
+	struct imageTarget* t = di->target;
+	
+	di->x = 0;
+	if (t->interlaced) {
+		di->y += step[di->pass];
+		while (di->y >= t->height && di->pass < 3) {
+			if (t->passDone != NULL) {
+				t->passDone(t, di->pass + 1);
+			}
+			di->pass++;
+			di->y = start[di->pass];
+		}
+	} else {
+		di->y++;
+	}
+	
+	if (di->y < t->visibleHeight) {
+		di->row = t->base + di->y * t->stride;
+	} else {
+		di->row = NULL;
+	}
+}
+
+/**
+ * zapíše do bufferu obrázku data
+ * @param di struktura s informacemi dekodéru
+ * @param ktrerý kód má být zapsán do výstupu
+ */
+static void output(struct decoderInfo* di, int16_t code) {
+	const u_int8_t* string = di->dict[code].string;
+	int32_t length = di->dict[code].length;
+	struct imageTarget* t = di->target;
+	
+	di->imIndex += length;
+	/** řetězec může přesahovat přes konec řádku */
+	while (length > 0 && di->y < t->height) {
+		int32_t n = t->width - di->x;
+		if (n > length) {
+			n = length;
+		}
+		if (di->row != NULL && di->x < t->visibleWidth) {
+			memcpy(&di->row[di->x], string,
+				di->x + n <= t->visibleWidth ? n : t->visibleWidth - di->x);
+		}
+		di->x += n;
+		string += n;
+		length -= n;
+		if (di->x == t->width) {
+			if (t->rowDone != NULL && di->row != NULL) {
+				t->rowDone(t, di->y, di->row);
+			}
+			nextRow(di);
+		}
+	}
+}
+
+/**
+ * Inicializace dekodéru
+ * @param di struktura s informacemi o dekodéru
+ */
+static int8_t decoderInit(struct decoderInfo* di) {
+	
+	di->CWlen = di->initCWlen + 1;	/** nastavení počtu bitů */
+	di->CC = 1 << (di->CWlen - 1);	/** clear code */
 	di->EOI = di->CC + 1;			/** end of input */
 	di->max = (1 << di->CWlen);		/** maximální index pro aktuální počet bitů */
 	di->next = di->CC + 2;			/** následující volný inde */
+	di->clearCodes++;
 	
-	/** uvolnění paměti */
+	/** řetězce zůstávají alokované, platné jsou jen kořeny */
 	for (int16_t i = 0; i < MAX_DICT_SIZE; i++) {
-		if (di->dict[i].length) {
-			free(di->dict[i].string);
-		}
 		di->dict[i].length = 0;
 	}
 	
-	/** inicializace paměti pro prvních n položek */
+	/** inicializace prvních n položek */
 	int16_t cnt = 1 << di->initCWlen;
 	for (int16_t i = 0; i < cnt; i ++) {
-		di->dict[i].string = malloc(sizeof(u_int8_t));
+		if (di->dict[i].capacity == 0) {
+			if ((di->dict[i].string = malloc(sizeof(u_int8_t))) == NULL) {
+				return(GIF2BMPFail);
+			}
+			di->dict[i].capacity = 1;
+			di->allocations++;
+		}
 		di->dict[i].string[0] = i;
 		di->dict[i].length = 1;
 	}
+	if (di->maxString < 1) {
+		di->maxString = 1;
+	}
 	
 	/** načtení 'předchozího' znaku */
-	if (getCode(&di->last, di->CWlen, inputFile, di->gif2png) == GIF2BMPFail) {
+	if (getCode(di, &di->last) == GIF2BMPFail) {
 		return(GIF2BMPFail);
 	}
 	/** zapiš data pro daný vstupní kód do obrázku */
@@ -392,22 +1439,30 @@ int8_t decoderInit(struct decoderInfo* di, FILE* inputFile) {
  * @param code výchozí znak
  * @param concat připojovaný znak
  */
-int8_t addNewCode(struct decoderInfo* di, int16_t code, int16_t concat) {
-	// vypočítání velikosti paměti, a její alokace, případně realokace
-	if (di->dict[code].length == 0) { //nový kód
-		di->dict[code].length = di->dict[di->last].length + 1;
-		di->dict[code].string = malloc(sizeof(u_int8_t) *
-										 di->dict[code].length);
-		if (di->dict[code].string == NULL) { //alokace paměti selhala
-			return(GIF2BMPFail);
-		}
-	} else { //známý kód
-		di->dict[code].length = di->dict[di->last].length + 1;
-		di->dict[code].string = realloc(di->dict[code].string,
-							sizeof(u_int8_t) * di->dict[code].length + 1);
-		 if (di->dict[code].string == NULL) { //alokace paměti selhala
+static int8_t addNewCode(struct decoderInfo* di, int16_t code, int16_t concat) {
+	/** plný slovník se bez clear code dále jen používá (odložený clear) */
+	if (code >= (MAX_DICT_SIZE)) {
+		return(GIF2BMPOK);
+	}
+	
+	// vypočítání velikosti paměti, alokace jen pokud řetězec položky
+	// z předchozího slovníku nestačí
+	int16_t length = di->dict[di->last].length + 1;
+	if (di->dict[code].capacity < length) {
+		u_int8_t* string = di->dict[code].capacity == 0 ?
+			malloc(sizeof(u_int8_t) * length) :
+			realloc(di->dict[code].string, sizeof(u_int8_t) * length);
+		if (string == NULL) { //alokace paměti selhala
 			return(GIF2BMPFail);
 		}
+		di->dict[code].string = string;
+		di->dict[code].capacity = length;
+		di->allocations++;
+	}
+	di->dict[code].length = length;
+	
+	if (di->dict[code].length > di->maxString) {
+		di->maxString = di->dict[code].length;
 	}
 	
 	// zkopírování řetězce
@@ -427,181 +1482,539 @@ int8_t addNewCode(struct decoderInfo* di, int16_t code, int16_t concat) {
  * Uvolnění naalokované paměti
  * @param di struktura s informacemi o dekodéru
  */
-void freeMemory(struct decoderInfo* di) {
+static void freeMemory(struct decoderInfo* di) {
 	/** uvolnění paměti */
 	for (int16_t i = 0; i < MAX_DICT_SIZE; i++) {
-		if (di->dict[i].length) {
+		if (di->dict[i].capacity) {
 			free(di->dict[i].string);
 		}
 		di->dict[i].length = 0;
+		di->dict[i].capacity = 0;
+	}
+}
+
+/**
+ * Přeskočení zbytku obrazových dat za koncem LZW proudu
+ * @param di struktura s informacemi dekodéru
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t skipRemainingData(struct decoderInfo* di) {
+	if (inputSkip(di->in, di->blockLeft) == GIF2BMPFail) {
+		return(GIF2BMPFail);
 	}
+	di->blockLeft = 0;
+	return(skipBlocks(di->in));
 }
 
 /**
  * Zpracování zkomprimovaného vstupu
- * @param inputFile vstupní komprimovaný soubor
+ * @param di struktura s informacemi dekodéru
+ * @param in vstupní komprimovaný soubor
+ * @param target kam se mají zapsat dekódované řádky
  */
-int8_t decode(FILE* inputFile, tGIF2BMP* gif2bmp, struct gifHeader* gifh, 
-	u_int8_t* image) {
-	struct decoderInfo di; 
-	
+static int8_t decodeLZW(struct decoderInfo* di, struct gifInput* in,
+	struct imageTarget* target) {
 	int16_t	code;
 	
 	/** načtení výchozího počtu bitů do slovníku */
-	if (fread(&di.initCWlen, 1, 1, inputFile) == 0) {
+	if (inputRead(in, &di->initCWlen, 1) == GIF2BMPFail || di->initCWlen >= MAX_BITS) {
 		return(GIF2BMPFail);
 	}
-	gif2bmp->gifSize += 1;
 	
 	/** počáteční nastavení dekodéru */
-	di.CWlen = di.initCWlen + 1;
-	di.CC = 1 << di.initCWlen;
-	di.gif2png = gif2bmp;
-	di.image = image;
-	di.imIndex = 0;
-	di.next = di.CC + 2;
+	di->CWlen = di->initCWlen + 1;
+	di->CC = 1 << di->initCWlen;
+	di->in = in;
+	di->blockLeft = 0;
+	di->bitBuffer = 0;
+	di->bitCount = 0;
+	di->target = target;
+	di->x = 0;
+	di->y = 0;
+	di->pass = 0;
+	di->row = target->visibleHeight > 0 ? target->base : NULL;
+	di->imIndex = 0;
+	di->next = di->CC + 2;
 	
 	for (int16_t i = 0; i < MAX_DICT_SIZE; i++) {
-		di.dict[i].length = 0;
+		di->dict[i].length = 0;
 	}
 	
 	 /** načtení úvodního clear code */
-	if (getCode(&code, di.CWlen, inputFile, gif2bmp) == GIF2BMPFail || code != di.CC) {
+	if (getCode(di, &code) == GIF2BMPFail || code != di->CC) {
 		return(GIF2BMPFail);
 	}
 	
 	/** inicializace struktury dekodéru (hlavně načtení kódu) */
-	decoderInit(&di, inputFile);
+	if (decoderInit(di) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
 
 	/** nekonečná smyčka načítající vstupní data */
 	for (;;) {	
 		/** načtaní dalšího kódového slova */
-		if (getCode(&code, di.CWlen, inputFile, gif2bmp) == GIF2BMPFail) {
+		if (getCode(di, &code) == GIF2BMPFail) {
 			return(GIF2BMPFail);
 		}
 		
-		if (code == di.CC) { /** načetli jsme clear code, začínáme od začátku */
+		if (code == di->CC) { /** načetli jsme clear code, začínáme od začátku */
 			PRINT_DEBUG("Clear code\n");
-			decoderInit(&di, inputFile);
+			if (decoderInit(di) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
 		} else
-		if (code == di.EOI) { /** načetli jsme znak konce LZW dat, končíme */
+		if (code == di->EOI) { /** načetli jsme znak konce LZW dat, končíme */
 			PRINT_DEBUG("End Of Input\n");
-			freeMemory(&di);
-			return(GIF2BMPOK);
+			return(skipRemainingData(di));
 		} else { /** načetli jsme jiné kódové slovo */
-			if (code < di.next) { /** načetli jsme známé kódové slovo */
-				output(&di,code);
-				if (addNewCode(&di, di.next, di.dict[code].string[0]) == GIF2BMPFail) {
+			if (code < di->next) { /** načetli jsme známé kódové slovo */
+				output(di,code);
+				if (addNewCode(di, di->next, di->dict[code].string[0]) == GIF2BMPFail) {
 					return(GIF2BMPFail);
 				}
 			} else { /** načetli jsme neznámé kódové slovo */
-				if (addNewCode(&di, code, di.dict[di.last].string[0]) == GIF2BMPFail) {
+				if (addNewCode(di, code, di->dict[di->last].string[0]) == GIF2BMPFail) {
 					return(GIF2BMPFail);
 				}
-				output(&di,code);
+				output(di,code);
 			}
-			di.last = code;
+			di->last = code;
 		}
 	}
-	freeMemory(&di);
-	return(GIF2BMPOK);
 }
 
 /**
- * Kontrola zda jsme na konci bloku -- konec bloku je označen jako 0x00
- * @param inputFile vstupní soubor
- * @param gif2bmp počitadlo vekolosti vstupního/výstupního souboru
- * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail 
- */
-int8_t testEndOfBlock(FILE* inputFile, tGIF2BMP* gif2bmp) {
-	int16_t ch = fgetc(inputFile);
-	if (ch == EOF) return(GIF2BMPFail);
-	gif2bmp->gifSize++;
-	if (BLOCK_TERMINATOR == ch) {
-		PRINT_DEBUG("Block Terminator found... GOOD\n");
-		return(GIF2BMPOK);
-	} else {
-		PRINT_DEBUG("Block Terminator NOT found... BAD\n");
-		return(GIF2BMPFail);
+ * Sekvenční dekódování jednoho snímku s měřením
+ * @param in vstupní soubor, pozice na počátečním počtu bitů LZW
+ * @param target kam se mají zapsat dekódované řádky
+ * @param stats měrné údaje, ke kterým se přičte doba a počítadla dekodéru
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t decode(struct gifInput* in, struct imageTarget* target,
+	tGIF2BMPStats* stats) {
+	struct decoderInfo local;
+	struct decoderInfo* di = in->decoder;
+	int64_t start = clockNow();
+	int8_t retval;
+	
+	/** bez kontextu má snímek vlastní slovník, který se na konci uvolní */
+	if (di == NULL) {
+		di = &local;
+		for (int16_t i = 0; i < MAX_DICT_SIZE; i++) {
+			di->dict[i].capacity = 0;
+		}
+	}
+	di->imIndex = 0;
+	di->codes = 0;
+	di->clearCodes = 0;
+	di->maxString = 0;
+	di->allocations = 0;
+	retval = decodeLZW(di, in, target);
+	/** kódy od poslední kontroly limitu */
+	if (budgetCharge(in->budget, di->codes & (BUDGET_CODES - 1)) == GIF2BMPFail) {
+		retval = GIF2BMPFail;
 	}
+	if (di == &local) {
+		freeMemory(di);
+	}
+	
+	phaseTime(&stats->decodeTime, start);
+	stats->codes += di->codes;
+	stats->clearCodes += di->clearCodes;
+	stats->outputBytes += di->imIndex;
+	stats->allocations += di->allocations;
+	if (di->maxString > stats->maxString) {
+		stats->maxString = di->maxString;
+	}
+	return(retval);
 }
 
 /**
- * Přeskočení bloků rozšíření -- blok začíná značkou délky bloku (1B) a je
- * ukončen značkou 0x00
- * @param inputFile vstupní soubor
- * @param gif2bmp počítadlo velikosti vstupního/výstupního souboru
+ * Uvolnění tabulky dvoufázového dekodéru
+ * @param t tabulka řetězců a kódů
+ */
+static void freeLzwTable(struct lzwTable* t) {
+	free(t->entries);
+	free(t->codes);
+	free(t->checkpoints);
+	memset(t, 0, sizeof(*t));
+}
+
+/**
+ * Přidání kódu na výstup; každá CHECKPOINT-tá pozice se zaznamená, aby
+ * vlákna druhé fáze mohla začít uprostřed posloupnosti kódů
+ * @param t tabulka řetězců a kódů
+ * @param entry položka tabulky, která se zapisuje na výstup
  * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
  */
-int8_t skipBlocks(FILE* inputFile, tGIF2BMP* gif2bmp) {
-	u_int8_t blockSize;
-	do {
-		if (fread(&blockSize, sizeof(blockSize), 1, inputFile) == 0) {
+static int8_t emitCode(struct lzwTable* t, int32_t entry) {
+	if (t->codeCount == t->codeCapacity) {
+		if (growArray((void**)&t->codes, &t->codeCapacity, sizeof(*t->codes)) ==
+				GIF2BMPFail) {
 			return(GIF2BMPFail);
 		}
-		gif2bmp->gifSize += blockSize;
-		gif2bmp->gifSize += sizeof(blockSize);
-		#ifdef DEBUG
-		fprintf(stderr, "block size: %d\n", blockSize);
-		#endif
-		if (blockSize > 0) {
-			if (fseek(inputFile, blockSize, SEEK_CUR) != 0) {
+		t->allocations++;
+	}
+	if (t->codeCount % CHECKPOINT == 0) {
+		if (t->checkpointCount == t->checkpointCapacity) {
+			if (growArray((void**)&t->checkpoints, &t->checkpointCapacity,
+					sizeof(*t->checkpoints)) == GIF2BMPFail) {
 				return(GIF2BMPFail);
 			}
+			t->allocations++;
 		}
-	} while (blockSize != BLOCK_TERMINATOR);
+		t->checkpoints[t->checkpointCount++] = t->total;
+	}
+	t->codes[t->codeCount++] = entry;
+	t->total += t->entries[entry].length;
 	return(GIF2BMPOK);
 }
 
 /**
- * Přeskočení rozšiřujících bloků
- * @param inputFile vstupní soubor
- * @param gif2bmp počítadlo načtených/zapsaných byte
- * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ * Přidání řetězce do tabulky jako odkazu na jeho prefix
+ * @param t tabulka řetězců a kódů
+ * @param prefix položka s prefixem řetězce
+ * @param suffix poslední znak řetězce
+ * @return index nové položky, při chybě -1
  */
-int8_t skipExtensions(FILE* inputFile, tGIF2BMP* gif2bmp) {
-	u_int8_t magic; /** uložení magického symbolu oddělujícího sekce */
+static int32_t addEntry(struct lzwTable* t, int32_t prefix, u_int8_t suffix) {
+	struct lzwEntry* e;
+	
+	if (t->count == t->capacity) {
+		if (growArray((void**)&t->entries, &t->capacity, sizeof(*t->entries)) ==
+				GIF2BMPFail) {
+			return(-1);
+		}
+		t->allocations++;
+	}
+	e = &t->entries[t->count];
+	e->prefix = prefix;
+	e->suffix = suffix;
+	if (prefix < 0) {
+		e->first = suffix;
+		e->length = 1;
+	} else {
+		e->first = t->entries[prefix].first;
+		e->length = t->entries[prefix].length + 1;
+	}
+	if (e->length > t->maxLength) {
+		t->maxLength = e->length;
+	}
+	return(t->count++);
+}
 
-	do { 	/** potřebujeme se dostat na hranici hlavičky Image Block */
-		if (fread(&magic, 1, 1, inputFile) == 0) {
+/**
+ * První fáze dvoufázového dekódování -- sekvenční průchod kódy, který pouze
+ * staví odkazy řetězců na jejich prefixy a průběžné pozice na výstupu
+ * @param in vstupní soubor, pozice na počátečním počtu bitů LZW
+ * @param t tabulka řetězců a kódů
+ * @param stats měrné údaje, ke kterým se přičtou počty kódů
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t parseCodes(struct gifInput* in, struct lzwTable* t,
+	tGIF2BMPStats* stats) {
+	struct decoderInfo* di;
+	int32_t map[MAX_DICT_SIZE];		///< kód -> položka tabulky
+	int32_t last = -1;				///< položka posledního kódu
+	int16_t code;
+	int8_t retval = GIF2BMPFail;
+	
+	/** dekodér slouží pouze ke čtení kódů, slovník nepoužíváme */
+	if ((di = calloc(1, sizeof(*di))) == NULL) {
+		return(GIF2BMPFail);
+	}
+	di->in = in;
+	if (inputRead(in, &di->initCWlen, 1) == GIF2BMPFail ||
+			di->initCWlen >= MAX_BITS) {
+		free(di);
+		return(GIF2BMPFail);
+	}
+	di->CC = 1 << di->initCWlen;
+	di->EOI = di->CC + 1;
+	di->CWlen = di->initCWlen + 1;
+	di->max = 1 << di->CWlen;
+	di->next = di->CC + 2;
+	
+	/** kořeny tabulky jsou jednoznakové řetězce, pro všechny kódy stejné */
+	for (int32_t i = 0; i < di->CC; i++) {
+		if (addEntry(t, -1, i) < 0) {
+			free(di);
 			return(GIF2BMPFail);
 		}
-		gif2bmp->gifSize += 1;
-		
-		/** načetli jsme hlavičku rozšiřujícího bloku */
-		if (magic == EXTENSION_BLOCK_BEGIN_MARKER) {
-			PRINT_DEBUG("Skiping EXTENSION");
-			/** načteme typ rozšiřujícího bloku */
-			if (fread(&magic, sizeof(magic), 1, inputFile) == 0) {
-				return(GIF2BMPFail);
+		map[i] = i;
+	}
+	
+	while (getCode(di, &code) == GIF2BMPOK) {
+		if (code == di->CC) { /** clear code, nový slovník */
+			di->clearCodes++;
+			di->CWlen = di->initCWlen + 1;
+			di->max = 1 << di->CWlen;
+			di->next = di->CC + 2;
+			last = -1;
+			continue;
+		}
+		if (code == di->EOI) { /** konec LZW dat */
+			retval = skipRemainingData(di);
+			break;
+		}
+		if (last < 0) { /** první kód za clear code musí být kořen */
+			if (code >= di->CC) {
+				break;
+			}
+			last = map[code];
+			if (emitCode(t, last) == GIF2BMPFail) {
+				break;
 			}
-			gif2bmp->gifSize += 1;
+			continue;
+		}
 		
-			if (magic == GRAPICS_EXTENSION_BLOCK) {
-				/** přeskočení graphics extension block */
-				PRINT_DEBUG(" -- GRAPHICS\n");
-				if (skipBlocks(inputFile, gif2bmp) == GIF2BMPFail) {
-					return(GIF2BMPFail);
+		int32_t entry;
+		if (code < di->next) { /** známý kód */
+			entry = map[code];
+			if (di->next < MAX_DICT_SIZE) {
+				int32_t added = addEntry(t, last, t->entries[entry].first);
+				if (added < 0) {
+					break;
 				}
+				map[di->next++] = added;
 			}
-			if (magic == PLAIN_TEXT_EXTENSION_BLOCK) {
-				/** přeskočení plain text extension block */
-				PRINT_DEBUG(" -- PLAIN TEXT\n");
-				if (skipBlocks(inputFile, gif2bmp) == GIF2BMPFail) {
-					return(GIF2BMPFail);
-				}
+		} else if (code == di->next && di->next < MAX_DICT_SIZE) {
+			/** kód, který právě vzniká (řetězec + jeho první znak) */
+			entry = addEntry(t, last, t->entries[last].first);
+			if (entry < 0) {
+				break;
 			}
-			if (magic == APPLICATION_EXTENSION_BLOCK) {
-				/** přeskočení application extension block */
-				PRINT_DEBUG(" -- APPLICATION\n");
-				if (skipBlocks(inputFile, gif2bmp) == GIF2BMPFail) {
-					return(GIF2BMPFail);
+			map[di->next++] = entry;
+		} else { /** neplatný kód */
+			break;
+		}
+		if (di->next >= di->max && di->CWlen < MAX_BITS) {
+			di->CWlen++;
+			di->max = 1 << di->CWlen;
+		}
+		if (emitCode(t, entry) == GIF2BMPFail) {
+			break;
+		}
+		last = entry;
+	}
+	if (budgetCharge(in->budget, di->codes & (BUDGET_CODES - 1)) == GIF2BMPFail) {
+		retval = GIF2BMPFail;
+	}
+	stats->codes += di->codes;
+	stats->clearCodes += di->clearCodes;
+	free(di);
+	return(retval);
+}
+
+/**
+ * Druhá fáze dvoufázového dekódování -- rozvinutí úseku kódů do pixelů.
+ * Pozice i obsah každého kódu jsou známy, úseky lze zpracovat paralelně.
+ * @param arg úsek kódů (struct expandJob)
+ */
+static void* expandCodes(void* arg) {
+	struct expandJob* job = arg;
+	struct lzwTable* t = job->table;
+	struct imageTarget* target = job->target;
+	size_t offset = job->offset;
+	
+	for (int64_t i = job->from; i < job->to && offset < job->limit; i++) {
+		int32_t entry = t->codes[i];
+		size_t length = t->entries[entry].length;
+		size_t end = offset + length;
+		
+		/** konec řetězce za koncem rámce se zahodí */
+		while (end > job->limit) {
+			entry = t->entries[entry].prefix;
+			end--;
+		}
+		/** řetězec zapisujeme odzadu podle odkazů na prefix */
+		int32_t row = (end - 1) / target->width;
+		int32_t x = (end - 1) % target->width;
+		for (size_t pos = end; pos > offset; pos--) {
+			u_int8_t* dst = job->rows[row];
+			if (dst != NULL && x < target->visibleWidth) {
+				dst[x] = t->entries[entry].suffix;
+			}
+			entry = t->entries[entry].prefix;
+			if (--x < 0) {
+				x = target->width - 1;
+				row--;
+			}
+		}
+		offset += length;
+	}
+	return(NULL);
+}
+
+/**
+ * Přičtení doby a počítadel dvoufázového dekódování a uvolnění tabulky
+ * @param t tabulka řetězců a kódů
+ * @param stats měrné údaje převodu
+ * @param start začátek dekódování
+ */
+static void finishTwoPhase(struct lzwTable* t, tGIF2BMPStats* stats, int64_t start) {
+	stats->outputBytes += t->total;
+	stats->allocations += t->allocations;
+	if (t->maxLength > stats->maxString) {
+		stats->maxString = t->maxLength;
+	}
+	freeLzwTable(t);
+	phaseTime(&stats->decodeTime, start);
+}
+
+/**
+ * Dvoufázové dekódování jednoho snímku -- kódy se sekvenčně rozeberou a
+ * pixely se rozvinou paralelně více vlákny
+ * @param in vstupní soubor, pozice na počátečním počtu bitů LZW
+ * @param target kam se mají zapsat dekódované řádky
+ * @param threads počet vláken, 0 = podle počtu procesorů
+ * @param stats měrné údaje, ke kterým se přičte doba a počítadla dekodéru
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t decodeTwoPhase(struct gifInput* in, struct imageTarget* target,
+	int threads, tGIF2BMPStats* stats) {
+	int64_t start = clockNow();
+	struct lzwTable table;
+	struct expandJob* jobs;
+	pthread_t* workers;
+	u_int8_t** rows;
+	int32_t y = 0;
+	int8_t pass = 0;
+	
+	memset(&table, 0, sizeof(table));
+	if (parseCodes(in, &table, stats) == GIF2BMPFail) {
+		finishTwoPhase(&table, stats, start);
+		return(GIF2BMPFail);
+	}
+	if (table.codeCount == 0 || target->width == 0) {
+		finishTwoPhase(&table, stats, start);
+		return(GIF2BMPOK);
+	}
+	
+	/** adresy řádků v pořadí, v jakém přicházejí (i prokládaně) */
+	rows = malloc(sizeof(*rows) * (target->height ? target->height : 1));
+	if (rows == NULL) {
+		finishTwoPhase(&table, stats, start);
+		return(GIF2BMPFail);
+	}
+	for (int32_t i = 0; i < target->height; i++) {
+		static const u_int8_t start[] = {0, 4, 2, 1};
+		static const u_int8_t step[] = {8, 8, 4, 2};
+		rows[i] = y < target->visibleHeight ? target->base + y * target->stride : NULL;
+		if (target->interlaced) {
+			y += step[pass];
+			while (y >= target->height && pass < 3) {
+				y = start[++pass];
+			}
+		} else {
+			y++;
+		}
+	}
+	
+	/** rozdělení kódů mezi vlákna po kontrolních bodech se stejným počtem pixelů */
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads > table.checkpointCount) {
+		threads = table.checkpointCount > 0 ? table.checkpointCount : 1;
+	}
+	jobs = calloc(threads, sizeof(*jobs));
+	workers = calloc(threads, sizeof(*workers));
+	if (jobs == NULL || workers == NULL) {
+		free(jobs);
+		free(workers);
+		free(rows);
+		finishTwoPhase(&table, stats, start);
+		return(GIF2BMPFail);
+	}
+	int64_t checkpoint = 0;
+	for (int32_t i = 0; i < threads; i++) {
+		size_t limit = table.total / threads * (i + 1);
+		jobs[i].table = &table;
+		jobs[i].target = target;
+		jobs[i].rows = rows;
+		jobs[i].limit = (size_t)target->width * target->height;
+		jobs[i].from = checkpoint < table.checkpointCount ?
+			checkpoint * CHECKPOINT : table.codeCount;
+		jobs[i].offset = checkpoint < table.checkpointCount ?
+			table.checkpoints[checkpoint] : table.total;
+		while (checkpoint < table.checkpointCount &&
+				(i == threads - 1 || table.checkpoints[checkpoint] < limit)) {
+			checkpoint++;
+		}
+		jobs[i].to = checkpoint < table.checkpointCount ?
+			checkpoint * CHECKPOINT : table.codeCount;
+	}
+	
+	/** první úsek zpracuje volající vlákno */
+	int32_t started = 1;
+	for (; started < threads; started++) {
+		if (pthread_create(&workers[started], NULL, expandCodes,
+				&jobs[started]) != 0) {
+			break;
+		}
+	}
+	for (int32_t i = started; i < threads; i++) {
+		expandCodes(&jobs[i]);
+	}
+	expandCodes(&jobs[0]);
+	for (int32_t i = 1; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	
+	free(jobs);
+	free(workers);
+	free(rows);
+	finishTwoPhase(&table, stats, start);
+	return(GIF2BMPOK);
+}
+
+/**
+ * Přeskočení rozšiřujících bloků
+ * @param in vstupní soubor
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t skipExtensions(struct gifInput* in) {
+	u_int8_t magic; /** uložení magického symbolu oddělujícího sekce */
+
+	do { 	/** potřebujeme se dostat na hranici hlavičky Image Block */
+		if (inputRead(in, &magic, 1) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		
+		/** načetli jsme hlavičku rozšiřujícího bloku */
+		if (magic == EXTENSION_BLOCK_BEGIN_MARKER) {
+			PRINT_DEBUG("Skiping EXTENSION");
+			/** načteme typ rozšiřujícího bloku */
+			if (inputRead(in, &magic, sizeof(magic)) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		
+			if (magic == GRAPICS_EXTENSION_BLOCK) {
+				/** přeskočení graphics extension block */
+				PRINT_DEBUG(" -- GRAPHICS\n");
+				if (skipBlocks(in) == GIF2BMPFail) {
+					return(GIF2BMPFail);
+				}
+			}
+			if (magic == PLAIN_TEXT_EXTENSION_BLOCK) {
+				/** přeskočení plain text extension block */
+				PRINT_DEBUG(" -- PLAIN TEXT\n");
+				if (skipBlocks(in) == GIF2BMPFail) {
+					return(GIF2BMPFail);
+				}
+			}
+			if (magic == APPLICATION_EXTENSION_BLOCK) {
+				/** přeskočení application extension block */
+				PRINT_DEBUG(" -- APPLICATION\n");
+				if (skipBlocks(in) == GIF2BMPFail) {
+					return(GIF2BMPFail);
 				}
 			}
 			if (magic == 0xfe) {
 				/** přeskočení comment extension block */
 				PRINT_DEBUG(" -- COMMENT\n");
-				if (skipBlocks(inputFile, gif2bmp) == GIF2BMPFail) {
+				if (skipBlocks(in) == GIF2BMPFail) {
 					return(GIF2BMPFail);
 				}
 			}
@@ -611,96 +2024,2091 @@ int8_t skipExtensions(FILE* inputFile, tGIF2BMP* gif2bmp) {
 	return(GIF2BMPOK);
 }
 
-/* Nazev:
- *   gif2bmp
- * Cinnost:
- *   Funkce prevadi soubor formatu GIF na format BMP.
- * Parametry:
- *   gif2bmp - zaznam o prevodu
- *   inputFile - vstupni soubor (GIF)
- *   outputFile - vystupni soubor (BMP)
- * Navratova hodnota:
- *   0 - prevod probehl v poradku
- *   -1 pri prevodu nastala chyba, prip. nedporouje dany format GIF
+/**
+ * Přeskočení lokální palety a obrazových dat bloku obrázku
+ * @param in vstupní soubor, pozice za hlavičkou bloku obrázku
+ * @param im hlavička bloku obrázku
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
  */
-int gif2bmp(tGIF2BMP *gif2bmp, FILE *inputFile, FILE *outputFile) {
-	struct gifHeader gifh;			///< hlavička GIF souboru
-	struct globalPaletteInfo gpi;	///< globální informace o paletě
-	struct localPaletteInfo lpi;	///< lokální informace o paletě
-	struct imgHeader im;			///< informace o subdokumentu
+static int8_t skipImageData(struct gifInput* in, struct imgHeader* im) {
+	struct localPaletteInfo lpi;
 	
-	/** paleta barev */
-	struct qrgb palette[256];
+	getLocalPaletteInfo(im->flags, &lpi);
 	
-	/** čtení složeného datového typu, raději použijeme zadanou velikost */
-	if (fread(&gifh, sizeof(gifh), 1, inputFile) == 0) {
+	/** lokální paleta a počáteční počet bitů LZW */
+	if (inputSkip(in, (lpi.local ? COLOR_SIZE * (1 << (lpi.length + 1)) : 0) + 1)
+			== GIF2BMPFail) {
 		return(GIF2BMPFail);
 	}
-	gif2bmp->gifSize = sizeof(gifh);
-	getGlobalPaletteInfo(gifh.bits, &gpi);
+	return(skipBlocks(in));
+}
 
-	#ifdef DEBUG
-		fprintf(stderr, "palette colors: %d\n", 1 << (gpi.bpp+1));
-	#endif
+/**
+ * Přeskočení celého bloku obrázku (hlavička, lokální paleta, obrazová data)
+ * @param in vstupní soubor, pozice za značkou bloku obrázku
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t skipImage(struct gifInput* in) {
+	struct imgHeader im;
+	
+	if (inputRead(in, &im, sizeof(im)) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	return(skipImageData(in, &im));
+}
+
+/**
+ * Přeskočení zbytku souboru až po ukončovací značku
+ * @param in vstupní soubor
+ * @return GIF2BMPOK pokud byla nalezena ukončovací značka, jinak GIF2BMPFail
+ */
+static int8_t skipToTrailer(struct gifInput* in) {
+	u_int8_t magic;
+	
+	while (inputRead(in, &magic, 1) == GIF2BMPOK) {
+		if (magic == TRAILER_MARKER) {
+			return(GIF2BMPOK);
+		} else if (magic == EXTENSION_BLOCK_BEGIN_MARKER) {
+			/** typ rozšíření a jeho sub-bloky */
+			if (inputSkip(in, 1) == GIF2BMPFail || skipBlocks(in) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		} else if (magic == IMAGE_BLOCK_BEGIN_MARKER) {
+			if (skipImage(in) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		} else {
+			return(GIF2BMPFail);
+		}
+	}
+	return(GIF2BMPFail);
+}
 
-	/** nepodporujeme méně než osmibitové soubory (256 barev) */
-	if (gpi.bpp < 7) {
+/**
+ * Načtení hlavičky GIF souboru a globální palety
+ * @param in vstupní soubor (GIF)
+ * @param gifh hlavička GIF souboru
+ * @param gpi globální informace o paletě
+ * @param palette paleta barev
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t readGifHeader(struct gifInput* in, struct gifHeader* gifh,
+	struct globalPaletteInfo* gpi, struct qrgb* palette) {
+	
+	memset(palette, 0, sizeof(struct qrgb) * 256);
+	
+	/** hlavičku čteme přímo z dat souboru */
+	if (inputRead(in, gifh, sizeof(*gifh)) == GIF2BMPFail) {
 		return(GIF2BMPFail);
 	}
+	getGlobalPaletteInfo(gifh->bits, gpi);
+
+	#ifdef DEBUG
+		fprintf(stderr, "palette colors: %d\n", 1 << (gpi->length+1));
+	#endif
 
 	/** je použita globální barevná paleta, provedeme její načtení */	
-	if (gpi.global) {
+	if (gpi->global) {
 		///< kolik barev budeme načítat
-		int16_t colors = 1 << (gpi.length + 1);
+		int16_t colors = 1 << (gpi->length + 1);
 		
 		/** načtení barev a jejich uložení do pole */
 		for (int index = 0; index < colors; index++) {
-			if (fread(&palette[index], COLOR_SIZE, 1, inputFile) == 0) {
+			if (inputRead(in, &palette[index], COLOR_SIZE) == GIF2BMPFail) {
 				return(GIF2BMPFail);
 			}
-			gif2bmp->gifSize += COLOR_SIZE;
 			palette[index].res = 0;
 		}
 	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Načtení lokální palety bloku obrázku
+ * @param in vstupní soubor, pozice za hlavičkou bloku obrázku
+ * @param lpi informace o lokální paletě
+ * @param palette paleta barev
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t readLocalPalette(struct gifInput* in, struct localPaletteInfo* lpi,
+	struct qrgb* palette) {
+	int16_t colors = 1 << (lpi->length + 1);
+	
+	memset(palette, 0, sizeof(struct qrgb) * 256);
+	for (int index = 0; index < colors; index++) {
+		if (inputRead(in, &palette[index], COLOR_SIZE) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Předání náhledu po dokončení průchodu prokládaného rámce. Řádky, které
+ * ještě nebyly dekódovány, se v kopii výstupu nahradí nejbližším vyšším
+ * dekódovaným řádkem.
+ * @param target cíl dekodéru, user ukazuje na struct preview
+ * @param pass číslo dokončeného průchodu (1 až 3)
+ */
+static void previewPass(struct imageTarget* target, int32_t pass) {
+	static const u_int8_t mask[] = {7, 3, 1};
+	struct preview* p = target->user;
+	u_int8_t* pixels = p->buffer +
+		(p->out->size - (size_t)p->rowLength * p->height);
+	
+	memcpy(p->buffer, p->out->data, p->out->size);
+	for (int32_t y = 0; y < target->visibleHeight; y++) {
+		int32_t src = y & ~mask[pass - 1];
+		
+		if (src != y) {
+			/** obrázek je uložen zdola nahoru */
+			memcpy(&pixels[(size_t)(p->height - 1 - p->row0 - y) * p->rowLength],
+				&pixels[(size_t)(p->height - 1 - p->row0 - src) * p->rowLength],
+				p->rowLength);
+		}
+	}
+	p->options->preview(p->options->previewUser, pass, p->buffer, p->out->size);
+}
+
+/**
+ * Převod GIF souboru zpřístupněného v paměti na BMP soubor
+ * @param gif2bmp záznam o převodu
+ * @param in vstupní soubor (GIF)
+ * @param sink výstupní soubor (BMP)
+ * @param options volby převodu
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t convertImage(tGIF2BMP* gif2bmp, struct gifInput* in, struct bmpSink* sink,
+	const tGIF2BMPOptions* options) {
+	struct gifHeader gifh;			///< hlavička GIF souboru
+	struct globalPaletteInfo gpi;	///< globální informace o paletě
+	struct localPaletteInfo lpi;	///< lokální informace o paletě
+	struct imgHeader im;			///< informace o subdokumentu
+	struct bmpOutput out;			///< výstupní soubor v paměti
+	struct imageTarget target;		///< kam dekodér zapisuje řádky
+	struct preview preview;			///< náhledy po průchodech prokládání
+	u_int32_t table[256];			///< předpočítaná paleta BMP
+	int32_t colors;					///< počet barev použité palety GIF
+	int8_t retval;
+	tGIF2BMPStats* stats = options->stats;	///< měření fází převodu
+	int64_t start = clockNow();		///< začátek měřené fáze
+	
+	/** paleta barev */
+	struct qrgb palette[256];
+	
+	if (readGifHeader(in, &gifh, &gpi, palette) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	colors = gpi.global ? 1 << (gpi.length + 1) : 0;
+	start = phaseTime(&stats->headerTime, start);
 	
 	/** přeskočení rozšiřujících hlaviček */
-	if (skipExtensions(inputFile, gif2bmp) == GIF2BMPFail) {
+	if (skipExtensions(in) == GIF2BMPFail) {
 		return(GIF2BMPFail);
 	}
+	start = phaseTime(&stats->extensionTime, start);
 	
 	/** načtení hlavičky Image Block */
-	if (fread(&im, sizeof(im), 1, inputFile) == 0) {
+	if (inputRead(in, &im, sizeof(im)) == GIF2BMPFail) {
 		return(GIF2BMPFail);
 	}
-	gif2bmp->gifSize += sizeof(im);
 	
 	/** zpracování informací o lokální paletě */
 	getLocalPaletteInfo(im.flags, &lpi);
 
-	/** lokální barevné paleta použita? nerozumět! */
+	/** lokální paleta nahrazuje pro tento obrázek globální */
 	if (lpi.local) {
-		return(GIF2BMPFail);
+		if (readLocalPalette(in, &lpi, palette) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		colors = 1 << (lpi.length + 1);
 	}
+	buildColorTable(table, palette, colors, -1);
+	start = phaseTime(&stats->headerTime, start);
 	
-	/** dekódování vstupního souboru */
+	/** velikost BMP souboru je známa předem, připravíme celý výstup */
 	#ifdef DEBUG
-		fprintf(stderr, "width: %d, height: %d, malloc: %lu\n", gifh.width,
-				 gifh.height, sizeof(u_int8_t) * gifh.width * gifh.height);
+		fprintf(stderr, "width: %d, height: %d, bmp size: %lu\n", gifh.width,
+				 gifh.height, (unsigned long)bmpFileSize(gifh.width, gifh.height, 8, 256));
 	#endif
-	u_int8_t* image = malloc(sizeof(u_int8_t) * gifh.width * gifh.height);
-	if (decode(inputFile, gif2bmp, &gifh, image) == GIF2BMPFail) {
+	if (bmpOutputOpen(&out, sink, bmpFileSize(gifh.width, gifh.height, 8, 256))
+			== GIF2BMPFail) {
 		return(GIF2BMPFail);
 	}
 	
-	/** zkontrolujeme jestli jsme na konci souboru */
-	testEndOfBlock(inputFile, gif2bmp);
+	/** dekódování vstupního souboru přímo do výstupu */
+	if (writeBmpHeader(&out, gifh.width, gifh.height, 8, BI_RGB, table, 256,
+			gif2bmp) ==
+			GIF2BMPFail ||
+		writeBmpData(&out, &gifh, &im, lpi.interlaced, &target, gif2bmp) ==
+			GIF2BMPFail) {
+		bmpOutputClose(&out);
+		return(GIF2BMPFail);
+	}
+	phaseTime(&stats->writeTime, start);
 	
-	/** dočteme soubor do konce */
-	while (fgetc(inputFile) != EOF) {
-		gif2bmp->gifSize++;
+	/** náhledy po průchodech vyžadují postupné dekódování jedním vláknem */
+	memset(&preview, 0, sizeof(preview));
+	if (options->preview != NULL && lpi.interlaced) {
+		preview.options = options;
+		preview.out = &out;
+		preview.buffer = malloc(out.size);
+		preview.rowLength = bmpRowLength(gifh.width, 8);
+		preview.height = gifh.height;
+		preview.row0 = im.row0;
+		if (preview.buffer == NULL) {
+			bmpOutputClose(&out);
+			return(GIF2BMPFail);
+		}
+		target.passDone = previewPass;
+		target.user = &preview;
+	}
+	if ((options->parallelLZW && preview.buffer == NULL ?
+			decodeTwoPhase(in, &target, options->threads, stats) :
+			decode(in, &target, stats)) == GIF2BMPFail) {
+		free(preview.buffer);
+		bmpOutputClose(&out);
+		return(GIF2BMPFail);
 	}
+	free(preview.buffer);
+	
+	/** zbytek souboru projdeme až k ukončovací značce */
+	start = clockNow();
+	skipToTrailer(in);
+	start = phaseTime(&stats->extensionTime, start);
 
 	/** vrátíme výsledek zápisu dat */
-	return(writeBmpData(outputFile, &gifh, &gpi, palette, image, lpi.interlaced,
-		gif2bmp));
+	retval = bmpOutputClose(&out);
+	phaseTime(&stats->writeTime, start);
+	return(retval);
+}
+
+/**
+ * Načtení rozšíření Graphic Control (průhlednost, způsob odstranění snímku)
+ * @param in vstupní soubor, pozice za typem rozšíření
+ * @param frame snímek, kterému rozšíření patří
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t readGraphicsControl(struct gifInput* in, struct frameInfo* frame) {
+	u_int8_t blockSize;
+	u_int8_t gce[4];
+	
+	if (inputRead(in, &blockSize, 1) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	if (blockSize >= sizeof(gce)) {
+		if (inputRead(in, gce, sizeof(gce)) == GIF2BMPFail ||
+			inputSkip(in, blockSize - sizeof(gce)) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		frame->disposal = (gce[0] >> 2) & 0x07;
+		frame->transparent = gce[0] & 0x01;
+		frame->delay = gce[1] | (gce[2] << 8);
+		frame->transparentIndex = gce[3];
+	} else if (inputSkip(in, blockSize) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	/** případné další sub-bloky a terminátor */
+	return(blockSize == BLOCK_TERMINATOR ? GIF2BMPOK : skipBlocks(in));
+}
+
+/**
+ * Přečtení rozšíření až po další blok obrázku a jeho hlavičky. Vstup se čte
+ * jen dopředu, takže funkci lze použít i na proud.
+ * @param in vstupní soubor, pozice na začátku bloku
+ * @param frame hlavička bloku obrázku, jeho pozice a rozšíření Graphic Control
+ * @return GIF2BMPOK pokud byl blok obrázku nalezen, IMAGE_END na ukončovací
+ *   značce nebo konci souboru mezi bloky, GIF2BMPFail pro zkrácený nebo
+ *   poškozený soubor
+ */
+static int8_t readNextImage(struct gifInput* in, struct frameInfo* frame) {
+	u_int8_t magic;
+	
+	memset(frame, 0, sizeof(*frame));
+	while (inputRead(in, &magic, 1) == GIF2BMPOK) {
+		if (magic == EXTENSION_BLOCK_BEGIN_MARKER) {
+			if (inputRead(in, &magic, 1) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+			if (magic == GRAPICS_EXTENSION_BLOCK) {
+				if (readGraphicsControl(in, frame) == GIF2BMPFail) {
+					return(GIF2BMPFail);
+				}
+			} else if (skipBlocks(in) == GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		} else if (magic == IMAGE_BLOCK_BEGIN_MARKER) {
+			frame->offset = inputTell(in);
+			return(inputRead(in, &frame->im, sizeof(frame->im)));
+		} else {
+			/** ukončovací značka, nebo poškozený soubor */
+			return(magic == TRAILER_MARKER ? IMAGE_END : GIF2BMPFail);
+		}
+	}
+	/** chybějící ukončovací značka za celým blokem nevadí */
+	return(IMAGE_END);
+}
+
+/**
+ * Předběžný průchod souborem -- zaznamená pozici každého bloku obrázku a
+ * k němu příslušné rozšíření Graphic Control, obrazová data přeskakuje
+ * @param in vstupní soubor, pozice za globální paletou
+ * @param frames pole nalezených snímků (alokuje funkce)
+ * @param count počet nalezených snímků
+ * @param limit nejvyšší počet hledaných snímků, 0 = bez omezení
+ * @return GIF2BMPOK pokud nedošlo k chybě, GIF2BMPFail i pro zkrácený nebo
+ *   poškozený snímek
+ */
+static int8_t scanFrames(struct gifInput* in, struct frameInfo** frames, int32_t* count,
+	int32_t limit) {
+	struct frameInfo pending;		///< právě nalezený snímek
+	int32_t capacity = 0;
+	int8_t retval = GIF2BMPOK;
+	
+	*frames = NULL;
+	*count = 0;
+	
+	while ((limit <= 0 || *count < limit) &&
+			(retval = readNextImage(in, &pending)) == GIF2BMPOK) {
+		if (*count == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			struct frameInfo* tmp = realloc(*frames, sizeof(**frames) * capacity);
+			if (tmp == NULL) {
+				free(*frames);
+				*frames = NULL;
+				return(GIF2BMPFail);
+			}
+			*frames = tmp;
+		}
+		/** obrazová data přeskočíme po sub-blocích */
+		if ((retval = skipImageData(in, &pending.im)) == GIF2BMPFail) {
+			break;
+		}
+		(*frames)[(*count)++] = pending;
+	}
+	
+	/** zkrácený nebo poškozený snímek je chyba i za platnými snímky, jinak
+	 * by se animace tiše převedla bez nich */
+	if (*count == 0 || retval == GIF2BMPFail) {
+		free(*frames);
+		*frames = NULL;
+		return(GIF2BMPFail);
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Převod barev palety na indexy nejbližších barev jiné palety (podle
+ * vzdálenosti v RGB)
+ * @param map výsledné indexy pro všech 256 barev
+ * @param colors tabulka převáděných barev (BGRA)
+ * @param table tabulka barev cílové palety (BGRA)
+ * @param count počet barev cílové palety
+ */
+static void mapPalette(u_int8_t* map, const u_int32_t* colors,
+	const u_int32_t* table, int32_t count) {
+	for (int32_t i = 0; i < 256; i++) {
+		int32_t best = INT32_MAX;
+		
+		map[i] = 0;
+		for (int32_t j = 0; j < count && best > 0; j++) {
+			int32_t db = (int32_t)(colors[i] & 0xff) - (int32_t)(table[j] & 0xff);
+			int32_t dg = (int32_t)((colors[i] >> 8) & 0xff) -
+				(int32_t)((table[j] >> 8) & 0xff);
+			int32_t dr = (int32_t)((colors[i] >> 16) & 0xff) -
+				(int32_t)((table[j] >> 16) & 0xff);
+			int32_t distance = dr * dr + dg * dg + db * db;
+			if (distance < best) {
+				best = distance;
+				map[i] = j;
+			}
+		}
+	}
+}
+
+/**
+ * Dekódování jednoho snímku animace do jeho vlastního bufferu
+ * @param pool sdílený stav vláken (vstup, paleta a volby převodu)
+ * @param frame snímek k dekódování
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t decodeFrame(struct framePool* pool, struct frameInfo* frame) {
+	struct gifInput local = *pool->in;	///< vlastní pozice čtení pro vlákno
+	struct localPaletteInfo lpi;
+	struct imageTarget target;
+	struct qrgb palette[256];
+	size_t pixels = (size_t)frame->im.width * frame->im.height;
+	tGIF2BMPStats stats;		///< měření snímku, přičte se pod zámkem
+	int8_t retval;
+	
+	/** snímky dekódují i vlákna skupiny, slovník kontextu patří jen
+	 * vláknu převodu */
+	local.decoder = NULL;
+	getLocalPaletteInfo(frame->im.flags, &lpi);
+	local.pos = frame->offset + sizeof(struct imgHeader);
+	frame->mapped = 0;
+	if (lpi.local) {
+		if (readLocalPalette(&local, &lpi, palette) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		buildColorTable(frame->colors, palette, 1 << (lpi.length + 1),
+			frame->transparent ? frame->transparentIndex : -1);
+		/** paletový výstup má jedinou paletu pro všechny snímky, barvy
+		 * lokální palety se nahradí nejbližšími barvami palety výstupu */
+		if (pool->bitCount <= 8 && pool->options->frames != GIF2BMPFirstFrame) {
+			mapPalette(frame->map, frame->colors, pool->outputTable,
+				pool->outputColors);
+			frame->mapped = 1;
+		}
+	} else {
+		buildColorTable(frame->colors, pool->palette, pool->colors,
+			frame->transparent ? frame->transparentIndex : -1);
+	}
+	
+	frame->data = calloc(pixels ? pixels : 1, 1);
+	if (frame->data == NULL) {
+		return(GIF2BMPFail);
+	}
+	target.base = frame->data;
+	target.stride = frame->im.width;
+	target.width = target.visibleWidth = frame->im.width;
+	target.height = target.visibleHeight = frame->im.height;
+	target.interlaced = lpi.interlaced;
+	target.rowDone = NULL;
+	target.passDone = NULL;
+	memset(&stats, 0, sizeof(stats));
+	retval = pool->options->parallelLZW ?
+		decodeTwoPhase(&local, &target, pool->lzwThreads, &stats) :
+		decode(&local, &target, &stats);
+	
+	pthread_mutex_lock(&pool->lock);
+	addStats(pool->options->stats, &stats);
+	pthread_mutex_unlock(&pool->lock);
+	return(retval);
+}
+
+/**
+ * Vlákno dekódující snímky animace v pořadí, v jakém je skládání potřebuje
+ * @param arg sdílený stav vláken (struct framePool)
+ */
+static void* frameWorker(void* arg) {
+	struct framePool* pool = arg;
+	
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		/** nepředbíháme skládání o víc než velikost okna (omezení paměti) */
+		while (!pool->abort && pool->next < pool->count &&
+				pool->next >= pool->composed + pool->window) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if (pool->abort || pool->next >= pool->count) {
+			break;
+		}
+		int32_t i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		
+		int8_t result = decodeFrame(pool, &pool->frames[i]);
+		
+		pthread_mutex_lock(&pool->lock);
+		pool->frames[i].state = result == GIF2BMPOK ? FRAME_DECODED : FRAME_FAILED;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return(NULL);
+}
+
+/**
+ * Čekání na dekódování snímku; pokud jej zatím žádné vlákno nezačalo
+ * dekódovat, dekóduje jej volající vlákno samo
+ * @param pool sdílený stav vláken
+ * @param i index snímku
+ * @return GIF2BMPOK pokud byl snímek dekódován, jinak GIF2BMPFail
+ */
+static int8_t waitFrame(struct framePool* pool, int32_t i) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->frames[i].state == FRAME_PENDING) {
+		if (pool->next == i) {
+			pool->next++;
+			pthread_mutex_unlock(&pool->lock);
+			int8_t result = decodeFrame(pool, &pool->frames[i]);
+			pthread_mutex_lock(&pool->lock);
+			pool->frames[i].state = result == GIF2BMPOK ? FRAME_DECODED : FRAME_FAILED;
+		} else {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return(pool->frames[i].state == FRAME_DECODED ? GIF2BMPOK : GIF2BMPFail);
+}
+
+/**
+ * Vyplnění souvislé řady pixelů plátna jednou hodnotou
+ * @param dst první pixel
+ * @param count počet pixelů
+ * @param bitCount barevná hloubka plátna (do 8 = indexy, jinak BGRA)
+ * @param value index barvy nebo barva BGRA
+ */
+static void fillPixels(u_int8_t* dst, size_t count, int16_t bitCount, u_int32_t value) {
+	if (bitCount <= 8) {
+		memset(dst, value, count);
+	} else {
+		u_int32_t* pixel = (u_int32_t*)dst;
+		for (size_t i = 0; i < count; i++) {
+			pixel[i] = value;
+		}
+	}
+}
+
+/**
+ * Složení snímku do plátna podle průhledné barvy
+ * @param canvas plátno velikosti logické obrazovky
+ * @param gifh hlavička GIF souboru
+ * @param frame dekódovaný snímek
+ * @param bitCount barevná hloubka plátna (do 8 = indexy, jinak BGRA)
+ */
+static void composeFrame(u_int8_t* canvas, struct gifHeader* gifh,
+	struct frameInfo* frame, int16_t bitCount) {
+	struct imgHeader* im = &frame->im;
+	int32_t width, height;
+	
+	if (im->col0 >= gifh->width || im->row0 >= gifh->height) {
+		return;
+	}
+	width = im->width < gifh->width - im->col0 ? im->width : gifh->width - im->col0;
+	height = im->height < gifh->height - im->row0 ? im->height : gifh->height - im->row0;
+	
+	for (int32_t y = 0; y < height; y++) {
+		size_t at = (size_t)(im->row0 + y) * gifh->width + im->col0;
+		const u_int8_t* src = &frame->data[(size_t)y * im->width];
+		if (bitCount > 8) {
+			/** převod přes tabulku barev, průhlednost řeší nulová alfa */
+			composeRow((u_int32_t*)canvas + at, src, width, frame->colors);
+		} else if (frame->mapped) {
+			/** průhlednost se určuje podle indexu lokální palety */
+			for (int32_t x = 0; x < width; x++) {
+				if (!frame->transparent || src[x] != frame->transparentIndex) {
+					canvas[at + x] = frame->map[src[x]];
+				}
+			}
+		} else if (frame->transparent) {
+			for (int32_t x = 0; x < width; x++) {
+				if (src[x] != frame->transparentIndex) {
+					canvas[at + x] = src[x];
+				}
+			}
+		} else {
+			memcpy(&canvas[at], src, width);
+		}
+	}
+}
+
+/**
+ * Odstranění snímku z plátna po jeho zobrazení
+ * @param canvas plátno velikosti logické obrazovky
+ * @param previous plátno před vykreslením snímku
+ * @param gifh hlavička GIF souboru
+ * @param frame zobrazený snímek
+ * @param bitCount barevná hloubka plátna (do 8 = indexy, jinak BGRA)
+ * @param background hodnota pozadí plátna
+ */
+static void disposeFrame(u_int8_t* canvas, u_int8_t* previous, struct gifHeader* gifh,
+	struct frameInfo* frame, int16_t bitCount, u_int32_t background) {
+	struct imgHeader* im = &frame->im;
+	size_t pixelSize = bitCount <= 8 ? 1 : sizeof(u_int32_t);
+	size_t size = (size_t)gifh->width * gifh->height * pixelSize;
+	
+	if (frame->disposal == DISPOSE_PREVIOUS) {
+		/** obnovení stavu před vykreslením snímku */
+		memcpy(canvas, previous, size);
+	} else if (frame->disposal == DISPOSE_BACKGROUND &&
+			im->col0 < gifh->width && im->row0 < gifh->height) {
+		/** vyplnění oblasti snímku barvou pozadí */
+		int32_t width = im->width < gifh->width - im->col0 ?
+			im->width : gifh->width - im->col0;
+		int32_t height = im->height < gifh->height - im->row0 ?
+			im->height : gifh->height - im->row0;
+		for (int32_t y = 0; y < height; y++) {
+			fillPixels(&canvas[((size_t)(im->row0 + y) * gifh->width + im->col0) *
+				pixelSize], width, bitCount, background);
+		}
+	}
+}
+
+/**
+ * Zápis řádků plátna do BMP výstupu (převrácených podle osy y)
+ * @param pixels začátek obrazových dat v BMP výstupu
+ * @param canvas plátno velikosti logické obrazovky
+ * @param width šířka plátna
+ * @param height výška plátna
+ * @param bitCount barevná hloubka výstupu
+ */
+static void writeCanvasRows(u_int8_t* pixels, const u_int8_t* canvas, int32_t width,
+	int32_t height, int16_t bitCount) {
+	int32_t rowLength = bmpRowLength(width, bitCount);
+	size_t pixelSize = bitCount <= 8 ? 1 : sizeof(u_int32_t);
+	
+	for (int32_t row = 0; row < height; row++) {
+		u_int8_t* dst = &pixels[(size_t)(height - 1 - row) * rowLength];
+		const u_int8_t* src = &canvas[(size_t)row * width * pixelSize];
+		if (bitCount == 24) {
+			packRow24(dst, (const u_int32_t*)src, width);
+		} else if (bitCount < 8) {
+			packRowBits(dst, src, width, bitCount);
+		} else {
+			memcpy(dst, src, (size_t)width * pixelSize);
+		}
+	}
+}
+
+/**
+ * Kontrola vzoru jmen souborů snímků -- povolena je právě jedna konverze %d
+ * (případně s šířkou, např. %03d), jinak by šlo o neřízený formátovací řetězec
+ * @param pattern vzor jmen souborů
+ * @return GIF2BMPOK pokud je vzor v pořádku, jinak GIF2BMPFail
+ */
+static int8_t checkFramePattern(const char* pattern) {
+	int conversions = 0;
+	
+	if (pattern == NULL) {
+		return(GIF2BMPFail);
+	}
+	for (const char* p = pattern; *p; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		if (p[1] == '%') {
+			p++;
+			continue;
+		}
+		p++;
+		while (*p >= '0' && *p <= '9') {
+			p++;
+		}
+		if (*p != 'd') {
+			return(GIF2BMPFail);
+		}
+		conversions++;
+	}
+	return(conversions == 1 ? GIF2BMPOK : GIF2BMPFail);
+}
+
+/**
+ * Test, zda některý snímek má vlastní lokální paletu
+ * @param frames nalezené snímky
+ * @param count počet snímků
+ * @return 1 pokud alespoň jeden snímek má lokální paletu, jinak 0
+ */
+static int8_t hasLocalPalettes(const struct frameInfo* frames, int32_t count) {
+	struct localPaletteInfo lpi;
+	
+	for (int32_t i = 0; i < count; i++) {
+		getLocalPaletteInfo(frames[i].im.flags, &lpi);
+		if (lpi.local) {
+			return(1);
+		}
+	}
+	return(0);
+}
+
+/**
+ * Určení formátu výstupu z voleb převodu a velikosti palety
+ * @param options volby převodu
+ * @param paletteColors počet barev palety GIF použité pro výstup
+ * @param bitCount barevná hloubka výstupu
+ * @param compression komprese výstupu (BI_RGB, BI_RLE8)
+ * @return počet barev palety BMP, záporný pokud formát nelze použít
+ */
+static int32_t resolveFormat(const tGIF2BMPOptions* options, int32_t paletteColors,
+	int16_t* bitCount, int32_t* compression) {
+	int32_t colorCount;
+	
+	*bitCount = options->bitCount ? options->bitCount : 8;
+	*compression = options->compression == GIF2BMPCompressRLE8 ? BI_RLE8 : BI_RGB;
+	if (*bitCount != 1 && *bitCount != 4 && *bitCount != 8 && *bitCount != 24 &&
+			*bitCount != 32) {
+		return(-1);
+	}
+	/** komprese je definována jen pro paletu s 8 bity na pixel */
+	if (options->compression != GIF2BMPCompressNone && *bitCount != 8) {
+		return(-1);
+	}
+	
+	/** nejmenší formát, do kterého se paleta vejde */
+	if (options->compression == GIF2BMPCompressAuto) {
+		if (paletteColors <= 2) {
+			*bitCount = 1;
+		} else if (paletteColors <= 16) {
+			*bitCount = 4;
+		} else {
+			*compression = BI_RLE8;
+		}
+	}
+	colorCount = *bitCount <= 8 ? 1 << *bitCount : 0;
+	return(*bitCount < 8 && paletteColors > colorCount ? -1 : colorCount);
+}
+
+/**
+ * Zápis plátna jako celého BMP souboru
+ * @param gif2bmp záznam o převodu
+ * @param sink kam se výstup zapíše
+ * @param canvas plátno (indexy barev nebo barvy BGRA)
+ * @param width šířka plátna
+ * @param height výška plátna
+ * @param bitCount barevná hloubka výstupu
+ * @param compression komprese obrazových dat (BI_RGB, BI_RLE8)
+ * @param table předpočítaná paleta BMP
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t writeCanvasFile(tGIF2BMP* gif2bmp, struct bmpSink* sink,
+	const u_int8_t* canvas,
+	int32_t width, int32_t height, int16_t bitCount, int32_t compression,
+	const u_int32_t* table) {
+	struct bmpOutput out;
+	int32_t colorCount = bitCount <= 8 ? 1 << bitCount : 0;
+	size_t size = bmpFileSize(width, height, bitCount, colorCount);
+	size_t dataSize = (size_t)bmpRowLength(width, bitCount) * height;
+	
+	if (compression == BI_RLE8) {
+		/** velikost komprimovaných dat je známa až po zakódování */
+		struct rleBuffer buffer;
+		int8_t retval;
+		
+		memset(&buffer, 0, sizeof(buffer));
+		retval = rleEncodeFrame(&buffer, canvas, width, height);
+		if (retval == GIF2BMPOK) {
+			retval = writeRleOutput(gif2bmp, sink, width, height, table, &buffer, 1);
+		}
+		free(buffer.data);
+		return(retval);
+	}
+	if (bmpOutputOpen(&out, sink, size) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	writeBmpHeader(&out, width, height, bitCount, BI_RGB, table, colorCount,
+		gif2bmp);
+	writeCanvasRows(out.data + (size - dataSize), canvas, width, height, bitCount);
+	gif2bmp->bmpSize += dataSize;
+	return(bmpOutputClose(&out));
+}
+
+/**
+ * Zápis jednoho složeného snímku do samostatného BMP souboru
+ * @param gif2bmp záznam o převodu
+ * @param options volby převodu (vzor jmen souborů)
+ * @param index číslo snímku
+ * @param canvas složené plátno
+ * @param gifh hlavička GIF souboru
+ * @param bitCount barevná hloubka výstupu
+ * @param compression komprese obrazových dat (BI_RGB, BI_RLE8)
+ * @param table předpočítaná paleta BMP
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t writeFrameFile(tGIF2BMP* gif2bmp, const tGIF2BMPOptions* options,
+	int32_t index, const u_int8_t* canvas, struct gifHeader* gifh,
+	int16_t bitCount, int32_t compression, const u_int32_t* table) {
+	char filename[FILENAME_MAX];
+	struct bmpSink sink = {NULL, NULL, 0, 0};
+	
+	sink.memoryLimit = options->memoryLimit;
+	snprintf(filename, sizeof(filename), options->framePattern, (int)index);
+	if ((sink.file = fopen(filename, "wb")) == NULL) {
+		return(GIF2BMPFail);
+	}
+	if (writeCanvasFile(gif2bmp, &sink, canvas, gifh->width, gifh->height,
+			bitCount, compression, table) == GIF2BMPFail) {
+		fclose(sink.file);
+		return(GIF2BMPFail);
+	}
+	return(fclose(sink.file) == 0 ? GIF2BMPOK : GIF2BMPFail);
+}
+
+/**
+ * Převod snímků GIF přes plátno -- všechny snímky animace, nebo první snímek
+ * v jiném než přímo dekódovaném formátu (true-color, 1/4 bity, BI_RLE8).
+ * Snímky se dekódují paralelně skupinou vláken (datové proudy snímků jsou
+ * nezávislé), skládání podle pravidel odstranění a průhlednosti probíhá
+ * sériově v pořadí snímků.
+ * @param gif2bmp záznam o převodu
+ * @param in vstupní soubor (GIF)
+ * @param sink výstupní soubor (BMP) pro GIF2BMPFirstFrame
+ *   a GIF2BMPSpriteSheet
+ * @param options volby převodu
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t convertFrames(tGIF2BMP* gif2bmp, struct gifInput* in,
+	struct bmpSink* sink, const tGIF2BMPOptions* options) {
+	struct gifHeader gifh;			///< hlavička GIF souboru
+	struct globalPaletteInfo gpi;	///< globální informace o paletě
+	struct qrgb palette[256];		///< paleta barev
+	u_int32_t table[256];			///< předpočítaná globální paleta
+	u_int32_t outputTable[256];		///< paleta BMP výstupu
+	struct framePool pool;			///< sdílený stav dekódujících vláken
+	struct bmpOutput sheet;			///< výstup se všemi snímky pod sebou
+	struct rleBuffer* chunks = NULL;	///< snímky listu v kódování BI_RLE8
+	pthread_t* workers = NULL;
+	int32_t workerCount = 0;
+	int32_t threads;
+	u_int8_t* canvas = NULL;
+	u_int8_t* previous = NULL;
+	int8_t retval = GIF2BMPOK;
+	int16_t bitCount;				///< barevná hloubka výstupu
+	int32_t compression;			///< komprese výstupu
+	int32_t paletteColors;			///< počet barev palety výstupu
+	int32_t colorCount;				///< počet barev palety BMP
+	int64_t sheetHeight;			///< výška výstupu se všemi snímky
+	u_int32_t background;
+	size_t canvasSize;
+	int64_t limit = options->memoryLimit > 0 ? options->memoryLimit :
+		MEMORY_LIMIT;					///< limit paměti pro snímky a plátno
+	int64_t frameSize = 1;			///< počet pixelů největšího snímku
+	tGIF2BMPStats* stats = options->stats;	///< měření fází převodu
+	int64_t start = clockNow();		///< začátek měřené fáze
+	
+	if (resolveFormat(options, 0, &bitCount, &compression) < 0) {
+		return(GIF2BMPFail);
+	}
+	if (readGifHeader(in, &gifh, &gpi, palette) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	if (options->frames == GIF2BMPAllFrames &&
+			checkFramePattern(options->framePattern) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	
+	memset(&pool, 0, sizeof(pool));
+	pool.colors = gpi.global ? 1 << (gpi.length + 1) : 0;
+	buildColorTable(table, palette, pool.colors, -1);
+	start = phaseTime(&stats->headerTime, start);
+	if (scanFrames(in, &pool.frames, &pool.count,
+			options->frames == GIF2BMPFirstFrame ? 1 : 0) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	start = phaseTime(&stats->extensionTime, start);
+	
+	/** paleta výstupu; samotný první snímek smí mít vlastní lokální paletu,
+	 * bez globální palety ji převezme paleta výstupu všech snímků */
+	paletteColors = pool.colors;
+	memcpy(outputTable, table, sizeof(table));
+	if (options->frames == GIF2BMPFirstFrame || pool.colors == 0) {
+		struct localPaletteInfo lpi;
+		struct gifInput local = *in;
+		struct qrgb localPalette[256];
+		
+		getLocalPaletteInfo(pool.frames[0].im.flags, &lpi);
+		local.pos = pool.frames[0].offset + sizeof(struct imgHeader);
+		if (lpi.local) {
+			if (readLocalPalette(&local, &lpi, localPalette) == GIF2BMPFail) {
+				free(pool.frames);
+				return(GIF2BMPFail);
+			}
+			paletteColors = 1 << (lpi.length + 1);
+			buildColorTable(outputTable, localPalette, paletteColors, -1);
+		}
+		start = phaseTime(&stats->headerTime, start);
+	}
+	
+	colorCount = resolveFormat(options, paletteColors, &bitCount, &compression);
+	/** lokální palety dalších snímků se do jediné palety nevejdou, výchozí
+	 * formát proto přejde na true-color (zadaná paleta se mapuje) */
+	if (colorCount >= 0 && options->frames != GIF2BMPFirstFrame &&
+			options->bitCount == 0 && options->compression == GIF2BMPCompressNone &&
+			hasLocalPalettes(pool.frames, pool.count)) {
+		bitCount = 24;
+		colorCount = 0;
+	}
+	sheetHeight = (int64_t)gifh.height * pool.count;
+	if (colorCount < 0 || (options->frames != GIF2BMPAllFrames &&
+			sheetHeight > INT32_MAX)) {
+		free(pool.frames);
+		return(GIF2BMPFail);
+	}
+	
+	/** pozadí: index barvy, u 32 bitů průhledná, jinak barva z globální palety */
+	if (bitCount <= 8) {
+		background = gifh.bgColor;
+	} else if (bitCount == 32) {
+		background = 0;
+	} else {
+		background = table[gifh.bgColor] | 0xff000000u;
+	}
+	
+	/** plátno velikosti logické obrazovky, na začátku vyplněné pozadím */
+	canvasSize = (size_t)gifh.width * gifh.height *
+		(bitCount <= 8 ? 1 : sizeof(u_int32_t));
+	canvas = malloc(canvasSize ? canvasSize : 1);
+	for (int32_t i = 0; i < pool.count; i++) {
+		/** kopie plátna je potřeba jen pro obnovení předchozího stavu */
+		if (pool.frames[i].disposal == DISPOSE_PREVIOUS) {
+			previous = malloc(canvasSize ? canvasSize : 1);
+			if (previous == NULL) {
+				free(canvas);
+				canvas = NULL;
+			}
+			break;
+		}
+	}
+	if (canvas == NULL) {
+		free(canvas);
+		free(previous);
+		free(pool.frames);
+		return(GIF2BMPFail);
+	}
+	fillPixels(canvas, (size_t)gifh.width * gifh.height, bitCount, background);
+	start = phaseTime(&stats->composeTime, start);
+	
+	/** všechny snímky pod sebou do jednoho BMP; komprimovaná data mají
+	 * velikost známou až na konci, snímky se proto kódují do bufferů */
+	memset(&sheet, 0, sizeof(sheet));
+	if (options->frames != GIF2BMPAllFrames && compression == BI_RLE8) {
+		chunks = calloc(pool.count, sizeof(*chunks));
+		if (chunks == NULL) {
+			free(canvas);
+			free(previous);
+			free(pool.frames);
+			return(GIF2BMPFail);
+		}
+	} else if (options->frames != GIF2BMPAllFrames) {
+		if (bmpOutputOpen(&sheet, sink, bmpFileSize(gifh.width,
+				sheetHeight, bitCount, colorCount)) == GIF2BMPFail) {
+			free(canvas);
+			free(previous);
+			free(pool.frames);
+			return(GIF2BMPFail);
+		}
+		writeBmpHeader(&sheet, gifh.width, sheetHeight, bitCount, BI_RGB,
+			outputTable, colorCount, gif2bmp);
+	}
+	phaseTime(&stats->writeTime, start);
+	
+	/** spuštění vláken; volající vlákno dekóduje také */
+	pool.in = in;
+	pool.options = options;
+	pool.palette = palette;
+	pool.bitCount = bitCount;
+	pool.outputTable = outputTable;
+	pool.outputColors = paletteColors;
+	/** dekódované a dosud nesložené snímky se musí vejít do limitu paměti */
+	limit -= (int64_t)canvasSize * (previous != NULL ? 2 : 1);
+	for (int32_t i = 0; i < pool.count; i++) {
+		if ((int64_t)pool.frames[i].im.width * pool.frames[i].im.height >
+				frameSize) {
+			frameSize = (int64_t)pool.frames[i].im.width * pool.frames[i].im.height;
+		}
+	}
+	pool.window = limit / frameSize < DECODE_WINDOW ?
+		(limit / frameSize > 1 ? limit / frameSize : 1) : DECODE_WINDOW;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+	threads = options->threads > 0 ? options->threads :
+		(int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	workerCount = threads > pool.count ? pool.count - 1 : threads - 1;
+	/** snímky dekódované souběžně si vlákna -p dělí, jinak by jich běželo
+	 * až threads x threads */
+	pool.lzwThreads = workerCount > 0 ? threads / (workerCount + 1) : threads;
+	if (pool.lzwThreads < 1) {
+		pool.lzwThreads = 1;
+	}
+	if (workerCount > 0) {
+		workers = malloc(sizeof(*workers) * workerCount);
+		for (int32_t i = 0; workers != NULL && i < workerCount; i++) {
+			if (pthread_create(&workers[i], NULL, frameWorker, &pool) != 0) {
+				workerCount = i;
+				break;
+			}
+		}
+		if (workers == NULL) {
+			workerCount = 0;
+		}
+	}
+	
+	/** sériové skládání snímků v pořadí */
+	for (int32_t i = 0; i < pool.count; i++) {
+		struct frameInfo* frame = &pool.frames[i];
+		
+		/** limit převodu platí i pro skládání dlouhých animací */
+		if (waitFrame(&pool, i) == GIF2BMPFail ||
+				budgetCharge(in->budget, 0) == GIF2BMPFail) {
+			retval = GIF2BMPFail;
+			break;
+		}
+		start = clockNow();
+		if (frame->disposal == DISPOSE_PREVIOUS) {
+			memcpy(previous, canvas, canvasSize);
+		}
+		/** samotný paletový snímek má indexy beze změny jako přímý převod */
+		if (bitCount <= 8 && options->frames == GIF2BMPFirstFrame) {
+			frame->transparent = 0;
+		}
+		composeFrame(canvas, &gifh, frame, bitCount);
+		start = phaseTime(&stats->composeTime, start);
+		
+		if (chunks != NULL) {
+			if (rleEncodeFrame(&chunks[i], canvas, gifh.width, gifh.height) ==
+					GIF2BMPFail) {
+				retval = GIF2BMPFail;
+				break;
+			}
+		} else if (options->frames != GIF2BMPAllFrames) {
+			int32_t rowLength = bmpRowLength(gifh.width, bitCount);
+			/** snímek i leží v listu na řádcích i*výška (shora) */
+			writeCanvasRows(sheet.data + (sheet.size - (size_t)rowLength *
+				gifh.height * (i + 1)), canvas, gifh.width, gifh.height, bitCount);
+		} else if (writeFrameFile(gif2bmp, options, i, canvas, &gifh, bitCount,
+				compression, outputTable) == GIF2BMPFail) {
+			retval = GIF2BMPFail;
+			break;
+		}
+		start = phaseTime(&stats->writeTime, start);
+		disposeFrame(canvas, previous, &gifh, frame, bitCount, background);
+		phaseTime(&stats->composeTime, start);
+		
+		/** uvolnění snímku a posun okna pro dekódující vlákna */
+		pthread_mutex_lock(&pool.lock);
+		free(frame->data);
+		frame->data = NULL;
+		pool.composed++;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+	
+	/** ukončení vláken */
+	pthread_mutex_lock(&pool.lock);
+	pool.abort = 1;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+	for (int32_t i = 0; i < workerCount; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
+	
+	start = clockNow();
+	if (chunks != NULL) {
+		if (retval == GIF2BMPOK) {
+			retval = writeRleOutput(gif2bmp, sink, gifh.width, sheetHeight,
+				outputTable, chunks, pool.count);
+		}
+		for (int32_t i = 0; i < pool.count; i++) {
+			free(chunks[i].data);
+		}
+		free(chunks);
+	} else if (options->frames != GIF2BMPAllFrames) {
+		gif2bmp->bmpSize += (int64_t)bmpRowLength(gifh.width, bitCount) *
+			gifh.height * pool.count;
+		if (bmpOutputClose(&sheet) == GIF2BMPFail) {
+			retval = GIF2BMPFail;
+		}
+	}
+	for (int32_t i = 0; i < pool.count; i++) {
+		free(pool.frames[i].data);
+	}
+	free(pool.frames);
+	free(canvas);
+	free(previous);
+	start = phaseTime(&stats->writeTime, start);
+	
+	/** u prvního snímku projdeme zbytek souboru až k ukončovací značce */
+	if (retval == GIF2BMPOK && options->frames == GIF2BMPFirstFrame) {
+		skipToTrailer(in);
+		phaseTime(&stats->extensionTime, start);
+	}
+	return(retval);
+}
+
+/**
+ * Zpracování dokončeného řádku rámce při zmenšování. Paletový výstup
+ * vzorkuje levý horní pixel každého čtverce, true-color výstup sčítá složky
+ * všech pixelů čtverce (box filtr).
+ * @param target cíl dekodéru, user ukazuje na struct thumbnail
+ * @param y řádek rámce
+ * @param row indexy pixelů řádku
+ */
+static void thumbnailRow(struct imageTarget* target, int32_t y, const u_int8_t* row) {
+	struct thumbnail* t = target->user;
+	int32_t sy = t->row0 + y;
+	int32_t oy = sy / t->factor;
+	int32_t ox = t->col0 / t->factor;
+	int32_t phase = t->col0 % t->factor;
+	
+	if (t->bitCount <= 8) {
+		u_int8_t* dst = &t->pixels[(size_t)oy * t->width];
+		if (sy % t->factor != 0) {
+			return;
+		}
+		for (int32_t x = phase ? t->factor - phase : 0; x < target->visibleWidth;
+				x += t->factor) {
+			dst[(t->col0 + x) / t->factor] = row[x];
+		}
+		return;
+	}
+	
+	u_int64_t* sum = &t->sums[(size_t)oy * t->width * 4];
+	for (int32_t x = 0; x < target->visibleWidth; x++) {
+		u_int32_t color = t->colors[row[x]];
+		/** průhledný pixel odkrývá pozadí */
+		if (!(color & 0xff000000u)) {
+			color = t->background;
+		}
+		if (color & 0xff000000u) {
+			u_int64_t* cell = &sum[4 * ox];
+			cell[0] += color & 0xff;
+			cell[1] += (color >> 8) & 0xff;
+			cell[2] += (color >> 16) & 0xff;
+			cell[3]++;
+		}
+		if (++phase == t->factor) {
+			phase = 0;
+			ox++;
+		}
+	}
+}
+
+/**
+ * Délka průniku dvou intervalů [a0, a1) a [b0, b1)
+ */
+static int32_t overlap(int32_t a0, int32_t a1, int32_t b0, int32_t b1) {
+	int32_t from = a0 > b0 ? a0 : b0;
+	int32_t to = a1 < b1 ? a1 : b1;
+	
+	return(to > from ? to - from : 0);
+}
+
+/**
+ * Započtení pozadí v části obrazovky, kterou rámec nepokrývá (box filtr)
+ * @param t zmenšovaný obrázek
+ * @param gifh hlavička GIF souboru
+ * @param target cíl dekodéru (viditelná část rámce)
+ */
+static void thumbnailBackground(struct thumbnail* t, struct gifHeader* gifh,
+	struct imageTarget* target) {
+	if (!(t->background & 0xff000000u)) {
+		return;
+	}
+	for (int32_t oy = 0; oy < t->height; oy++) {
+		int32_t y0 = oy * t->factor;
+		int32_t y1 = y0 + t->factor < gifh->height ? y0 + t->factor : gifh->height;
+		int32_t coverY = overlap(y0, y1, t->row0, t->row0 + target->visibleHeight);
+		
+		for (int32_t ox = 0; ox < t->width; ox++) {
+			int32_t x0 = ox * t->factor;
+			int32_t x1 = x0 + t->factor < gifh->width ? x0 + t->factor : gifh->width;
+			int64_t uncovered = (int64_t)(x1 - x0) * (y1 - y0) - (int64_t)coverY *
+				overlap(x0, x1, t->col0, t->col0 + target->visibleWidth);
+			u_int64_t* cell = &t->sums[((size_t)oy * t->width + ox) * 4];
+			
+			cell[0] += uncovered * (t->background & 0xff);
+			cell[1] += uncovered * ((t->background >> 8) & 0xff);
+			cell[2] += uncovered * ((t->background >> 16) & 0xff);
+			cell[3] += uncovered;
+		}
+	}
+}
+
+/**
+ * Převod součtů box filtru na pixely BGRA. Alfa odpovídá podílu
+ * neprůhledných pixelů ve čtverci.
+ * @param t zmenšovaný obrázek
+ * @param gifh hlavička GIF souboru
+ */
+static void thumbnailFinish(struct thumbnail* t, struct gifHeader* gifh) {
+	u_int32_t* dst = (u_int32_t*)t->pixels;
+	
+	for (int32_t oy = 0; oy < t->height; oy++) {
+		int32_t rows = gifh->height - oy * t->factor < t->factor ?
+			gifh->height - oy * t->factor : t->factor;
+		for (int32_t ox = 0; ox < t->width; ox++) {
+			int32_t cols = gifh->width - ox * t->factor < t->factor ?
+				gifh->width - ox * t->factor : t->factor;
+			u_int64_t* cell = &t->sums[((size_t)oy * t->width + ox) * 4];
+			u_int64_t n = cell[3];
+			
+			if (n == 0) {
+				*dst++ = 0;
+				continue;
+			}
+			*dst++ = (u_int32_t)((cell[0] + n / 2) / n) |
+				((u_int32_t)((cell[1] + n / 2) / n) << 8) |
+				((u_int32_t)((cell[2] + n / 2) / n) << 16) |
+				((u_int32_t)(255 * n / ((u_int64_t)rows * cols)) << 24);
+		}
+	}
+}
+
+/**
+ * Příprava prvního snímku k dekódování po řádcích (náhled, výřezy)
+ * @param in vstupní soubor (GIF)
+ * @param ff první snímek, jeho paleta a cíl dekodéru bez bufferu
+ * @param stats měrné údaje, ke kterým se přičte čtení hlaviček a rozšíření
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t readFirstFrame(struct gifInput* in, struct firstFrame* ff,
+	tGIF2BMPStats* stats) {
+	struct globalPaletteInfo gpi;	///< globální informace o paletě
+	struct localPaletteInfo lpi;	///< lokální informace o paletě
+	struct qrgb palette[256];		///< paleta barev
+	int64_t start = clockNow();		///< začátek měřené fáze
+	
+	memset(ff, 0, sizeof(*ff));
+	if (readGifHeader(in, &ff->gifh, &gpi, palette) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	ff->colors = gpi.global ? 1 << (gpi.length + 1) : 0;
+	start = phaseTime(&stats->headerTime, start);
+	if (readNextImage(in, &ff->frame) != GIF2BMPOK) {
+		return(GIF2BMPFail);
+	}
+	start = phaseTime(&stats->extensionTime, start);
+	
+	/** pozadí je vždy z globální palety, lokální paleta platí pro rámec */
+	buildColorTable(ff->table, palette, ff->colors, -1);
+	ff->background = ff->table[ff->gifh.bgColor];
+	ff->data = in;
+	getLocalPaletteInfo(ff->frame.im.flags, &lpi);
+	if (lpi.local) {
+		if (readLocalPalette(in, &lpi, palette) == GIF2BMPFail) {
+			return(GIF2BMPFail);
+		}
+		ff->colors = 1 << (lpi.length + 1);
+	}
+	buildColorTable(ff->table, palette, ff->colors, -1);
+	buildColorTable(ff->frame.colors, palette, ff->colors,
+		ff->frame.transparent ? ff->frame.transparentIndex : -1);
+	
+	/** rozměry rámce a jeho část ležící v logické obrazovce */
+	ff->target.width = ff->frame.im.width;
+	ff->target.height = ff->frame.im.height;
+	ff->target.interlaced = lpi.interlaced;
+	if (ff->frame.im.col0 < ff->gifh.width && ff->frame.im.row0 < ff->gifh.height) {
+		ff->target.visibleWidth = ff->target.width <
+			ff->gifh.width - ff->frame.im.col0 ?
+			ff->target.width : ff->gifh.width - ff->frame.im.col0;
+		ff->target.visibleHeight = ff->target.height <
+			ff->gifh.height - ff->frame.im.row0 ?
+			ff->target.height : ff->gifh.height - ff->frame.im.row0;
+	}
+	phaseTime(&stats->headerTime, start);
+	return(GIF2BMPOK);
+}
+
+/**
+ * Převod prvního snímku na zmenšený náhled. Dekodér předává hotové řádky
+ * přímo zmenšování, celý obrázek v plné velikosti se nikde neukládá.
+ * @param gif2bmp záznam o převodu
+ * @param in vstupní soubor (GIF)
+ * @param sink výstupní soubor (BMP)
+ * @param options volby převodu (scale, maxDim)
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t convertThumbnail(tGIF2BMP* gif2bmp, struct gifInput* in,
+	struct bmpSink* sink, const tGIF2BMPOptions* options) {
+	struct firstFrame ff;			///< první snímek
+	struct thumbnail thumb;			///< zmenšovaný obrázek
+	u_int8_t* row;					///< jediný řádek rámce v plné velikosti
+	int16_t bitCount;
+	int32_t compression;
+	int32_t longer;
+	int8_t retval;
+	int64_t start;					///< začátek měřené fáze
+	
+	if (readFirstFrame(in, &ff, options->stats) == GIF2BMPFail ||
+			resolveFormat(options, ff.colors, &bitCount, &compression) < 0) {
+		return(GIF2BMPFail);
+	}
+	memset(&thumb, 0, sizeof(thumb));
+	thumb.background = bitCount == 32 ? 0 : ff.background;
+	
+	/** faktor zmenšení: zadaný, případně větší, aby se delší strana vešla */
+	longer = ff.gifh.width > ff.gifh.height ? ff.gifh.width : ff.gifh.height;
+	thumb.factor = options->scale > 1 ? options->scale : 1;
+	if (options->maxDim > 0 && longer > options->maxDim &&
+			(longer + options->maxDim - 1) / options->maxDim > thumb.factor) {
+		thumb.factor = (longer + options->maxDim - 1) / options->maxDim;
+	}
+	thumb.width = (ff.gifh.width + thumb.factor - 1) / thumb.factor;
+	thumb.height = (ff.gifh.height + thumb.factor - 1) / thumb.factor;
+	thumb.col0 = ff.frame.im.col0;
+	thumb.row0 = ff.frame.im.row0;
+	thumb.bitCount = bitCount;
+	thumb.colors = ff.frame.colors;
+	
+	thumb.pixels = malloc((size_t)thumb.width * thumb.height *
+		(bitCount <= 8 ? 1 : sizeof(u_int32_t)) + 1);
+	thumb.sums = bitCount <= 8 ? NULL :
+		calloc((size_t)thumb.width * thumb.height * 4 + 1, sizeof(u_int64_t));
+	row = malloc((size_t)ff.target.width + 1);
+	if (thumb.pixels == NULL || row == NULL || (bitCount > 8 && thumb.sums == NULL)) {
+		free(thumb.pixels);
+		free(thumb.sums);
+		free(row);
+		return(GIF2BMPFail);
+	}
+	
+	/** dekodér zapisuje všechny řádky do jednoho bufferu (nulová vzdálenost) */
+	ff.target.base = row;
+	ff.target.stride = 0;
+	ff.target.rowDone = thumbnailRow;
+	ff.target.user = &thumb;
+	
+	if (bitCount <= 8) {
+		memset(thumb.pixels, ff.gifh.bgColor, (size_t)thumb.width * thumb.height);
+	} else {
+		thumbnailBackground(&thumb, &ff.gifh, &ff.target);
+	}
+	
+	retval = decode(ff.data, &ff.target, options->stats);
+	start = clockNow();
+	if (retval == GIF2BMPOK) {
+		if (bitCount > 8) {
+			thumbnailFinish(&thumb, &ff.gifh);
+		}
+		start = phaseTime(&options->stats->composeTime, start);
+		retval = writeCanvasFile(gif2bmp, sink, thumb.pixels, thumb.width,
+			thumb.height, bitCount, compression, ff.table);
+		start = phaseTime(&options->stats->writeTime, start);
+	}
+	free(thumb.pixels);
+	free(thumb.sums);
+	free(row);
+	
+	/** zbytek souboru projdeme až k ukončovací značce */
+	if (retval == GIF2BMPOK) {
+		skipToTrailer(in);
+		phaseTime(&options->stats->extensionTime, start);
+	}
+	return(retval);
+}
+
+/**
+ * Zpracování dokončeného řádku rámce pro výřezy -- do každého výřezu, který
+ * řádek protíná, se zkopíruje jen jeho část, ostatní pixely se zahodí
+ * @param target cíl dekodéru, user ukazuje na struct cropSet
+ * @param y řádek rámce
+ * @param row indexy pixelů řádku
+ */
+static void cropRow(struct imageTarget* target, int32_t y, const u_int8_t* row) {
+	struct cropSet* set = target->user;
+	int32_t sy = set->row0 + y;
+	
+	for (int32_t i = 0; i < set->count; i++) {
+		struct cropRegion* r = &set->regions[i];
+		int32_t from = r->x > set->col0 ? r->x : set->col0;
+		int32_t to = r->x + r->width < set->col0 + target->visibleWidth ?
+			r->x + r->width : set->col0 + target->visibleWidth;
+		
+		if (sy < r->y || sy >= r->y + r->height || from >= to) {
+			continue;
+		}
+		if (set->bitCount <= 8) {
+			memcpy(&r->pixels[(size_t)(sy - r->y) * r->width + (from - r->x)],
+				&row[from - set->col0], to - from);
+		} else {
+			/** plátno je vyplněné pozadím, průhledné pixely jej nepřepíší */
+			composeRow((u_int32_t*)r->pixels + (size_t)(sy - r->y) * r->width +
+				(from - r->x), &row[from - set->col0], to - from, set->colors);
+		}
+	}
+}
+
+/**
+ * Převod výřezů prvního snímku. Všechny výřezy vzniknou z jediného průchodu
+ * dekodéru, v paměti se drží jen pixely výřezů a jeden řádek rámce.
+ * @param gif2bmp záznam o převodu
+ * @param in vstupní soubor (GIF)
+ * @param sink výstupní soubor (BMP) pro jediný výřez
+ * @param options volby převodu (výřezy, vzor jmen souborů pro více výřezů)
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t convertCrops(tGIF2BMP* gif2bmp, struct gifInput* in,
+	struct bmpSink* sink, const tGIF2BMPOptions* options) {
+	struct firstFrame ff;			///< první snímek
+	struct cropSet set;				///< výřezy
+	u_int8_t* row;					///< jediný řádek rámce v plné velikosti
+	int16_t bitCount;
+	int32_t compression;
+	size_t pixelSize;
+	int8_t retval = GIF2BMPOK;
+	int64_t start;					///< začátek měřené fáze
+	
+	if (options->cropCount > 1 &&
+			checkFramePattern(options->framePattern) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	if (readFirstFrame(in, &ff, options->stats) == GIF2BMPFail ||
+			resolveFormat(options, ff.colors, &bitCount, &compression) < 0) {
+		return(GIF2BMPFail);
+	}
+	pixelSize = bitCount <= 8 ? 1 : sizeof(u_int32_t);
+	
+	memset(&set, 0, sizeof(set));
+	set.col0 = ff.frame.im.col0;
+	set.row0 = ff.frame.im.row0;
+	set.bitCount = bitCount;
+	set.colors = ff.frame.colors;
+	set.regions = calloc(options->cropCount, sizeof(*set.regions));
+	row = malloc((size_t)ff.target.width + 1);
+	if (set.regions == NULL || row == NULL) {
+		free(set.regions);
+		free(row);
+		return(GIF2BMPFail);
+	}
+	
+	/** výřezy oříznuté na logickou obrazovku, vyplněné pozadím */
+	for (int32_t i = 0; i < options->cropCount && retval == GIF2BMPOK; i++) {
+		const tGIF2BMPCrop* crop = &options->crops[i];
+		struct cropRegion* r = &set.regions[i];
+		
+		r->x = crop->x;
+		r->y = crop->y;
+		r->width = overlap(crop->x, crop->x + crop->width, 0, ff.gifh.width);
+		r->height = overlap(crop->y, crop->y + crop->height, 0, ff.gifh.height);
+		set.count++;
+		if (crop->x < 0 || crop->y < 0 || r->width == 0 || r->height == 0 ||
+				(r->pixels = malloc((size_t)r->width * r->height * pixelSize)) ==
+				NULL) {
+			retval = GIF2BMPFail;
+			break;
+		}
+		fillPixels(r->pixels, (size_t)r->width * r->height, bitCount,
+			bitCount <= 8 ? ff.gifh.bgColor :
+			bitCount == 32 ? 0 : ff.background | 0xff000000u);
+	}
+	
+	if (retval == GIF2BMPOK) {
+		ff.target.base = row;
+		ff.target.stride = 0;
+		ff.target.rowDone = cropRow;
+		ff.target.user = &set;
+		retval = decode(ff.data, &ff.target, options->stats);
+	}
+	
+	/** zápis výřezů: jediný do výstupu, více podle vzoru jmen souborů */
+	start = clockNow();
+	for (int32_t i = 0; i < set.count && retval == GIF2BMPOK; i++) {
+		struct cropRegion* r = &set.regions[i];
+		
+		if (options->cropCount == 1) {
+			retval = writeCanvasFile(gif2bmp, sink, r->pixels, r->width,
+				r->height, bitCount, compression, ff.table);
+		} else {
+			char filename[FILENAME_MAX];
+			struct bmpSink file = {NULL, NULL, 0, options->memoryLimit};
+			
+			snprintf(filename, sizeof(filename), options->framePattern, (int)i);
+			if ((file.file = fopen(filename, "wb")) == NULL) {
+				retval = GIF2BMPFail;
+				break;
+			}
+			retval = writeCanvasFile(gif2bmp, &file, r->pixels, r->width,
+				r->height, bitCount, compression, ff.table);
+			if (fclose(file.file) != 0) {
+				retval = GIF2BMPFail;
+			}
+		}
+	}
+	for (int32_t i = 0; i < set.count; i++) {
+		free(set.regions[i].pixels);
+	}
+	free(set.regions);
+	free(row);
+	start = phaseTime(&options->stats->writeTime, start);
+	
+	/** zbytek souboru projdeme až k ukončovací značce */
+	if (retval == GIF2BMPOK) {
+		skipToTrailer(in);
+		phaseTime(&options->stats->extensionTime, start);
+	}
+	return(retval);
+}
+
+/**
+ * Zápis jednoho řádku obrazovky do výstupu. Řádek se sestaví z pozadí
+ * a případně z řádku rámce stejně jako při skládání na plátno.
+ * @param w zapisovaný první snímek
+ * @param y číslo řádku v logické obrazovce
+ * @param row řádek rámce (indexy), NULL pro řádek mimo rámec
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t writerLine(struct rowWriter* w, int32_t y, const u_int8_t* row) {
+	fillPixels(w->line, w->width, w->bitCount, w->background);
+	if (row != NULL && w->bitCount > 8) {
+		composeRow((u_int32_t*)w->line + w->col0, row, w->visibleWidth, w->colors);
+	} else if (row != NULL) {
+		memcpy(&w->line[w->col0], row, w->visibleWidth);
+	}
+	
+	if (w->rows != NULL) {
+		/** řádek se kóduje vždy znovu od začátku svého bufferu */
+		struct rleBuffer* buffer = &w->rows[y];
+		
+		while (buffer->capacity < 2 * (int64_t)w->width + 2) {
+			if (growArray((void**)&buffer->data, &buffer->capacity, 1) ==
+					GIF2BMPFail) {
+				return(GIF2BMPFail);
+			}
+		}
+		buffer->length = rleEncodeRow(buffer->data, w->line, w->width);
+	} else {
+		writeCanvasRows(&w->pixels[(size_t)(w->height - 1 - y) * w->rowLength],
+			w->line, w->width, 1, w->bitCount);
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Zpracování řádku dekódovaného rámce při zápisu po řádcích
+ * @param target cíl dekodéru, user ukazuje na struct rowWriter
+ * @param y číslo řádku rámce
+ * @param row indexy pixelů řádku rámce
+ */
+static void writerRow(struct imageTarget* target, int32_t y, const u_int8_t* row) {
+	struct rowWriter* w = target->user;
+	
+	if (writerLine(w, w->row0 + y, row) == GIF2BMPFail) {
+		/** další řádky už nemá smysl zapisovat, chybu ohlásí prázdný buffer */
+		free(w->rows[w->row0 + y].data);
+		w->rows[w->row0 + y].data = NULL;
+		w->rows[w->row0 + y].capacity = 0;
+	}
+}
+
+/**
+ * Převod prvního snímku po řádcích přímo do výstupu, bez bufferu s indexy
+ * celého snímku a bez plátna. Používá se pro obrázky, jejichž buffery by
+ * překročily limit paměti.
+ * @param gif2bmp záznam o převodu
+ * @param in vstupní soubor (GIF)
+ * @param sink výstupní soubor (BMP)
+ * @param options volby převodu (bitCount, compression)
+ * @return GIF2BMPOK pokud nedošlo k chybě, jinak GIF2BMPFail
+ */
+static int8_t convertRows(tGIF2BMP* gif2bmp, struct gifInput* in,
+	struct bmpSink* sink, const tGIF2BMPOptions* options) {
+	struct firstFrame ff;			///< první snímek
+	struct rowWriter w;				///< zápis řádků do výstupu
+	struct bmpOutput out;			///< nekomprimovaný výstup
+	u_int8_t* row;					///< jediný řádek rámce
+	u_int8_t* zero;					///< řádek rámce, který dekodér nezapsal
+	int16_t bitCount;
+	int32_t compression;
+	int32_t colorCount;
+	int8_t retval = GIF2BMPOK;
+	int64_t start;					///< začátek měřené fáze
+	
+	if (readFirstFrame(in, &ff, options->stats) == GIF2BMPFail ||
+			(colorCount = resolveFormat(options, ff.colors, &bitCount,
+			&compression)) < 0) {
+		return(GIF2BMPFail);
+	}
+	
+	start = clockNow();
+	memset(&w, 0, sizeof(w));
+	memset(&out, 0, sizeof(out));
+	w.width = ff.gifh.width;
+	w.height = ff.gifh.height;
+	w.col0 = ff.frame.im.col0;
+	w.row0 = ff.frame.im.row0;
+	w.visibleWidth = ff.target.visibleWidth;
+	w.bitCount = bitCount;
+	w.colors = ff.frame.colors;
+	/** pozadí stejné jako u skládání snímků */
+	if (bitCount <= 8) {
+		w.background = ff.gifh.bgColor;
+	} else if (bitCount == 32) {
+		w.background = 0;
+	} else {
+		w.background = ff.background | 0xff000000u;
+	}
+	w.rowLength = bmpRowLength(w.width, bitCount);
+	w.line = malloc((size_t)w.width * sizeof(u_int32_t) + 1);
+	row = malloc((size_t)ff.target.width + 1);
+	zero = calloc((size_t)ff.target.width + 1, 1);
+	if (compression == BI_RLE8) {
+		w.rows = calloc(w.height ? w.height : 1, sizeof(*w.rows));
+	} else if (bmpOutputOpen(&out, sink, bmpFileSize(w.width, w.height,
+			bitCount, colorCount)) == GIF2BMPOK) {
+		writeBmpHeader(&out, w.width, w.height, bitCount, BI_RGB, ff.table,
+			colorCount, gif2bmp);
+		w.pixels = out.data + (out.size - (size_t)w.rowLength * w.height);
+	}
+	if (w.line == NULL || row == NULL || zero == NULL ||
+			(w.rows == NULL && w.pixels == NULL)) {
+		retval = GIF2BMPFail;
+	}
+	
+	/** řádky, které dekodér nezapíše, odpovídají nulovým indexům rámce */
+	for (int32_t y = 0; y < w.height && retval == GIF2BMPOK; y++) {
+		retval = writerLine(&w, y, y >= w.row0 &&
+			y - w.row0 < ff.target.visibleHeight ? zero : NULL);
+	}
+	
+	phaseTime(&options->stats->writeTime, start);
+	
+	/** dekodér předává hotové řádky rámce přímo do výstupu */
+	if (retval == GIF2BMPOK) {
+		ff.target.base = row;
+		ff.target.stride = 0;
+		ff.target.rowDone = writerRow;
+		ff.target.user = &w;
+		retval = decode(ff.data, &ff.target, options->stats);
+	}
+	
+	start = clockNow();
+	if (w.rows != NULL) {
+		for (int32_t y = 0; y < w.height && retval == GIF2BMPOK; y++) {
+			if (w.rows[y].data == NULL) {
+				retval = GIF2BMPFail;
+			}
+		}
+		if (retval == GIF2BMPOK) {
+			retval = writeRleOutput(gif2bmp, sink, w.width, w.height,
+				ff.table, w.rows, w.height);
+		}
+		for (int32_t y = 0; y < w.height; y++) {
+			free(w.rows[y].data);
+		}
+		free(w.rows);
+	} else if (w.pixels != NULL) {
+		gif2bmp->bmpSize += (int64_t)w.rowLength * w.height;
+		if (bmpOutputClose(&out) == GIF2BMPFail) {
+			retval = GIF2BMPFail;
+		}
+	}
+	free(w.line);
+	free(row);
+	free(zero);
+	start = phaseTime(&options->stats->writeTime, start);
+	
+	if (retval == GIF2BMPOK) {
+		skipToTrailer(in);
+		phaseTime(&options->stats->extensionTime, start);
+	}
+	return(retval);
+}
+
+/**
+ * Paměť potřebná pro převod prvního snímku skládáním na plátno
+ * @param in vstupní soubor (GIF) celý v paměti, pozice čtení se nemění
+ * @param options volby převodu
+ * @return počet byte bufferu s indexy snímku a plátna, 0 pokud soubor
+ *   nelze přečíst
+ */
+static int64_t firstFrameMemory(struct gifInput* in, const tGIF2BMPOptions* options) {
+	struct gifInput probe = *in;	///< kopie vstupu pro čtení hlaviček
+	struct gifHeader gifh;			///< hlavička GIF souboru
+	struct globalPaletteInfo gpi;	///< globální informace o paletě
+	struct qrgb palette[256];		///< paleta barev
+	struct frameInfo frame;			///< první snímek
+	
+	if (readGifHeader(&probe, &gifh, &gpi, palette) == GIF2BMPFail ||
+			readNextImage(&probe, &frame) != GIF2BMPOK) {
+		return(0);
+	}
+	return((int64_t)gifh.width * gifh.height *
+		(options->bitCount > 8 ? sizeof(u_int32_t) : 1) +
+		(int64_t)frame.im.width * frame.im.height);
+}
+
+/* Nazev:
+ *   gif2bmp
+ * Cinnost:
+ *   Funkce prevadi soubor formatu GIF na format BMP.
+ * Parametry:
+ *   gif2bmp - zaznam o prevodu
+ *   inputFile - vstupni soubor (GIF)
+ *   outputFile - vystupni soubor (BMP)
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nedporouje dany format GIF
+ */
+int gif2bmp(tGIF2BMP *gif2bmp, FILE *inputFile, FILE *outputFile) {
+	return(gif2bmpEx(gif2bmp, inputFile, outputFile, NULL));
+}
+
+/**
+ * Převod GIF souboru ze souboru nebo z paměti na BMP podle voleb
+ * @param gif2bmp záznam o převodu
+ * @param inputFile vstupní soubor (GIF), NULL pro vstup v paměti
+ * @param data GIF soubor v paměti (pokud inputFile je NULL)
+ * @param length délka GIF souboru v paměti
+ * @param sink výstupní soubor (BMP)
+ * @param options volby převodu, NULL znamená výchozí volby
+ * @return GIF2BMPOK pokud nedošlo k chybě, GIF2BMPAbort po vyčerpání limitu
+ * převodu, jinak GIF2BMPFail
+ */
+static int8_t convert(tGIF2BMP* gif2bmp, FILE* inputFile, const u_int8_t* data,
+	size_t length, struct bmpSink* sink, const tGIF2BMPOptions* options) {
+	struct gifInput in;				///< vstupní soubor v paměti
+	tGIF2BMPOptions defaults = {GIF2BMPFirstFrame, 0, 0, NULL, 0,
+		GIF2BMPCompressNone, 0, 0, NULL, 0, NULL, NULL, 0, NULL, 0, 0, NULL,
+		NULL};
+	struct budget budget;			///< limit doby a kódů převodu
+	tGIF2BMPOptions measured;		///< volby s vždy platnými měrnými údaji
+	tGIF2BMPStats unused;			///< měrné údaje, které volající nechce
+	struct rusage usage;
+	int64_t start = clockNow();
+	int8_t stream;
+	int8_t retval;
+	
+	if (options == NULL) {
+		options = &defaults;
+	}
+	/** fáze se měří vždy (cena je zanedbatelná), převody tak nemusí testovat
+	 * ukazatel na měrné údaje */
+	measured = *options;
+	if (measured.stats == NULL) {
+		measured.stats = &unused;
+	}
+	memset(measured.stats, 0, sizeof(*measured.stats));
+	options = &measured;
+	/** limit paměti platí i pro buffer výstupu do proudu, tedy i pro paletový
+	 * první snímek dekódovaný přímo do výstupu */
+	sink->memoryLimit = options->memoryLimit;
+	
+	/** jen skládání snímků potřebuje náhodný přístup ke vstupu */
+	stream = options->cropCount > 0 || options->scale > 1 ||
+		options->maxDim > 0 || (options->frames == GIF2BMPFirstFrame &&
+		(options->bitCount == 0 || options->bitCount == 8) &&
+		options->compression == GIF2BMPCompressNone);
+	if (inputFile == NULL) {
+		inputMemory(&in, data, length);
+	} else if (inputOpen(&in, inputFile, stream) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	/** limit sdílí přes vstup všechny dekodéry převodu */
+	if (options->timeLimit > 0 || options->codeLimit > 0 ||
+			options->cancel != NULL) {
+		memset(&budget, 0, sizeof(budget));
+		budget.deadline = options->timeLimit > 0 ? start + options->timeLimit : 0;
+		budget.codeLimit = options->codeLimit;
+		budget.cancel = options->cancel;
+		in.budget = &budget;
+	}
+	/** sekvenční dekodér převodu používá slovník kontextu */
+	if (options->context != NULL) {
+		in.decoder = &options->context->decoder;
+	}
+	
+	/** náhledy po průchodech umí jen přímé dekódování do výstupu */
+	if (options->preview != NULL && (options->cropCount > 0 ||
+			options->scale > 1 || options->maxDim > 0 ||
+			options->frames != GIF2BMPFirstFrame ||
+			(options->bitCount != 0 && options->bitCount != 8) ||
+			options->compression != GIF2BMPCompressNone)) {
+		retval = GIF2BMPFail;
+	} else
+	/** výřezy prvního snímku */
+	if (options->cropCount > 0) {
+		retval = options->frames == GIF2BMPFirstFrame && options->scale <= 1 &&
+			options->maxDim <= 0 ?
+			convertCrops(gif2bmp, &in, sink, options) : GIF2BMPFail;
+	} else
+	/** zmenšený náhled prvního snímku, zmenšování animací podporováno není */
+	if (options->scale > 1 || options->maxDim > 0) {
+		retval = options->frames == GIF2BMPFirstFrame ?
+			convertThumbnail(gif2bmp, &in, sink, options) : GIF2BMPFail;
+	} else
+	/** paletový první snímek se dekóduje přímo do výstupu */
+	if (options->frames == GIF2BMPFirstFrame &&
+			(options->bitCount == 0 || options->bitCount == 8) &&
+			options->compression == GIF2BMPCompressNone) {
+		retval = convertImage(gif2bmp, &in, sink, options);
+	} else
+	/** první snímek, jehož buffery by překročily limit paměti, po řádcích */
+	if (options->frames == GIF2BMPFirstFrame &&
+			firstFrameMemory(&in, options) > (options->memoryLimit > 0 ?
+			options->memoryLimit : MEMORY_LIMIT)) {
+		retval = convertRows(gif2bmp, &in, sink, options);
+	} else {
+		retval = convertFrames(gif2bmp, &in, sink, options);
+	}
+	
+	/** chyba způsobená vyčerpáním limitu se odlišuje */
+	if (retval == GIF2BMPFail && in.budget != NULL && budget.expired) {
+		retval = GIF2BMPAbort;
+	}
+	
+	/** vstup byl zpracován celý, velikost GIF odpovídá jeho délce */
+	gif2bmp->gifSize = retval == GIF2BMPOK ? inputSize(&in) : inputTell(&in);
+	inputClose(&in);
+	
+	phaseTime(&options->stats->totalTime, start);
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		options->stats->peakRSS = usage.ru_maxrss;
+	}
+	return(retval);
+}
+
+
+/* Nazev:
+ *   gif2bmpEx
+ * Cinnost:
+ *   Funkce prevadi soubor formatu GIF na format BMP podle zadanych voleb.
+ * Parametry:
+ *   gif2bmp - zaznam o prevodu
+ *   inputFile - vstupni soubor (GIF)
+ *   outputFile - vystupni soubor (BMP), pro GIF2BMPAllFrames se nepouziva
+ *   options - volby prevodu, NULL znamena vychozi volby
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nedporouje dany format GIF
+ *   -2 prevod prekrocil limit doby nebo kodu, prip. byl zrusen
+ */
+int gif2bmpEx(tGIF2BMP *gif2bmp, FILE *inputFile, FILE *outputFile,
+	const tGIF2BMPOptions *options) {
+	struct bmpSink sink = {outputFile, NULL, 0, 0};
+	
+	return(convert(gif2bmp, inputFile, NULL, 0, &sink, options));
+}
+
+/* Nazev:
+ *   gif2bmpMem
+ * Cinnost:
+ *   Funkce prevadi GIF v pameti na BMP v pameti podle zadanych voleb, bez
+ *   prace se soubory.
+ * Parametry:
+ *   gif2bmp - zaznam o prevodu
+ *   data - GIF soubor
+ *   length - delka GIF souboru
+ *   output - alokovany BMP soubor, uvolnuje volajici funkci free
+ *   outputLength - delka BMP souboru
+ *   options - volby prevodu, NULL znamena vychozi volby; GIF2BMPAllFrames
+ *     a vice vyrezu (zapis do souboru) nejsou podporovany
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nedporouje dany format GIF
+ *   -2 prevod prekrocil limit doby nebo kodu, prip. byl zrusen
+ */
+int gif2bmpMem(tGIF2BMP *gif2bmp, const u_int8_t *data, size_t length,
+	u_int8_t **output, size_t *outputLength, const tGIF2BMPOptions *options) {
+	struct bmpSink sink = {NULL, NULL, 0, 0};
+	int8_t retval = GIF2BMPFail;
+	
+	*output = NULL;
+	*outputLength = 0;
+	if (options == NULL || (options->frames != GIF2BMPAllFrames &&
+			options->cropCount <= 1)) {
+		retval = convert(gif2bmp, NULL, data, length, &sink, options);
+	}
+	if (retval == GIF2BMPOK && sink.data != NULL) {
+		*output = sink.data;
+		*outputLength = sink.size;
+	} else {
+		free(sink.data);
+		retval = retval == GIF2BMPAbort ? GIF2BMPAbort : GIF2BMPFail;
+	}
+	return(retval);
+}
+
+/**
+ * Předání řádků dekódovaného snímku funkci volajícího
+ */
+struct decodeRows {
+	tGIF2BMPRowCallback row;	/** funkce volajícího */
+	void*	  user;
+	u_int8_t* line;			/** řádek logické obrazovky */
+	int32_t	  width;		/** šířka logické obrazovky */
+	int32_t	  col0;			/** poloha rámce v logické obrazovce */
+	int32_t	  row0;
+	int32_t	  visibleWidth;	/** kolik sloupců rámce leží v obrázku */
+	u_int8_t  background;	/** index barvy pozadí */
+};
+
+/**
+ * Sestavení řádku obrazovky z pozadí a hotového řádku rámce a jeho předání
+ * volajícímu
+ * @param target cíl dekodéru, user ukazuje na struct decodeRows
+ * @param y číslo řádku rámce
+ * @param row indexy pixelů řádku rámce
+ */
+static void decodeRow(struct imageTarget* target, int32_t y, const u_int8_t* row) {
+	struct decodeRows* d = target->user;
+	
+	memset(d->line, d->background, d->width);
+	memcpy(&d->line[d->col0], row, d->visibleWidth);
+	d->row(d->user, d->row0 + y, d->line);
+}
+
+/* Nazev:
+ *   gif2bmpDecode
+ * Cinnost:
+ *   Funkce dekoduje prvni snimek GIF v pameti na indexy do palety
+ *   v rozmerech logicke obrazovky (pixely mimo ramec snimku maji barvu
+ *   pozadi, stejne jako 8bitovy vystup gif2bmp). Indexy uklada do bufferu,
+ *   nebo predava po radcich funkci row, jakmile je radek dekodovany.
+ * Parametry:
+ *   image - rozmery, paleta a pripadne indexy snimku
+ *   data - GIF soubor
+ *   length - delka GIF souboru
+ *   row - funkce volana pro kazdy radek, NULL = indexy do image->pixels
+ *   user - data pro funkci row
+ * Navratova hodnota:
+ *   0 - dekodovani probehlo v poradku
+ *   -1 pri dekodovani nastala chyba, prip. nedporouje dany format GIF
+ */
+int gif2bmpDecode(tGIF2BMPImage *image, const u_int8_t *data, size_t length,
+	tGIF2BMPRowCallback row, void *user) {
+	struct gifInput in;				///< vstupní soubor v paměti
+	struct firstFrame ff;			///< první snímek
+	struct decodeRows d;			///< předávání řádků
+	tGIF2BMPStats unused;			///< měrné údaje se nepředávají
+	u_int8_t* frameRow = NULL;		///< jediný řádek rámce
+	int8_t retval;
+	
+	memset(image, 0, sizeof(*image));
+	image->transparent = -1;
+	memset(&unused, 0, sizeof(unused));
+	inputMemory(&in, data, length);
+	if (readFirstFrame(&in, &ff, &unused) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	image->width = ff.gifh.width;
+	image->height = ff.gifh.height;
+	image->colors = ff.colors;
+	for (int32_t i = 0; i < ff.colors; i++) {
+		image->palette[i][0] = ff.table[i] >> 16;
+		image->palette[i][1] = ff.table[i] >> 8;
+		image->palette[i][2] = ff.table[i];
+	}
+	if (ff.frame.transparent) {
+		image->transparent = ff.frame.transparentIndex;
+	}
+	
+	if (row == NULL) {
+		/** indexy celé obrazovky, rámec se dekóduje přímo na své místo */
+		size_t size = (size_t)image->width * image->height;
+		
+		if ((image->pixels = calloc(size + 1, 1)) == NULL) {
+			return(GIF2BMPFail);
+		}
+		/** pozadí stejně jako v 8bitovém BMP */
+		if (ff.frame.im.col0 != 0 || ff.frame.im.row0 != 0 ||
+				ff.frame.im.width < image->width ||
+				ff.frame.im.height < image->height) {
+			memset(image->pixels, ff.gifh.bgColor, size);
+		}
+		if (ff.target.visibleHeight > 0) {
+			ff.target.base = &image->pixels[(size_t)ff.frame.im.row0 *
+				image->width + ff.frame.im.col0];
+		}
+		ff.target.stride = image->width;
+		retval = decode(ff.data, &ff.target, &unused);
+		if (retval == GIF2BMPFail) {
+			free(image->pixels);
+			image->pixels = NULL;
+		}
+		return(retval);
+	}
+	
+	/** řádky obrazovky mimo rámec jsou jen pozadí, předáme je hned */
+	d.row = row;
+	d.user = user;
+	d.width = image->width;
+	d.col0 = ff.frame.im.col0;
+	d.row0 = ff.frame.im.row0;
+	d.visibleWidth = ff.target.visibleWidth;
+	d.background = ff.gifh.bgColor;
+	d.line = malloc((size_t)d.width + 1);
+	frameRow = malloc((size_t)ff.target.width + 1);
+	if (d.line == NULL || frameRow == NULL) {
+		free(d.line);
+		free(frameRow);
+		return(GIF2BMPFail);
+	}
+	memset(d.line, d.background, d.width);
+	for (int32_t y = 0; y < image->height; y++) {
+		if (y < d.row0 || y - d.row0 >= ff.target.visibleHeight) {
+			row(user, y, d.line);
+		}
+	}
+	ff.target.base = frameRow;
+	ff.target.stride = 0;
+	ff.target.rowDone = decodeRow;
+	ff.target.user = &d;
+	retval = decode(ff.data, &ff.target, &unused);
+	free(d.line);
+	free(frameRow);
+	return(retval);
+}
+
+/* Nazev:
+ *   gif2bmpInfo
+ * Cinnost:
+ *   Funkce zjisti rozmery, velikost palety, pocet snimku a prokladani GIF
+ *   souboru. Obrazova data se preskakuji po sub-blocich bez dekodovani LZW.
+ * Parametry:
+ *   info - zjistene informace
+ *   inputFile - vstupni soubor (GIF)
+ * Navratova hodnota:
+ *   0 - soubor se podarilo projit
+ *   -1 soubor neni GIF nebo je poskozeny
+ */
+int gif2bmpInfo(tGIF2BMPInfo *info, FILE *inputFile) {
+	struct gifInput in;				///< vstupní soubor v paměti
+	struct gifHeader gifh;			///< hlavička GIF souboru
+	struct globalPaletteInfo gpi;	///< globální informace o paletě
+	struct qrgb palette[256];		///< paleta barev
+	struct frameInfo* frames = NULL;	///< nalezené snímky
+	int32_t count = 0;
+	int8_t retval;
+	
+	memset(info, 0, sizeof(*info));
+	if (inputOpen(&in, inputFile, 1) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	
+	/** hlavička a předběžný průchod bloky, stejný jako u animací */
+	retval = readGifHeader(&in, &gifh, &gpi, palette);
+	if (retval == GIF2BMPOK && memcmp(gifh.id, "GIF", 3) != 0) {
+		retval = GIF2BMPFail;
+	}
+	if (retval == GIF2BMPOK) {
+		retval = scanFrames(&in, &frames, &count, 0);
+	}
+	if (retval == GIF2BMPOK) {
+		info->width = gifh.width;
+		info->height = gifh.height;
+		info->colors = gpi.global ? 1 << (gpi.length + 1) : 0;
+		info->frames = count;
+		for (int32_t i = 0; i < count; i++) {
+			struct localPaletteInfo lpi;
+			
+			getLocalPaletteInfo(frames[i].im.flags, &lpi);
+			info->localPalettes += lpi.local;
+			if (i == 0) {
+				info->interlaced = lpi.interlaced;
+			}
+		}
+	}
+	info->gifSize = inputTell(&in);
+	free(frames);
+	inputClose(&in);
+	return(retval);
+}
+
+/* Nazev:
+ *   gif2bmpContextCreate
+ * Cinnost:
+ *   Funkce vytvori prazdny stav pro opakovane prevody; prevody s nim si
+ *   ponechavaji alokovane retezce slovniku sekvencniho dekoderu LZW.
+ * Navratova hodnota:
+ *   stav pro tGIF2BMPOptions.context, NULL pri nedostatku pameti
+ */
+tGIF2BMPContext *gif2bmpContextCreate(void) {
+	return(calloc(1, sizeof(tGIF2BMPContext)));
+}
+
+/* Nazev:
+ *   gif2bmpContextFree
+ * Cinnost:
+ *   Funkce uvolni stav pro opakovane prevody i pamet, kterou si ponechal.
+ * Parametry:
+ *   context - stav, NULL se ignoruje
+ */
+void gif2bmpContextFree(tGIF2BMPContext *context) {
+	if (context == NULL) {
+		return;
+	}
+	freeMemory(&context->decoder);
+	free(context);
 }
@@ -13,6 +13,7 @@
 
 #define GIF2BMPOK 0
 #define GIF2BMPFail -1
+#define GIF2BMPAbort -2
 
 /* Datovy typ zaznamu o konverzi */
 typedef struct{
@@ -22,6 +23,145 @@ typedef struct{
 	int64_t gifSize;
 } tGIF2BMP;
 
+/* Datovy typ s informacemi o GIF souboru bez dekodovani obrazovych dat */
+typedef struct{
+	/* rozmery logicke obrazovky */
+	int width;
+	int height;
+	/* pocet barev globalni palety, 0 = bez globalni palety */
+	int colors;
+	/* pocet snimku */
+	int frames;
+	/* prvni snimek je prokladany */
+	int interlaced;
+	/* pocet snimku s lokalni paletou */
+	int localPalettes;
+	/* pocet prectenych byte GIF souboru */
+	int64_t gifSize;
+} tGIF2BMPInfo;
+
+/* Datovy typ s mernimi udaji o prevodu; doby jsou v nanosekundach, u snimku
+ * dekodovanych vice vlakny se doby dekodovani scitaji */
+typedef struct{
+	/* cteni hlavicky GIF, palet a hlavicky obrazku */
+	int64_t headerTime;
+	/* prochazeni rozsirujicich bloku a preskakovani ostatnich snimku */
+	int64_t extensionTime;
+	/* dekodovani LZW vcetne ukladani radku na misto (i prokladanych) */
+	int64_t decodeTime;
+	/* skladani snimku na platno a jejich odstraneni */
+	int64_t composeTime;
+	/* priprava a zapis vystupu BMP vcetne komprese */
+	int64_t writeTime;
+	/* cely prevod */
+	int64_t totalTime;
+	/* pocet prectenych kodu LZW, z toho clear code */
+	int64_t codes;
+	int64_t clearCodes;
+	/* nejdelsi retezec slovniku */
+	int64_t maxString;
+	/* pocet byte zapsanych dekoderem do radku */
+	int64_t outputBytes;
+	/* pocet alokaci slovniku a tabulek dekoderu */
+	int64_t allocations;
+	/* nejvetsi rezidentni pamet procesu v KiB */
+	int64_t peakRSS;
+} tGIF2BMPStats;
+
+/* Rezimy prevodu snimku animovaneho GIF */
+#define GIF2BMPFirstFrame 0		/* pouze prvni snimek */
+#define GIF2BMPAllFrames 1		/* kazdy snimek do samostatneho BMP souboru */
+#define GIF2BMPSpriteSheet 2	/* vsechny snimky pod sebou v jednom BMP */
+
+/* Komprese vystupniho BMP */
+#define GIF2BMPCompressNone 0	/* nekomprimovane radky */
+#define GIF2BMPCompressRLE8 1	/* BI_RLE8, pouze pro 8 bitu na pixel */
+#define GIF2BMPCompressAuto 2	/* 1 nebo 4 bity pro malou paletu, jinak BI_RLE8 */
+
+/* Vyrez prvniho snimku v souradnicich logicke obrazovky */
+typedef struct{
+	int x;
+	int y;
+	int width;
+	int height;
+} tGIF2BMPCrop;
+
+/* Datovy typ stavu, ktery si mezi prevody ponechava slovnik dekoderu LZW */
+typedef struct GIF2BMPContext tGIF2BMPContext;
+
+/* Datovy typ s volbami prevodu */
+typedef struct{
+	/* rezim prevodu snimku animace (GIF2BMPFirstFrame, ...) */
+	int frames;
+	/* pocet vlaken pro dekodovani snimku, 0 = podle poctu procesoru */
+	int threads;
+	/* dvoufazove dekodovani LZW jednoho snimku, pixely rozvine vice vlaken */
+	int parallelLZW;
+	/* vzor jmen souboru snimku pro GIF2BMPAllFrames s prave jednim %d */
+	const char *framePattern;
+	/* barevna hloubka BMP: 0 nebo 8 = paleta, 1 a 4 = paleta s nejvyse 2
+	 * a 16 barvami, 24 = RGB, 32 = RGB s alfou (pruhledna barva GIF ma
+	 * nulovou alfu); pri 0 se vice snimku s lokalni paletou zapise
+	 * ve 24 bitech, jinak se barvy lokalnich palet nahradi nejblizsimi
+	 * barvami palety vystupu */
+	int bitCount;
+	/* komprese BMP (GIF2BMPCompressNone, ...) */
+	int compression;
+	/* zmenseni prvniho snimku N-krat v kazde ose, 0 nebo 1 = bez zmenseni */
+	int scale;
+	/* nejvetsi delka delsi strany zmenseneho snimku, 0 = bez omezeni */
+	int maxDim;
+	/* vyrezy prvniho snimku z jedineho dekodovani; vice nez jeden vyrez se
+	 * zapisuje do souboru podle framePattern */
+	const tGIF2BMPCrop *crops;
+	int cropCount;
+	/* nahled prokladaneho prvniho snimku po dokonceni pruchodu 1 az 3:
+	 * kompletni BMP, chybejici radky nahrazuje nejblizsi vyssi dekodovany
+	 * radek; pouze pro paletovy vystup bez komprese a zmenseni, NULL = bez
+	 * nahledu */
+	void (*preview)(void *user, int pass, const void *bmp, int64_t size);
+	void *previewUser;
+	/* limit pameti pro buffery s indexy a platno v byte; prvni snimek, ktery
+	 * by jej prekrocil, se zapisuje po radcich primo do vystupu a animace
+	 * dekoduji dopredu mene snimku; vetsi vystup do proudu (roura, stdout)
+	 * se pripravi v docasnem souboru, 0 = vychozi limit 1 GiB */
+	int64_t memoryLimit;
+	/* merne udaje o prevodu, vynuluji se na zacatku prevodu, NULL = nemerit */
+	tGIF2BMPStats *stats;
+	/* nejdelsi doba prevodu v nanosekundach, 0 = bez limitu; kontroluje se
+	 * po kazdych 4096 kodech LZW a pred skladanim kazdeho snimku */
+	int64_t timeLimit;
+	/* nejvyssi pocet kodu LZW vsech dekodovanych snimku, 0 = bez limitu */
+	int64_t codeLimit;
+	/* priznak zruseni prevodu, ktery muze nastavit jine vlakno (nenulova
+	 * hodnota prevod ukonci), NULL = prevod nelze zrusit */
+	const int *cancel;
+	/* stav ponechany mezi prevody (gif2bmpContextCreate): sekvencni
+	 * dekodovani snimku vlaknem prevodu pouziva jeho slovnik, jehoz retezce
+	 * zustavaji alokovane; stav smi pouzivat jen jeden prevod najednou,
+	 * NULL = kazdy snimek ma vlastni slovnik */
+	tGIF2BMPContext *context;
+} tGIF2BMPOptions;
+
+/* Prvni snimek dekodovany na indexy do palety */
+typedef struct{
+	/* rozmery logicke obrazovky */
+	int width;
+	int height;
+	/* pocet barev palety a paleta snimku (R, G, B) */
+	int colors;
+	u_int8_t palette[256][3];
+	/* index pruhledne barvy, -1 = neni definovana */
+	int transparent;
+	/* width * height indexu po radcich shora dolu, uvolnuje volajici funkci
+	 * free; NULL pri predavani radku funkci */
+	u_int8_t *pixels;
+} tGIF2BMPImage;
+
+/* Funkce volana pro kazdy dekodovany radek logicke obrazovky; prokladane
+ * snimky predavaji radky v poradi pruchodu */
+typedef void (*tGIF2BMPRowCallback)(void *user, int y, const u_int8_t *row);
+
 /* Nazev:
  *   gif2bmp
  * Cinnost:
@@ -36,6 +176,98 @@ typedef struct{
  */
 int gif2bmp(tGIF2BMP *gif2bmp, FILE *inputFile, FILE *outputFile);
 
+/* Nazev:
+ *   gif2bmpEx
+ * Cinnost:
+ *   Funkce prevadi soubor formatu GIF na format BMP podle zadanych voleb.
+ *   Snimky animace se dekoduji paralelne a skladaji podle pravidel
+ *   odstraneni snimku a pruhlednosti.
+ * Parametry:
+ *   gif2bmp - zaznam o prevodu
+ *   inputFile - vstupni soubor (GIF)
+ *   outputFile - vystupni soubor (BMP), pro GIF2BMPAllFrames se nepouziva
+ *   options - volby prevodu, NULL znamena vychozi volby
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nedporouje dany format GIF
+ *   -2 prevod prekrocil limit doby nebo kodu, prip. byl zrusen
+ */
+int gif2bmpEx(tGIF2BMP *gif2bmp, FILE *inputFile, FILE *outputFile,
+	const tGIF2BMPOptions *options);
+
+/* Nazev:
+ *   gif2bmpMem
+ * Cinnost:
+ *   Funkce prevadi GIF v pameti na BMP v pameti podle zadanych voleb, bez
+ *   docasnych souboru.
+ * Parametry:
+ *   gif2bmp - zaznam o prevodu
+ *   data - GIF soubor
+ *   length - delka GIF souboru
+ *   output - alokovany BMP soubor, uvolnuje volajici funkci free
+ *   outputLength - delka BMP souboru
+ *   options - volby prevodu, NULL znamena vychozi volby; GIF2BMPAllFrames
+ *     a vice vyrezu (zapis do souboru) nejsou podporovany
+ * Navratova hodnota:
+ *   0 - prevod probehl v poradku
+ *   -1 pri prevodu nastala chyba, prip. nedporouje dany format GIF
+ *   -2 prevod prekrocil limit doby nebo kodu, prip. byl zrusen
+ */
+int gif2bmpMem(tGIF2BMP *gif2bmp, const u_int8_t *data, size_t length,
+	u_int8_t **output, size_t *outputLength, const tGIF2BMPOptions *options);
+
+/* Nazev:
+ *   gif2bmpDecode
+ * Cinnost:
+ *   Funkce dekoduje prvni snimek GIF v pameti na indexy do palety
+ *   v rozmerech logicke obrazovky; pixely mimo ramec snimku maji barvu
+ *   pozadi. Indexy uklada do image->pixels, nebo je predava po radcich.
+ * Parametry:
+ *   image - rozmery, paleta a pripadne indexy snimku
+ *   data - GIF soubor
+ *   length - delka GIF souboru
+ *   row - funkce volana pro kazdy radek, NULL = indexy do image->pixels
+ *   user - data pro funkci row
+ * Navratova hodnota:
+ *   0 - dekodovani probehlo v poradku
+ *   -1 pri dekodovani nastala chyba, prip. nedporouje dany format GIF
+ */
+int gif2bmpDecode(tGIF2BMPImage *image, const u_int8_t *data, size_t length,
+	tGIF2BMPRowCallback row, void *user);
+
+/* Nazev:
+ *   gif2bmpInfo
+ * Cinnost:
+ *   Funkce zjisti rozmery, velikost palety, pocet snimku a prokladani GIF
+ *   souboru. Obrazova data se preskakuji po sub-blocich bez dekodovani LZW.
+ * Parametry:
+ *   info - zjistene informace
+ *   inputFile - vstupni soubor (GIF)
+ * Navratova hodnota:
+ *   0 - soubor se podarilo projit
+ *   -1 soubor neni GIF nebo je poskozeny
+ */
+int gif2bmpInfo(tGIF2BMPInfo *info, FILE *inputFile);
+
+/* Nazev:
+ *   gif2bmpContextCreate
+ * Cinnost:
+ *   Funkce vytvori prazdny stav pro opakovane prevody; prevody s nim si
+ *   ponechavaji alokovane retezce slovniku sekvencniho dekoderu LZW.
+ * Navratova hodnota:
+ *   stav pro tGIF2BMPOptions.context, NULL pri nedostatku pameti
+ */
+tGIF2BMPContext *gif2bmpContextCreate(void);
+
+/* Nazev:
+ *   gif2bmpContextFree
+ * Cinnost:
+ *   Funkce uvolni stav pro opakovane prevody i pamet, kterou si ponechal.
+ * Parametry:
+ *   context - stav, NULL se ignoruje
+ */
+void gif2bmpContextFree(tGIF2BMPContext *context);
+
 
 #endif
 
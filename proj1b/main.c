@@ -5,18 +5,80 @@
  * Komentar:
  */ 
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <getopt.h> /** C99 getopt */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <linux/fs.h>	/** FICLONE */
 
 #include "gif2bmp.h"
 
 /** Informace o tom zda se poradilo zpracovat parametry prikazove radky, pouzito
- * jako navratova hodnota */
+ * jako navratova hodnota; COMMAND_LINE_HELP je vyzadana napoveda */
 #define COMMAND_LINE_OK 1
 #define COMMAND_LINE_ERR 0
+#define COMMAND_LINE_HELP 2
+
+/** dlouhé volby bez jednopísmenné varianty */
+#define OPTION_SCALE 256
+#define OPTION_MAX_DIM 257
+#define OPTION_CROP 258
+#define OPTION_INFO 259
+#define OPTION_PREVIEW 260
+#define OPTION_MEM_LIMIT 261
+#define OPTION_STATS 262
+#define OPTION_IN_DIR 263
+#define OPTION_OUT_DIR 264
+#define OPTION_SERVE 265
+#define OPTION_CONNECT 266
+#define OPTION_REPEAT 267
+#define OPTION_SEND_PATH 268
+#define OPTION_CACHE 269
+#define OPTION_CACHE_SIZE 270
+#define OPTION_TIME_LIMIT 271
+#define OPTION_CODE_LIMIT 272
+
+/** nejvyšší počet výřezů zadaných na příkazové řádce */
+#define MAX_CROPS 256
+
+/** značka hlavičky požadavku a odpovědi serveru ("G2BR") */
+#define SERVE_MAGIC 0x47324252
+/** příznaky požadavku */
+#define SERVE_PATH 1		/** data jsou cesta k souboru na straně serveru */
+#define SERVE_STATS 2		/** odpověď má obsahovat měrné údaje převodu */
+
+/** verze klíčů mezipaměti, zvýší se při každé změně výstupu převodu */
+#define CACHE_VERSION 1
+/** výchozí největší velikost mezipaměti v MiB */
+#define CACHE_SIZE_DEFAULT 256
 
 /** jmeno pouzite ve vystupu do logovaciho souboru */
 const char* username = "xbarto42";
 
+/**
+ * Mezipaměť výsledků převodu na disku. Položka je soubor BMP pojmenovaný
+ * podle otisku vstupu a voleb převodu, čas změny souboru je čas jeho
+ * posledního použití.
+ */
+struct cache {
+	char* dir;				/** adresář mezipaměti, NULL = bez mezipaměti */
+	int64_t limit;			/** největší součet velikostí položek v byte */
+	int64_t size;			/** odhad součtu velikostí, -1 = neznámý */
+	int64_t hits;			/** počet převodů nalezených v mezipaměti */
+	int64_t misses;			/** počet převodů, které se musely provést */
+	pthread_mutex_t lock;	/** zámek počítadel a odstraňování položek */
+};
+
 /**
  * Struktura s konfigurací aplikace
  */
@@ -27,6 +89,55 @@ struct configuration {
 	FILE* ofile;
 	char* log;			/** jméno pro uložení informací o de/kompresi*/
 	FILE* lfile;
+	tGIF2BMPOptions options;	/** volby převodu */
+	char pattern[FILENAME_MAX];	/** vzor jmen souborů jednotlivých snímků */
+	tGIF2BMPCrop crops[MAX_CROPS];	/** výřezy prvního snímku */
+	char* preview;		/** vzor jmen souborů náhledů po průchodech */
+	int info;			/** pouze výpis informací o souborech */
+	char** files;		/** soubory zadané za volbami (pro --info) */
+	int fileCount;
+	tGIF2BMPStats stats;	/** měrné údaje převodu (--stats) */
+	int jobs;			/** vlákna dávkového převodu, 0 = podle počtu procesorů,
+						 * -1 = jediný soubor */
+	char* inDir;		/** adresář se vstupními soubory dávky */
+	char* outDir;		/** adresář pro výstupní soubory dávky */
+	char* serve;		/** socket, na kterém běží server (--serve) */
+	char* connect;		/** socket serveru, kterému se převod pošle */
+	int repeat;			/** kolikrát klient požadavek pošle */
+	int sendPath;		/** klient posílá místo obsahu cestu k souboru */
+	struct cache cache;	/** mezipaměť výsledků (--cache) */
+};
+
+/**
+ * Hlavička požadavku na server. Za ní následuje length byte dat: obsah
+ * souboru GIF, nebo jeho cesta (SERVE_PATH). Socket je lokální, čísla jsou
+ * v pořadí byte stroje.
+ */
+struct serveRequest {
+	u_int32_t magic;		/** SERVE_MAGIC */
+	int32_t flags;			/** SERVE_PATH, SERVE_STATS */
+	int32_t frames;			/** GIF2BMPFirstFrame nebo GIF2BMPSpriteSheet */
+	int32_t parallelLZW;
+	int32_t bitCount;
+	int32_t compression;
+	int32_t scale;
+	int32_t maxDim;
+	tGIF2BMPCrop crop;		/** výřez, nulová šířka = bez výřezu */
+	int64_t memoryLimit;
+	int64_t timeLimit;		/** limit doby převodu v ns, 0 = bez limitu */
+	int64_t codeLimit;		/** limit počtu kódů LZW, 0 = bez limitu */
+	int64_t length;			/** délka dat za hlavičkou */
+};
+
+/**
+ * Hlavička odpovědi serveru, za ní následuje length byte souboru BMP
+ */
+struct serveResponse {
+	u_int32_t magic;		/** SERVE_MAGIC */
+	int32_t retval;			/** návratová hodnota gif2bmpEx */
+	tGIF2BMP result;		/** záznam o převodu */
+	tGIF2BMPStats stats;	/** měrné údaje, jen se SERVE_STATS */
+	int64_t length;			/** délka souboru BMP za hlavičkou */
 };
 
 /**
@@ -55,8 +166,13 @@ void openFiles(struct configuration* config) {
 		config->ifile = stdin;
 	}
 	
-	/** otevřeme výstupní soubor */
-	if (config->output) {
+	/** otevřeme výstupní soubor, snímky, výřezy a dávku si otevírá převod sám,
+	 * server výstup nemá */
+	if (config->options.frames == GIF2BMPAllFrames ||
+			config->options.cropCount > 1 || config->jobs >= 0 ||
+			config->serve != NULL) {
+		config->ofile = NULL;
+	} else if (config->output) {
 		openOneFile(config->output, &config->ofile, "wb");
 	} else {
 		config->ofile = stdout;
@@ -82,7 +198,7 @@ void closeFiles(struct configuration* config) {
 	config->ifile = NULL;
 	
 	/** zavřeme výstupní soubor */
-	if (config->ofile != stdout) {
+	if (config->ofile != stdout && config->ofile != NULL) {
 		fclose(config->ofile);
 	}
 	config->ofile = NULL;
@@ -94,6 +210,26 @@ void closeFiles(struct configuration* config) {
 	config->lfile = NULL;
 }
 
+/**
+ * Zápis měrných údajů převodu jako jednoho objektu JSON (bez konce řádku)
+ * @param file soubor se záznamem
+ * @param s měrné údaje převodu
+ */
+void writeStats(FILE* file, const tGIF2BMPStats* s) {
+	fprintf(file, "{\"headerTime\": %lld, "
+		"\"extensionTime\": %lld, \"decodeTime\": %lld, "
+		"\"composeTime\": %lld, \"writeTime\": %lld, "
+		"\"totalTime\": %lld, \"codes\": %lld, \"clearCodes\": %lld, "
+		"\"maxString\": %lld, \"outputBytes\": %lld, "
+		"\"allocations\": %lld, \"peakRSS\": %lld}",
+		(long long int)s->headerTime, (long long int)s->extensionTime,
+		(long long int)s->decodeTime, (long long int)s->composeTime,
+		(long long int)s->writeTime, (long long int)s->totalTime,
+		(long long int)s->codes, (long long int)s->clearCodes,
+		(long long int)s->maxString, (long long int)s->outputBytes,
+		(long long int)s->allocations, (long long int)s->peakRSS);
+}
+
 /**
  * Zapsani vysledky zpracovani do logovaciho souboru
  * @param config	konfigurace programu
@@ -108,7 +244,74 @@ void writeResults(struct configuration* config, tGIF2BMP* result) {
 		fprintf(config->lfile, "uncodedSize = %lld\n", (long long int)result->bmpSize);
 		/** velikost zakódovaného souboru */
 		fprintf(config->lfile, "codedSize = %lld\n", (long long int)result->gifSize);
+		/** měrné údaje převodu jako jeden objekt JSON */
+		if (config->options.stats != NULL) {
+			fprintf(config->lfile, "stats = ");
+			writeStats(config->lfile, config->options.stats);
+			fprintf(config->lfile, "\n");
+		}
+		/** počítadla mezipaměti */
+		if (config->cache.dir != NULL) {
+			fprintf(config->lfile, "cacheHits = %lld\n",
+				(long long int)config->cache.hits);
+			fprintf(config->lfile, "cacheMisses = %lld\n",
+				(long long int)config->cache.misses);
+		}
+	}
+}
+
+/**
+ * Vytvoření vzoru jmen souborů snímků z názvu výstupního souboru, číslo
+ * snímku se vloží před příponu (out.bmp -> out_000.bmp)
+ * @param pattern buffer pro vzor
+ * @param size velikost bufferu
+ * @param name jméno výstupního souboru
+ */
+void framePattern(char* pattern, size_t size, const char* name) {
+	const char* dot = strrchr(name, '.');
+	const char* slash = strrchr(name, '/');
+	
+	/** vzor zadaný uživatelem použijeme přímo */
+	if (strchr(name, '%') != NULL) {
+		snprintf(pattern, size, "%s", name);
+	} else if (dot != NULL && (slash == NULL || dot > slash)) {
+		snprintf(pattern, size, "%.*s_%%03d%s", (int)(dot - name), name, dot);
+	} else {
+		snprintf(pattern, size, "%s_%%03d", name);
+	}
+}
+
+/**
+ * Vzor jmen souborů snímků pro jediný převáděný soubor
+ * @param config struktura s konfigurací aplikace
+ */
+void makeFramePattern(struct configuration* config) {
+	framePattern(config->pattern, sizeof(config->pattern),
+		config->output ? config->output : "frame.bmp");
+	config->options.framePattern = config->pattern;
+}
+
+/**
+ * Zápis náhledu po dokončení průchodu prokládaného obrázku do souboru podle
+ * vzoru, číslo průchodu se dosadí za %d
+ * @param user struktura s konfigurací aplikace
+ * @param pass číslo dokončeného průchodu
+ * @param bmp kompletní BMP soubor náhledu
+ * @param size velikost náhledu
+ */
+void writePreview(void* user, int pass, const void* bmp, int64_t size) {
+	struct configuration* config = user;
+	char name[FILENAME_MAX];
+	FILE* file;
+	
+	snprintf(name, sizeof(name), config->preview, pass);
+	file = fopen(name, "wb");
+	if (file == NULL) {
+		perror("fopen");
+		return;
 	}
+	fwrite(bmp, 1, size, file);
+	fclose(file);
 }
 
 /**
@@ -116,18 +319,54 @@ void writeResults(struct configuration* config, tGIF2BMP* result) {
  * @param argc	počet parametrů příkazové řádky
  * @param argv	pole ukazatelů na parametry příkazové řádky
  * @param config	struktura do které se uloží konfigurační hodnoty
+ * @return COMMAND_LINE_OK, COMMAND_LINE_HELP pro -h, jinak COMMAND_LINE_ERR
  */
 int commandline(int argc, char **argv, struct configuration* config) {
 	int c;
 	extern char *optarg;
+	static const struct option longOptions[] = {
+		{"scale", required_argument, NULL, OPTION_SCALE},
+		{"max-dim", required_argument, NULL, OPTION_MAX_DIM},
+		{"crop", required_argument, NULL, OPTION_CROP},
+		{"info", no_argument, NULL, OPTION_INFO},
+		{"preview", required_argument, NULL, OPTION_PREVIEW},
+		{"mem-limit", required_argument, NULL, OPTION_MEM_LIMIT},
+		{"stats", no_argument, NULL, OPTION_STATS},
+		{"in-dir", required_argument, NULL, OPTION_IN_DIR},
+		{"out-dir", required_argument, NULL, OPTION_OUT_DIR},
+		{"serve", required_argument, NULL, OPTION_SERVE},
+		{"connect", required_argument, NULL, OPTION_CONNECT},
+		{"repeat", required_argument, NULL, OPTION_REPEAT},
+		{"send-path", no_argument, NULL, OPTION_SEND_PATH},
+		{"cache", required_argument, NULL, OPTION_CACHE},
+		{"cache-size", required_argument, NULL, OPTION_CACHE_SIZE},
+		{"time-limit", required_argument, NULL, OPTION_TIME_LIMIT},
+		{"code-limit", required_argument, NULL, OPTION_CODE_LIMIT},
+		{NULL, 0, NULL, 0}
+	};
 	
 	/** výchozí směr komprese je nedefinováno */
 	config->log = NULL;
 	config->input = NULL;
 	config->output = NULL;
+	config->preview = NULL;
+	config->info = 0;
+	config->jobs = -1;
+	config->inDir = NULL;
+	config->outDir = NULL;
+	config->serve = NULL;
+	config->connect = NULL;
+	config->repeat = 1;
+	config->sendPath = 0;
+	memset(&config->cache, 0, sizeof(config->cache));
+	config->cache.limit = (int64_t)CACHE_SIZE_DEFAULT << 20;
+	config->cache.size = -1;
+	pthread_mutex_init(&config->cache.lock, NULL);
+	memset(&config->options, 0, sizeof(config->options));
 	
 	/** zpracování parametrů příkazové rádky */
-	while ((c = getopt(argc, argv, "i:o:l:h")) != -1) {
+	while ((c = getopt_long(argc, argv, "i:o:l:apst:b:rzj:h", longOptions,
+			NULL)) != -1) {
 		switch (c) {
 			case 'i':	/** parametr specifikující vstupní soubor */
 				config->input = optarg; 
@@ -138,27 +377,1445 @@ int commandline(int argc, char **argv, struct configuration* config) {
 			case 'l':	/** parametr specifikující log soubor */
 				config->log = optarg;
 				break;
+			case 'a':	/** každý snímek animace do samostatného souboru */
+				config->options.frames = GIF2BMPAllFrames;
+				break;
+			case 's':	/** všechny snímky animace pod sebou do jednoho souboru */
+				config->options.frames = GIF2BMPSpriteSheet;
+				break;
+			case 'p':	/** paralelní rozvinutí LZW jednoho snímku */
+				config->options.parallelLZW = 1;
+				break;
+			case 't':	/** počet vláken dekódujících snímky */
+				config->options.threads = atoi(optarg);
+				break;
+			case 'b':	/** barevná hloubka výstupu */
+				config->options.bitCount = atoi(optarg);
+				if (config->options.bitCount != 1 && config->options.bitCount != 4 &&
+						config->options.bitCount != 8 && config->options.bitCount != 24 &&
+						config->options.bitCount != 32) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case 'r':	/** komprese BI_RLE8 */
+				config->options.compression = GIF2BMPCompressRLE8;
+				break;
+			case 'z':	/** nejmenší paletový formát podle velikosti palety */
+				config->options.compression = GIF2BMPCompressAuto;
+				break;
+			case OPTION_SCALE:	/** zmenšení N-krát */
+				config->options.scale = atoi(optarg);
+				if (config->options.scale < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_MAX_DIM:	/** zmenšení na nejvýše D pixelů */
+				config->options.maxDim = atoi(optarg);
+				if (config->options.maxDim < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_CROP:	/** výřez x,y,w,h, lze zadat opakovaně */
+				if (config->options.cropCount == MAX_CROPS) {
+					return(COMMAND_LINE_ERR);
+				} else {
+					tGIF2BMPCrop* crop = &config->crops[config->options.cropCount];
+					char end;
+					
+					if (sscanf(optarg, "%d,%d,%d,%d%c", &crop->x, &crop->y,
+							&crop->width, &crop->height, &end) != 4 ||
+							crop->x < 0 || crop->y < 0 || crop->width < 1 ||
+							crop->height < 1) {
+						return(COMMAND_LINE_ERR);
+					}
+					config->options.crops = config->crops;
+					config->options.cropCount++;
+				}
+				break;
+			case OPTION_INFO:	/** informace o souborech bez převodu */
+				config->info = 1;
+				break;
+			case OPTION_PREVIEW:	/** náhledy po průchodech prokládání */
+				{
+					const char* mark = strchr(optarg, '%');
+					
+					/** vzor musí obsahovat právě jedno %d */
+					if (mark == NULL || mark[1] != 'd' ||
+							strchr(mark + 2, '%') != NULL) {
+						return(COMMAND_LINE_ERR);
+					}
+				}
+				config->preview = optarg;
+				config->options.preview = writePreview;
+				config->options.previewUser = config;
+				break;
+			case OPTION_MEM_LIMIT:	/** limit paměti pro buffery v MiB */
+				config->options.memoryLimit = (int64_t)atoi(optarg) << 20;
+				if (config->options.memoryLimit < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_STATS:	/** měření fází převodu do záznamu */
+				config->options.stats = &config->stats;
+				break;
+			case 'j':	/** dávkový převod N vlákny */
+				config->jobs = atoi(optarg);
+				if (config->jobs < 0) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_IN_DIR:	/** dávka ze souborů *.gif v adresáři */
+				config->inDir = optarg;
+				break;
+			case OPTION_OUT_DIR:	/** adresář pro výstupy dávky */
+				config->outDir = optarg;
+				break;
+			case OPTION_SERVE:	/** server na lokálním socketu */
+				config->serve = optarg;
+				break;
+			case OPTION_CONNECT:	/** převod na serveru */
+				config->connect = optarg;
+				break;
+			case OPTION_REPEAT:	/** opakování požadavku klientem */
+				config->repeat = atoi(optarg);
+				if (config->repeat < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_SEND_PATH:	/** klient posílá cestu k souboru */
+				config->sendPath = 1;
+				break;
+			case OPTION_CACHE:	/** mezipaměť výsledků v adresáři */
+				config->cache.dir = optarg;
+				break;
+			case OPTION_CACHE_SIZE:	/** velikost mezipaměti v MiB */
+				config->cache.limit = (int64_t)atoi(optarg) << 20;
+				if (config->cache.limit < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_TIME_LIMIT:	/** limit doby převodu v ms */
+				config->options.timeLimit = atoll(optarg) * 1000000;
+				if (config->options.timeLimit < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
+			case OPTION_CODE_LIMIT:	/** limit počtu kódů LZW */
+				config->options.codeLimit = atoll(optarg);
+				if (config->options.codeLimit < 1) {
+					return(COMMAND_LINE_ERR);
+				}
+				break;
 			case 'h':	/** zobraz nápovědu */
-				return(COMMAND_LINE_ERR);
+				return(COMMAND_LINE_HELP);
 			case '?':
 				exit(-1);
 		}		
 	}
+	/** mezipaměť je věcí serveru, výpis informací nic nepřevádí */
+	if (config->cache.dir != NULL && (config->connect != NULL || config->info)) {
+		return(COMMAND_LINE_ERR);
+	}
+	/** server obsluhuje klienty skupinou vláken, klient převádí jediný
+	 * soubor do jediného výstupu */
+	if (config->serve != NULL) {
+		if (config->connect != NULL || config->info || config->inDir != NULL ||
+				config->options.preview != NULL) {
+			return(COMMAND_LINE_ERR);
+		}
+		if (config->jobs < 0) {
+			config->jobs = 0;
+		}
+		if (config->options.threads == 0) {
+			config->options.threads = 1;
+		}
+		return(COMMAND_LINE_OK);
+	}
+	if (config->connect != NULL && (config->jobs >= 0 || config->info ||
+			config->inDir != NULL || config->options.preview != NULL ||
+			config->options.frames == GIF2BMPAllFrames ||
+			config->options.cropCount > 1 ||
+			(config->sendPath && config->input == NULL))) {
+		return(COMMAND_LINE_ERR);
+	}
+	/** dávka: převod každého souboru jedním vláknem, náhledy by si
+	 * přepisovaly soubory */
+	if (config->inDir != NULL && config->jobs < 0) {
+		config->jobs = 0;
+	}
+	if (config->jobs >= 0) {
+		if (config->options.preview != NULL || config->info) {
+			return(COMMAND_LINE_ERR);
+		}
+		if (config->options.threads == 0) {
+			config->options.threads = 1;
+		}
+	} else if (config->options.frames == GIF2BMPAllFrames ||
+			config->options.cropCount > 1) {
+		makeFramePattern(config);
+	}
+	config->files = &argv[optind];
+	config->fileCount = argc - optind;
 	return(COMMAND_LINE_OK);
 }
 
+/**
+ * Výpis informací o jednom souboru na jeden řádek
+ * @param config struktura s konfigurací aplikace
+ * @param name jméno souboru ve výpisu
+ * @param file vstupní soubor
+ * @param total součet přečtených byte
+ * @return 0 pokud se soubor podařilo projít, jinak -1
+ */
+int printInfo(struct configuration* config, const char* name, FILE* file,
+	tGIF2BMP* total) {
+	tGIF2BMPInfo info;
+	
+	if (gif2bmpInfo(&info, file) != GIF2BMPOK) {
+		fprintf(config->ofile, "%s error\n", name);
+		total->gifSize += info.gifSize;
+		return(GIF2BMPFail);
+	}
+	fprintf(config->ofile, "%s width=%d height=%d colors=%d frames=%d "
+		"interlaced=%d localPalettes=%d\n", name, info.width, info.height,
+		info.colors, info.frames, info.interlaced, info.localPalettes);
+	total->gifSize += info.gifSize;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Výpis informací o všech souborech zadaných za volbami, případně o -i/stdin
+ * @param config struktura s konfigurací aplikace
+ * @param total součet přečtených byte
+ * @return 0 pokud se všechny soubory podařilo projít, jinak -1
+ */
+int probeFiles(struct configuration* config, tGIF2BMP* total) {
+	int retval = GIF2BMPOK;
+	
+	if (config->fileCount == 0) {
+		return(printInfo(config, config->input ? config->input : "-",
+			config->ifile, total));
+	}
+	for (int i = 0; i < config->fileCount; i++) {
+		FILE* file = fopen(config->files[i], "rb");
+		
+		if (file == NULL) {
+			fprintf(config->ofile, "%s error\n", config->files[i]);
+			retval = GIF2BMPFail;
+			continue;
+		}
+		if (printInfo(config, config->files[i], file, total) != GIF2BMPOK) {
+			retval = GIF2BMPFail;
+		}
+		fclose(file);
+	}
+	return(retval);
+}
+
+/**
+ * Načtení celého vstupu do paměti
+ * @param file vstupní soubor
+ * @param data alokovaný obsah souboru
+ * @param length délka obsahu
+ * @return 0 pokud se vstup podařilo načíst, jinak -1
+ */
+int readInput(FILE* file, u_int8_t** data, int64_t* length) {
+	size_t capacity = 0;
+	size_t count;
+	
+	*data = NULL;
+	*length = 0;
+	do {
+		if ((size_t)*length == capacity) {
+			u_int8_t* buffer;
+			capacity = capacity ? capacity * 2 : 65536;
+			if ((buffer = realloc(*data, capacity)) == NULL) {
+				return(-1);
+			}
+			*data = buffer;
+		}
+		count = fread(*data + *length, 1, capacity - *length, file);
+		*length += count;
+	} while (count > 0);
+	return(ferror(file) ? -1 : 0);
+}
+
+/**
+ * Rotace 64bitového čísla doleva
+ */
+u_int64_t rotl64(u_int64_t x, int r) {
+	return((x << r) | (x >> (64 - r)));
+}
+
+/**
+ * Závěrečné promíchání bitů otisku
+ */
+u_int64_t fmix64(u_int64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return(k);
+}
+
+/**
+ * 128bitový otisk dat (MurmurHash3 x64_128), zpracovává 16 byte najednou
+ * @param data hashovaná data
+ * @param length délka dat
+ * @param hash výsledný otisk
+ */
+void cacheHash(const u_int8_t* data, size_t length, u_int64_t hash[2]) {
+	const u_int64_t c1 = 0x87c37b91114253d5ULL;
+	const u_int64_t c2 = 0x4cf5ad432745937fULL;
+	u_int64_t h1 = CACHE_VERSION;
+	u_int64_t h2 = CACHE_VERSION;
+	u_int64_t k1;
+	u_int64_t k2;
+	size_t blocks = length / 16;
+	const u_int8_t* tail = data + blocks * 16;
+	
+	for (size_t i = 0; i < blocks; i++) {
+		memcpy(&k1, data + i * 16, 8);
+		memcpy(&k2, data + i * 16 + 8, 8);
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+	/** zbývajících nejvýše 15 byte */
+	k1 = 0;
+	k2 = 0;
+	for (size_t i = length & 15; i > 8; i--) {
+		k2 ^= (u_int64_t)tail[i - 1] << ((i - 9) * 8);
+	}
+	for (size_t i = (length & 15) < 8 ? length & 15 : 8; i > 0; i--) {
+		k1 ^= (u_int64_t)tail[i - 1] << ((i - 1) * 8);
+	}
+	k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	
+	h1 ^= length;
+	h2 ^= length;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	hash[0] = h1;
+	hash[1] = h2;
+}
+
+/**
+ * Lze výsledek převodu uložit do mezipaměti? Jen převod do jediného souboru
+ * bez vedlejších výstupů.
+ * @param options volby převodu
+ * @return 1 pokud lze, jinak 0
+ */
+int cacheable(const tGIF2BMPOptions* options) {
+	return(options->frames != GIF2BMPAllFrames && options->cropCount <= 1 &&
+		options->preview == NULL);
+}
+
+/**
+ * Jméno položky mezipaměti -- otisk vstupu a volby, které mění výstup
+ * @param name buffer pro jméno
+ * @param size velikost bufferu
+ * @param data vstupní soubor
+ * @param length délka vstupního souboru
+ * @param options volby převodu
+ */
+void cacheName(char* name, size_t size, const u_int8_t* data, int64_t length,
+	const tGIF2BMPOptions* options) {
+	u_int64_t hash[2];
+	tGIF2BMPCrop crop = {0, 0, 0, 0};
+	
+	cacheHash(data, length, hash);
+	if (options->cropCount == 1) {
+		crop = options->crops[0];
+	}
+	snprintf(name, size, "%016llx%016llx-f%d-b%d-z%d-s%d-d%d-c%d,%d,%d,%d.bmp",
+		(unsigned long long)hash[0], (unsigned long long)hash[1],
+		options->frames, options->bitCount, options->compression,
+		options->scale, options->maxDim, crop.x, crop.y, crop.width,
+		crop.height);
+}
+
+/**
+ * Otevření položky mezipaměti, nalezená položka se označí jako naposledy
+ * použitá
+ * @param cache mezipaměť
+ * @param name jméno položky
+ * @param size velikost položky
+ * @return deskriptor položky, -1 pokud v mezipaměti není
+ */
+int cacheLookup(struct cache* cache, const char* name, int64_t* size) {
+	char path[FILENAME_MAX];
+	struct stat st;
+	int fd;
+	
+	snprintf(path, sizeof(path), "%s/%s", cache->dir, name);
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return(-1);
+	}
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return(-1);
+	}
+	futimens(fd, NULL);
+	*size = st.st_size;
+	return(fd);
+}
+
+/**
+ * Položka při odstraňování nejdéle nepoužitých položek
+ */
+struct cacheEntry {
+	char* name;
+	struct timespec used;	/** čas posledního použití */
+	int64_t size;
+};
+
+/**
+ * Porovnání položek podle času posledního použití (pro qsort)
+ */
+int compareEntries(const void* a, const void* b) {
+	const struct timespec* x = &((const struct cacheEntry*)a)->used;
+	const struct timespec* y = &((const struct cacheEntry*)b)->used;
+	
+	if (x->tv_sec != y->tv_sec) {
+		return(x->tv_sec < y->tv_sec ? -1 : 1);
+	}
+	return(x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec);
+}
+
+/**
+ * Odstranění nejdéle nepoužitých položek, dokud součet velikostí
+ * přesahuje limit. Adresář se prochází, jen když odhad součtu limit
+ * překročí, odhad se tím zároveň zpřesní. Volá se se zamčenou mezipamětí.
+ * @param cache mezipaměť
+ */
+void cacheEvict(struct cache* cache) {
+	DIR* dir;
+	struct dirent* entry;
+	struct cacheEntry* entries = NULL;
+	int32_t count = 0;
+	int32_t capacity = 0;
+	int64_t total = 0;
+	
+	if (cache->size >= 0 && cache->size <= cache->limit) {
+		return;
+	}
+	if ((dir = opendir(cache->dir)) == NULL) {
+		return;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		struct stat st;
+		
+		/** rozepsané položky začínají tečkou */
+		if (entry->d_name[0] == '.' ||
+				fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 ||
+				!S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if (count == capacity) {
+			int32_t newCapacity = capacity ? capacity * 2 : 256;
+			struct cacheEntry* tmp = realloc(entries, sizeof(*entries) * newCapacity);
+			if (tmp == NULL) {
+				break;
+			}
+			entries = tmp;
+			capacity = newCapacity;
+		}
+		if ((entries[count].name = strdup(entry->d_name)) == NULL) {
+			break;
+		}
+		entries[count].used = st.st_mtim;
+		entries[count].size = st.st_size;
+		total += st.st_size;
+		count++;
+	}
+	
+	qsort(entries, count, sizeof(*entries), compareEntries);
+	for (int32_t i = 0; i < count; i++) {
+		if (total > cache->limit && unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+			total -= entries[i].size;
+		}
+		free(entries[i].name);
+	}
+	free(entries);
+	closedir(dir);
+	cache->size = total;
+}
+
+/**
+ * Uložení výsledku převodu do mezipaměti. Položka se zapíše pod dočasným
+ * jménem a přejmenuje, souběžné čtení tak nikdy nevidí rozepsaný soubor.
+ * @param cache mezipaměť
+ * @param name jméno položky
+ * @param data soubor BMP
+ * @param size velikost souboru BMP
+ */
+void cacheStore(struct cache* cache, const char* name, const u_int8_t* data,
+	size_t size) {
+	static int32_t serial = 0;
+	char path[FILENAME_MAX];
+	char temp[FILENAME_MAX];
+	size_t written = 0;
+	int fd;
+	
+	snprintf(path, sizeof(path), "%s/%s", cache->dir, name);
+	snprintf(temp, sizeof(temp), "%s/.%d.%d.tmp", cache->dir, (int)getpid(),
+		__atomic_fetch_add(&serial, 1, __ATOMIC_RELAXED));
+	if ((fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0 &&
+			errno == ENOENT && mkdir(cache->dir, 0755) == 0) {
+		fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	}
+	if (fd < 0) {
+		return;
+	}
+	while (written < size) {
+		ssize_t count = write(fd, data + written, size - written);
+		if (count <= 0) {
+			break;
+		}
+		written += count;
+	}
+	if (close(fd) != 0 || written < size || rename(temp, path) != 0) {
+		unlink(temp);
+		return;
+	}
+	
+	pthread_mutex_lock(&cache->lock);
+	if (cache->size >= 0) {
+		cache->size += size;
+	}
+	cacheEvict(cache);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Započtení nalezené nebo chybějící položky
+ * @param cache mezipaměť
+ * @param hit 1 pokud byla položka nalezena
+ */
+void cacheCount(struct cache* cache, int hit) {
+	pthread_mutex_lock(&cache->lock);
+	if (hit) {
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Kopie položky mezipaměti do výstupu -- sdílením bloků (reflink), pokud
+ * jej souborový systém umí a výstup je prázdný soubor, jinak sendfile,
+ * případně čtením a zápisem
+ * @param in položka mezipaměti
+ * @param out výstupní soubor nebo socket
+ * @param size velikost položky
+ * @return 0 pokud se položku podařilo zkopírovat, jinak -1
+ */
+int cacheCopy(int in, int out, int64_t size) {
+	off_t offset = 0;
+	
+#ifdef FICLONE
+	struct stat st;
+	
+	if (fstat(out, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0 &&
+			lseek(out, 0, SEEK_CUR) == 0 && ioctl(out, FICLONE, in) == 0) {
+		return(lseek(out, 0, SEEK_END) == size ? 0 : -1);
+	}
+#endif
+	while (offset < size) {
+		if (sendfile(out, in, &offset, size - offset) <= 0) {
+			break;
+		}
+	}
+	/** sendfile výstup nepodporuje (např. soubor otevřený pro připojování) */
+	while (offset < size) {
+		u_int8_t buffer[65536];
+		ssize_t count = pread(in, buffer, size - offset < (int64_t)sizeof(buffer) ?
+			(size_t)(size - offset) : sizeof(buffer), offset);
+		ssize_t written = 0;
+		
+		if (count <= 0) {
+			return(-1);
+		}
+		while (written < count) {
+			ssize_t part = write(out, buffer + written, count - written);
+			if (part <= 0) {
+				return(-1);
+			}
+			written += part;
+		}
+		offset += count;
+	}
+	return(0);
+}
+
+/**
+ * Převod přes mezipaměť. Nalezený výsledek se zkopíruje do výstupu bez
+ * dekódování, jinak se soubor převede v paměti a výsledek se uloží.
+ * Záznam o převodu je stejný jako při převodu bez mezipaměti.
+ * @param config struktura s konfigurací aplikace
+ * @param input vstupní soubor (GIF)
+ * @param output výstupní soubor (BMP)
+ * @param options volby převodu
+ * @param result záznam o převodu
+ * @param hit 1 pokud byl výsledek nalezen v mezipaměti
+ * @return návratová hodnota převodu
+ */
+int convertCached(struct configuration* config, FILE* input, FILE* output,
+	const tGIF2BMPOptions* options, tGIF2BMP* result, int* hit) {
+	char name[FILENAME_MAX];
+	tGIF2BMP converted = {0, 0};
+	u_int8_t* data;
+	u_int8_t* bmp = NULL;
+	int64_t length;
+	int64_t size;
+	size_t bmpSize = 0;
+	int retval;
+	int fd;
+	
+	*hit = 0;
+	if (readInput(input, &data, &length) != 0) {
+		free(data);
+		return(GIF2BMPFail);
+	}
+	cacheName(name, sizeof(name), data, length, options);
+	if ((fd = cacheLookup(&config->cache, name, &size)) >= 0) {
+		*hit = 1;
+		retval = fflush(output) == 0 &&
+			cacheCopy(fd, fileno(output), size) == 0 ? GIF2BMPOK : GIF2BMPFail;
+		close(fd);
+		if (options->stats != NULL) {
+			memset(options->stats, 0, sizeof(*options->stats));
+		}
+		converted.bmpSize = size;
+		converted.gifSize = length;
+	} else {
+		retval = gif2bmpMem(&converted, data, length, &bmp, &bmpSize, options);
+		if (retval == GIF2BMPOK && fwrite(bmp, 1, bmpSize, output) != bmpSize) {
+			retval = GIF2BMPFail;
+		}
+		/** ukládají se jen výsledky, jejichž záznam lze z položky obnovit */
+		if (retval == GIF2BMPOK && converted.bmpSize == (int64_t)bmpSize &&
+				converted.gifSize == length) {
+			cacheStore(&config->cache, name, bmp, bmpSize);
+		}
+	}
+	cacheCount(&config->cache, *hit);
+	result->bmpSize += converted.bmpSize;
+	result->gifSize += converted.gifSize;
+	free(bmp);
+	free(data);
+	return(retval);
+}
+
+/**
+ * Jeden soubor dávkového převodu
+ */
+struct batchItem {
+	char* input;			/** jméno vstupního souboru */
+	char* output;			/** jméno výstupního souboru */
+	tGIF2BMP result;		/** záznam o převodu */
+	tGIF2BMPStats stats;	/** měrné údaje převodu (--stats) */
+	int retval;				/** návratová hodnota převodu */
+	int cached;				/** výsledek byl nalezen v mezipaměti */
+};
+
+/**
+ * Soubory přidělené jednomu vláknu -- vlastník bere od začátku, ostatní
+ * vlákna po vyčerpání svých souborů kradou od konce
+ */
+struct batchQueue {
+	pthread_mutex_t lock;
+	int32_t head;			/** první nezpracovaný soubor */
+	int32_t tail;			/** soubor za posledním nezpracovaným */
+};
+
+/**
+ * Sdílený stav dávkového převodu
+ */
+struct batch {
+	struct configuration* config;
+	struct batchItem* items;	/** všechny soubory dávky */
+	int32_t count;
+	struct batchQueue* queues;	/** fronta každého vlákna */
+	int32_t workers;
+};
+
+/**
+ * Argument vlákna dávkového převodu
+ */
+struct batchWorker {
+	struct batch* batch;
+	int32_t id;				/** index vlastní fronty */
+	pthread_t thread;
+};
+
+/**
+ * Přidání souboru do dávky
+ * @param items pole souborů, případně zvětšené
+ * @param count počet souborů
+ * @param capacity velikost pole
+ * @param input jméno vstupního souboru (převezme se), NULL pokud se jej
+ *   nepodařilo alokovat
+ * @param outDir adresář výstupu, NULL = vedle vstupního souboru
+ * @return 0 pokud nedošlo k chybě, jinak -1
+ */
+int addBatchItem(struct batchItem** items, int32_t* count, int32_t* capacity,
+	char* input, const char* outDir) {
+	const char* base;
+	const char* dot;
+	size_t length;
+	struct batchItem* item;
+	
+	if (input == NULL) {
+		return(GIF2BMPFail);
+	}
+	if (*count == *capacity) {
+		int32_t newCapacity = *capacity ? *capacity * 2 : 256;
+		struct batchItem* tmp = realloc(*items, sizeof(**items) * newCapacity);
+		if (tmp == NULL) {
+			free(input);
+			return(GIF2BMPFail);
+		}
+		*items = tmp;
+		*capacity = newCapacity;
+	}
+	
+	/** výstup má jméno vstupu s příponou .bmp, případně v adresáři outDir */
+	base = strrchr(input, '/');
+	base = base != NULL ? base + 1 : input;
+	dot = strrchr(base, '.');
+	length = dot != NULL ? (size_t)(dot - base) : strlen(base);
+	item = &(*items)[*count];
+	memset(item, 0, sizeof(*item));
+	item->input = input;
+	item->output = malloc((outDir ? strlen(outDir) : 0) + strlen(input) + 6);
+	if (item->output == NULL) {
+		free(input);
+		return(GIF2BMPFail);
+	}
+	if (outDir != NULL) {
+		sprintf(item->output, "%s/%.*s.bmp", outDir, (int)length, base);
+	} else {
+		sprintf(item->output, "%.*s.bmp", (int)(base - input + length), input);
+	}
+	(*count)++;
+	return(GIF2BMPOK);
+}
+
+/**
+ * Porovnání souborů dávky podle jména vstupu (pro qsort)
+ */
+int compareItems(const void* a, const void* b) {
+	return(strcmp(((const struct batchItem*)a)->input,
+		((const struct batchItem*)b)->input));
+}
+
+/**
+ * Seznam souborů dávky -- soubory *.gif z adresáře inDir seřazené podle
+ * jména, jinak jména po řádcích ze vstupu (-i nebo stdin)
+ * @param config struktura s konfigurací aplikace
+ * @param items nalezené soubory
+ * @param count počet souborů
+ * @return 0 pokud se seznam podařilo sestavit, jinak -1
+ */
+int listBatch(struct configuration* config, struct batchItem** items,
+	int32_t* count) {
+	int32_t capacity = 0;
+	
+	*items = NULL;
+	*count = 0;
+	if (config->inDir != NULL) {
+		DIR* dir = opendir(config->inDir);
+		struct dirent* entry;
+		
+		if (dir == NULL) {
+			perror("opendir");
+			return(GIF2BMPFail);
+		}
+		while ((entry = readdir(dir)) != NULL) {
+			size_t length = strlen(entry->d_name);
+			char* input;
+			
+			if (length <= 4 || strcasecmp(entry->d_name + length - 4, ".gif") != 0) {
+				continue;
+			}
+			input = malloc(strlen(config->inDir) + length + 2);
+			if (input != NULL) {
+				sprintf(input, "%s/%s", config->inDir, entry->d_name);
+			}
+			if (addBatchItem(items, count, &capacity, input, config->outDir) ==
+					GIF2BMPFail) {
+				closedir(dir);
+				return(GIF2BMPFail);
+			}
+		}
+		closedir(dir);
+		qsort(*items, *count, sizeof(**items), compareItems);
+	} else {
+		char* line = NULL;
+		size_t size = 0;
+		ssize_t length;
+		
+		while ((length = getline(&line, &size, config->ifile)) != -1) {
+			while (length > 0 && (line[length - 1] == '\n' ||
+					line[length - 1] == '\r')) {
+				line[--length] = '\0';
+			}
+			if (length > 0 && addBatchItem(items, count, &capacity,
+					strdup(line), config->outDir) == GIF2BMPFail) {
+				free(line);
+				return(GIF2BMPFail);
+			}
+		}
+		free(line);
+	}
+	return(GIF2BMPOK);
+}
+
+/**
+ * Převod jednoho souboru dávky
+ * @param config struktura s konfigurací aplikace (společné volby)
+ * @param item převáděný soubor
+ */
+void convertBatchItem(struct configuration* config, struct batchItem* item) {
+	tGIF2BMPOptions options = config->options;
+	char pattern[FILENAME_MAX];
+	FILE* input;
+	FILE* output = NULL;
+	
+	item->retval = GIF2BMPFail;
+	if ((input = fopen(item->input, "rb")) == NULL) {
+		return;
+	}
+	/** snímky a výřezy mají vzor jmen odvozený z výstupu souboru */
+	if (options.frames == GIF2BMPAllFrames || options.cropCount > 1) {
+		framePattern(pattern, sizeof(pattern), item->output);
+		options.framePattern = pattern;
+	} else if ((output = fopen(item->output, "wb")) == NULL) {
+		fclose(input);
+		return;
+	}
+	if (options.stats != NULL) {
+		options.stats = &item->stats;
+	}
+	if (config->cache.dir != NULL && cacheable(&options)) {
+		item->retval = convertCached(config, input, output, &options,
+			&item->result, &item->cached);
+	} else {
+		item->retval = gif2bmpEx(&item->result, input, output, &options);
+	}
+	fclose(input);
+	if (output != NULL && fclose(output) != 0) {
+		item->retval = GIF2BMPFail;
+	}
+}
+
+/**
+ * Další soubor pro vlákno -- z vlastní fronty, jinak ukradený z konce fronty
+ * jiného vlákna
+ * @param batch sdílený stav dávky
+ * @param id index vlastní fronty
+ * @return index souboru, -1 pokud jsou všechny fronty prázdné
+ */
+int32_t takeBatchItem(struct batch* batch, int32_t id) {
+	for (int32_t i = 0; i < batch->workers; i++) {
+		struct batchQueue* queue = &batch->queues[(id + i) % batch->workers];
+		int32_t item = -1;
+		
+		pthread_mutex_lock(&queue->lock);
+		if (queue->head < queue->tail) {
+			item = i == 0 ? queue->head++ : --queue->tail;
+		}
+		pthread_mutex_unlock(&queue->lock);
+		if (item >= 0) {
+			return(item);
+		}
+	}
+	return(-1);
+}
+
+/**
+ * Vlákno dávkového převodu
+ * @param arg vlákno a sdílený stav (struct batchWorker)
+ */
+void* batchWorker(void* arg) {
+	struct batchWorker* worker = arg;
+	int32_t item;
+	
+	while ((item = takeBatchItem(worker->batch, worker->id)) >= 0) {
+		convertBatchItem(worker->batch->config, &worker->batch->items[item]);
+	}
+	return(NULL);
+}
+
+/**
+ * Přičtení měrných údajů jednoho souboru k souhrnu dávky
+ * @param total souhrn dávky
+ * @param part údaje souboru
+ */
+void sumStats(tGIF2BMPStats* total, const tGIF2BMPStats* part) {
+	total->headerTime += part->headerTime;
+	total->extensionTime += part->extensionTime;
+	total->decodeTime += part->decodeTime;
+	total->composeTime += part->composeTime;
+	total->writeTime += part->writeTime;
+	total->totalTime += part->totalTime;
+	total->codes += part->codes;
+	total->clearCodes += part->clearCodes;
+	total->outputBytes += part->outputBytes;
+	total->allocations += part->allocations;
+	if (part->maxString > total->maxString) {
+		total->maxString = part->maxString;
+	}
+	if (part->peakRSS > total->peakRSS) {
+		total->peakRSS = part->peakRSS;
+	}
+}
+
+/**
+ * Dávkový převod souborů skupinou vláken. Soubory se rozdělí mezi vlákna
+ * po souvislých úsecích, vlákno, které svůj úsek dokončí, krade soubory
+ * ostatním. Výsledky všech souborů se zapíší do jednoho záznamu v pořadí
+ * seznamu.
+ * @param config struktura s konfigurací aplikace
+ * @param total součet velikostí všech souborů
+ * @return 0 pokud se všechny soubory podařilo převést, jinak -1
+ */
+int convertBatch(struct configuration* config, tGIF2BMP* total) {
+	struct batch batch;
+	struct batchWorker* workers;
+	int retval = GIF2BMPOK;
+	
+	if (listBatch(config, &batch.items, &batch.count) == GIF2BMPFail) {
+		return(GIF2BMPFail);
+	}
+	batch.config = config;
+	batch.workers = config->jobs > 0 ? config->jobs :
+		(int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	if (batch.workers > batch.count) {
+		batch.workers = batch.count > 0 ? batch.count : 1;
+	}
+	batch.queues = calloc(batch.workers, sizeof(*batch.queues));
+	workers = calloc(batch.workers, sizeof(*workers));
+	if (batch.queues == NULL || workers == NULL) {
+		free(batch.queues);
+		free(workers);
+		return(GIF2BMPFail);
+	}
+	
+	/** souvislé úseky souborů, vlastní vlákno je zpracuje od začátku */
+	for (int32_t i = 0; i < batch.workers; i++) {
+		pthread_mutex_init(&batch.queues[i].lock, NULL);
+		batch.queues[i].head = (int64_t)batch.count * i / batch.workers;
+		batch.queues[i].tail = (int64_t)batch.count * (i + 1) / batch.workers;
+		workers[i].batch = &batch;
+		workers[i].id = i;
+	}
+	/** první frontu zpracuje volající vlákno, fronty vláken, která se
+	 * nepodařilo spustit, přitom vykrade */
+	int32_t started = 1;
+	for (; started < batch.workers; started++) {
+		if (pthread_create(&workers[started].thread, NULL, batchWorker,
+				&workers[started]) != 0) {
+			break;
+		}
+	}
+	batchWorker(&workers[0]);
+	for (int32_t i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	for (int32_t i = 0; i < batch.workers; i++) {
+		pthread_mutex_destroy(&batch.queues[i].lock);
+	}
+	
+	/** záznam o každém souboru na jeden řádek, na konci souhrn */
+	for (int32_t i = 0; i < batch.count; i++) {
+		struct batchItem* item = &batch.items[i];
+		
+		if (item->retval != GIF2BMPOK) {
+			retval = GIF2BMPFail;
+		}
+		total->bmpSize += item->result.bmpSize;
+		total->gifSize += item->result.gifSize;
+		if (config->options.stats != NULL) {
+			sumStats(config->options.stats, &item->stats);
+		}
+		if (config->lfile != NULL) {
+			fprintf(config->lfile, "%s %s uncodedSize=%lld codedSize=%lld",
+				item->input, item->retval == GIF2BMPOK ? "ok" :
+				item->retval == GIF2BMPAbort ? "aborted" : "error",
+				(long long int)item->result.bmpSize,
+				(long long int)item->result.gifSize);
+			if (config->cache.dir != NULL) {
+				fprintf(config->lfile, " cache=%s", item->cached ? "hit" : "miss");
+			}
+			if (config->options.stats != NULL) {
+				fprintf(config->lfile, " stats=");
+				writeStats(config->lfile, &item->stats);
+			}
+			fprintf(config->lfile, "\n");
+		}
+		free(item->input);
+		free(item->output);
+	}
+	free(batch.items);
+	free(batch.queues);
+	free(workers);
+	return(retval);
+}
+
+/**
+ * Přečtení přesně length byte ze socketu
+ * @param fd socket
+ * @param data buffer pro data
+ * @param length počet byte
+ * @return 0 pokud se data podařilo přečíst, jinak -1 (chyba nebo konec
+ *   spojení)
+ */
+int readFull(int fd, void* data, size_t length) {
+	u_int8_t* position = data;
+	
+	while (length > 0) {
+		ssize_t count = recv(fd, position, length, 0);
+		if (count <= 0) {
+			return(-1);
+		}
+		position += count;
+		length -= count;
+	}
+	return(0);
+}
+
+/**
+ * Zápis přesně length byte do socketu, ukončené spojení nevyvolá SIGPIPE
+ * @param fd socket
+ * @param data zapisovaná data
+ * @param length počet byte
+ * @return 0 pokud se data podařilo zapsat, jinak -1
+ */
+int writeFull(int fd, const void* data, size_t length) {
+	const u_int8_t* position = data;
+	
+	while (length > 0) {
+		ssize_t count = send(fd, position, length, MSG_NOSIGNAL);
+		if (count <= 0) {
+			return(-1);
+		}
+		position += count;
+		length -= count;
+	}
+	return(0);
+}
+
+/**
+ * Adresa lokálního socketu
+ * @param address vyplněná adresa
+ * @param path cesta k socketu
+ * @return 0 pokud se cesta do adresy vejde, jinak -1
+ */
+int socketAddress(struct sockaddr_un* address, const char* path) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) {
+		return(-1);
+	}
+	strcpy(address->sun_path, path);
+	return(0);
+}
+
+/**
+ * Vlákno serveru, jeho buffer pro data požadavku a slovník dekodéru
+ * zůstávají mezi požadavky alokované
+ */
+struct serveWorker {
+	struct configuration* config;
+	int socket;				/** naslouchající socket */
+	u_int8_t* buffer;		/** data posledního požadavku */
+	size_t capacity;
+	tGIF2BMPContext* context;	/** stav převodů vlákna, NULL = každý převod
+								 * alokuje vlastní */
+	pthread_t thread;
+};
+
+/**
+ * Obsluha jednoho požadavku klienta
+ * @param worker vlákno serveru
+ * @param fd spojení s klientem
+ * @return 0 pokud lze spojení použít pro další požadavek, jinak -1
+ */
+int serveRequest(struct serveWorker* worker, int fd) {
+	struct serveRequest request;
+	struct serveResponse response;
+	tGIF2BMPOptions options = worker->config->options;
+	FILE* input;
+	FILE* output;
+	char* data = NULL;
+	size_t size = 0;
+	
+	if (readFull(fd, &request, sizeof(request)) != 0 ||
+			request.magic != SERVE_MAGIC || request.length < 0 ||
+			(request.frames != GIF2BMPFirstFrame &&
+			request.frames != GIF2BMPSpriteSheet)) {
+		return(-1);
+	}
+	/** buffer se jen zvětšuje, cesta potřebuje ukončovací nulu */
+	if ((size_t)request.length + 1 > worker->capacity) {
+		u_int8_t* buffer = realloc(worker->buffer, request.length + 1);
+		if (buffer == NULL) {
+			return(-1);
+		}
+		worker->buffer = buffer;
+		worker->capacity = request.length + 1;
+	}
+	if (readFull(fd, worker->buffer, request.length) != 0) {
+		return(-1);
+	}
+	worker->buffer[request.length] = '\0';
+	
+	/** volby požadavku, počet vláken a limit paměti určuje server */
+	options.frames = request.frames;
+	options.parallelLZW = request.parallelLZW;
+	options.bitCount = request.bitCount;
+	options.compression = request.compression;
+	options.scale = request.scale;
+	options.maxDim = request.maxDim;
+	options.crops = &request.crop;
+	options.cropCount = request.crop.width > 0 ? 1 : 0;
+	options.context = worker->context;
+	if (request.memoryLimit > 0 && (options.memoryLimit == 0 ||
+			request.memoryLimit < options.memoryLimit)) {
+		options.memoryLimit = request.memoryLimit;
+	}
+	/** limity doby a kódů platí přísnější ze serveru a požadavku */
+	if (request.timeLimit > 0 && (options.timeLimit == 0 ||
+			request.timeLimit < options.timeLimit)) {
+		options.timeLimit = request.timeLimit;
+	}
+	if (request.codeLimit > 0 && (options.codeLimit == 0 ||
+			request.codeLimit < options.codeLimit)) {
+		options.codeLimit = request.codeLimit;
+	}
+	memset(&response, 0, sizeof(response));
+	options.stats = (request.flags & SERVE_STATS) ? &response.stats : NULL;
+	response.magic = SERVE_MAGIC;
+	response.retval = GIF2BMPFail;
+	
+	if (request.flags & SERVE_PATH) {
+		input = fopen((char*)worker->buffer, "rb");
+		output = open_memstream(&data, &size);
+		if (input != NULL && output != NULL) {
+			response.retval = gif2bmpEx(&response.result, input, output, &options);
+		}
+		if (input != NULL) {
+			fclose(input);
+		}
+		if (output != NULL && fclose(output) != 0) {
+			response.retval = GIF2BMPFail;
+		}
+	} else if (worker->config->cache.dir != NULL) {
+		/** nalezený výsledek se pošle přímo z položky mezipaměti */
+		char name[FILENAME_MAX];
+		int64_t length;
+		int cached;
+		int hit;
+		
+		cacheName(name, sizeof(name), worker->buffer, request.length, &options);
+		if ((cached = cacheLookup(&worker->config->cache, name, &length)) >= 0) {
+			response.retval = GIF2BMPOK;
+			response.result.bmpSize = length;
+			response.result.gifSize = request.length;
+			response.length = length;
+			hit = writeFull(fd, &response, sizeof(response)) == 0 &&
+				cacheCopy(cached, fd, length) == 0;
+			close(cached);
+			cacheCount(&worker->config->cache, 1);
+			return(hit ? 0 : -1);
+		}
+		response.retval = gif2bmpMem(&response.result, worker->buffer,
+			request.length, (u_int8_t**)&data, &size, &options);
+		if (response.retval == GIF2BMPOK &&
+				response.result.bmpSize == (int64_t)size &&
+				response.result.gifSize == request.length) {
+			cacheStore(&worker->config->cache, name, (u_int8_t*)data, size);
+		}
+		cacheCount(&worker->config->cache, 0);
+	} else {
+		/** data požadavku se převádí přímo z bufferu do paměti */
+		response.retval = gif2bmpMem(&response.result, worker->buffer,
+			request.length, (u_int8_t**)&data, &size, &options);
+	}
+	if (response.retval == GIF2BMPOK) {
+		response.length = size;
+	}
+	if (writeFull(fd, &response, sizeof(response)) != 0 ||
+			writeFull(fd, data, response.length) != 0) {
+		free(data);
+		return(-1);
+	}
+	free(data);
+	return(0);
+}
+
+/**
+ * Vlákno serveru -- přijímá spojení a obsluhuje jejich požadavky, dokud je
+ * klient neukončí
+ * @param arg vlákno serveru (struct serveWorker)
+ */
+void* serveWorker(void* arg) {
+	struct serveWorker* worker = arg;
+	
+	for (;;) {
+		int fd = accept(worker->socket, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+		while (serveRequest(worker, fd) == 0) {
+		}
+		close(fd);
+	}
+	return(NULL);
+}
+
+/**
+ * Server převádějící soubory pro klienty na lokálním socketu. Spojení
+ * přijímá pevný počet vláken, každé obsluhuje jedno spojení, dokud je
+ * klient neukončí. Funkce se vrací jen při chybě.
+ * @param config struktura s konfigurací aplikace
+ * @return GIF2BMPFail
+ */
+int serve(struct configuration* config) {
+	struct sockaddr_un address;
+	struct serveWorker* workers;
+	int32_t count = config->jobs > 0 ? config->jobs :
+		(int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	struct stat st;
+	int fd;
+	
+	if (socketAddress(&address, config->serve) != 0) {
+		fprintf(stderr, "serve: socket path too long\n");
+		return(GIF2BMPFail);
+	}
+	/** socket po předchozím běhu serveru odstraníme */
+	if (lstat(config->serve, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(config->serve);
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+			listen(fd, SOMAXCONN) != 0) {
+		perror("serve");
+		return(GIF2BMPFail);
+	}
+	if (count < 1) {
+		count = 1;
+	}
+	/** sendfile z mezipaměti nemá obdobu MSG_NOSIGNAL */
+	signal(SIGPIPE, SIG_IGN);
+	if ((workers = calloc(count, sizeof(*workers))) == NULL) {
+		close(fd);
+		return(GIF2BMPFail);
+	}
+	for (int32_t i = 0; i < count; i++) {
+		workers[i].config = config;
+		workers[i].socket = fd;
+		workers[i].context = gif2bmpContextCreate();
+		if (i > 0 && pthread_create(&workers[i].thread, NULL, serveWorker,
+				&workers[i]) != 0) {
+			break;
+		}
+	}
+	serveWorker(&workers[0]);
+	return(GIF2BMPFail);
+}
+
+/**
+ * Data požadavku klienta -- absolutní cesta k ifile, nebo celý vstup
+ * @param config struktura s konfigurací aplikace
+ * @param request hlavička požadavku, doplní se příznak a délka dat
+ * @param data alokovaná data požadavku
+ * @return 0 pokud se data podařilo připravit, jinak -1
+ */
+int clientData(struct configuration* config, struct serveRequest* request,
+	u_int8_t** data) {
+	if (config->sendPath) {
+		if ((*data = (u_int8_t*)realpath(config->input, NULL)) == NULL) {
+			perror("realpath");
+			return(-1);
+		}
+		request->flags |= SERVE_PATH;
+		request->length = strlen((char*)*data);
+		return(0);
+	}
+	return(readInput(config->ifile, data, &request->length));
+}
+
+/**
+ * Převod souboru na serveru. Požadavek se pošle repeat-krát po jednom
+ * spojení (pro měření), do výstupu se zapíše poslední odpověď.
+ * @param config struktura s konfigurací aplikace
+ * @param result záznam o převodu
+ * @return návratová hodnota převodu na serveru, GIF2BMPFail při chybě spojení
+ */
+int runClient(struct configuration* config, tGIF2BMP* result) {
+	struct sockaddr_un address;
+	struct serveRequest request;
+	struct serveResponse response;
+	u_int8_t* data = NULL;
+	u_int8_t* output = NULL;
+	int retval = GIF2BMPFail;
+	int fd = -1;
+	int i;
+	
+	memset(&request, 0, sizeof(request));
+	request.magic = SERVE_MAGIC;
+	request.frames = config->options.frames;
+	request.parallelLZW = config->options.parallelLZW;
+	request.bitCount = config->options.bitCount;
+	request.compression = config->options.compression;
+	request.scale = config->options.scale;
+	request.maxDim = config->options.maxDim;
+	if (config->options.cropCount == 1) {
+		request.crop = config->crops[0];
+	}
+	request.memoryLimit = config->options.memoryLimit;
+	request.timeLimit = config->options.timeLimit;
+	request.codeLimit = config->options.codeLimit;
+	if (config->options.stats != NULL) {
+		request.flags |= SERVE_STATS;
+	}
+	
+	if (clientData(config, &request, &data) != 0) {
+		free(data);
+		return(GIF2BMPFail);
+	}
+	if (socketAddress(&address, config->connect) != 0 ||
+			(fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		perror("connect");
+	} else {
+		for (i = 0; i < config->repeat; i++) {
+			free(output);
+			output = NULL;
+			if (writeFull(fd, &request, sizeof(request)) != 0 ||
+					writeFull(fd, data, request.length) != 0 ||
+					readFull(fd, &response, sizeof(response)) != 0 ||
+					response.magic != SERVE_MAGIC || response.length < 0 ||
+					(output = malloc(response.length + 1)) == NULL ||
+					readFull(fd, output, response.length) != 0) {
+				fprintf(stderr, "connect: request failed\n");
+				break;
+			}
+		}
+		/** odpověď na poslední požadavek zapíšeme jako místní převod */
+		if (i == config->repeat) {
+			*result = response.result;
+			if (config->options.stats != NULL) {
+				*config->options.stats = response.stats;
+			}
+			retval = response.retval;
+			if (fwrite(output, 1, response.length, config->ofile) !=
+					(size_t)response.length) {
+				retval = GIF2BMPFail;
+			}
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	free(data);
+	free(output);
+	return(retval);
+}
+
 /**
  * Vypsání nápovědy k aplikaci - její vypsání je zajištěno v případě
  * že zadán parametr -h
  */
 void help(void) {
-	printf("gif2bmp [-i ifile] [-o ofile] [-l logfile] [-h]\n\n"
+	printf("gif2bmp [-i ifile] [-o ofile] [-l logfile] [-a|-s] [-p] [-t threads] [-b bits] [-r|-z]\n\t[--scale N|--max-dim D] [--crop x,y,w,h ...]\n\t[--preview pattern] [--mem-limit MiB] [--stats]\n\t[--time-limit ms] [--code-limit N] [--cache dir [--cache-size MiB]] [-h]\n"
+			"gif2bmp -j N [--in-dir dir] [--out-dir dir] [-i list] [volby převodu]\n"
+			"gif2bmp --info [-o ofile] [-l logfile] [soubor.gif ...]\n"
+			"gif2bmp --serve socket [-j N] [-t threads] [--mem-limit MiB]\n"
+			"\t[--time-limit ms] [--code-limit N]\n"
+			"gif2bmp --connect socket [--repeat N] [--send-path] [-i ifile] [-o ofile]\n"
+			"\t[-l logfile] [volby převodu]\n\n"
 			"\t-i ifile jméno vstupního souboru, pokud není zadán bude se\n"
 			"\t\t za vstup považovat stdin\n"
 			"\t-o ofile jméno výstupního souboru, pokud není zadán bude se\n"
 			"\t\t za výstup považovat stdout\n"
 			"\t-l lfile jméno souboru pro výstupní zprávy, pokud není zadán\n"
 			"\t\t bude výstup ignorován\n"
+			"\t-a\t každý snímek animace do samostatného souboru, číslo\n"
+			"\t\t snímku se vloží před příponu ofile (out_000.bmp)\n"
+			"\t-s\t všechny snímky animace pod sebou do jednoho souboru\n"
+			"\t-p\t dvoufázové dekódování, pixely jednoho snímku rozvine\n"
+			"\t\t více vláken současně\n"
+			"\t-t threads počet vláken dekódujících snímky animace, příp.\n"
+			"\t\t rozvíjejících pixely snímku (-p)\n"
+			"\t-b bits\t barevná hloubka výstupu: 8 (paleta, výchozí), 1 a 4\n"
+			"\t\t (paleta s nejvýše 2 a 16 barvami), 24 nebo 32 (průhledná\n"
+			"\t\t barva GIF má nulovou alfu); bez -b se snímky s lokální\n"
+			"\t\t paletou (-a, -s) zapíší v 24 bitech, zadaná paleta\n"
+			"\t\t dostane nejbližší barvy\n"
+			"\t-r\t komprese BI_RLE8 (pouze pro 8 bitů)\n"
+			"\t-z\t nejmenší výstup: 1 nebo 4 bity pro malou paletu, jinak\n"
+			"\t\t BI_RLE8\n"
+			"\t--scale N\t zmenšení prvního snímku N-krát během dekódování\n"
+			"\t\t (true-color průměruje bloky N x N, paleta je vzorkuje)\n"
+			"\t--max-dim D zmenšení tak, aby delší strana měla nejvýše D\n"
+			"\t\t pixelů\n"
+			"\t--crop x,y,w,h výřez prvního snímku; lze zadat opakovaně,\n"
+			"\t\t všechny výřezy vzniknou z jednoho dekódování a číslo\n"
+			"\t\t výřezu se vloží před příponu ofile (out_000.bmp)\n"
+			"\t--info\t pouze vypíše rozměry, velikost palety, počet snímků\n"
+			"\t\t a prokládání každého souboru na jeden řádek, obrazová\n"
+			"\t\t data se nedekódují\n"
+			"\t--preview pattern náhledy prokládaného obrázku po průchodech\n"
+			"\t\t 1 až 3 do souborů podle vzoru s %%d za číslo průchodu\n"
+			"\t\t (prev_%%d.bmp), chybějící řádky se zopakují\n"
+			"\t--mem-limit MiB limit paměti pro buffery snímku (výchozí\n"
+			"\t\t 1024); větší první snímek se zapisuje po řádcích přímo\n"
+			"\t\t do výstupu, animace dekódují dopředu méně snímků;\n"
+			"\t\t větší výstup do roury se připraví v dočasném souboru\n"
+			"\t--time-limit ms nejdelší doba převodu; po jejím uplynutí\n"
+			"\t\t převod skončí s návratovou hodnotou -2 (254), dávka\n"
+			"\t\t zapíše aborted; u serveru platí přísnější z limitů\n"
+			"\t\t serveru a klienta\n"
+			"\t--code-limit N nejvyšší počet kódů LZW všech snímků, jinak\n"
+			"\t\t jako --time-limit\n"
+			"\t--stats\t do lfile přidá řádek stats s objektem JSON: doby\n"
+			"\t\t fází převodu v ns, počty kódů a clear code, nejdelší\n"
+			"\t\t řetězec slovníku, zapsané byte, alokace a špičková\n"
+			"\t\t rezidentní paměť v KiB\n");
+	printf("\t-j N\t dávkový převod N vlákny (0 = podle počtu procesorů);\n"
+			"\t\t jména souborů se čtou po řádcích z ifile nebo stdin,\n"
+			"\t\t výstup má jméno vstupu s příponou .bmp, lfile obsahuje\n"
+			"\t\t řádek o každém souboru a souhrn; bez -t převádí každý\n"
+			"\t\t soubor jediné vlákno\n"
+			"\t--in-dir dir dávka ze všech souborů *.gif v adresáři\n"
+			"\t--out-dir dir adresář pro výstupy dávky\n"
+			"\t--serve socket server na lokálním socketu; spojení obsluhuje\n"
+			"\t\t N vláken (výchozí podle počtu procesorů), každé převádí\n"
+			"\t\t jedním vláknem, pokud není zadáno -t\n"
+			"\t--connect socket převod na serveru, výstup a lfile jako\n"
+			"\t\t u místního převodu (bez -a a více výřezů)\n"
+			"\t--repeat N pošle požadavek N-krát po jednom spojení\n"
+			"\t--send-path pošle serveru místo obsahu cestu k ifile\n"
+			"\t--cache dir mezipaměť výsledků v adresáři: stejný vstup se\n"
+			"\t\t stejnými volbami se znovu nedekóduje, výsledek se\n"
+			"\t\t zkopíruje z mezipaměti; lfile obsahuje počty nalezených\n"
+			"\t\t a chybějících výsledků (server: jen data v požadavku,\n"
+			"\t\t bez -a a více výřezů)\n"
+			"\t--cache-size MiB největší velikost mezipaměti (výchozí\n"
+			"\t\t 256), nejdéle nepoužité výsledky se odstraní\n"
 			"\t-h\t zobrazí tuto nápovědu\n");
 }
 
@@ -168,22 +1825,47 @@ void help(void) {
 int main(int argc, char **argv) {
 	struct	configuration configuration; /** konfigurace zpracování */
 	int		retval=0;						 /** návratová hodnota */
+	int		parsed;							 /** výsledek zpracování příkazové řádky */
 	
 	/** pokud se podari zpracovani prikazove radky */
-	if (commandline(argc, argv, &configuration)) {
+	parsed = commandline(argc, argv, &configuration);
+	if (parsed == COMMAND_LINE_OK) {
 		tGIF2BMP result = {0, 0};			/** výsledky de/komprese */
 		
 			openFiles(&configuration);
 			/** zpracujeme */
-			retval = gif2bmp(&result, configuration.ifile,
-									configuration.ofile);
+			if (configuration.info) {
+				retval = probeFiles(&configuration, &result);
+			} else if (configuration.serve != NULL) {
+				retval = serve(&configuration);
+			} else if (configuration.connect != NULL) {
+				retval = runClient(&configuration, &result);
+			} else if (configuration.jobs >= 0) {
+				retval = convertBatch(&configuration, &result);
+			} else if (configuration.cache.dir != NULL &&
+					cacheable(&configuration.options)) {
+				int hit;
+				
+				retval = convertCached(&configuration, configuration.ifile,
+					configuration.ofile, &configuration.options, &result, &hit);
+			} else {
+				retval = gif2bmpEx(&result, configuration.ifile,
+									configuration.ofile, &configuration.options);
+			}
+			if (retval == GIF2BMPAbort) {
+				fprintf(stderr, "gif2bmp: conversion limit exceeded\n");
+			}
 			/** zapiseme vysledky prevodu */
 			writeResults(&configuration, &result);
 			/** zavreme soubory */
 			closeFiles(&configuration);
 	} else {
-		/** zpracovani prikazove radky se nezdarilo, vypiseme ovladani */
+		/** zpracovani prikazove radky se nezdarilo, vypiseme ovladani;
+		 * chybna hodnota volby konci chybou jako neznama volba */
 		help();
+		if (parsed == COMMAND_LINE_ERR) {
+			retval = -1;
+		}
 	}
 	
 	/** ukoncime s navratovou hodnotou, ktera nam byla vracena po zpracovani */
@@ -0,0 +1,182 @@
+/*
+ * Autor:    Jaroslav Bartoň, xbarto42
+ * Datum:	 2008-4-16
+ * Soubor:   tests/roundtrip.c
+ * Komentar: převod náhodných BMP přes bmp2gif a zpět přes gif2bmp
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bmp2gif.h"
+#include "gif2bmp.h"
+
+/** počet náhodných obrázků */
+#define IMAGES 1500
+
+/**
+ * Zápis čísla little-endian
+ * @param dst cíl
+ * @param value hodnota
+ * @param bytes počet byte
+ */
+static void putLE(u_int8_t* dst, u_int32_t value, int bytes) {
+	for (int i = 0; i < bytes; i++) {
+		dst[i] = value >> (8 * i);
+	}
+}
+
+/**
+ * Čtení čísla little-endian
+ * @param src zdroj
+ * @param bytes počet byte
+ * @return hodnota
+ */
+static u_int32_t getLE(const u_int8_t* src, int bytes) {
+	u_int32_t value = 0;
+
+	for (int i = bytes - 1; i >= 0; i--) {
+		value = value << 8 | src[i];
+	}
+	return(value);
+}
+
+/**
+ * Náhodný 8bitový BMP s paletou colors barev
+ * @param width šířka
+ * @param height výška
+ * @param colors počet barev palety
+ * @param length délka vytvořeného souboru
+ * @return alokovaný BMP soubor
+ */
+static u_int8_t* randomBmp(int32_t width, int32_t height, int32_t colors,
+	size_t* length) {
+	int32_t rowLength = (width + 3) & ~3;
+	size_t offset = 14 + 40 + 4 * colors;
+	u_int8_t* bmp;
+	int32_t runs = rand() % 2;		///< dlouhé běhy stejných indexů
+
+	*length = offset + (size_t)rowLength * height;
+	bmp = calloc(*length, 1);
+	if (bmp == NULL) {
+		return(NULL);
+	}
+	bmp[0] = 'B';
+	bmp[1] = 'M';
+	putLE(bmp + 2, *length, 4);
+	putLE(bmp + 10, offset, 4);
+	putLE(bmp + 14, 40, 4);
+	putLE(bmp + 18, width, 4);
+	putLE(bmp + 22, height, 4);
+	putLE(bmp + 26, 1, 2);
+	putLE(bmp + 28, 8, 2);
+	putLE(bmp + 34, (u_int32_t)rowLength * height, 4);
+	putLE(bmp + 46, colors, 4);
+	for (int32_t i = 0; i < 4 * colors; i++) {
+		bmp[54 + i] = i % 4 == 3 ? 0 : rand();
+	}
+	for (int32_t y = 0; y < height; y++) {
+		for (int32_t x = 0; x < width; x++) {
+			bmp[offset + (size_t)y * rowLength + x] = runs && x > 0 && rand() % 8 ?
+				bmp[offset + (size_t)y * rowLength + x - 1] : rand() % colors;
+		}
+	}
+	return(bmp);
+}
+
+/**
+ * Porovnání indexů a použitých barev dvou 8bitových BMP
+ * @param a původní BMP
+ * @param b BMP po převodu
+ * @param width šířka
+ * @param height výška
+ * @return 0 pokud obrázky odpovídají, jinak -1
+ */
+static int compareBmp(const u_int8_t* a, const u_int8_t* b, int32_t width,
+	int32_t height) {
+	int32_t rowLength = (width + 3) & ~3;
+	const u_int8_t* pa = a + getLE(a + 10, 4);
+	const u_int8_t* pb = b + getLE(b + 10, 4);
+
+	if ((int32_t)getLE(b + 18, 4) != width || (int32_t)getLE(b + 22, 4) != height ||
+			getLE(b + 28, 2) != 8) {
+		return(-1);
+	}
+	for (int32_t y = 0; y < height; y++) {
+		for (int32_t x = 0; x < width; x++) {
+			u_int8_t index = pa[(size_t)y * rowLength + x];
+			if (pb[(size_t)y * rowLength + x] != index ||
+					memcmp(a + 54 + 4 * index, b + 54 + 4 * index, 3) != 0) {
+				return(-1);
+			}
+		}
+	}
+	return(0);
+}
+
+int main(void) {
+	/** slovník sdílený dekódováními obrázků s různou délkou kódů */
+	tGIF2BMPContext* context = gif2bmpContextCreate();
+	int failures = 0;
+
+	srand(42);
+	for (int i = 0; i < IMAGES; i++) {
+		/** drobné obrázky s malou paletou často končí zvětšením délky kódu */
+		int32_t size = i % 3 == 0 ? 8 : i % 10 ? 40 : 300;
+		int32_t width = 1 + rand() % size;
+		int32_t height = 1 + rand() % size;
+		int32_t colors = 2 + rand() % (i % 3 == 0 ? 4 : 255);
+		tBMP2GIFOptions encode = {rand() % 3};
+		tBMP2GIF b2g = {0, 0};
+		u_int8_t* bmp;
+		size_t bmpLength;
+		char* gif = NULL;
+		size_t gifLength = 0;
+		FILE* input;
+		FILE* output;
+
+		if ((bmp = randomBmp(width, height, colors, &bmpLength)) == NULL) {
+			return(EXIT_FAILURE);
+		}
+		input = fmemopen(bmp, bmpLength, "rb");
+		output = open_memstream(&gif, &gifLength);
+		if (input == NULL || output == NULL ||
+				bmp2gifEx(&b2g, input, output, &encode) != 0) {
+			fprintf(stderr, "%dx%d, %d barev: bmp2gif selhal\n", width, height,
+				colors);
+			failures++;
+		}
+		if (input != NULL) {
+			fclose(input);
+		}
+		if (output != NULL) {
+			fclose(output);
+		}
+
+		/** sériové i dvoufázové dekódování */
+		for (int parallel = 0; gif != NULL && parallel < 2; parallel++) {
+			tGIF2BMPOptions decode;
+			tGIF2BMP g2b = {0, 0};
+			u_int8_t* out = NULL;
+			size_t outLength = 0;
+
+			memset(&decode, 0, sizeof(decode));
+			decode.parallelLZW = parallel;
+			decode.threads = 2;
+			decode.context = i % 2 ? context : NULL;
+			if (gif2bmpMem(&g2b, (u_int8_t*)gif, gifLength, &out, &outLength,
+					&decode) != 0 || compareBmp(bmp, out, width, height) != 0) {
+				fprintf(stderr, "%dx%d, %d barev, clear %d%s: obrázek se liší\n",
+					width, height, colors, encode.clearPolicy,
+					parallel ? ", -p" : "");
+				failures++;
+			}
+			free(out);
+		}
+		free(gif);
+		free(bmp);
+	}
+	gif2bmpContextFree(context);
+	printf("roundtrip: %d obrázků, %d chyb\n", IMAGES, failures);
+	return(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
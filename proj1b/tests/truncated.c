@@ -0,0 +1,221 @@
+/*
+ * Autor:    Jaroslav Bartoň, xbarto42
+ * Datum:	 2008-4-16
+ * Soubor:   tests/truncated.c
+ * Komentar: zkrácená a poškozená animace musí skončit chybou
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bmp2gif.h"
+#include "gif2bmp.h"
+
+/** počet snímků animace */
+#define FRAMES 3
+
+/**
+ * Zápis čísla little-endian
+ * @param dst cíl
+ * @param value hodnota
+ * @param bytes počet byte
+ */
+static void putLE(u_int8_t* dst, u_int32_t value, int bytes) {
+	for (int i = 0; i < bytes; i++) {
+		dst[i] = value >> (8 * i);
+	}
+}
+
+/**
+ * Náhodný 8bitový BMP 48x32 se 16 barvami
+ * @param length délka souboru
+ * @return alokovaný BMP
+ */
+static u_int8_t* randomBmp(size_t* length) {
+	int32_t width = 48;
+	int32_t height = 32;
+	int32_t offset = 54 + 4 * 16;
+	u_int8_t* bmp;
+
+	*length = offset + (size_t)width * height;
+	if ((bmp = calloc(*length, 1)) == NULL) {
+		return(NULL);
+	}
+	bmp[0] = 'B';
+	bmp[1] = 'M';
+	putLE(bmp + 2, *length, 4);
+	putLE(bmp + 10, offset, 4);
+	putLE(bmp + 14, 40, 4);
+	putLE(bmp + 18, width, 4);
+	putLE(bmp + 22, height, 4);
+	putLE(bmp + 26, 1, 2);
+	putLE(bmp + 28, 8, 2);
+	putLE(bmp + 46, 16, 4);
+	for (int32_t i = 0; i < 4 * 16; i++) {
+		bmp[54 + i] = i % 4 == 3 ? 0 : rand();
+	}
+	for (size_t i = offset; i < *length; i++) {
+		bmp[i] = rand() % 16;
+	}
+	return(bmp);
+}
+
+/**
+ * Přeskočení sub-bloků až po terminátor
+ * @param gif GIF soubor
+ * @param pos pozice prvního sub-bloku
+ * @return pozice za terminátorem
+ */
+static size_t skipBlocks(const u_int8_t* gif, size_t pos) {
+	while (gif[pos] != 0) {
+		pos += gif[pos] + 1;
+	}
+	return(pos + 1);
+}
+
+/**
+ * Animace z FRAMES kopií bloku obrázku jednosnímkového GIF
+ * @param gif jednosnímkový GIF z bmp2gif
+ * @param length délka animace
+ * @param frames pozice začátků bloků obrázku v animaci
+ * @return alokovaná animace, NULL při chybě
+ */
+static u_int8_t* animation(const u_int8_t* gif, size_t* length,
+	size_t* frames) {
+	size_t pos = 13 + ((gif[10] & 0x80) ? 3 << ((gif[10] & 7) + 1) : 0);
+	size_t header = pos;
+	size_t image;
+	u_int8_t* out;
+
+	/** rozšíření před blokem obrázku se vynechají */
+	while (gif[pos] == 0x21) {
+		pos = skipBlocks(gif, pos + 2);
+	}
+	if (gif[pos] != 0x2c || (gif[pos + 9] & 0x80)) {
+		return(NULL);
+	}
+	image = pos;
+	pos = skipBlocks(gif, pos + 11);
+	*length = header + FRAMES * (pos - image) + 1;
+	if ((out = malloc(*length)) == NULL) {
+		return(NULL);
+	}
+	memcpy(out, gif, header);
+	for (int i = 0; i < FRAMES; i++) {
+		frames[i] = header + i * (pos - image);
+		memcpy(out + frames[i], gif + image, pos - image);
+	}
+	out[*length - 1] = 0x3b;
+	return(out);
+}
+
+/**
+ * Převod animace na pás snímků sériovým i dvoufázovým dekódováním snímků
+ * a zjištění informací
+ * @param gif animace
+ * @param length délka animace
+ * @param frames počet snímků zjištěný gif2bmpInfo, -1 při chybě
+ * @return výsledek gif2bmpMem, -2 pokud se oba způsoby dekódování liší
+ */
+static int convert(const u_int8_t* gif, size_t length, int* frames) {
+	tGIF2BMPOptions options;
+	tGIF2BMPInfo info;
+	tGIF2BMP g2b = {0, 0};
+	u_int8_t* out = NULL;
+	size_t outLength = 0;
+	FILE* input;
+	int retval = 0;
+
+	for (int parallel = 0; parallel < 2; parallel++) {
+		int result;
+
+		memset(&options, 0, sizeof(options));
+		options.frames = GIF2BMPSpriteSheet;
+		options.parallelLZW = parallel;
+		options.threads = 2;
+		result = gif2bmpMem(&g2b, gif, length, &out, &outLength, &options);
+		free(out);
+		out = NULL;
+		retval = parallel && result != retval ? -2 : result;
+	}
+	*frames = -1;
+	memset(&info, 0, sizeof(info));
+	if ((input = fmemopen((void*)gif, length, "rb")) != NULL) {
+		if (gif2bmpInfo(&info, input) == GIF2BMPOK) {
+			*frames = info.frames;
+		}
+		fclose(input);
+	}
+	return(retval);
+}
+
+int main(void) {
+	size_t frames[FRAMES];
+	size_t bmpLength;
+	size_t length;
+	u_int8_t* bmp;
+	u_int8_t* anim;
+	char* gif = NULL;
+	size_t gifLength = 0;
+	tBMP2GIF b2g = {0, 0};
+	FILE* input;
+	FILE* output;
+	int failures = 0;
+	int cuts = 0;
+	int count;
+
+	srand(42);
+	if ((bmp = randomBmp(&bmpLength)) == NULL ||
+			(input = fmemopen(bmp, bmpLength, "rb")) == NULL ||
+			(output = open_memstream(&gif, &gifLength)) == NULL) {
+		return(EXIT_FAILURE);
+	}
+	if (bmp2gif(&b2g, input, output) != 0) {
+		fprintf(stderr, "truncated: bmp2gif selhal\n");
+		return(EXIT_FAILURE);
+	}
+	fclose(input);
+	fclose(output);
+	if ((anim = animation((u_int8_t*)gif, &length, frames)) == NULL) {
+		fprintf(stderr, "truncated: neočekávaná struktura GIF\n");
+		return(EXIT_FAILURE);
+	}
+
+	/** celá animace a animace bez ukončovací značky jsou v pořádku */
+	if (convert(anim, length, &count) != GIF2BMPOK || count != FRAMES) {
+		fprintf(stderr, "truncated: celá animace selhala\n");
+		failures++;
+	}
+	if (convert(anim, length - 1, &count) != GIF2BMPOK || count != FRAMES) {
+		fprintf(stderr, "truncated: animace bez ukončovací značky selhala\n");
+		failures++;
+	}
+	/** zkrácení uvnitř druhého a dalších snímků je chyba */
+	for (size_t cut = frames[1] + 1; cut < length - 1; cut++) {
+		int boundary = 0;
+
+		for (int i = 2; i < FRAMES; i++) {
+			boundary |= cut == frames[i];
+		}
+		if (boundary) {
+			continue;
+		}
+		cuts++;
+		if (convert(anim, cut, &count) != GIF2BMPFail || count != -1) {
+			fprintf(stderr, "truncated: zkrácení na %zu byte prošlo\n", cut);
+			failures++;
+		}
+	}
+	/** neznámý blok místo posledního snímku je chyba */
+	anim[frames[FRAMES - 1]] = 0x99;
+	if (convert(anim, length, &count) != GIF2BMPFail || count != -1) {
+		fprintf(stderr, "truncated: poškozený blok prošel\n");
+		failures++;
+	}
+
+	free(anim);
+	free(gif);
+	free(bmp);
+	printf("truncated: %d zkrácení, %d chyb\n", cuts, failures);
+	return(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}